@@ -13,6 +13,7 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/BlobVerifierLib.h>
+#include <Library/MemoryAllocationLib.h>
 
 /**
   The SEV Hashes table must be in encrypted memory and has the table
@@ -75,22 +76,20 @@ FindBlobEntryGuid (
 }
 
 /**
-  Verify blob from an external source.
+  Look up the expected hash of a blob in the SEV hashes table.
 
-  @param[in] BlobName           The name of the blob
-  @param[in] Buf                The data of the blob
-  @param[in] BufSize            The size of the blob in bytes
+  @param[in]  BlobName          The name of the blob
+  @param[out] ExpectedHash      On success, the SHA-256 digest that the blob
+                                must have.
 
-  @retval EFI_SUCCESS           The blob was verified successfully.
-  @retval EFI_ACCESS_DENIED     The blob could not be verified, and therefore
-                                should be considered non-secure.
+  @retval EFI_SUCCESS           The expected hash was found.
+  @retval EFI_ACCESS_DENIED     The table has no valid hash for the blob.
 **/
+STATIC
 EFI_STATUS
-EFIAPI
-VerifyBlob (
+FindBlobHash (
   IN  CONST CHAR16  *BlobName,
-  IN  CONST VOID    *Buf,
-  IN  UINT32        BufSize
+  OUT CONST UINT8   **ExpectedHash
   )
 {
   CONST GUID  *Guid;
@@ -126,9 +125,7 @@ VerifyBlob (
        Remaining -= Entry->Len,
        Entry = (HASH_TABLE *)((UINT8 *)Entry + Entry->Len))
   {
-    UINTN       EntrySize;
-    EFI_STATUS  Status;
-    UINT8       Hash[SHA256_DIGEST_SIZE];
+    UINTN  EntrySize;
 
     if (!CompareGuid (&Entry->Guid, Guid)) {
       continue;
@@ -148,31 +145,8 @@ VerifyBlob (
       return EFI_ACCESS_DENIED;
     }
 
-    //
-    // Calculate the buffer's hash and verify that it is identical to the
-    // expected hash table entry
-    //
-    Sha256HashAll (Buf, BufSize, Hash);
-
-    if (CompareMem (Entry->Data, Hash, EntrySize) == 0) {
-      Status = EFI_SUCCESS;
-      DEBUG ((
-        DEBUG_INFO,
-        "%a: Hash comparison succeeded for \"%s\"\n",
-        __FUNCTION__,
-        BlobName
-        ));
-    } else {
-      Status = EFI_ACCESS_DENIED;
-      DEBUG ((
-        DEBUG_ERROR,
-        "%a: Hash comparison failed for \"%s\"\n",
-        __FUNCTION__,
-        BlobName
-        ));
-    }
-
-    return Status;
+    *ExpectedHash = Entry->Data;
+    return EFI_SUCCESS;
   }
 
   DEBUG ((
@@ -184,6 +158,191 @@ VerifyBlob (
   return EFI_ACCESS_DENIED;
 }
 
+/**
+  Compare the calculated hash of a blob with the expected one.
+
+  @param[in] BlobName           The name of the blob
+  @param[in] ExpectedHash       The hash from the SEV hashes table
+  @param[in] Hash               The SHA-256 digest of the blob
+
+  @retval EFI_SUCCESS           The hashes are identical.
+  @retval EFI_ACCESS_DENIED     The hashes differ.
+**/
+STATIC
+EFI_STATUS
+CompareBlobHash (
+  IN  CONST CHAR16  *BlobName,
+  IN  CONST UINT8   *ExpectedHash,
+  IN  CONST UINT8   *Hash
+  )
+{
+  if (CompareMem (ExpectedHash, Hash, SHA256_DIGEST_SIZE) != 0) {
+    DEBUG ((
+      DEBUG_ERROR,
+      "%a: Hash comparison failed for \"%s\"\n",
+      __FUNCTION__,
+      BlobName
+      ));
+    return EFI_ACCESS_DENIED;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: Hash comparison succeeded for \"%s\"\n",
+    __FUNCTION__,
+    BlobName
+    ));
+  return EFI_SUCCESS;
+}
+
+/**
+  Verify blob from an external source.
+
+  @param[in] BlobName           The name of the blob
+  @param[in] Buf                The data of the blob
+  @param[in] BufSize            The size of the blob in bytes
+
+  @retval EFI_SUCCESS           The blob was verified successfully.
+  @retval EFI_ACCESS_DENIED     The blob could not be verified, and therefore
+                                should be considered non-secure.
+**/
+EFI_STATUS
+EFIAPI
+VerifyBlob (
+  IN  CONST CHAR16  *BlobName,
+  IN  CONST VOID    *Buf,
+  IN  UINT32        BufSize
+  )
+{
+  EFI_STATUS   Status;
+  CONST UINT8  *ExpectedHash;
+  UINT8        Hash[SHA256_DIGEST_SIZE];
+
+  Status = FindBlobHash (BlobName, &ExpectedHash);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Calculate the buffer's hash and verify that it is identical to the
+  // expected hash table entry
+  //
+  Sha256HashAll (Buf, BufSize, Hash);
+  return CompareBlobHash (BlobName, ExpectedHash, Hash);
+}
+
+//
+// State of a verification in pieces. The SHA-256 context, whose size is only
+// known at runtime, follows the structure.
+//
+typedef struct {
+  CONST CHAR16    *BlobName;
+  CONST UINT8     *ExpectedHash;
+  BOOLEAN         Failed;
+} VERIFY_CONTEXT;
+
+/**
+  Start verifying a blob from an external source that is passed in pieces,
+  for example as it is being read.
+
+  @param[in]  BlobName          The name of the blob
+  @param[out] Context           On success, the verification context to pass
+                                to VerifyBlobUpdate() and VerifyBlobFinal().
+
+  @retval EFI_SUCCESS           The verification has been started.
+  @retval EFI_ACCESS_DENIED     The blob can not be verified, and therefore
+                                should be considered non-secure.
+  @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
+**/
+EFI_STATUS
+EFIAPI
+VerifyBlobStart (
+  IN  CONST CHAR16  *BlobName,
+  OUT VOID          **Context
+  )
+{
+  EFI_STATUS      Status;
+  CONST UINT8     *ExpectedHash;
+  VERIFY_CONTEXT  *Verify;
+
+  Status = FindBlobHash (BlobName, &ExpectedHash);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Verify = AllocatePool (sizeof *Verify + Sha256GetContextSize ());
+  if (Verify == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Verify->BlobName     = BlobName;
+  Verify->ExpectedHash = ExpectedHash;
+  Verify->Failed       = !Sha256Init (Verify + 1);
+
+  *Context = Verify;
+  return EFI_SUCCESS;
+}
+
+/**
+  Pass the next piece of a blob to a verification started with
+  VerifyBlobStart().
+
+  @param[in] Context            The verification context.
+  @param[in] Buf                The next piece of the blob
+  @param[in] BufSize            The size of the piece in bytes
+**/
+VOID
+EFIAPI
+VerifyBlobUpdate (
+  IN  VOID          *Context,
+  IN  CONST VOID    *Buf,
+  IN  UINTN         BufSize
+  )
+{
+  VERIFY_CONTEXT  *Verify;
+
+  Verify = Context;
+  if (!Verify->Failed && !Sha256Update (Verify + 1, Buf, BufSize)) {
+    Verify->Failed = TRUE;
+  }
+}
+
+/**
+  Finish a verification started with VerifyBlobStart(), and release Context.
+
+  @param[in] Context            The verification context.
+
+  @retval EFI_SUCCESS           The blob was verified successfully.
+  @retval EFI_ACCESS_DENIED     The blob could not be verified, and therefore
+                                should be considered non-secure.
+**/
+EFI_STATUS
+EFIAPI
+VerifyBlobFinal (
+  IN  VOID          *Context
+  )
+{
+  VERIFY_CONTEXT  *Verify;
+  EFI_STATUS      Status;
+  UINT8           Hash[SHA256_DIGEST_SIZE];
+
+  Verify = Context;
+  if (Verify->Failed || !Sha256Final (Verify + 1, Hash)) {
+    DEBUG ((
+      DEBUG_ERROR,
+      "%a: Failed to hash \"%s\"\n",
+      __FUNCTION__,
+      Verify->BlobName
+      ));
+    Status = EFI_ACCESS_DENIED;
+  } else {
+    Status = CompareBlobHash (Verify->BlobName, Verify->ExpectedHash, Hash);
+  }
+
+  FreePool (Verify);
+  return Status;
+}
+
 /**
   Locate the SEV hashes table.
 
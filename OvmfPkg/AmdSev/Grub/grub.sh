@@ -45,6 +45,8 @@ GRUB_MODULES="
             linuxefi
             reboot
             efisecret
+            tpm
+            gcry_sha512
             "
 basedir=$(dirname -- "$0")
 
@@ -86,6 +88,7 @@ echo ${basedir}
 mkimage="/home/amd/Downloads/grub2-V2/grub-mkimage"
 
 ${mkimage} -O x86_64-efi \
+           --prelink \
            -p '(crypto0)' \
            -c "${basedir}/grub-bootstrap.cfg" \
            -m "${basedir}/disk.fat" \
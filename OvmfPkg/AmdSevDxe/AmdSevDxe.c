@@ -23,6 +23,9 @@
 #include <Pi/PrePiDxeCis.h>
 #include <Protocol/SevMemoryAcceptance.h>
 #include <Protocol/MemoryAccept.h>
+#include <Register/Amd/Cpuid.h>
+#include <Register/Amd/Ghcb.h>
+#include <Register/Amd/Msr.h>
 #include <Uefi/UefiSpec.h>
 
 // Present, initialized, tested bits defined in MdeModulePkg/Core/Dxe/DxeMain.h
@@ -46,6 +49,11 @@ STATIC EFI_EVENT  mAcceptAllMemoryEvent = NULL;
 
 #define IS_ALIGNED(x, y)  ((((x) & ((y) - 1)) == 0))
 
+//
+// Number of times ReportCpuidExitCost() executes its mix of CPUID leaves.
+//
+#define CPUID_BENCHMARK_ITERATIONS  1000
+
 STATIC
 EFI_STATUS
 EFIAPI
@@ -166,6 +174,67 @@ STATIC
 OVMF_SEV_MEMORY_ACCEPTANCE_PROTOCOL
   mMemoryAcceptanceProtocol = { AllowUnacceptedMemory };
 
+/**
+  Measure the cost of a CPUID #VC on this processor.
+
+  Executes the CPUID leaves most used by the firmware and boot loaders many
+  times, and reports the average cycles a CPUID takes, and how many of them
+  are spent in the #VC handler according to its statistics. Comparing the
+  report of two builds shows the effect of a change to the #VC handler.
+
+**/
+STATIC
+VOID
+ReportCpuidExitCost (
+  VOID
+  )
+{
+  STATIC CONST UINT32       Leaves[] = {
+    CPUID_SIGNATURE,
+    CPUID_VERSION_INFO,
+    CPUID_EXTENDED_FUNCTION,
+    CPUID_EXTENDED_CPU_SIG,
+    CPUID_VIR_PHY_ADDRESS_SIZE,
+    CPUID_MEMORY_ENCRYPTION_INFO
+  };
+  MSR_SEV_ES_GHCB_REGISTER  Msr;
+  SEV_ES_PER_CPU_DATA       *SevEsData;
+  UINT64                    Count;
+  UINT64                    Cycles;
+  UINT64                    Start;
+  UINT64                    Elapsed;
+  UINTN                     Iteration;
+  UINTN                     Index;
+
+  Msr.GhcbPhysicalAddress = AsmReadMsr64 (MSR_SEV_ES_GHCB);
+  SevEsData               = (SEV_ES_PER_CPU_DATA *)((GHCB *)Msr.Ghcb + 1);
+
+  Count  = SevEsData->VcStatistics.Count[CcExitTypeCpuid];
+  Cycles = SevEsData->VcStatistics.Cycles[CcExitTypeCpuid];
+  Start  = AsmReadTsc ();
+  for (Iteration = 0; Iteration < CPUID_BENCHMARK_ITERATIONS; Iteration++) {
+    for (Index = 0; Index < ARRAY_SIZE (Leaves); Index++) {
+      AsmCpuid (Leaves[Index], NULL, NULL, NULL, NULL);
+    }
+  }
+
+  Elapsed = AsmReadTsc () - Start;
+  Count   = SevEsData->VcStatistics.Count[CcExitTypeCpuid] - Count;
+  Cycles  = SevEsData->VcStatistics.Cycles[CcExitTypeCpuid] - Cycles;
+  if (Count == 0) {
+    return;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %Lu CPUID #VCs, %Lu cycles each, %Lu of them in the handler\n",
+    __FUNCTION__,
+    Count,
+    DivU64x64Remainder (Elapsed, Count, NULL),
+    DivU64x64Remainder (Cycles, Count, NULL)
+    ));
+}
+
 STATIC EDKII_MEMORY_ACCEPT_PROTOCOL  mMemoryAcceptProtocol = {
   AmdSevMemoryAccept
 };
@@ -189,6 +258,10 @@ AmdSevDxeEntryPoint (
     return EFI_UNSUPPORTED;
   }
 
+  if (FeaturePcdGet (PcdAmdSevCpuidExitReport) && MemEncryptSevEsIsEnabled ()) {
+    ReportCpuidExitCost ();
+  }
+
   //
   // Iterate through the GCD map and clear the C-bit from MMIO and NonExistent
   // memory space. The NonExistent memory space will be used for mapping the
@@ -0,0 +1,98 @@
+/** @file
+
+  Publish the debug log ring that PlatformPei set up as a UEFI configuration
+  table, and make DEBUG() write through to the debug I/O port from
+  ExitBootServices() on.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Guid/DebugLogRing.h>
+#include <Library/DebugLib.h>
+#include <Library/PcdLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+STATIC EFI_EVENT  mExitBootServicesEvent;
+
+/**
+  Notification function of the ExitBootServices() event.
+
+  Nothing is left to collect more output, so write what has been logged to
+  the debug I/O port, and any later messages along with it.
+
+  @param[in] Event    Event whose notification function is being invoked.
+  @param[in] Context  The debug log ring.
+
+**/
+STATIC
+VOID
+EFIAPI
+DebugLogExitBootServices (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  OVMF_DEBUG_LOG_RING  *Ring;
+
+  Ring         = Context;
+  Ring->Flags |= OVMF_DEBUG_LOG_RING_WRITE_THROUGH;
+
+  //
+  // This message flushes the ring.
+  //
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %Lu bytes logged\n",
+    __FUNCTION__,
+    Ring->Head
+    ));
+}
+
+EFI_STATUS
+EFIAPI
+DebugLogDxeEntryPoint (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  OVMF_DEBUG_LOG_RING  *Ring;
+  EFI_STATUS           Status;
+
+  if (FixedPcdGet32 (PcdOvmfDebugLogSize) == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Ring = (OVMF_DEBUG_LOG_RING *)(UINTN)FixedPcdGet32 (PcdOvmfDebugLogBase);
+  if (Ring->Signature != OVMF_DEBUG_LOG_RING_SIGNATURE) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                  TPL_CALLBACK,
+                  DebugLogExitBootServices,
+                  Ring,
+                  &mExitBootServicesEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->InstallConfigurationTable (&gOvmfDebugLogRingGuid, Ring);
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (mExitBootServicesEvent);
+    return Status;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %u KB debug log ring at 0x%Lx\n",
+    __FUNCTION__,
+    Ring->DataSize / SIZE_1KB,
+    Ring->Data
+    ));
+  return EFI_SUCCESS;
+}
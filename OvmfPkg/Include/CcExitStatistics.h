@@ -0,0 +1,48 @@
+/** @file
+
+  Confidential computing #VC/#VE handler statistics
+
+  The SEV-ES #VC handler keeps these in the per-CPU data page that follows
+  each GHCB page (SEV_ES_PER_CPU_DATA), the TDX #VE handler keeps them in
+  the TDX work area.
+
+  Copyright (c) 2022, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef CC_EXIT_STATISTICS_H_
+#define CC_EXIT_STATISTICS_H_
+
+#include <Base.h>
+
+//
+// Exit types counted by the #VC and #VE handlers.
+//
+typedef enum {
+  CcExitTypeCpuid,
+  CcExitTypeIo,
+  CcExitTypeMsr,
+  CcExitTypeMmio,
+  CcExitTypeOther,
+  CcExitTypeMax
+} CC_EXIT_TYPE;
+
+typedef struct {
+  //
+  // Number of exits, and the TSC cycles spent handling them, by exit type.
+  // A nested #VC is counted, but timed as part of the exit it happened in;
+  // RDTSC/RDTSCP exits are counted but not timed.
+  //
+  UINT64    Count[CcExitTypeMax];
+  UINT64    Cycles[CcExitTypeMax];
+
+  //
+  // Lookups in the cache of MMIO pages validated as unencrypted, SEV-ES
+  // only.
+  //
+  UINT64    MmioCacheHits;
+  UINT64    MmioCacheMisses;
+} CC_EXIT_STATISTICS;
+
+#endif
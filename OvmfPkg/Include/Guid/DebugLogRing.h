@@ -0,0 +1,57 @@
+/** @file
+   UEFI Configuration Table for exposing the firmware debug log.
+
+   The DEBUG() output of SEC, PEI and DXE is kept in a ring buffer in memory
+   and written to the debug I/O port in bulk. The ring stays reserved after
+   ExitBootServices(), so that an OS loader or the OS can read the firmware
+   log back.
+
+   The newest Head bytes ever logged end at offset (Head % DataSize) of the
+   buffer at Data; the ring holds the last MIN (Head, DataSize) of them.
+
+   Copyright (c) 2022, Red Hat, Inc.<BR>
+
+   SPDX-License-Identifier: BSD-2-Clause-Patent
+ **/
+
+#ifndef OVMF_DEBUG_LOG_RING_H_
+#define OVMF_DEBUG_LOG_RING_H_
+
+#include <Uefi/UefiBaseType.h>
+
+#define OVMF_DEBUG_LOG_RING_GUID                        \
+  { 0x614d0a24,                                         \
+    0x5a72,                                             \
+    0x40d6,                                             \
+    { 0x9b, 0xd3, 0x1d, 0xa9, 0xfb, 0x84, 0xe4, 0x51 }, \
+  }
+
+#define OVMF_DEBUG_LOG_RING_SIGNATURE  SIGNATURE_32 ('D', 'L', 'O', 'G')
+
+//
+// Write every message to the debug I/O port as soon as it is logged.
+//
+#define OVMF_DEBUG_LOG_RING_WRITE_THROUGH  BIT0
+
+typedef struct {
+  UINT32    Signature;
+  UINT32    Flags;
+  //
+  // Taken with InterlockedCompareExchange32() while the ring is updated.
+  //
+  UINT32    Lock;
+  //
+  // Size of the buffer at Data, a power of two.
+  //
+  UINT32    DataSize;
+  UINT64    Data;
+  //
+  // Number of bytes ever logged, and ever written to the debug I/O port.
+  //
+  UINT64    Head;
+  UINT64    Flushed;
+} OVMF_DEBUG_LOG_RING;
+
+extern EFI_GUID  gOvmfDebugLogRingGuid;
+
+#endif
@@ -127,7 +127,7 @@ typedef struct {
 //
 #define VRING_DESC_F_NEXT      BIT0 // more descriptors in this request
 #define VRING_DESC_F_WRITE     BIT1 // buffer to be written *by the host*
-#define VRING_DESC_F_INDIRECT  BIT2 // unused
+#define VRING_DESC_F_INDIRECT  BIT2 // buffer contains a descriptor table
 
 #pragma pack(1)
 typedef struct {
@@ -145,6 +145,27 @@ typedef struct {
   VRING_AVAIL            Avail;
   VRING_USED             Used;
   UINT16                 QueueSize;
+
+  //
+  // The VIRTIO_F_RING_* features that VirtioLib uses on this ring.
+  //
+  // With VIRTIO_F_RING_PACKED, Desc points to the packed descriptor ring, and
+  // Avail.Flags and Used.Flags to the driver and device event suppression
+  // structures; the other Avail and Used fields are unused. PackedAvailIdx and
+  // PackedAvailWrap track the next descriptor to make available, and
+  // PackedHeadFlags holds the flags of the head descriptor of the chain being
+  // built, which are written last.
+  //
+  // With VIRTIO_F_RING_INDIRECT_DESC, descriptor chains are built in the
+  // QueueSize element table at Indirect, which the device sees at
+  // IndirectDeviceAddress, and take one descriptor on the ring.
+  //
+  UINT64                 Features;
+  UINT16                 PackedAvailIdx;
+  BOOLEAN                PackedAvailWrap;
+  UINT16                 PackedHeadFlags;
+  volatile VOID          *Indirect;
+  UINT64                 IndirectDeviceAddress;
 } VRING;
 
 //
@@ -93,4 +93,33 @@ typedef struct {
 #define VIRTIO_MMIO_OFFSET_QUEUE_USED_HI      0xa4
 #define VIRTIO_MMIO_OFFSET_CONFIG_GENERATION  0xfc
 
+//
+// Packed virtqueues, from the VirtIo 1.1 specification
+//
+#define VIRTIO_F_RING_PACKED  BIT34
+
+#define VRING_PACKED_DESC_F_AVAIL  BIT7
+#define VRING_PACKED_DESC_F_USED   BIT15
+
+#pragma pack (1)
+typedef struct {
+  UINT64    Addr;
+  UINT32    Len;
+  UINT16    Id;
+  UINT16    Flags;
+} VRING_PACKED_DESC;
+
+typedef struct {
+  UINT16    Desc;  // descriptor ring offset, and wrap counter in bit 15
+  UINT16    Flags;
+} VRING_PACKED_EVENT;
+#pragma pack ()
+
+//
+// Values for the VRING_PACKED_EVENT.Flags field
+//
+#define VRING_PACKED_EVENT_F_ENABLE   0x0
+#define VRING_PACKED_EVENT_F_DISABLE  0x1
+#define VRING_PACKED_EVENT_F_DESC     0x2
+
 #endif // _VIRTIO_1_0_H_
@@ -35,4 +35,55 @@ VerifyBlob (
   IN  UINT32        BufSize
   );
 
+/**
+  Start verifying a blob from an external source that is passed in pieces,
+  for example as it is being read.
+
+  @param[in]  BlobName          The name of the blob
+  @param[out] Context           On success, the verification context to pass
+                                to VerifyBlobUpdate() and VerifyBlobFinal().
+
+  @retval EFI_SUCCESS           The verification has been started.
+  @retval EFI_ACCESS_DENIED     The blob can not be verified, and therefore
+                                should be considered non-secure.
+  @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
+**/
+EFI_STATUS
+EFIAPI
+VerifyBlobStart (
+  IN  CONST CHAR16  *BlobName,
+  OUT VOID          **Context
+  );
+
+/**
+  Pass the next piece of a blob to a verification started with
+  VerifyBlobStart().
+
+  @param[in] Context            The verification context.
+  @param[in] Buf                The next piece of the blob
+  @param[in] BufSize            The size of the piece in bytes
+**/
+VOID
+EFIAPI
+VerifyBlobUpdate (
+  IN  VOID          *Context,
+  IN  CONST VOID    *Buf,
+  IN  UINTN         BufSize
+  );
+
+/**
+  Finish a verification started with VerifyBlobStart(), and release Context.
+
+  @param[in] Context            The verification context.
+
+  @retval EFI_SUCCESS           The blob was verified successfully.
+  @retval EFI_ACCESS_DENIED     The blob could not be verified, and therefore
+                                should be considered non-secure.
+**/
+EFI_STATUS
+EFIAPI
+VerifyBlobFinal (
+  IN  VOID          *Context
+  );
+
 #endif
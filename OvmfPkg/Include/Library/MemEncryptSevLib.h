@@ -13,6 +13,7 @@
 
 #include <Base.h>
 #include <WorkArea.h>
+#include <CcExitStatistics.h>
 
 //
 // Define the maximum number of #VCs allowed (e.g. the level of nesting
@@ -23,6 +24,13 @@
 //
 #define VMGEXIT_MAXIMUM_VC_COUNT  2
 
+//
+// Size of the per-CPU area private to the #VC handler, which holds its
+// validated MMIO and CPUID caches. SEV_ES_PER_CPU_DATA must stay within the
+// page that follows the GHCB page.
+//
+#define SEV_ES_VC_CACHE_SIZE  SIZE_1KB
+
 //
 // Per-CPU data mapping structure
 //   Use UINT32 for cached indicators and compare to a specific value
@@ -35,6 +43,9 @@ typedef struct {
 
   UINTN     VcCount;
   VOID      *GhcbBackupPages;
+
+  CC_EXIT_STATISTICS    VcStatistics;
+  UINT64                VcCache[SEV_ES_VC_CACHE_SIZE / sizeof (UINT64)];
 } SEV_ES_PER_CPU_DATA;
 
 //
@@ -47,6 +58,15 @@ typedef enum {
   MemEncryptSevAddressRangeError,
 } MEM_ENCRYPT_SEV_ADDRESS_RANGE_STATE;
 
+//
+// A memory region, for the functions changing the encryption state of
+// several regions at once.
+//
+typedef struct {
+  PHYSICAL_ADDRESS    BaseAddress;
+  UINTN               NumPages;
+} MEM_ENCRYPT_SEV_PAGE_RANGE;
+
 /**
   Returns a boolean to indicate whether SEV-SNP is enabled
 
@@ -133,6 +153,66 @@ MemEncryptSevSetPageEncMask (
   IN UINTN             NumPages
   );
 
+/**
+  This function clears memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  The regions are sorted and merged where they touch, the TLB is flushed
+  once, and with SEV-SNP the page state changes of all the regions are made
+  together, with 2MB entries where the alignment allows. Use this rather than
+  calling MemEncryptSevClearPageEncMask() for each of several regions.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were cleared for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Clearing the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+MemEncryptSevClearPageEncMaskRanges (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  );
+
+/**
+  This function sets memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  The regions are sorted and merged where they touch, the TLB is flushed
+  once, and with SEV-SNP the page state changes of all the regions are made
+  together, with 2MB entries where the alignment allows. Use this rather than
+  calling MemEncryptSevSetPageEncMask() for each of several regions.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were set for the memory
+                                      regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Setting the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+MemEncryptSevSetPageEncMaskRanges (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  );
+
 /**
   Locate the page range that covers the initial (pre-SMBASE-relocation) SMRAM
   Save State Map.
@@ -189,6 +269,37 @@ MemEncryptSevGetAddressRangeState (
   IN UINTN             Length
   );
 
+/**
+  Returns the page state generation.
+
+  The generation changes whenever this library changes the encryption state
+  of a page, so that results derived from MemEncryptSevGetAddressRangeState()
+  can be cached until the next change.
+
+  @return  The page state generation
+**/
+UINT32
+EFIAPI
+MemEncryptSevGetPageStateGeneration (
+  VOID
+  );
+
+/**
+  Returns the number of SEV-SNP page state change VMGEXITs made by this
+  library, and the number it would have made with a separate request of 4KB
+  entries for each region it was asked to change.
+
+  @param[out] Exits           The number of page state change VMGEXITs.
+  @param[out] UnbatchedExits  The number of page state change VMGEXITs
+                              without batching.
+**/
+VOID
+EFIAPI
+MemEncryptSevGetPageStateChangeExits (
+  OUT UINT64  *Exits,
+  OUT UINT64  *UnbatchedExits
+  );
+
 /**
   This function clears memory encryption bit for the MMIO region specified by
   BaseAddress and NumPages.
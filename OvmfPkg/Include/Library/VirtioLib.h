@@ -51,6 +51,55 @@ VirtioRingInit (
   OUT VRING                   *Ring
   );
 
+/**
+
+  Configure a virtio ring, using ring features that the driver negotiated with
+  the device.
+
+  This function sets up internal storage (the guest-host communication area)
+  and lays out several "navigation" (ie. no-ownership) pointers to parts of
+  that storage.
+
+  Relevant sections from the virtio-0.9.5 spec:
+  - 1.1 Virtqueues,
+  - 2.3 Virtqueue Configuration.
+
+  Relevant sections from the virtio-1.1 spec:
+  - 2.6.5.3 Indirect Descriptors,
+  - 2.6.7 Used Buffer Notification Suppression,
+  - 2.7 Packed Virtqueues.
+
+  @param[in]  VirtIo            The virtio device which will use the ring.
+
+  @param[in]  QueueSize         The number of descriptors to allocate for the
+                                virtio ring, as requested by the host.
+
+  @param[in]  Features          The features negotiated with the device. Of
+                                these, VIRTIO_F_RING_INDIRECT_DESC,
+                                VIRTIO_F_RING_EVENT_IDX and
+                                VIRTIO_F_RING_PACKED are used on the ring by
+                                VirtioPrepare(), VirtioAppendDesc() and
+                                VirtioFlush(); the rest are ignored.
+
+  @param[out] Ring              The virtio ring to set up.
+
+  @return                       Status codes propagated from
+                                VirtIo->AllocateSharedPages().
+
+  @retval EFI_SUCCESS           Allocation and setup successful. Ring->Base
+                                (and nothing else) is responsible for
+                                deallocation.
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioRingInitWithFeatures (
+  IN  VIRTIO_DEVICE_PROTOCOL  *VirtIo,
+  IN  UINT16                  QueueSize,
+  IN  UINT64                  Features,
+  OUT VRING                   *Ring
+  );
+
 /**
 
   Map the ring buffer so that it can be accessed equally by both guest
@@ -58,7 +107,9 @@ VirtioRingInit (
 
   @param[in]      VirtIo          The virtio device instance.
 
-  @param[in]      Ring            The virtio ring to map.
+  @param[in,out]  Ring            The virtio ring to map. If it uses indirect
+                                  descriptors, the device address of the
+                                  table is recorded in it.
 
   @param[out]     RingBaseShift   A resulting translation offset, to be
                                   passed to VirtIo->SetQueueAddress().
@@ -71,10 +122,10 @@ VirtioRingInit (
 EFI_STATUS
 EFIAPI
 VirtioRingMap (
-  IN  VIRTIO_DEVICE_PROTOCOL  *VirtIo,
-  IN  VRING                   *Ring,
-  OUT UINT64                  *RingBaseShift,
-  OUT VOID                    **Mapping
+  IN     VIRTIO_DEVICE_PROTOCOL  *VirtIo,
+  IN OUT VRING                   *Ring,
+  OUT    UINT64                  *RingBaseShift,
+  OUT    VOID                    **Mapping
   );
 
 /**
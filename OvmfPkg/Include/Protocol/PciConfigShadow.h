@@ -0,0 +1,65 @@
+/** @file
+  Protocol/GUID definition for the PCI configuration space shadow that the
+  DxeShadowPciLibI440FxQ35 instances of PciLib share during boot.
+
+  Each PCI configuration access is an exit to the hypervisor, and a costly one
+  in SEV-ES, SEV-SNP and TDX guests. The standard header registers that only
+  change when written are therefore shadowed in memory, for as long as boot
+  services are available. The first module that uses the library allocates the
+  shadow and installs it on a new handle; later modules locate it.
+
+  Note that this protocol is considered internal ABI, and may change structure
+  at any time without regard for backward compatibility.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef OVMF_PCI_CONFIG_SHADOW_H_
+#define OVMF_PCI_CONFIG_SHADOW_H_
+
+#define OVMF_PCI_CONFIG_SHADOW_PROTOCOL_GUID \
+  {0x1042f33f, 0xc354, 0x4872, {0xa2, 0xd2, 0xcf, 0x73, 0xc4, 0x39, 0xff, 0xaf}}
+
+//
+// Set in Address once the entry is in use.
+//
+#define OVMF_PCI_CONFIG_SHADOW_IN_USE  BIT31
+
+typedef struct {
+  //
+  // The PCI_LIB_ADDRESS of a dword aligned register, ORed with
+  // OVMF_PCI_CONFIG_SHADOW_IN_USE.
+  //
+  UINT32    Address;
+  UINT32    Value;
+  //
+  // The bytes of Value that match the hardware, one bit per byte.
+  //
+  UINT8     Valid;
+} OVMF_PCI_CONFIG_SHADOW_ENTRY;
+
+typedef struct {
+  //
+  // Cleared at ExitBootServices(), by the first library instance to see it.
+  //
+  BOOLEAN                         Enabled;
+  //
+  // Reads served from the shadow, that is, configuration accesses avoided;
+  // reads that had to fill an entry; and the number of times the whole
+  // shadow was dropped because a bridge was reprogrammed.
+  //
+  UINT64                          Hits;
+  UINT64                          Misses;
+  UINT64                          Flushes;
+  //
+  // Open addressing hash table, with a power of two number of entries.
+  //
+  UINT32                          NumEntries;
+  OVMF_PCI_CONFIG_SHADOW_ENTRY    *Entries;
+} OVMF_PCI_CONFIG_SHADOW;
+
+extern EFI_GUID  gOvmfPciConfigShadowProtocolGuid;
+
+#endif
@@ -12,6 +12,7 @@
 
 #include <ConfidentialComputingGuestAttr.h>
 #include <IndustryStandard/Tpm20.h>
+#include <CcExitStatistics.h>
 
 //
 // Confidential computing work area header definition. Any change
@@ -54,6 +55,21 @@ typedef struct _SEC_SEV_ES_WORK_AREA {
   // detection in OvmfPkg/ResetVector/Ia32/AmdSev.c
   //
   UINT8     ReceivedVc;
+
+  //
+  // Changed by MemEncryptSevLib whenever it changes the encryption state of
+  // a page. The #VC handler drops the MMIO pages it has validated when it
+  // changes.
+  //
+  UINT32    PageStateGeneration;
+
+  //
+  // SEV-SNP page state change VMGEXITs made by MemEncryptSevLib, and the
+  // ones it would have made with a separate request of 4KB entries per
+  // region.
+  //
+  UINT64    PageStateChangeExits;
+  UINT64    PageStateChangeUnbatchedExits;
 } SEC_SEV_ES_WORK_AREA;
 
 //
@@ -86,6 +102,13 @@ typedef struct _SEC_TDX_WORK_AREA {
   UINT32                   Gpaw;
   UINT64                   HobList;
   TDX_MEASUREMENTS_DATA    TdxMeasurementsData;
+
+  //
+  // #VE handler state, shared by all vCPUs and updated without a lock.
+  // VeDumpedRip is the MMIO instruction the handler dumped last.
+  //
+  CC_EXIT_STATISTICS       VeStatistics;
+  UINT64                   VeDumpedRip;
 } SEC_TDX_WORK_AREA;
 
 typedef struct _TDX_WORK_AREA {
@@ -26,6 +26,11 @@ extern BOOLEAN  mReservedSharedMemSupported;
 #define RESERVED_MEM_BITMAP_2M_MASK    0x180000
 #define RESERVED_MEM_BITMAP_MASK       0x1fffff
 
+//
+// mReservedMemBitmap is a UINT32, one bit per piece of reserved memory.
+//
+#define RESERVED_MEM_SLOTS_MAX  32
+
 /**
  * mReservedMemRanges describes the layout of the reserved memory.
  * The reserved memory consists of disfferent size of memory region.
@@ -143,6 +148,9 @@ IoMmuInitReservedSharedMem (
   EFI_PHYSICAL_ADDRESS      PhysicalAddress;
   UINT64                    SharedAddress;
 
+  MEM_ENCRYPT_SEV_PAGE_RANGE  Ranges[RESERVED_MEM_SLOTS_MAX];
+  UINTN                       RangeCount;
+
   if (!mReservedSharedMemSupported) {
     return EFI_UNSUPPORTED;
   }
@@ -160,6 +168,7 @@ IoMmuInitReservedSharedMem (
 
   mReservedMemBitmap        = 0;
   mReservedSharedMemAddress = PhysicalAddress;
+  RangeCount                = 0;
 
   for (Index1 = 0; Index1 < ARRAY_SIZE (mReservedMemRanges); Index1++) {
     MemRange                         = &mReservedMemRanges[Index1];
@@ -169,12 +178,10 @@ IoMmuInitReservedSharedMem (
       SharedAddress = (UINT64)(UINTN)(MemRange->StartAddressOfMemRange + Index2 * SIZE_OF_MEM_RANGE (MemRange) + MemRange->HeaderSize);
 
       if (CC_GUEST_IS_SEV (PcdGet64 (PcdConfidentialComputingGuestAttr))) {
-        Status = MemEncryptSevClearPageEncMask (
-                   0,
-                   SharedAddress,
-                   EFI_SIZE_TO_PAGES (MemRange->DataSize)
-                   );
-        ASSERT (!EFI_ERROR (Status));
+        ASSERT (RangeCount < RESERVED_MEM_SLOTS_MAX);
+        Ranges[RangeCount].BaseAddress = SharedAddress;
+        Ranges[RangeCount].NumPages    = EFI_SIZE_TO_PAGES (MemRange->DataSize);
+        RangeCount++;
       } else if (CC_GUEST_IS_TDX (PcdGet64 (PcdConfidentialComputingGuestAttr))) {
         Status = MemEncryptTdxSetPageSharedBit (
                    0,
@@ -190,6 +197,15 @@ IoMmuInitReservedSharedMem (
     PhysicalAddress += (MemRange->Slots * SIZE_OF_MEM_RANGE (MemRange));
   }
 
+  //
+  // Share all the data parts at once, with a single TLB flush and as few
+  // page state changes as SEV-SNP allows.
+  //
+  if (RangeCount != 0) {
+    Status = MemEncryptSevClearPageEncMaskRanges (0, Ranges, RangeCount);
+    ASSERT (!EFI_ERROR (Status));
+  }
+
   return EFI_SUCCESS;
 }
 
@@ -208,22 +224,24 @@ IoMmuReleaseReservedSharedMem (
   IOMMU_RESERVED_MEM_RANGE  *MemRange;
   UINT64                    SharedAddress;
 
+  MEM_ENCRYPT_SEV_PAGE_RANGE  Ranges[RESERVED_MEM_SLOTS_MAX];
+  UINTN                       RangeCount;
+
   if (!mReservedSharedMemSupported) {
     return EFI_SUCCESS;
   }
 
+  RangeCount = 0;
   for (Index1 = 0; Index1 < ARRAY_SIZE (mReservedMemRanges); Index1++) {
     MemRange = &mReservedMemRanges[Index1];
     for (Index2 = 0; Index2 < MemRange->Slots; Index2++) {
       SharedAddress = (UINT64)(UINTN)(MemRange->StartAddressOfMemRange + Index2 * SIZE_OF_MEM_RANGE (MemRange) + MemRange->HeaderSize);
 
       if (CC_GUEST_IS_SEV (PcdGet64 (PcdConfidentialComputingGuestAttr))) {
-        Status = MemEncryptSevSetPageEncMask (
-                   0,
-                   SharedAddress,
-                   EFI_SIZE_TO_PAGES (MemRange->DataSize)
-                   );
-        ASSERT (!EFI_ERROR (Status));
+        ASSERT (RangeCount < RESERVED_MEM_SLOTS_MAX);
+        Ranges[RangeCount].BaseAddress = SharedAddress;
+        Ranges[RangeCount].NumPages    = EFI_SIZE_TO_PAGES (MemRange->DataSize);
+        RangeCount++;
       } else if (CC_GUEST_IS_TDX (PcdGet64 (PcdConfidentialComputingGuestAttr))) {
         Status = MemEncryptTdxClearPageSharedBit (
                    0,
@@ -237,6 +255,11 @@ IoMmuReleaseReservedSharedMem (
     }
   }
 
+  if (RangeCount != 0) {
+    Status = MemEncryptSevSetPageEncMaskRanges (0, Ranges, RangeCount);
+    ASSERT (!EFI_ERROR (Status));
+  }
+
   if (!MemoryMapLocked) {
     FreePages ((VOID *)(UINTN)mReservedSharedMemAddress, EFI_SIZE_TO_PAGES (CalcuateReservedMemSize ()));
     mReservedSharedMemAddress = 0;
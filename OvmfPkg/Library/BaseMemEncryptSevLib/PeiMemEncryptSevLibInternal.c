@@ -141,3 +141,95 @@ MemEncryptSevGetEncryptionMask (
 
   return SevEsWorkArea->EncryptionMask;
 }
+
+/**
+  Returns the page state generation.
+
+  @return  The page state generation
+**/
+UINT32
+EFIAPI
+MemEncryptSevGetPageStateGeneration (
+  VOID
+  )
+{
+  SEC_SEV_ES_WORK_AREA  *SevEsWorkArea;
+
+  SevEsWorkArea = GetSevEsWorkArea ();
+  if (SevEsWorkArea == NULL) {
+    return 0;
+  }
+
+  return *(volatile UINT32 *)&SevEsWorkArea->PageStateGeneration;
+}
+
+/**
+  Record that the encryption state of a page has changed.
+
+  Must be called after the page table change, so that anything cached under
+  the previous generation is dropped.
+**/
+VOID
+EFIAPI
+InternalMemEncryptSevPageStateChanged (
+  VOID
+  )
+{
+  SEC_SEV_ES_WORK_AREA  *SevEsWorkArea;
+
+  SevEsWorkArea = GetSevEsWorkArea ();
+  if (SevEsWorkArea != NULL) {
+    SevEsWorkArea->PageStateGeneration++;
+  }
+}
+
+/**
+  Returns the number of SEV-SNP page state change VMGEXITs made by this
+  library, and the number it would have made with a separate request of 4KB
+  entries for each region it was asked to change.
+
+  @param[out] Exits           The number of page state change VMGEXITs.
+  @param[out] UnbatchedExits  The number of page state change VMGEXITs
+                              without batching.
+**/
+VOID
+EFIAPI
+MemEncryptSevGetPageStateChangeExits (
+  OUT UINT64  *Exits,
+  OUT UINT64  *UnbatchedExits
+  )
+{
+  SEC_SEV_ES_WORK_AREA  *SevEsWorkArea;
+
+  *Exits          = 0;
+  *UnbatchedExits = 0;
+
+  SevEsWorkArea = GetSevEsWorkArea ();
+  if (SevEsWorkArea != NULL) {
+    *Exits          = SevEsWorkArea->PageStateChangeExits;
+    *UnbatchedExits = SevEsWorkArea->PageStateChangeUnbatchedExits;
+  }
+}
+
+/**
+  Record page state change VMGEXITs in the SEV-ES work area.
+
+  @param[in]  Exits           The number of VMGEXITs issued.
+  @param[in]  UnbatchedExits  The number of VMGEXITs a separate request of
+                              4KB entries per range would have issued.
+**/
+VOID
+EFIAPI
+InternalMemEncryptSevCountPageStateChanges (
+  IN UINT64  Exits,
+  IN UINT64  UnbatchedExits
+  )
+{
+  SEC_SEV_ES_WORK_AREA  *SevEsWorkArea;
+
+  SevEsWorkArea = GetSevEsWorkArea ();
+  if (SevEsWorkArea != NULL) {
+    SevEsWorkArea->PageStateChangeExits          += Exits;
+    SevEsWorkArea->PageStateChangeUnbatchedExits += UnbatchedExits;
+  }
+}
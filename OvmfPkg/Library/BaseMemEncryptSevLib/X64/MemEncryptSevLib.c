@@ -81,6 +81,70 @@ MemEncryptSevSetPageEncMask (
            );
 }
 
+/**
+  This function clears memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were cleared for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Clearing the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+MemEncryptSevClearPageEncMaskRanges (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  return InternalMemEncryptSevSetRangesDecrypted (
+           Cr3BaseAddress,
+           Ranges,
+           RangeCount
+           );
+}
+
+/**
+  This function sets memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were set for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Setting the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+MemEncryptSevSetPageEncMaskRanges (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  return InternalMemEncryptSevSetRangesEncrypted (
+           Cr3BaseAddress,
+           Ranges,
+           RangeCount
+           );
+}
+
 /**
   Returns the encryption state of the specified virtual address range.
 
@@ -651,44 +651,64 @@ Done:
   return Status;
 }
 
+/**
+  Check whether a page table entry already maps its memory encrypted, or
+  unencrypted, as Mode asks.
+
+  @param[in]  PageTableEntry          Page table entry
+  @param[in]  Mode                    Set or Clear mode
+
+  @retval TRUE                        Mode would not change the entry.
+  @retval FALSE                       Mode would change the entry.
+**/
+STATIC
+BOOLEAN
+IsCBitInMode (
+  IN  UINT64          PageTableEntry,
+  IN  MAP_RANGE_MODE  Mode
+  )
+{
+  UINT64  AddressEncMask;
+
+  AddressEncMask = InternalGetMemEncryptionAddressMask ();
+
+  return ((PageTableEntry & AddressEncMask) != 0) == (Mode == SetCBit);
+}
+
 /**
   This function either sets or clears memory encryption bit for the memory
-  region specified by PhysicalAddress and Length from the current page table
-  context.
+  region specified by PhysicalAddress and Length in the page table at
+  Cr3BaseAddress.
 
   The function iterates through the PhysicalAddress one page at a time, and set
   or clears the memory encryption mask in the page table. If it encounters
   that a given physical address range is part of large page then it attempts to
   change the attribute at one go (based on size), otherwise it splits the
   large pages into smaller (e.g 2M page into 4K pages) and then try to set or
-  clear the encryption bit on the smallest page size.
+  clear the encryption bit on the smallest page size. A large page which
+  already has the encryption bit as requested is left alone.
 
-  @param[in]  Cr3BaseAddress          Cr3 Base Address (if zero then use
-                                      current CR3)
+  The caller flushes the TLB.
+
+  @param[in]  Cr3BaseAddress          Cr3 Base Address
   @param[in]  PhysicalAddress         The physical address that is the start
                                       address of a memory region.
   @param[in]  Length                  The length of memory region
   @param[in]  Mode                    Set or Clear mode
-  @param[in]  CacheFlush              Flush the caches before applying the
-                                      encryption mask
-  @param[in]  Mmio                    The physical address specified is Mmio
+  @param[in]  PgTableMask             Page table address mask
 
-  @retval RETURN_SUCCESS              The attributes were cleared for the
+  @retval RETURN_SUCCESS              The attributes were changed for the
                                       memory region.
-  @retval RETURN_INVALID_PARAMETER    Number of pages is zero.
-  @retval RETURN_UNSUPPORTED          Setting the memory encyrption attribute
-                                      is not supported
+  @retval RETURN_NO_MAPPING           Part of the memory region is not mapped.
 **/
 STATIC
 RETURN_STATUS
-EFIAPI
-SetMemoryEncDec (
+SetRangeEncDec (
   IN    PHYSICAL_ADDRESS  Cr3BaseAddress,
   IN    PHYSICAL_ADDRESS  PhysicalAddress,
   IN    UINTN             Length,
   IN    MAP_RANGE_MODE    Mode,
-  IN    BOOLEAN           CacheFlush,
-  IN    BOOLEAN           Mmio
+  IN    UINT64            PgTableMask
   )
 {
   PAGE_MAP_AND_DIRECTORY_POINTER  *PageMapLevel4Entry;
@@ -696,89 +716,10 @@ SetMemoryEncDec (
   PAGE_MAP_AND_DIRECTORY_POINTER  *PageDirectoryPointerEntry;
   PAGE_TABLE_1G_ENTRY             *PageDirectory1GEntry;
   PAGE_TABLE_ENTRY                *PageDirectory2MEntry;
-  PHYSICAL_ADDRESS                OrigPhysicalAddress;
   PAGE_TABLE_4K_ENTRY             *PageTableEntry;
-  UINT64                          PgTableMask;
-  UINT64                          AddressEncMask;
-  BOOLEAN                         IsWpEnabled;
-  UINTN                           OrigLength;
-  RETURN_STATUS                   Status;
-
-  //
-  // Set PageMapLevel4Entry to suppress incorrect compiler/analyzer warnings.
-  //
-  PageMapLevel4Entry = NULL;
-
-  DEBUG ((
-    DEBUG_VERBOSE,
-    "%a:%a: Cr3Base=0x%Lx Physical=0x%Lx Length=0x%Lx Mode=%a CacheFlush=%u Mmio=%u\n",
-    gEfiCallerBaseName,
-    __FUNCTION__,
-    Cr3BaseAddress,
-    PhysicalAddress,
-    (UINT64)Length,
-    (Mode == SetCBit) ? "Encrypt" : "Decrypt",
-    (UINT32)CacheFlush,
-    (UINT32)Mmio
-    ));
-
-  //
-  // Check if we have a valid memory encryption mask
-  //
-  AddressEncMask = InternalGetMemEncryptionAddressMask ();
-  if (!AddressEncMask) {
-    return RETURN_ACCESS_DENIED;
-  }
-
-  PgTableMask = AddressEncMask | EFI_PAGE_MASK;
-
-  if (Length == 0) {
-    return RETURN_INVALID_PARAMETER;
-  }
-
-  //
-  // We are going to change the memory encryption attribute from C=0 -> C=1 or
-  // vice versa Flush the caches to ensure that data is written into memory
-  // with correct C-bit
-  //
-  if (CacheFlush) {
-    WriteBackInvalidateDataCacheRange ((VOID *)(UINTN)PhysicalAddress, Length);
-  }
-
-  //
-  // Make sure that the page table is changeable.
-  //
-  IsWpEnabled = IsReadOnlyPageWriteProtected ();
-  if (IsWpEnabled) {
-    DisableReadOnlyPageWriteProtect ();
-  }
-
-  Status = EFI_SUCCESS;
-
-  //
-  // To maintain the security gurantees we must set the page to shared in the RMP
-  // table before clearing the memory encryption mask from the current page table.
-  //
-  // The InternalSetPageState() is used for setting the page state in the RMP table.
-  //
-  if (!Mmio && (Mode == ClearCBit) && MemEncryptSevSnpIsEnabled ()) {
-    InternalSetPageState (PhysicalAddress, EFI_SIZE_TO_PAGES (Length), SevSnpPageShared, FALSE);
-  }
-
-  //
-  // Save the specified length and physical address (we need it later).
-  //
-  OrigLength          = Length;
-  OrigPhysicalAddress = PhysicalAddress;
+  UINTN                           Skip;
 
   while (Length != 0) {
-    //
-    // If Cr3BaseAddress is not specified then read the current CR3
-    //
-    if (Cr3BaseAddress == 0) {
-      Cr3BaseAddress = AsmReadCr3 ();
-    }
-
     PageMapLevel4Entry  = (VOID *)(Cr3BaseAddress & ~PgTableMask);
     PageMapLevel4Entry += PML4_OFFSET (PhysicalAddress);
     if (!PageMapLevel4Entry->Bits.Present) {
@@ -789,8 +730,7 @@ SetMemoryEncDec (
         __FUNCTION__,
         PhysicalAddress
         ));
-      Status = RETURN_NO_MAPPING;
-      goto Done;
+      return RETURN_NO_MAPPING;
     }
 
     PageDirectory1GEntry = (VOID *)(
@@ -806,8 +746,7 @@ SetMemoryEncDec (
         __FUNCTION__,
         PhysicalAddress
         ));
-      Status = RETURN_NO_MAPPING;
-      goto Done;
+      return RETURN_NO_MAPPING;
     }
 
     //
@@ -829,6 +768,14 @@ SetMemoryEncDec (
           ));
         PhysicalAddress += BIT30;
         Length          -= BIT30;
+      } else if (IsCBitInMode (PageDirectory1GEntry->Uint64, Mode)) {
+        //
+        // Nothing to change in this page, so don't split it
+        //
+        Skip             = (UINTN)(BIT30 - (PhysicalAddress & (BIT30 - 1)));
+        Skip             = MIN (Skip, Length);
+        PhysicalAddress += Skip;
+        Length          -= Skip;
       } else {
         //
         // We must split the page
@@ -868,8 +815,7 @@ SetMemoryEncDec (
           __FUNCTION__,
           PhysicalAddress
           ));
-        Status = RETURN_NO_MAPPING;
-        goto Done;
+        return RETURN_NO_MAPPING;
       }
 
       //
@@ -884,6 +830,14 @@ SetMemoryEncDec (
           SetOrClearCBit (&PageDirectory2MEntry->Uint64, Mode);
           PhysicalAddress += BIT21;
           Length          -= BIT21;
+        } else if (IsCBitInMode (PageDirectory2MEntry->Uint64, Mode)) {
+          //
+          // Nothing to change in this page, so don't split it
+          //
+          Skip             = (UINTN)(BIT21 - (PhysicalAddress & (BIT21 - 1)));
+          Skip             = MIN (Skip, Length);
+          PhysicalAddress += Skip;
+          Length          -= Skip;
         } else {
           //
           // We must split up this page into 4K pages
@@ -920,8 +874,7 @@ SetMemoryEncDec (
             __FUNCTION__,
             PhysicalAddress
             ));
-          Status = RETURN_NO_MAPPING;
-          goto Done;
+          return RETURN_NO_MAPPING;
         }
 
         SetOrClearCBit (&PageTableEntry->Uint64, Mode);
@@ -931,12 +884,225 @@ SetMemoryEncDec (
     }
   }
 
+  return RETURN_SUCCESS;
+}
+
+/**
+  Sort memory regions by address and merge the ones that overlap or touch.
+
+  @param[in, out] Ranges              The memory regions
+  @param[in]      RangeCount          The number of entries in Ranges
+
+  @return                             The number of regions left at the
+                                      start of Ranges
+**/
+STATIC
+UINTN
+SortAndMergeRanges (
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  MEM_ENCRYPT_SEV_PAGE_RANGE  Range;
+  PHYSICAL_ADDRESS            End;
+  UINTN                       Index;
+  UINTN                       Pos;
+  UINTN                       Count;
+
+  //
+  // Insertion sort: batches are short, and often already in order.
+  //
+  for (Index = 1; Index < RangeCount; Index++) {
+    Range = Ranges[Index];
+    for (Pos = Index; Pos > 0; Pos--) {
+      if (Ranges[Pos - 1].BaseAddress <= Range.BaseAddress) {
+        break;
+      }
+
+      Ranges[Pos] = Ranges[Pos - 1];
+    }
+
+    Ranges[Pos] = Range;
+  }
+
+  Count = 0;
+  for (Index = 0; Index < RangeCount; Index++) {
+    if (Count != 0) {
+      End = Ranges[Count - 1].BaseAddress +
+            EFI_PAGES_TO_SIZE (Ranges[Count - 1].NumPages);
+      if (Ranges[Index].BaseAddress <= End) {
+        End = MAX (
+                End,
+                Ranges[Index].BaseAddress +
+                EFI_PAGES_TO_SIZE (Ranges[Index].NumPages)
+                );
+        Ranges[Count - 1].NumPages =
+          EFI_SIZE_TO_PAGES ((UINTN)(End - Ranges[Count - 1].BaseAddress));
+        continue;
+      }
+    }
+
+    Ranges[Count++] = Ranges[Index];
+  }
+
+  return Count;
+}
+
+/**
+  This function either sets or clears memory encryption bit for the memory
+  regions specified by Ranges from the current page table context.
+
+  The regions are sorted and merged first. The page table is then changed
+  for all of them with a single TLB flush, and with SEV-SNP their page state
+  changes are made together, with 2MB entries where the alignment allows.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+  @param[in]      Mode                Set or Clear mode
+  @param[in]      CacheFlush          Flush the caches before applying the
+                                      encryption mask
+  @param[in]      Mmio                The regions specified are Mmio
+
+  @retval RETURN_SUCCESS              The attributes were changed for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Setting the memory encyrption attribute
+                                      is not supported
+**/
+STATIC
+RETURN_STATUS
+SetRangesEncDec (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount,
+  IN     MAP_RANGE_MODE              Mode,
+  IN     BOOLEAN                     CacheFlush,
+  IN     BOOLEAN                     Mmio
+  )
+{
+  UINT64         PgTableMask;
+  UINT64         AddressEncMask;
+  BOOLEAN        IsWpEnabled;
+  BOOLEAN        Snp;
+  UINTN          Index;
+  UINTN          Exits;
+  UINTN          UnbatchedExits;
+  RETURN_STATUS  Status;
+
+  DEBUG ((
+    DEBUG_VERBOSE,
+    "%a:%a: Cr3Base=0x%Lx Ranges=%Lu Mode=%a CacheFlush=%u Mmio=%u\n",
+    gEfiCallerBaseName,
+    __FUNCTION__,
+    Cr3BaseAddress,
+    (UINT64)RangeCount,
+    (Mode == SetCBit) ? "Encrypt" : "Decrypt",
+    (UINT32)CacheFlush,
+    (UINT32)Mmio
+    ));
+
+  //
+  // Check if we have a valid memory encryption mask
+  //
+  AddressEncMask = InternalGetMemEncryptionAddressMask ();
+  if (!AddressEncMask) {
+    return RETURN_ACCESS_DENIED;
+  }
+
+  PgTableMask = AddressEncMask | EFI_PAGE_MASK;
+
+  if (RangeCount == 0) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  for (Index = 0; Index < RangeCount; Index++) {
+    DEBUG ((
+      DEBUG_VERBOSE,
+      "%a:%a: Physical=0x%Lx Length=0x%Lx\n",
+      gEfiCallerBaseName,
+      __FUNCTION__,
+      Ranges[Index].BaseAddress,
+      (UINT64)EFI_PAGES_TO_SIZE (Ranges[Index].NumPages)
+      ));
+    if (Ranges[Index].NumPages == 0) {
+      return RETURN_INVALID_PARAMETER;
+    }
+  }
+
+  //
+  // What the page state changes would have cost without batching, counted
+  // before the regions are merged.
+  //
+  Snp            = !Mmio && MemEncryptSevSnpIsEnabled ();
+  UnbatchedExits = Snp ? InternalPageStateChangeExits (Ranges, RangeCount) : 0;
+
+  RangeCount = SortAndMergeRanges (Ranges, RangeCount);
+
+  //
+  // We are going to change the memory encryption attribute from C=0 -> C=1 or
+  // vice versa Flush the caches to ensure that data is written into memory
+  // with correct C-bit
+  //
+  if (CacheFlush) {
+    for (Index = 0; Index < RangeCount; Index++) {
+      WriteBackInvalidateDataCacheRange (
+        (VOID *)(UINTN)Ranges[Index].BaseAddress,
+        EFI_PAGES_TO_SIZE (Ranges[Index].NumPages)
+        );
+    }
+  }
+
+  //
+  // Make sure that the page table is changeable.
+  //
+  IsWpEnabled = IsReadOnlyPageWriteProtected ();
+  if (IsWpEnabled) {
+    DisableReadOnlyPageWriteProtect ();
+  }
+
+  Status = EFI_SUCCESS;
+  Exits  = 0;
+
+  //
+  // To maintain the security gurantees we must set the page to shared in the RMP
+  // table before clearing the memory encryption mask from the current page table.
+  //
+  // The InternalSetPageStateRanges() is used for setting the page state in the RMP table.
+  //
+  if (Snp && (Mode == ClearCBit)) {
+    Exits = InternalSetPageStateRanges (Ranges, RangeCount, SevSnpPageShared, TRUE);
+  }
+
+  //
+  // If Cr3BaseAddress is not specified then read the current CR3
+  //
+  if (Cr3BaseAddress == 0) {
+    Cr3BaseAddress = AsmReadCr3 ();
+  }
+
+  for (Index = 0; Index < RangeCount; Index++) {
+    Status = SetRangeEncDec (
+               Cr3BaseAddress,
+               Ranges[Index].BaseAddress,
+               EFI_PAGES_TO_SIZE (Ranges[Index].NumPages),
+               Mode,
+               PgTableMask
+               );
+    if (RETURN_ERROR (Status)) {
+      goto Done;
+    }
+  }
+
   //
   // Protect the page table by marking the memory used for page table to be
   // read-only.
   //
   if (IsWpEnabled) {
-    EnablePageTableProtection ((UINTN)PageMapLevel4Entry, TRUE);
+    EnablePageTableProtection ((UINTN)(Cr3BaseAddress & ~PgTableMask), TRUE);
   }
 
   //
@@ -948,15 +1114,10 @@ SetMemoryEncDec (
   // SEV-SNP requires that all the private pages (i.e pages mapped encrypted) must be
   // added in the RMP table before the access.
   //
-  // The InternalSetPageState() is used for setting the page state in the RMP table.
+  // The InternalSetPageStateRanges() is used for setting the page state in the RMP table.
   //
-  if ((Mode == SetCBit) && MemEncryptSevSnpIsEnabled ()) {
-    InternalSetPageState (
-      OrigPhysicalAddress,
-      EFI_SIZE_TO_PAGES (OrigLength),
-      SevSnpPagePrivate,
-      FALSE
-      );
+  if (Snp && (Mode == SetCBit)) {
+    Exits = InternalSetPageStateRanges (Ranges, RangeCount, SevSnpPagePrivate, TRUE);
   }
 
 Done:
@@ -967,9 +1128,59 @@ Done:
     EnableReadOnlyPageWriteProtect ();
   }
 
+  if (Snp) {
+    InternalMemEncryptSevCountPageStateChanges (Exits, UnbatchedExits);
+  }
+
+  //
+  // Even a failed call may have changed some of the pages.
+  //
+  InternalMemEncryptSevPageStateChanged ();
+
   return Status;
 }
 
+/**
+  This function either sets or clears memory encryption bit for the memory
+  region specified by PhysicalAddress and Length from the current page table
+  context.
+
+  @param[in]  Cr3BaseAddress          Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in]  PhysicalAddress         The physical address that is the start
+                                      address of a memory region.
+  @param[in]  Length                  The length of memory region
+  @param[in]  Mode                    Set or Clear mode
+  @param[in]  CacheFlush              Flush the caches before applying the
+                                      encryption mask
+  @param[in]  Mmio                    The physical address specified is Mmio
+
+  @retval RETURN_SUCCESS              The attributes were cleared for the
+                                      memory region.
+  @retval RETURN_INVALID_PARAMETER    Number of pages is zero.
+  @retval RETURN_UNSUPPORTED          Setting the memory encyrption attribute
+                                      is not supported
+**/
+STATIC
+RETURN_STATUS
+EFIAPI
+SetMemoryEncDec (
+  IN    PHYSICAL_ADDRESS  Cr3BaseAddress,
+  IN    PHYSICAL_ADDRESS  PhysicalAddress,
+  IN    UINTN             Length,
+  IN    MAP_RANGE_MODE    Mode,
+  IN    BOOLEAN           CacheFlush,
+  IN    BOOLEAN           Mmio
+  )
+{
+  MEM_ENCRYPT_SEV_PAGE_RANGE  Range;
+
+  Range.BaseAddress = PhysicalAddress;
+  Range.NumPages    = EFI_SIZE_TO_PAGES (Length);
+
+  return SetRangesEncDec (Cr3BaseAddress, &Range, 1, Mode, CacheFlush, Mmio);
+}
+
 /**
   This function clears memory encryption bit for the memory region specified by
   PhysicalAddress and Length from the current page table context.
@@ -1038,6 +1249,76 @@ InternalMemEncryptSevSetMemoryEncrypted (
            );
 }
 
+/**
+  This function clears memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were cleared for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Clearing the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+InternalMemEncryptSevSetRangesDecrypted (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  return SetRangesEncDec (
+           Cr3BaseAddress,
+           Ranges,
+           RangeCount,
+           ClearCBit,
+           TRUE,
+           FALSE
+           );
+}
+
+/**
+  This function sets memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were set for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Setting the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+InternalMemEncryptSevSetRangesEncrypted (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  return SetRangesEncDec (
+           Cr3BaseAddress,
+           Ranges,
+           RangeCount,
+           SetCBit,
+           TRUE,
+           FALSE
+           );
+}
+
 /**
   This function clears memory encryption bit for the MMIO region specified by
   PhysicalAddress and Length.
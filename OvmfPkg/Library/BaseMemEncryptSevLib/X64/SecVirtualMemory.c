@@ -124,3 +124,65 @@ InternalMemEncryptSevClearMmioPageEncMask (
   //
   return RETURN_UNSUPPORTED;
 }
+
+/**
+  This function clears memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were cleared for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Clearing the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+InternalMemEncryptSevSetRangesDecrypted (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  //
+  // This function is not available during SEC.
+  //
+  return RETURN_UNSUPPORTED;
+}
+
+/**
+  This function sets memory encryption bit for the memory regions specified
+  by Ranges from the current page table context.
+
+  @param[in]      Cr3BaseAddress      Cr3 Base Address (if zero then use
+                                      current CR3)
+  @param[in, out] Ranges              The memory regions. They are sorted and
+                                      merged in place.
+  @param[in]      RangeCount          The number of entries in Ranges.
+
+  @retval RETURN_SUCCESS              The attributes were set for the
+                                      memory regions.
+  @retval RETURN_INVALID_PARAMETER    RangeCount or the number of pages of a
+                                      region is zero.
+  @retval RETURN_UNSUPPORTED          Setting the memory encryption attribute
+                                      is not supported
+**/
+RETURN_STATUS
+EFIAPI
+InternalMemEncryptSevSetRangesEncrypted (
+  IN     PHYSICAL_ADDRESS            Cr3BaseAddress,
+  IN OUT MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount
+  )
+{
+  //
+  // This function is not available during SEC.
+  //
+  return RETURN_UNSUPPORTED;
+}
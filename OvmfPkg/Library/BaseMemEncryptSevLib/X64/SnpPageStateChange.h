@@ -27,6 +27,34 @@ InternalSetPageState (
   IN BOOLEAN               UseLargeEntry
   );
 
+UINTN
+InternalSetPageStateRanges (
+  IN MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN UINTN                       RangeCount,
+  IN SEV_SNP_PAGE_STATE          State,
+  IN BOOLEAN                     UseLargeEntry
+  );
+
+UINTN
+InternalPageStateChangeExits (
+  IN MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN UINTN                       RangeCount
+  );
+
+/**
+  Record page state change VMGEXITs in the SEV-ES work area.
+
+  @param[in]  Exits           The number of VMGEXITs issued.
+  @param[in]  UnbatchedExits  The number of VMGEXITs a separate request of
+                              4KB entries per range would have issued.
+**/
+VOID
+EFIAPI
+InternalMemEncryptSevCountPageStateChanges (
+  IN UINT64  Exits,
+  IN UINT64  UnbatchedExits
+  );
+
 VOID
 SnpPageStateFailureTerminate (
   VOID
@@ -124,63 +124,93 @@ PvalidateRange (
   }
 }
 
+/**
+ Fill the page state structure with the next entries of the ranges, starting
+ at *RangeIndex and *BaseAddress, and advance both past them.
+
+ @return  The number of entries filled in.
+ */
 STATIC
-EFI_PHYSICAL_ADDRESS
+UINTN
 BuildPageStateBuffer (
-  IN EFI_PHYSICAL_ADDRESS        BaseAddress,
-  IN EFI_PHYSICAL_ADDRESS        EndAddress,
-  IN SEV_SNP_PAGE_STATE          State,
-  IN BOOLEAN                     UseLargeEntry,
-  IN SNP_PAGE_STATE_CHANGE_INFO  *Info
+  IN     MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN     UINTN                       RangeCount,
+  IN OUT UINTN                       *RangeIndex,
+  IN OUT EFI_PHYSICAL_ADDRESS        *BaseAddress,
+  IN     SEV_SNP_PAGE_STATE          State,
+  IN     BOOLEAN                     UseLargeEntry,
+  IN     SNP_PAGE_STATE_CHANGE_INFO  *Info
   )
 {
-  EFI_PHYSICAL_ADDRESS  NextAddress;
+  EFI_PHYSICAL_ADDRESS  NextAddress, EndAddress;
   UINTN                 i, RmpPageSize;
 
   // Clear the page state structure
   SetMem (Info, sizeof (*Info), 0);
 
-  i           = 0;
-  NextAddress = EndAddress;
+  i = 0;
 
   //
   // Populate the page state entry structure
   //
-  while ((BaseAddress < EndAddress) && (i < SNP_PAGE_STATE_MAX_ENTRY)) {
+  while ((*RangeIndex < RangeCount) && (i < SNP_PAGE_STATE_MAX_ENTRY)) {
+    EndAddress = Ranges[*RangeIndex].BaseAddress +
+                 EFI_PAGES_TO_SIZE (Ranges[*RangeIndex].NumPages);
+    if (*BaseAddress >= EndAddress) {
+      //
+      // Move on to the next range.
+      //
+      (*RangeIndex)++;
+      if (*RangeIndex < RangeCount) {
+        *BaseAddress = Ranges[*RangeIndex].BaseAddress;
+      }
+
+      continue;
+    }
+
     //
     // Is this a 2MB aligned page? Check if we can use the Large RMP entry.
     //
-    if (UseLargeEntry && IS_ALIGNED (BaseAddress, SIZE_2MB) &&
-        ((EndAddress - BaseAddress) >= SIZE_2MB))
+    if (UseLargeEntry && IS_ALIGNED (*BaseAddress, SIZE_2MB) &&
+        ((EndAddress - *BaseAddress) >= SIZE_2MB))
     {
       RmpPageSize = PvalidatePageSize2MB;
-      NextAddress = BaseAddress + SIZE_2MB;
+      NextAddress = *BaseAddress + SIZE_2MB;
     } else {
       RmpPageSize = PvalidatePageSize4K;
-      NextAddress = BaseAddress + EFI_PAGE_SIZE;
+      NextAddress = *BaseAddress + EFI_PAGE_SIZE;
     }
 
-    Info->Entry[i].GuestFrameNumber = BaseAddress >> EFI_PAGE_SHIFT;
+    Info->Entry[i].GuestFrameNumber = *BaseAddress >> EFI_PAGE_SHIFT;
     Info->Entry[i].PageSize         = RmpPageSize;
     Info->Entry[i].Operation        = MemoryStateToGhcbOp (State);
     Info->Entry[i].CurrentPage      = 0;
     Info->Header.EndEntry           = (UINT16)i;
 
-    BaseAddress = NextAddress;
+    *BaseAddress = NextAddress;
     i++;
   }
 
-  return NextAddress;
+  return i;
 }
 
+/**
+ Issue the page state change VMGEXIT until the hypervisor has processed all
+ the entries.
+
+ @return  The number of VMGEXITs issued.
+ */
 STATIC
-VOID
+UINTN
 PageStateChangeVmgExit (
   IN GHCB                        *Ghcb,
   IN SNP_PAGE_STATE_CHANGE_INFO  *Info
   )
 {
   EFI_STATUS  Status;
+  UINTN       Exits;
+
+  Exits = 0;
 
   //
   // As per the GHCB specification, the hypervisor can resume the guest before
@@ -196,6 +226,7 @@ PageStateChangeVmgExit (
     CcExitVmgSetOffsetValid (Ghcb, GhcbSwScratch);
 
     Status = CcExitVmgExit (Ghcb, SVM_EXIT_SNP_PAGE_STATE_CHANGE, 0, 0);
+    Exits++;
 
     //
     // The Page State Change VMGEXIT can pass the failure through the
@@ -205,47 +236,57 @@ PageStateChangeVmgExit (
       SnpPageStateFailureTerminate ();
     }
   }
+
+  return Exits;
 }
 
 /**
- The function is used to set the page state when SEV-SNP is active. The page state
- transition consist of changing the page ownership in the RMP table, and using the
- PVALIDATE instruction to update the Validated bit in RMP table.
+ The function is used to set the page state of several ranges when SEV-SNP is
+ active. The entries of all the ranges share the page state change requests,
+ so that a range does not need a VMGEXIT of its own.
 
  When the UseLargeEntry is set to TRUE, then function will try to use the large RMP
  entry (whevever possible).
+
+ @return  The number of page state change VMGEXITs issued.
  */
-VOID
-InternalSetPageState (
-  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
-  IN UINTN                 NumPages,
-  IN SEV_SNP_PAGE_STATE    State,
-  IN BOOLEAN               UseLargeEntry
+UINTN
+InternalSetPageStateRanges (
+  IN MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN UINTN                       RangeCount,
+  IN SEV_SNP_PAGE_STATE          State,
+  IN BOOLEAN                     UseLargeEntry
   )
 {
   GHCB                        *Ghcb;
-  EFI_PHYSICAL_ADDRESS        NextAddress, EndAddress;
+  EFI_PHYSICAL_ADDRESS        BaseAddress;
   MSR_SEV_ES_GHCB_REGISTER    Msr;
   BOOLEAN                     InterruptState;
   SNP_PAGE_STATE_CHANGE_INFO  *Info;
+  UINTN                       RangeIndex;
+  UINTN                       Exits;
 
   Msr.GhcbPhysicalAddress = AsmReadMsr64 (MSR_SEV_ES_GHCB);
   Ghcb                    = Msr.Ghcb;
 
-  EndAddress = BaseAddress + EFI_PAGES_TO_SIZE (NumPages);
+  for (RangeIndex = 0; RangeIndex < RangeCount; RangeIndex++) {
+    DEBUG ((
+      DEBUG_VERBOSE,
+      "%a:%a Address 0x%Lx - 0x%Lx State = %a LargeEntry = %d\n",
+      gEfiCallerBaseName,
+      __FUNCTION__,
+      Ranges[RangeIndex].BaseAddress,
+      Ranges[RangeIndex].BaseAddress + EFI_PAGES_TO_SIZE (Ranges[RangeIndex].NumPages),
+      State == SevSnpPageShared ? "Shared" : "Private",
+      UseLargeEntry
+      ));
+  }
 
-  DEBUG ((
-    DEBUG_VERBOSE,
-    "%a:%a Address 0x%Lx - 0x%Lx State = %a LargeEntry = %d\n",
-    gEfiCallerBaseName,
-    __FUNCTION__,
-    BaseAddress,
-    EndAddress,
-    State == SevSnpPageShared ? "Shared" : "Private",
-    UseLargeEntry
-    ));
+  Exits       = 0;
+  RangeIndex  = 0;
+  BaseAddress = (RangeCount != 0) ? Ranges[0].BaseAddress : 0;
 
-  while (BaseAddress < EndAddress) {
+  while (RangeIndex < RangeCount) {
     UINTN  CurrentEntry, EndEntry;
 
     //
@@ -256,14 +297,23 @@ InternalSetPageState (
     //
     // Build the page state structure
     //
-    Info        = (SNP_PAGE_STATE_CHANGE_INFO *)Ghcb->SharedBuffer;
-    NextAddress = BuildPageStateBuffer (
-                    BaseAddress,
-                    EndAddress,
-                    State,
-                    UseLargeEntry,
-                    Info
-                    );
+    Info = (SNP_PAGE_STATE_CHANGE_INFO *)Ghcb->SharedBuffer;
+    if (BuildPageStateBuffer (
+          Ranges,
+          RangeCount,
+          &RangeIndex,
+          &BaseAddress,
+          State,
+          UseLargeEntry,
+          Info
+          ) == 0)
+    {
+      //
+      // Only empty ranges were left.
+      //
+      CcExitVmgDone (Ghcb, InterruptState);
+      break;
+    }
 
     //
     // Save the current and end entry from the page state structure. We need
@@ -283,7 +333,7 @@ InternalSetPageState (
     //
     // Invoke the page state change VMGEXIT.
     //
-    PageStateChangeVmgExit (Ghcb, Info);
+    Exits += PageStateChangeVmgExit (Ghcb, Info);
 
     //
     // If the caller requested to change the page state to private then
@@ -294,7 +344,59 @@ InternalSetPageState (
     }
 
     CcExitVmgDone (Ghcb, InterruptState);
+  }
+
+  return Exits;
+}
+
+/**
+ The function is used to set the page state when SEV-SNP is active. The page state
+ transition consist of changing the page ownership in the RMP table, and using the
+ PVALIDATE instruction to update the Validated bit in RMP table.
 
-    BaseAddress = NextAddress;
+ When the UseLargeEntry is set to TRUE, then function will try to use the large RMP
+ entry (whevever possible).
+ */
+VOID
+InternalSetPageState (
+  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN UINTN                 NumPages,
+  IN SEV_SNP_PAGE_STATE    State,
+  IN BOOLEAN               UseLargeEntry
+  )
+{
+  MEM_ENCRYPT_SEV_PAGE_RANGE  Range;
+  UINTN                       Exits;
+
+  Range.BaseAddress = BaseAddress;
+  Range.NumPages    = NumPages;
+
+  Exits = InternalSetPageStateRanges (&Range, 1, State, UseLargeEntry);
+  InternalMemEncryptSevCountPageStateChanges (
+    Exits,
+    InternalPageStateChangeExits (&Range, 1)
+    );
+}
+
+/**
+ Return how many page state change VMGEXITs the ranges would take with 4KB
+ entries and a separate request per range, if the hypervisor processes all
+ the entries of a request at once.
+ */
+UINTN
+InternalPageStateChangeExits (
+  IN MEM_ENCRYPT_SEV_PAGE_RANGE  *Ranges,
+  IN UINTN                       RangeCount
+  )
+{
+  UINTN  Index;
+  UINTN  Exits;
+
+  Exits = 0;
+  for (Index = 0; Index < RangeCount; Index++) {
+    Exits += (Ranges[Index].NumPages + SNP_PAGE_STATE_MAX_ENTRY - 1) /
+             SNP_PAGE_STATE_MAX_ENTRY;
   }
+
+  return Exits;
 }
@@ -55,6 +55,78 @@ typedef PACKED struct {
   SEV_SNP_CPUID_FUNCTION    function[0];
 } SEV_SNP_CPUID_INFO;
 
+//
+// Maximum number of entries in the SEV-SNP CPUID table.
+//
+#define SEV_SNP_CPUID_COUNT_MAX  64
+
+//
+// Number of MMIO pages remembered as validated by ValidateMmioMemory().
+//
+#define VC_MMIO_CACHE_ENTRIES  8
+
+//
+// Number of CPUID results remembered by CpuidExit().
+//
+#define VC_CPUID_CACHE_ENTRIES  16
+
+//
+// A page found unencrypted under a page table and page state generation.
+//
+typedef struct {
+  UINT32    Cached;
+  UINT32    Generation;
+  UINT64    Cr3;
+  UINT64    Page;
+} VC_MMIO_CACHE_ENTRY;
+
+//
+// A CPUID result and the inputs it was computed for. Cr4 only holds the
+// CR4.OSXSAVE and CR4.PKE bits, which are reflected in leaves 1 and 7.
+//
+typedef struct {
+  UINT32    Cached;
+  UINT32    EaxIn;
+  UINT32    EcxIn;
+  UINT32    Cr4;
+  UINT64    XCr0;
+  UINT32    Eax;
+  UINT32    Ebx;
+  UINT32    Ecx;
+  UINT32    Edx;
+} VC_CPUID_CACHE_ENTRY;
+
+//
+// #VC handler caches, kept in SEV_ES_PER_CPU_DATA.VcCache. Like the rest of
+// the per-CPU data, the cached indicators are compared to 1.
+//
+typedef struct {
+  UINT32                  ApicBaseCached;
+  UINT64                  ApicBase;
+
+  UINTN                   MmioNext;
+  VC_MMIO_CACHE_ENTRY     Mmio[VC_MMIO_CACHE_ENTRIES];
+
+  //
+  // Positions of the SEV-SNP CPUID table entries, sorted by their inputs.
+  //
+  UINT32                  CpuidIndexed;
+  UINT8                   CpuidIndex[SEV_SNP_CPUID_COUNT_MAX];
+
+  UINTN                   CpuidNext;
+  VC_CPUID_CACHE_ENTRY    Cpuid[VC_CPUID_CACHE_ENTRIES];
+} VC_CACHE;
+
+STATIC_ASSERT (
+  sizeof (VC_CACHE) <= sizeof (((SEV_ES_PER_CPU_DATA *)0)->VcCache),
+  "VC_CACHE does not fit in SEV_ES_PER_CPU_DATA.VcCache"
+  );
+
+STATIC_ASSERT (
+  sizeof (SEV_ES_PER_CPU_DATA) <= SIZE_4KB,
+  "SEV_ES_PER_CPU_DATA does not fit in the page after the GHCB"
+  );
+
 /**
   Report an unsupported event to the hypervisor
 
@@ -99,6 +171,11 @@ UnsupportedExit (
   Examine the pagetable entry for the memory specified. MMIO should not be
   performed against encrypted memory. MMIO to the APIC page is always allowed.
 
+  Pages found to be unencrypted are remembered, together with the page table
+  and the page state generation they were found under, so that the page
+  table walk is only repeated after the encryption state of some page (or
+  the page table) has changed.
+
   @param[in] Ghcb           Pointer to the Guest-Hypervisor Communication Block
   @param[in] MemoryAddress  Memory address to validate
   @param[in] MemoryLength   Memory length to validate
@@ -118,22 +195,72 @@ ValidateMmioMemory (
   MEM_ENCRYPT_SEV_ADDRESS_RANGE_STATE  State;
   GHCB_EVENT_INJECTION                 GpEvent;
   UINTN                                Address;
+  SEV_ES_PER_CPU_DATA                  *SevEsData;
+  VC_CACHE                             *VcCache;
+  VC_MMIO_CACHE_ENTRY                  *Entry;
+  BOOLEAN                              SinglePage;
+  UINT64                               Cr3;
+  UINT32                               Generation;
+  UINTN                                Index;
+
+  SevEsData = (SEV_ES_PER_CPU_DATA *)(Ghcb + 1);
+  VcCache   = (VC_CACHE *)SevEsData->VcCache;
 
   //
   // Allow APIC accesses (which will have the encryption bit set during
-  // SEC and PEI phases).
+  // SEC and PEI phases). Reading the APIC base takes a CPUID and a RDMSR,
+  // that is two more #VCs, so it is read once; MsrExit() forgets it when
+  // the APIC base MSR is written.
   //
+  if (VcCache->ApicBaseCached != 1) {
+    VcCache->ApicBase       = GetLocalApicBaseAddress ();
+    VcCache->ApicBaseCached = 1;
+  }
+
   Address = MemoryAddress & ~(SIZE_4KB - 1);
-  if (Address == GetLocalApicBaseAddress ()) {
+  if (Address == VcCache->ApicBase) {
     return 0;
   }
 
+  //
+  // The generation must be read before the page table walk, so that a
+  // change made after it invalidates what the walk finds.
+  //
+  SinglePage = ((MemoryAddress + MemoryLength - 1) & ~(SIZE_4KB - 1)) == Address;
+  Cr3        = AsmReadCr3 ();
+  Generation = MemEncryptSevGetPageStateGeneration ();
+
+  if (SinglePage) {
+    for (Index = 0; Index < VC_MMIO_CACHE_ENTRIES; Index++) {
+      Entry = &VcCache->Mmio[Index];
+      if ((Entry->Cached == 1) && (Entry->Page == Address) &&
+          (Entry->Cr3 == Cr3) && (Entry->Generation == Generation))
+      {
+        SevEsData->VcStatistics.MmioCacheHits++;
+        return 0;
+      }
+    }
+  }
+
+  SevEsData->VcStatistics.MmioCacheMisses++;
+
   State = MemEncryptSevGetAddressRangeState (
-            0,
+            Cr3,
             MemoryAddress,
             MemoryLength
             );
   if (State == MemEncryptSevAddressRangeUnencrypted) {
+    if (SinglePage) {
+      Entry             = &VcCache->Mmio[VcCache->MmioNext];
+      VcCache->MmioNext = (VcCache->MmioNext + 1) % VC_MMIO_CACHE_ENTRIES;
+
+      Entry->Cached     = 0;
+      Entry->Generation = Generation;
+      Entry->Cr3        = Cr3;
+      Entry->Page       = Address;
+      Entry->Cached     = 1;
+    }
+
     return 0;
   }
 
@@ -713,12 +840,28 @@ MsrExit (
   IN     CC_INSTRUCTION_DATA     *InstructionData
   )
 {
-  UINT64  ExitInfo1, Status;
+  UINT64               ExitInfo1, Status;
+  SEV_ES_PER_CPU_DATA  *SevEsData;
+  VC_CACHE             *VcCache;
+  UINTN                Index;
 
   ExitInfo1 = 0;
 
   switch (*(InstructionData->OpCodes + 1)) {
     case 0x30: // WRMSR
+      //
+      // The APIC base may move, see ValidateMmioMemory(), and the APIC may
+      // be disabled, which CPUID leaf 1 reports.
+      //
+      if ((UINT32)Regs->Rcx == MSR_IA32_APIC_BASE) {
+        SevEsData               = (SEV_ES_PER_CPU_DATA *)(Ghcb + 1);
+        VcCache                 = (VC_CACHE *)SevEsData->VcCache;
+        VcCache->ApicBaseCached = 0;
+        for (Index = 0; Index < VC_CPUID_CACHE_ENTRIES; Index++) {
+          VcCache->Cpuid[Index].Cached = 0;
+        }
+      }
+
       ExitInfo1          = 1;
       Ghcb->SaveArea.Rax = Regs->Rax;
       CcExitVmgSetOffsetValid (Ghcb, GhcbRax);
@@ -1109,9 +1252,216 @@ SnpEnabled (
   return !!Msr.Bits.SevSnpBit;
 }
 
+/**
+  Check if a CPUID leaf/function is indexed via ECX sub-leaf/sub-function
+
+  @param[in]      EaxIn        EAX input for cpuid instruction
+
+  @retval FALSE                cpuid leaf/function is not indexed by ECX input
+  @retval TRUE                 cpuid leaf/function is indexed by ECX input
+
+**/
+STATIC
+BOOLEAN
+IsFunctionIndexed (
+  IN     UINT32  EaxIn
+  )
+{
+  switch (EaxIn) {
+    case CPUID_CACHE_PARAMS:
+    case CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS:
+    case CPUID_EXTENDED_TOPOLOGY:
+    case CPUID_EXTENDED_STATE:
+    case CPUID_INTEL_RDT_MONITORING:
+    case CPUID_INTEL_RDT_ALLOCATION:
+    case CPUID_INTEL_SGX:
+    case CPUID_INTEL_PROCESSOR_TRACE:
+    case CPUID_DETERMINISTIC_ADDRESS_TRANSLATION_PARAMETERS:
+    case CPUID_V2_EXTENDED_TOPOLOGY:
+    case 0x8000001D: /* Cache Topology Information */
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+  Compare the inputs matched by a SEV-SNP CPUID table entry to CPUID inputs.
+
+  @param[in]      CpuidFn      SEV-SNP CPUID table entry
+  @param[in]      EaxIn        EAX input for cpuid instruction
+  @param[in]      EcxIn        ECX input for cpuid instruction, 0 if the
+                               leaf/function is not indexed by ECX input
+
+  @retval -1                   The entry sorts before the inputs
+  @retval 0                    The entry matches the inputs
+  @retval 1                    The entry sorts after the inputs
+
+**/
+STATIC
+INTN
+CompareCpuidFunction (
+  IN     SEV_SNP_CPUID_FUNCTION  *CpuidFn,
+  IN     UINT32                  EaxIn,
+  IN     UINT32                  EcxIn
+  )
+{
+  UINT32  FnEcxIn;
+
+  if (CpuidFn->EaxIn != EaxIn) {
+    return (CpuidFn->EaxIn < EaxIn) ? -1 : 1;
+  }
+
+  FnEcxIn = IsFunctionIndexed (CpuidFn->EaxIn) ? CpuidFn->EcxIn : 0;
+  if (FnEcxIn != EcxIn) {
+    return (FnEcxIn < EcxIn) ? -1 : 1;
+  }
+
+  return 0;
+}
+
+/**
+  Get the SEV-SNP CPUID table, indexing it for this CPU on first use.
+
+  The table does not change after launch, so the positions of its entries
+  are sorted once by the inputs they match. Entries matching the same inputs
+  keep their table order, so that the first one is still found first. A
+  table with more entries than SEV-SNP allows is not indexed.
+
+  @param[in, out] VcCache      #VC handler caches of this CPU
+
+  @return                      SEV-SNP CPUID table
+
+**/
+STATIC
+SEV_SNP_CPUID_INFO *
+GetCpuidTable (
+  IN OUT VC_CACHE  *VcCache
+  )
+{
+  SEV_SNP_CPUID_INFO      *CpuidInfo;
+  SEV_SNP_CPUID_FUNCTION  *CpuidFn;
+  UINT32                  Idx;
+  UINT32                  Pos;
+
+  CpuidInfo = (SEV_SNP_CPUID_INFO *)(UINT64)PcdGet32 (PcdOvmfCpuidBase);
+
+  if ((VcCache->CpuidIndexed == 1) ||
+      (CpuidInfo->Count > SEV_SNP_CPUID_COUNT_MAX))
+  {
+    return CpuidInfo;
+  }
+
+  for (Idx = 0; Idx < CpuidInfo->Count; Idx++) {
+    CpuidFn = &CpuidInfo->function[Idx];
+    for (Pos = Idx; Pos > 0; Pos--) {
+      if (CompareCpuidFunction (
+            &CpuidInfo->function[VcCache->CpuidIndex[Pos - 1]],
+            CpuidFn->EaxIn,
+            IsFunctionIndexed (CpuidFn->EaxIn) ? CpuidFn->EcxIn : 0
+            ) <= 0)
+      {
+        break;
+      }
+
+      VcCache->CpuidIndex[Pos] = VcCache->CpuidIndex[Pos - 1];
+    }
+
+    VcCache->CpuidIndex[Pos] = (UINT8)Idx;
+  }
+
+  VcCache->CpuidIndexed = 1;
+  return CpuidInfo;
+}
+
+/**
+  Get a SEV-SNP CPUID table entry, in index order if the table is indexed.
+
+  @param[in]      VcCache      #VC handler caches of this CPU
+  @param[in]      CpuidInfo    SEV-SNP CPUID table
+  @param[in]      Pos          Position of the entry
+
+  @return                      SEV-SNP CPUID table entry
+
+**/
+STATIC
+SEV_SNP_CPUID_FUNCTION *
+GetCpuidFunction (
+  IN     VC_CACHE            *VcCache,
+  IN     SEV_SNP_CPUID_INFO  *CpuidInfo,
+  IN     UINT32              Pos
+  )
+{
+  if (VcCache->CpuidIndexed == 1) {
+    return &CpuidInfo->function[VcCache->CpuidIndex[Pos]];
+  }
+
+  return &CpuidInfo->function[Pos];
+}
+
+/**
+  Find the first SEV-SNP CPUID table entry matching CPUID inputs.
+
+  A binary search of the index when the table is indexed, a scan of the
+  table otherwise. In the index, the entry found is the first one that does
+  not sort before the inputs, so callers must still compare it.
+
+  @param[in]      VcCache      #VC handler caches of this CPU
+  @param[in]      CpuidInfo    SEV-SNP CPUID table
+  @param[in]      EaxIn        EAX input for cpuid instruction
+  @param[in]      EcxIn        ECX input for cpuid instruction, 0 if the
+                               leaf/function is not indexed by ECX input
+
+  @return                      Position of the entry for GetCpuidFunction(),
+                               CpuidInfo->Count if there is none
+
+**/
+STATIC
+UINT32
+FindCpuidFunction (
+  IN     VC_CACHE            *VcCache,
+  IN     SEV_SNP_CPUID_INFO  *CpuidInfo,
+  IN     UINT32              EaxIn,
+  IN     UINT32              EcxIn
+  )
+{
+  UINT32  Low;
+  UINT32  High;
+  UINT32  Mid;
+
+  if (VcCache->CpuidIndexed != 1) {
+    for (Low = 0; Low < CpuidInfo->Count; Low++) {
+      if (CompareCpuidFunction (&CpuidInfo->function[Low], EaxIn, EcxIn) == 0) {
+        break;
+      }
+    }
+
+    return Low;
+  }
+
+  Low  = 0;
+  High = CpuidInfo->Count;
+  while (Low < High) {
+    Mid = Low + (High - Low) / 2;
+    if (CompareCpuidFunction (
+          GetCpuidFunction (VcCache, CpuidInfo, Mid),
+          EaxIn,
+          EcxIn
+          ) < 0)
+    {
+      Low = Mid + 1;
+    } else {
+      High = Mid;
+    }
+  }
+
+  return Low;
+}
+
 /**
   Calculate the total XSAVE area size for enabled XSAVE areas
 
+  @param[in]      VcCache           #VC handler caches of this CPU
   @param[in]      XFeaturesEnabled  Bit-mask of enabled XSAVE features/areas as
                                     indicated by XCR0/MSR_IA32_XSS bits
   @param[in]      XSaveBaseSize     Base/legacy XSAVE area size (e.g. when
@@ -1129,10 +1479,11 @@ SnpEnabled (
 STATIC
 BOOLEAN
 GetCpuidXSaveSize (
-  IN     UINT64   XFeaturesEnabled,
-  IN     UINT32   XSaveBaseSize,
-  IN OUT UINT32   *XSaveSize,
-  IN     BOOLEAN  Compacted
+  IN     VC_CACHE  *VcCache,
+  IN     UINT64    XFeaturesEnabled,
+  IN     UINT32    XSaveBaseSize,
+  IN OUT UINT32    *XSaveSize,
+  IN     BOOLEAN   Compacted
   )
 {
   SEV_SNP_CPUID_INFO  *CpuidInfo;
@@ -1140,10 +1491,22 @@ GetCpuidXSaveSize (
   UINT32              Idx;
 
   *XSaveSize = XSaveBaseSize;
-  CpuidInfo  = (SEV_SNP_CPUID_INFO *)(UINT64)PcdGet32 (PcdOvmfCpuidBase);
+  CpuidInfo  = GetCpuidTable (VcCache);
 
-  for (Idx = 0; Idx < CpuidInfo->Count; Idx++) {
-    SEV_SNP_CPUID_FUNCTION  *CpuidFn = &CpuidInfo->function[Idx];
+  //
+  // Indexed, the leaf 0xD entries are next to each other.
+  //
+  Idx = 0;
+  if (VcCache->CpuidIndexed == 1) {
+    Idx = FindCpuidFunction (VcCache, CpuidInfo, CPUID_EXTENDED_STATE, 0);
+  }
+
+  for ( ; Idx < CpuidInfo->Count; Idx++) {
+    SEV_SNP_CPUID_FUNCTION  *CpuidFn = GetCpuidFunction (VcCache, CpuidInfo, Idx);
+
+    if ((VcCache->CpuidIndexed == 1) && (CpuidFn->EaxIn != 0xD)) {
+      break;
+    }
 
     if (!((CpuidFn->EaxIn == 0xD) &&
           ((CpuidFn->EcxIn == 0) || (CpuidFn->EcxIn == 1))))
@@ -1176,39 +1539,6 @@ GetCpuidXSaveSize (
   return TRUE;
 }
 
-/**
-  Check if a CPUID leaf/function is indexed via ECX sub-leaf/sub-function
-
-  @param[in]      EaxIn        EAX input for cpuid instruction
-
-  @retval FALSE                cpuid leaf/function is not indexed by ECX input
-  @retval TRUE                 cpuid leaf/function is indexed by ECX input
-
-**/
-STATIC
-BOOLEAN
-IsFunctionIndexed (
-  IN     UINT32  EaxIn
-  )
-{
-  switch (EaxIn) {
-    case CPUID_CACHE_PARAMS:
-    case CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS:
-    case CPUID_EXTENDED_TOPOLOGY:
-    case CPUID_EXTENDED_STATE:
-    case CPUID_INTEL_RDT_MONITORING:
-    case CPUID_INTEL_RDT_ALLOCATION:
-    case CPUID_INTEL_SGX:
-    case CPUID_INTEL_PROCESSOR_TRACE:
-    case CPUID_DETERMINISTIC_ADDRESS_TRANSLATION_PARAMETERS:
-    case CPUID_V2_EXTENDED_TOPOLOGY:
-    case 0x8000001D: /* Cache Topology Information */
-      return TRUE;
-  }
-
-  return FALSE;
-}
-
 /**
   Fetch CPUID leaf/function via SEV-SNP CPUID table.
 
@@ -1249,31 +1579,31 @@ GetCpuidFw (
   IN OUT BOOLEAN  *Unsupported
   )
 {
-  SEV_SNP_CPUID_INFO  *CpuidInfo;
-  BOOLEAN             Found;
-  UINT32              Idx;
+  SEV_SNP_CPUID_INFO      *CpuidInfo;
+  SEV_SNP_CPUID_FUNCTION  *CpuidFn;
+  SEV_ES_PER_CPU_DATA     *SevEsData;
+  VC_CACHE                *VcCache;
+  UINT32                  KeyEcxIn;
+  BOOLEAN                 Found;
+  UINT32                  Idx;
 
-  CpuidInfo = (SEV_SNP_CPUID_INFO *)(UINT64)PcdGet32 (PcdOvmfCpuidBase);
+  SevEsData = (SEV_ES_PER_CPU_DATA *)(Ghcb + 1);
+  VcCache   = (VC_CACHE *)SevEsData->VcCache;
+  CpuidInfo = GetCpuidTable (VcCache);
+  KeyEcxIn  = IsFunctionIndexed (EaxIn) ? EcxIn : 0;
   Found     = FALSE;
 
-  for (Idx = 0; Idx < CpuidInfo->Count; Idx++) {
-    SEV_SNP_CPUID_FUNCTION  *CpuidFn = &CpuidInfo->function[Idx];
+  Idx = FindCpuidFunction (VcCache, CpuidInfo, EaxIn, KeyEcxIn);
+  if (Idx < CpuidInfo->Count) {
+    CpuidFn = GetCpuidFunction (VcCache, CpuidInfo, Idx);
+    if (CompareCpuidFunction (CpuidFn, EaxIn, KeyEcxIn) == 0) {
+      *Eax = CpuidFn->Eax;
+      *Ebx = CpuidFn->Ebx;
+      *Ecx = CpuidFn->Ecx;
+      *Edx = CpuidFn->Edx;
 
-    if (CpuidFn->EaxIn != EaxIn) {
-      continue;
+      Found = TRUE;
     }
-
-    if (IsFunctionIndexed (CpuidFn->EaxIn) && (CpuidFn->EcxIn != EcxIn)) {
-      continue;
-    }
-
-    *Eax = CpuidFn->Eax;
-    *Ebx = CpuidFn->Ebx;
-    *Ecx = CpuidFn->Ecx;
-    *Edx = CpuidFn->Edx;
-
-    Found = TRUE;
-    break;
   }
 
   if (!Found) {
@@ -1356,6 +1686,7 @@ GetCpuidFw (
     }
 
     if (!GetCpuidXSaveSize (
+           VcCache,
            XCr0 | XssMsr.Uint64,
            *Ebx,
            &XSaveSize,
@@ -1399,6 +1730,97 @@ Out:
   return TRUE;
 }
 
+/**
+  Find a CPUID result remembered by CpuidExit().
+
+  @param[in]      VcCache      #VC handler caches of this CPU
+  @param[in]      EaxIn        EAX input for cpuid instruction
+  @param[in]      EcxIn        ECX input for cpuid instruction, 0 if the
+                               leaf/function is not indexed by ECX input
+  @param[in]      Cr4          CR4.OSXSAVE and CR4.PKE at time of cpuid
+                               instruction
+  @param[in]      XCr0         XCR0 at time of cpuid instruction, 0 unless
+                               the leaf is CPUID_EXTENDED_STATE
+
+  @return                      Cached result, NULL if there is none
+
+**/
+STATIC
+VC_CPUID_CACHE_ENTRY *
+FindCpuidResult (
+  IN     VC_CACHE  *VcCache,
+  IN     UINT32    EaxIn,
+  IN     UINT32    EcxIn,
+  IN     UINT32    Cr4,
+  IN     UINT64    XCr0
+  )
+{
+  VC_CPUID_CACHE_ENTRY  *Entry;
+  UINTN                 Index;
+
+  for (Index = 0; Index < VC_CPUID_CACHE_ENTRIES; Index++) {
+    Entry = &VcCache->Cpuid[Index];
+    if ((Entry->Cached == 1) &&
+        (Entry->EaxIn == EaxIn) &&
+        (Entry->EcxIn == EcxIn) &&
+        (Entry->Cr4 == Cr4) &&
+        (Entry->XCr0 == XCr0))
+    {
+      return Entry;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Remember a CPUID result, replacing the oldest one.
+
+  @param[in, out] VcCache      #VC handler caches of this CPU
+  @param[in]      EaxIn        EAX input for cpuid instruction
+  @param[in]      EcxIn        ECX input for cpuid instruction, 0 if the
+                               leaf/function is not indexed by ECX input
+  @param[in]      Cr4          CR4.OSXSAVE and CR4.PKE at time of cpuid
+                               instruction
+  @param[in]      XCr0         XCR0 at time of cpuid instruction, 0 unless
+                               the leaf is CPUID_EXTENDED_STATE
+  @param[in]      Eax          Leaf's EAX value
+  @param[in]      Ebx          Leaf's EBX value
+  @param[in]      Ecx          Leaf's ECX value
+  @param[in]      Edx          Leaf's EDX value
+
+**/
+STATIC
+VOID
+CacheCpuidResult (
+  IN OUT VC_CACHE  *VcCache,
+  IN     UINT32    EaxIn,
+  IN     UINT32    EcxIn,
+  IN     UINT32    Cr4,
+  IN     UINT64    XCr0,
+  IN     UINT32    Eax,
+  IN     UINT32    Ebx,
+  IN     UINT32    Ecx,
+  IN     UINT32    Edx
+  )
+{
+  VC_CPUID_CACHE_ENTRY  *Entry;
+
+  Entry              = &VcCache->Cpuid[VcCache->CpuidNext];
+  VcCache->CpuidNext = (VcCache->CpuidNext + 1) % VC_CPUID_CACHE_ENTRIES;
+
+  Entry->Cached = 0;
+  Entry->EaxIn  = EaxIn;
+  Entry->EcxIn  = EcxIn;
+  Entry->Cr4    = Cr4;
+  Entry->XCr0   = XCr0;
+  Entry->Eax    = Eax;
+  Entry->Ebx    = Ebx;
+  Entry->Ecx    = Ecx;
+  Entry->Edx    = Edx;
+  Entry->Cached = 1;
+}
+
 /**
   Handle a CPUID event.
 
@@ -1421,42 +1843,89 @@ CpuidExit (
   IN     CC_INSTRUCTION_DATA     *InstructionData
   )
 {
-  BOOLEAN  Unsupported;
-  UINT64   Status;
-  UINT32   EaxIn;
-  UINT32   EcxIn;
-  UINT64   XCr0;
-  UINT32   Eax;
-  UINT32   Ebx;
-  UINT32   Ecx;
-  UINT32   Edx;
+  BOOLEAN               Unsupported;
+  UINT64                Status;
+  UINT32                EaxIn;
+  UINT32                EcxIn;
+  UINT64                XCr0;
+  UINT32                Eax;
+  UINT32                Ebx;
+  UINT32                Ecx;
+  UINT32                Edx;
+  IA32_CR4              Cr4;
+  IA32_CR4              Cr4Key;
+  SEV_ES_PER_CPU_DATA   *SevEsData;
+  VC_CACHE              *VcCache;
+  VC_CPUID_CACHE_ENTRY  *Entry;
+  BOOLEAN               Cacheable;
+  UINT32                KeyEcxIn;
 
   EaxIn = (UINT32)(UINTN)Regs->Rax;
   EcxIn = (UINT32)(UINTN)Regs->Rcx;
+  XCr0  = 0;
 
+  Cr4.UintN = AsmReadCr4 ();
   if (EaxIn == CPUID_EXTENDED_STATE) {
-    IA32_CR4  Cr4;
-
-    Cr4.UintN           = AsmReadCr4 ();
     Ghcb->SaveArea.XCr0 = (Cr4.Bits.OSXSAVE == 1) ? AsmXGetBv (0) : 1;
     XCr0                = (Cr4.Bits.OSXSAVE == 1) ? AsmXGetBv (0) : 1;
   }
 
   if (SnpEnabled ()) {
-    if (!GetCpuidFw (
-           Ghcb,
-           EaxIn,
-           EcxIn,
-           XCr0,
-           &Eax,
-           &Ebx,
-           &Ecx,
-           &Edx,
-           &Status,
-           &Unsupported
-           ))
-    {
-      goto CpuidFail;
+    //
+    // A result from the CPUID table depends on the inputs, CR4 and XCR0, and
+    // on values from the hypervisor that are fixed for a CPU, except for the
+    // APIC enabled bit, see MsrExit(). The compacted XSAVE size also depends
+    // on MSR_IA32_XSS, which is only read when the CPU supports it, so that
+    // result is not remembered.
+    //
+    SevEsData           = (SEV_ES_PER_CPU_DATA *)(Ghcb + 1);
+    VcCache             = (VC_CACHE *)SevEsData->VcCache;
+    Cr4Key.UintN        = 0;
+    Cr4Key.Bits.OSXSAVE = Cr4.Bits.OSXSAVE;
+    Cr4Key.Bits.PKE     = Cr4.Bits.PKE;
+    KeyEcxIn            = IsFunctionIndexed (EaxIn) ? EcxIn : 0;
+    Cacheable           = !((EaxIn == CPUID_EXTENDED_STATE) && (EcxIn == 1));
+
+    Entry = NULL;
+    if (Cacheable) {
+      Entry = FindCpuidResult (VcCache, EaxIn, KeyEcxIn, (UINT32)Cr4Key.UintN, XCr0);
+    }
+
+    if (Entry != NULL) {
+      Eax = Entry->Eax;
+      Ebx = Entry->Ebx;
+      Ecx = Entry->Ecx;
+      Edx = Entry->Edx;
+    } else {
+      if (!GetCpuidFw (
+             Ghcb,
+             EaxIn,
+             EcxIn,
+             XCr0,
+             &Eax,
+             &Ebx,
+             &Ecx,
+             &Edx,
+             &Status,
+             &Unsupported
+             ))
+      {
+        goto CpuidFail;
+      }
+
+      if (Cacheable) {
+        CacheCpuidResult (
+          VcCache,
+          EaxIn,
+          KeyEcxIn,
+          (UINT32)Cr4Key.UintN,
+          XCr0,
+          Eax,
+          Ebx,
+          Ecx,
+          Edx
+          );
+      }
     }
   } else {
     if (!GetCpuidHyp (
@@ -1705,14 +2174,28 @@ InternalVmgExitHandleVc (
   UINT64                  ExitCode, Status;
   EFI_STATUS              VcRet;
   BOOLEAN                 InterruptState;
+  SEV_ES_PER_CPU_DATA     *SevEsData;
+  CC_EXIT_TYPE            ExitType;
+  BOOLEAN                 Timed;
+  UINT64                  StartTsc;
 
   VcRet = EFI_SUCCESS;
 
-  Regs = SystemContext.SystemContextX64;
+  Regs      = SystemContext.SystemContextX64;
+  SevEsData = (SEV_ES_PER_CPU_DATA *)(Ghcb + 1);
+
+  //
+  // Only the outermost #VC is timed: reading the TSC may itself cause a
+  // (nested) #VC, and RDTSC/RDTSCP exits must not read it at all.
+  //
+  ExitCode = Regs->ExceptionData;
+  Timed    = (SevEsData->VcCount == 1) &&
+             (ExitCode != SVM_EXIT_RDTSC) && (ExitCode != SVM_EXIT_RDTSCP);
+  StartTsc = Timed ? AsmReadTsc () : 0;
 
   CcExitVmgInit (Ghcb, &InterruptState);
 
-  ExitCode = Regs->ExceptionData;
+  ExitType = CcExitTypeOther;
   switch (ExitCode) {
     case SVM_EXIT_DR7_READ:
       NaeExit = Dr7ReadExit;
@@ -1731,7 +2214,8 @@ InternalVmgExitHandleVc (
       break;
 
     case SVM_EXIT_CPUID:
-      NaeExit = CpuidExit;
+      NaeExit  = CpuidExit;
+      ExitType = CcExitTypeCpuid;
       break;
 
     case SVM_EXIT_INVD:
@@ -1739,11 +2223,13 @@ InternalVmgExitHandleVc (
       break;
 
     case SVM_EXIT_IOIO_PROT:
-      NaeExit = IoioExit;
+      NaeExit  = IoioExit;
+      ExitType = CcExitTypeIo;
       break;
 
     case SVM_EXIT_MSR:
-      NaeExit = MsrExit;
+      NaeExit  = MsrExit;
+      ExitType = CcExitTypeMsr;
       break;
 
     case SVM_EXIT_VMMCALL:
@@ -1767,7 +2253,8 @@ InternalVmgExitHandleVc (
       break;
 
     case SVM_EXIT_NPF:
-      NaeExit = MmioExit;
+      NaeExit  = MmioExit;
+      ExitType = CcExitTypeMmio;
       break;
 
     default:
@@ -1796,6 +2283,11 @@ InternalVmgExitHandleVc (
 
   CcExitVmgDone (Ghcb, InterruptState);
 
+  SevEsData->VcStatistics.Count[ExitType]++;
+  if (Timed) {
+    SevEsData->VcStatistics.Cycles[ExitType] += AsmReadTsc () - StartTsc;
+  }
+
   return VcRet;
 }
 
@@ -13,6 +13,7 @@
 #include <Library/BaseMemoryLib.h>
 #include <IndustryStandard/Tdx.h>
 #include <IndustryStandard/InstructionParsing.h>
+#include <WorkArea.h>
 #include "CcInstruction.h"
 
 #define TDX_MMIO_READ   0
@@ -299,6 +300,66 @@ typedef struct {
   UINT32                  ReadOrWrite;
 } MMIO_EXIT_PARSED_INSTRUCTION;
 
+/**
+  Return the TDX work area, which holds the #VE handler state.
+
+  @return  The TDX work area, or NULL if this is not a TDX guest
+**/
+STATIC
+SEC_TDX_WORK_AREA *
+GetTdxWorkArea (
+  VOID
+  )
+{
+  TDX_WORK_AREA  *WorkArea;
+
+  WorkArea = (TDX_WORK_AREA *)(UINTN)FixedPcdGet32 (PcdOvmfWorkAreaBase);
+  if ((WorkArea == NULL) || (WorkArea->Header.GuestType != CcGuestTypeIntelTdx)) {
+    return NULL;
+  }
+
+  return &WorkArea->SecTdxWorkArea;
+}
+
+/**
+  Return the shared bit of guest physical addresses.
+
+  The GPA width is kept in the TDX work area by the reset vector, so that
+  the TDCALL is only needed if it is missing.
+
+  @param[out] SharedPageMask  The shared bit
+
+  @retval EFI_SUCCESS         The shared bit was returned
+  @retval EFI_DEVICE_ERROR    The TDCALL failed
+**/
+STATIC
+EFI_STATUS
+TdxGetSharedPageMask (
+  OUT UINT64  *SharedPageMask
+  )
+{
+  SEC_TDX_WORK_AREA  *TdxWorkArea;
+  TD_RETURN_DATA     TdReturnData;
+  UINT64             TdStatus;
+  UINT8              Gpaw;
+
+  TdxWorkArea = GetTdxWorkArea ();
+  if ((TdxWorkArea != NULL) && ((TdxWorkArea->Gpaw & 0x3f) != 0)) {
+    Gpaw = (UINT8)(TdxWorkArea->Gpaw & 0x3f);
+  } else {
+    TdStatus = TdCall (TDCALL_TDINFO, 0, 0, 0, &TdReturnData);
+    if (TdStatus != TDX_EXIT_REASON_SUCCESS) {
+      DEBUG ((DEBUG_ERROR, "%a: TDCALL failed with status=%llx\n", __FUNCTION__, TdStatus));
+      return EFI_DEVICE_ERROR;
+    }
+
+    Gpaw = (UINT8)(TdReturnData.TdInfo.Gpaw & 0x3f);
+  }
+
+  *SharedPageMask = 1ULL << (Gpaw - 1);
+  return EFI_SUCCESS;
+}
+
 /**
  * Parse the MMIO instructions.
  *
@@ -592,21 +653,15 @@ MmioExit (
   IN TDCALL_VEINFO_RETURN_DATA   *Veinfo
   )
 {
-  UINT64                        TdStatus;
   EFI_STATUS                    Status;
-  TD_RETURN_DATA                TdReturnData;
-  UINT8                         Gpaw;
   UINT64                        Val;
   UINT64                        TdSharedPageMask;
   CC_INSTRUCTION_DATA           InstructionData;
   MMIO_EXIT_PARSED_INSTRUCTION  ParsedInstruction;
+  SEC_TDX_WORK_AREA             *TdxWorkArea;
 
-  TdStatus = TdCall (TDCALL_TDINFO, 0, 0, 0, &TdReturnData);
-  if (TdStatus == TDX_EXIT_REASON_SUCCESS) {
-    Gpaw             = (UINT8)(TdReturnData.TdInfo.Gpaw & 0x3f);
-    TdSharedPageMask = 1ULL << (Gpaw - 1);
-  } else {
-    DEBUG ((DEBUG_ERROR, "%a: TDCALL failed with status=%llx\n", __FUNCTION__, TdStatus));
+  Status = TdxGetSharedPageMask (&TdSharedPageMask);
+  if (EFI_ERROR (Status)) {
     goto FatalError;
   }
 
@@ -653,7 +708,18 @@ MmioExit (
   // bump rip
   //
   Veinfo->ExitInstructionLength =  (UINT32)(CcInstructionLength (&InstructionData));
-  TdxDecodeInstruction ((UINT8 *)Regs->Rip, Veinfo->ExitInstructionLength);
+
+  //
+  // Show an instruction once, not on each access of a loop that polls or
+  // fills a device with it.
+  //
+  TdxWorkArea = GetTdxWorkArea ();
+  if ((TdxWorkArea == NULL) || (TdxWorkArea->VeDumpedRip != Regs->Rip)) {
+    TdxDecodeInstruction ((UINT8 *)Regs->Rip, Veinfo->ExitInstructionLength);
+    if (TdxWorkArea != NULL) {
+      TdxWorkArea->VeDumpedRip = Regs->Rip;
+    }
+  }
 
   return 0;
 
@@ -689,6 +755,14 @@ CcExitHandleVe (
   UINT64                  Status;
   TD_RETURN_DATA          ReturnData;
   EFI_SYSTEM_CONTEXT_X64  *Regs;
+  SEC_TDX_WORK_AREA       *TdxWorkArea;
+  CC_EXIT_TYPE            ExitType;
+  UINT64                  StartTsc;
+
+  //
+  // RDTSC does not cause a #VE in a TD, so every exit can be timed.
+  //
+  StartTsc = AsmReadTsc ();
 
   Regs   = SystemContext.SystemContextX64;
   Status = TdCall (TDCALL_TDGETVEINFO, 0, 0, 0, &ReturnData);
@@ -699,9 +773,11 @@ CcExitHandleVe (
     CpuDeadLoop ();
   }
 
+  ExitType = CcExitTypeOther;
   switch (ReturnData.VeInfo.ExitReason) {
     case EXIT_REASON_CPUID:
-      Status = CpuIdExit (Regs, &ReturnData.VeInfo);
+      ExitType = CcExitTypeCpuid;
+      Status   = CpuIdExit (Regs, &ReturnData.VeInfo);
       DEBUG ((
         DEBUG_VERBOSE,
         "CPUID #VE happened, ExitReasion is %d, ExitQualification = 0x%x.\n",
@@ -715,7 +791,8 @@ CcExitHandleVe (
       break;
 
     case EXIT_REASON_IO_INSTRUCTION:
-      Status = IoExit (Regs, &ReturnData.VeInfo);
+      ExitType = CcExitTypeIo;
+      Status   = IoExit (Regs, &ReturnData.VeInfo);
       DEBUG ((
         DEBUG_VERBOSE,
         "IO_Instruction #VE happened, ExitReasion is %d, ExitQualification = 0x%x.\n",
@@ -725,7 +802,8 @@ CcExitHandleVe (
       break;
 
     case EXIT_REASON_MSR_READ:
-      Status = ReadMsrExit (Regs, &ReturnData.VeInfo);
+      ExitType = CcExitTypeMsr;
+      Status   = ReadMsrExit (Regs, &ReturnData.VeInfo);
       DEBUG ((
         DEBUG_VERBOSE,
         "RDMSR #VE happened, ExitReasion is %d, ExitQualification = 0x%x. Regs->Rcx=0x%llx, Status = 0x%llx\n",
@@ -737,7 +815,8 @@ CcExitHandleVe (
       break;
 
     case EXIT_REASON_MSR_WRITE:
-      Status = WriteMsrExit (Regs, &ReturnData.VeInfo);
+      ExitType = CcExitTypeMsr;
+      Status   = WriteMsrExit (Regs, &ReturnData.VeInfo);
       DEBUG ((
         DEBUG_VERBOSE,
         "WRMSR #VE happened, ExitReasion is %d, ExitQualification = 0x%x. Regs->Rcx=0x%llx, Status = 0x%llx\n",
@@ -749,7 +828,8 @@ CcExitHandleVe (
       break;
 
     case EXIT_REASON_EPT_VIOLATION:
-      Status = MmioExit (Regs, &ReturnData.VeInfo);
+      ExitType = CcExitTypeMmio;
+      Status   = MmioExit (Regs, &ReturnData.VeInfo);
       DEBUG ((
         DEBUG_VERBOSE,
         "MMIO #VE happened, ExitReasion is %d, ExitQualification = 0x%x.\n",
@@ -793,5 +873,16 @@ CcExitHandleVe (
   }
 
   SystemContext.SystemContextX64->Rip += ReturnData.VeInfo.ExitInstructionLength;
+
+  //
+  // Concurrent #VEs on several vCPUs may lose an update; these are
+  // statistics, not worth a lock.
+  //
+  TdxWorkArea = GetTdxWorkArea ();
+  if (TdxWorkArea != NULL) {
+    TdxWorkArea->VeStatistics.Count[ExitType]++;
+    TdxWorkArea->VeStatistics.Cycles[ExitType] += AsmReadTsc () - StartTsc;
+  }
+
   return EFI_SUCCESS;
 }
@@ -19,11 +19,14 @@
 
 #include <IndustryStandard/Q35MchIch9.h>
 
+#include <Library/BaseLib.h>
 #include <Library/PciLib.h>
 #include <Library/PciCf8Lib.h>
 #include <Library/PciExpressLib.h>
 #include <Library/PcdLib.h>
 
+#include "PciShadow.h"
+
 STATIC BOOLEAN  mRunningOnQ35;
 
 RETURN_STATUS
@@ -34,9 +37,28 @@ InitializeConfigAccessMethod (
 {
   mRunningOnQ35 = (PcdGet16 (PcdOvmfHostBridgePciDevId) ==
                    INTEL_Q35_MCH_DEVICE_ID);
+  PciShadowInitialize ();
   return RETURN_SUCCESS;
 }
 
+/**
+  Read a 32-bit PCI configuration register, bypassing the shadow.
+
+  @param[in] Address  The address that encodes the PCI Bus, Device, Function
+                      and Register.
+
+  @return The value read from the PCI configuration register.
+**/
+UINT32
+PciConfigRead32 (
+  IN UINTN  Address
+  )
+{
+  return mRunningOnQ35 ?
+         PciExpressRead32 (Address) :
+         PciCf8Read32 (Address);
+}
+
 /**
   Registers a PCI device so PCI configuration registers may be accessed after
   SetVirtualAddressMap().
@@ -90,6 +112,12 @@ PciRead8 (
   IN      UINTN  Address
   )
 {
+  UINT32  Value;
+
+  if (PciShadowRead (Address, sizeof (UINT8), &Value)) {
+    return (UINT8)Value;
+  }
+
   return mRunningOnQ35 ?
          PciExpressRead8 (Address) :
          PciCf8Read8 (Address);
@@ -118,6 +146,7 @@ PciWrite8 (
   IN      UINT8  Value
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressWrite8 (Address, Value) :
          PciCf8Write8 (Address, Value);
@@ -150,6 +179,7 @@ PciOr8 (
   IN      UINT8  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressOr8 (Address, OrData) :
          PciCf8Or8 (Address, OrData);
@@ -182,6 +212,7 @@ PciAnd8 (
   IN      UINT8  AndData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressAnd8 (Address, AndData) :
          PciCf8And8 (Address, AndData);
@@ -217,6 +248,7 @@ PciAndThenOr8 (
   IN      UINT8  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressAndThenOr8 (Address, AndData, OrData) :
          PciCf8AndThenOr8 (Address, AndData, OrData);
@@ -251,9 +283,7 @@ PciBitFieldRead8 (
   IN      UINTN  EndBit
   )
 {
-  return mRunningOnQ35 ?
-         PciExpressBitFieldRead8 (Address, StartBit, EndBit) :
-         PciCf8BitFieldRead8 (Address, StartBit, EndBit);
+  return BitFieldRead8 (PciRead8 (Address), StartBit, EndBit);
 }
 
 /**
@@ -289,6 +319,7 @@ PciBitFieldWrite8 (
   IN      UINT8  Value
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressBitFieldWrite8 (Address, StartBit, EndBit, Value) :
          PciCf8BitFieldWrite8 (Address, StartBit, EndBit, Value);
@@ -330,6 +361,7 @@ PciBitFieldOr8 (
   IN      UINT8  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressBitFieldOr8 (Address, StartBit, EndBit, OrData) :
          PciCf8BitFieldOr8 (Address, StartBit, EndBit, OrData);
@@ -371,6 +403,7 @@ PciBitFieldAnd8 (
   IN      UINT8  AndData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressBitFieldAnd8 (Address, StartBit, EndBit, AndData) :
          PciCf8BitFieldAnd8 (Address, StartBit, EndBit, AndData);
@@ -417,6 +450,7 @@ PciBitFieldAndThenOr8 (
   IN      UINT8  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT8));
   return mRunningOnQ35 ?
          PciExpressBitFieldAndThenOr8 (Address, StartBit, EndBit, AndData, OrData) :
          PciCf8BitFieldAndThenOr8 (Address, StartBit, EndBit, AndData, OrData);
@@ -444,6 +478,12 @@ PciRead16 (
   IN      UINTN  Address
   )
 {
+  UINT32  Value;
+
+  if (PciShadowRead (Address, sizeof (UINT16), &Value)) {
+    return (UINT16)Value;
+  }
+
   return mRunningOnQ35 ?
          PciExpressRead16 (Address) :
          PciCf8Read16 (Address);
@@ -473,6 +513,7 @@ PciWrite16 (
   IN      UINT16  Value
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressWrite16 (Address, Value) :
          PciCf8Write16 (Address, Value);
@@ -506,6 +547,7 @@ PciOr16 (
   IN      UINT16  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressOr16 (Address, OrData) :
          PciCf8Or16 (Address, OrData);
@@ -539,6 +581,7 @@ PciAnd16 (
   IN      UINT16  AndData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressAnd16 (Address, AndData) :
          PciCf8And16 (Address, AndData);
@@ -575,6 +618,7 @@ PciAndThenOr16 (
   IN      UINT16  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressAndThenOr16 (Address, AndData, OrData) :
          PciCf8AndThenOr16 (Address, AndData, OrData);
@@ -610,9 +654,7 @@ PciBitFieldRead16 (
   IN      UINTN  EndBit
   )
 {
-  return mRunningOnQ35 ?
-         PciExpressBitFieldRead16 (Address, StartBit, EndBit) :
-         PciCf8BitFieldRead16 (Address, StartBit, EndBit);
+  return BitFieldRead16 (PciRead16 (Address), StartBit, EndBit);
 }
 
 /**
@@ -649,6 +691,7 @@ PciBitFieldWrite16 (
   IN      UINT16  Value
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressBitFieldWrite16 (Address, StartBit, EndBit, Value) :
          PciCf8BitFieldWrite16 (Address, StartBit, EndBit, Value);
@@ -691,6 +734,7 @@ PciBitFieldOr16 (
   IN      UINT16  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressBitFieldOr16 (Address, StartBit, EndBit, OrData) :
          PciCf8BitFieldOr16 (Address, StartBit, EndBit, OrData);
@@ -733,6 +777,7 @@ PciBitFieldAnd16 (
   IN      UINT16  AndData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressBitFieldAnd16 (Address, StartBit, EndBit, AndData) :
          PciCf8BitFieldAnd16 (Address, StartBit, EndBit, AndData);
@@ -780,6 +825,7 @@ PciBitFieldAndThenOr16 (
   IN      UINT16  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT16));
   return mRunningOnQ35 ?
          PciExpressBitFieldAndThenOr16 (Address, StartBit, EndBit, AndData, OrData) :
          PciCf8BitFieldAndThenOr16 (Address, StartBit, EndBit, AndData, OrData);
@@ -807,6 +853,12 @@ PciRead32 (
   IN      UINTN  Address
   )
 {
+  UINT32  Value;
+
+  if (PciShadowRead (Address, sizeof (UINT32), &Value)) {
+    return (UINT32)Value;
+  }
+
   return mRunningOnQ35 ?
          PciExpressRead32 (Address) :
          PciCf8Read32 (Address);
@@ -836,6 +888,7 @@ PciWrite32 (
   IN      UINT32  Value
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressWrite32 (Address, Value) :
          PciCf8Write32 (Address, Value);
@@ -869,6 +922,7 @@ PciOr32 (
   IN      UINT32  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressOr32 (Address, OrData) :
          PciCf8Or32 (Address, OrData);
@@ -902,6 +956,7 @@ PciAnd32 (
   IN      UINT32  AndData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressAnd32 (Address, AndData) :
          PciCf8And32 (Address, AndData);
@@ -938,6 +993,7 @@ PciAndThenOr32 (
   IN      UINT32  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressAndThenOr32 (Address, AndData, OrData) :
          PciCf8AndThenOr32 (Address, AndData, OrData);
@@ -973,9 +1029,7 @@ PciBitFieldRead32 (
   IN      UINTN  EndBit
   )
 {
-  return mRunningOnQ35 ?
-         PciExpressBitFieldRead32 (Address, StartBit, EndBit) :
-         PciCf8BitFieldRead32 (Address, StartBit, EndBit);
+  return BitFieldRead32 (PciRead32 (Address), StartBit, EndBit);
 }
 
 /**
@@ -1012,6 +1066,7 @@ PciBitFieldWrite32 (
   IN      UINT32  Value
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressBitFieldWrite32 (Address, StartBit, EndBit, Value) :
          PciCf8BitFieldWrite32 (Address, StartBit, EndBit, Value);
@@ -1054,6 +1109,7 @@ PciBitFieldOr32 (
   IN      UINT32  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressBitFieldOr32 (Address, StartBit, EndBit, OrData) :
          PciCf8BitFieldOr32 (Address, StartBit, EndBit, OrData);
@@ -1096,6 +1152,7 @@ PciBitFieldAnd32 (
   IN      UINT32  AndData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressBitFieldAnd32 (Address, StartBit, EndBit, AndData) :
          PciCf8BitFieldAnd32 (Address, StartBit, EndBit, AndData);
@@ -1143,6 +1200,7 @@ PciBitFieldAndThenOr32 (
   IN      UINT32  OrData
   )
 {
+  PciShadowInvalidate (Address, sizeof (UINT32));
   return mRunningOnQ35 ?
          PciExpressBitFieldAndThenOr32 (Address, StartBit, EndBit, AndData, OrData) :
          PciCf8BitFieldAndThenOr32 (Address, StartBit, EndBit, AndData, OrData);
@@ -1179,9 +1237,48 @@ PciReadBuffer (
   OUT     VOID   *Buffer
   )
 {
-  return mRunningOnQ35 ?
-         PciExpressReadBuffer (StartAddress, Size, Buffer) :
-         PciCf8ReadBuffer (StartAddress, Size, Buffer);
+  UINTN  ReturnValue;
+
+  //
+  // Split the range into the same cycles as PciExpressReadBuffer() and
+  // PciCf8ReadBuffer() do, but read each register through PciRead8/16/32(),
+  // so that the shadowed ones are not read from the hardware.
+  //
+  ReturnValue = Size;
+
+  if ((Size >= sizeof (UINT8)) && ((StartAddress & BIT0) != 0)) {
+    *(UINT8 *)Buffer = PciRead8 (StartAddress);
+    StartAddress    += sizeof (UINT8);
+    Size            -= sizeof (UINT8);
+    Buffer           = (UINT8 *)Buffer + sizeof (UINT8);
+  }
+
+  if ((Size >= sizeof (UINT16)) && ((StartAddress & BIT1) != 0)) {
+    WriteUnaligned16 ((UINT16 *)Buffer, PciRead16 (StartAddress));
+    StartAddress += sizeof (UINT16);
+    Size         -= sizeof (UINT16);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT16);
+  }
+
+  while (Size >= sizeof (UINT32)) {
+    WriteUnaligned32 ((UINT32 *)Buffer, PciRead32 (StartAddress));
+    StartAddress += sizeof (UINT32);
+    Size         -= sizeof (UINT32);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT32);
+  }
+
+  if (Size >= sizeof (UINT16)) {
+    WriteUnaligned16 ((UINT16 *)Buffer, PciRead16 (StartAddress));
+    StartAddress += sizeof (UINT16);
+    Size         -= sizeof (UINT16);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT16);
+  }
+
+  if (Size >= sizeof (UINT8)) {
+    *(UINT8 *)Buffer = PciRead8 (StartAddress);
+  }
+
+  return ReturnValue;
 }
 
 /**
@@ -1216,7 +1313,45 @@ PciWriteBuffer (
   IN      VOID   *Buffer
   )
 {
-  return mRunningOnQ35 ?
-         PciExpressWriteBuffer (StartAddress, Size, Buffer) :
-         PciCf8WriteBuffer (StartAddress, Size, Buffer);
+  UINTN  ReturnValue;
+
+  //
+  // Like PciReadBuffer(), write each register through PciWrite8/16/32(), so
+  // that only the shadowed registers actually written are dropped.
+  //
+  ReturnValue = Size;
+
+  if ((Size >= sizeof (UINT8)) && ((StartAddress & BIT0) != 0)) {
+    PciWrite8 (StartAddress, *(UINT8 *)Buffer);
+    StartAddress += sizeof (UINT8);
+    Size         -= sizeof (UINT8);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT8);
+  }
+
+  if ((Size >= sizeof (UINT16)) && ((StartAddress & BIT1) != 0)) {
+    PciWrite16 (StartAddress, ReadUnaligned16 ((UINT16 *)Buffer));
+    StartAddress += sizeof (UINT16);
+    Size         -= sizeof (UINT16);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT16);
+  }
+
+  while (Size >= sizeof (UINT32)) {
+    PciWrite32 (StartAddress, ReadUnaligned32 ((UINT32 *)Buffer));
+    StartAddress += sizeof (UINT32);
+    Size         -= sizeof (UINT32);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT32);
+  }
+
+  if (Size >= sizeof (UINT16)) {
+    PciWrite16 (StartAddress, ReadUnaligned16 ((UINT16 *)Buffer));
+    StartAddress += sizeof (UINT16);
+    Size         -= sizeof (UINT16);
+    Buffer        = (UINT8 *)Buffer + sizeof (UINT16);
+  }
+
+  if (Size >= sizeof (UINT8)) {
+    PciWrite8 (StartAddress, *(UINT8 *)Buffer);
+  }
+
+  return ReturnValue;
 }
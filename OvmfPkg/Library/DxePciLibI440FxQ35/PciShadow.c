@@ -0,0 +1,361 @@
+/** @file
+  Boot time shadow of PCI configuration space.
+
+  Every PCI configuration access is an exit to the hypervisor, and a costly
+  one in confidential guests, where the exit goes through the #VC or #VE
+  handler. PCI enumeration and the drivers binding to the devices read the
+  same standard header registers over and over again, so those are shadowed
+  in memory that all modules linking this library share, until
+  ExitBootServices().
+
+  Only registers that the hardware does not change behind the firmware's back
+  are shadowed. Every write drops the shadowed copy of the dwords it touches,
+  so the next read gets the new value, or the BAR size mask, from the
+  hardware. Writing the bus numbers or the Bridge Control register of a bridge
+  can hide or reset whole buses, so it drops the entire shadow.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Uefi.h>
+
+#include <IndustryStandard/Pci22.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/PciConfigShadow.h>
+
+#include "PciShadow.h"
+
+//
+// The number of entries in the shadow, and how many of them a lookup probes
+// before giving up. 4096 dwords cover the header of 256 functions.
+//
+#define SHADOW_ENTRIES_SHIFT  12
+#define SHADOW_MAX_PROBES     16
+
+//
+// Only the standard header is shadowed.
+//
+#define SHADOW_HEADER_SIZE  0x40
+
+//
+// The bytes of each header dword that may be shadowed, one bit per byte.
+// Excluded are the Status register (0x06), which latches errors, BIST (0x0F)
+// and, in type 1 headers, the Secondary Status register (0x1E).
+//
+STATIC CONST UINT8  mShadowableBytes[SHADOW_HEADER_SIZE / sizeof (UINT32)] = {
+  0xF, 0x3, 0xF, 0x7, 0xF, 0xF, 0xF, 0x3,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF
+};
+
+STATIC OVMF_PCI_CONFIG_SHADOW  *mShadow;
+STATIC EFI_EVENT               mExitBootServicesEvent;
+
+/**
+  Find the shadow entry of a dword aligned PCI configuration register.
+
+  @param[in] Address  The address that encodes the PCI Bus, Device, Function
+                      and dword aligned Register.
+  @param[in] Insert   Whether to claim a free entry for the register if it has
+                      none yet.
+
+  @return The entry, or NULL if there is none and none could be claimed.
+**/
+STATIC
+OVMF_PCI_CONFIG_SHADOW_ENTRY *
+FindEntry (
+  IN UINTN    Address,
+  IN BOOLEAN  Insert
+  )
+{
+  UINT32                        Key;
+  UINT32                        Index;
+  UINT32                        Probe;
+  OVMF_PCI_CONFIG_SHADOW_ENTRY  *Entry;
+
+  Key   = (UINT32)Address | OVMF_PCI_CONFIG_SHADOW_IN_USE;
+  Index = ((UINT32)Address * 0x9E3779B1U) >> (32 - SHADOW_ENTRIES_SHIFT);
+
+  //
+  // Entries are never freed one by one, so the first free entry ends the
+  // probe sequence.
+  //
+  for (Probe = 0; Probe < SHADOW_MAX_PROBES; Probe++) {
+    Entry = &mShadow->Entries[(Index + Probe) & (mShadow->NumEntries - 1)];
+    if (Entry->Address == Key) {
+      return Entry;
+    }
+
+    if (Entry->Address == 0) {
+      if (!Insert) {
+        return NULL;
+      }
+
+      Entry->Address = Key;
+      Entry->Valid   = 0;
+      return Entry;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Check whether the shadow of a function says that it has a type 0 header,
+  that is, that it is not a bridge.
+
+  @param[in] Function  The address that encodes the PCI Bus, Device and
+                       Function.
+
+  @retval TRUE   The function is known to have a type 0 header.
+  @retval FALSE  The function has another header type, or its header type is
+                 not shadowed.
+**/
+STATIC
+BOOLEAN
+IsDeviceHeader (
+  IN UINTN  Function
+  )
+{
+  OVMF_PCI_CONFIG_SHADOW_ENTRY  *Entry;
+  UINT8                         HeaderType;
+
+  Entry = FindEntry (Function + PCI_HEADER_TYPE_OFFSET - 2, FALSE);
+  if ((Entry == NULL) || ((Entry->Valid & BIT2) == 0)) {
+    return FALSE;
+  }
+
+  HeaderType = (UINT8)(Entry->Value >> 16);
+  return (BOOLEAN)((HeaderType & HEADER_LAYOUT_CODE) == HEADER_TYPE_DEVICE);
+}
+
+/**
+  Stop using the shadow, which lives in boot services memory, at
+  ExitBootServices().
+
+  @param[in] Event    Event whose notification function is being invoked.
+  @param[in] Context  Unused.
+**/
+STATIC
+VOID
+EFIAPI
+PciShadowExitBootServices (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  //
+  // Once one module has stopped using the shadow, writes through it no longer
+  // invalidate it, so all other modules have to stop too.
+  //
+  if (mShadow->Enabled) {
+    mShadow->Enabled = FALSE;
+    DEBUG ((
+      DEBUG_INFO,
+      "%a: %Lu config space reads avoided, %Lu misses, %Lu flushes\n",
+      __FUNCTION__,
+      mShadow->Hits,
+      mShadow->Misses,
+      mShadow->Flushes
+      ));
+  }
+
+  mShadow = NULL;
+}
+
+/**
+  Locate the shadow shared by all modules, or create it if this is the first
+  module to use it. Failure is not fatal: configuration space is then accessed
+  directly.
+**/
+VOID
+PciShadowInitialize (
+  VOID
+  )
+{
+  EFI_STATUS              Status;
+  OVMF_PCI_CONFIG_SHADOW  *Shadow;
+  EFI_HANDLE              Handle;
+
+  Status = gBS->LocateProtocol (
+                  &gOvmfPciConfigShadowProtocolGuid,
+                  NULL,
+                  (VOID **)&Shadow
+                  );
+  if (EFI_ERROR (Status)) {
+    Shadow = AllocateZeroPool (sizeof *Shadow);
+    if (Shadow == NULL) {
+      return;
+    }
+
+    Shadow->NumEntries = 1U << SHADOW_ENTRIES_SHIFT;
+    Shadow->Entries    = AllocateZeroPool (
+                           Shadow->NumEntries * sizeof *Shadow->Entries
+                           );
+    if (Shadow->Entries == NULL) {
+      FreePool (Shadow);
+      return;
+    }
+
+    Shadow->Enabled = TRUE;
+    Handle          = NULL;
+    Status          = gBS->InstallMultipleProtocolInterfaces (
+                             &Handle,
+                             &gOvmfPciConfigShadowProtocolGuid,
+                             Shadow,
+                             NULL
+                             );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "%a: %r\n", __FUNCTION__, Status));
+      FreePool (Shadow->Entries);
+      FreePool (Shadow);
+      return;
+    }
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                  TPL_CALLBACK,
+                  PciShadowExitBootServices,
+                  NULL,
+                  &mExitBootServicesEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  mShadow = Shadow;
+}
+
+/**
+  Stop the ExitBootServices() notification when the module is unloaded.
+  The shadow itself stays installed for the other modules.
+
+  @retval RETURN_SUCCESS  Always.
+**/
+RETURN_STATUS
+EFIAPI
+PciShadowDestructor (
+  VOID
+  )
+{
+  if (mExitBootServicesEvent != NULL) {
+    gBS->CloseEvent (mExitBootServicesEvent);
+  }
+
+  return RETURN_SUCCESS;
+}
+
+/**
+  Read a PCI configuration register through the shadow.
+
+  @param[in] Address  The address that encodes the PCI Bus, Device, Function
+                      and Register.
+  @param[in] Size     The width of the register in bytes: 1, 2 or 4.
+  @param[out] Value   The value of the register, zero-extended.
+
+  @retval TRUE   Value has been read, from the shadow or, if it was not
+                 shadowed yet, from the hardware.
+  @retval FALSE  The register is not shadowed; the caller has to access the
+                 hardware.
+**/
+BOOLEAN
+PciShadowRead (
+  IN  UINTN   Address,
+  IN  UINTN   Size,
+  OUT UINT32  *Value
+  )
+{
+  UINTN                         Offset;
+  UINT8                         Shadowable;
+  UINT8                         Bytes;
+  OVMF_PCI_CONFIG_SHADOW_ENTRY  *Entry;
+
+  if ((mShadow == NULL) || !mShadow->Enabled) {
+    return FALSE;
+  }
+
+  Offset = Address & 0xFFF;
+  if ((Offset >= SHADOW_HEADER_SIZE) || ((Offset & (Size - 1)) != 0)) {
+    return FALSE;
+  }
+
+  Shadowable = mShadowableBytes[Offset / sizeof (UINT32)];
+  Bytes      = (UINT8)(((1U << Size) - 1) << (Offset & 3));
+  if ((Shadowable & Bytes) != Bytes) {
+    return FALSE;
+  }
+
+  Entry = FindEntry (Address & ~(UINTN)3, TRUE);
+  if (Entry == NULL) {
+    return FALSE;
+  }
+
+  if ((Entry->Valid & Bytes) == Bytes) {
+    mShadow->Hits++;
+  } else {
+    Entry->Value = PciConfigRead32 (Address & ~(UINTN)3);
+    Entry->Valid = Shadowable;
+    mShadow->Misses++;
+  }
+
+  *Value = Entry->Value >> ((Offset & 3) * 8);
+  return TRUE;
+}
+
+/**
+  Drop the shadowed copy of the PCI configuration registers that a write is
+  about to change.
+
+  @param[in] Address  The address that encodes the PCI Bus, Device, Function
+                      and Register of the first byte written.
+  @param[in] Size     The number of bytes written.
+**/
+VOID
+PciShadowInvalidate (
+  IN UINTN  Address,
+  IN UINTN  Size
+  )
+{
+  UINTN                         Function;
+  UINTN                         Offset;
+  UINTN                         End;
+  OVMF_PCI_CONFIG_SHADOW_ENTRY  *Entry;
+
+  if ((mShadow == NULL) || !mShadow->Enabled) {
+    return;
+  }
+
+  Function = Address & ~(UINTN)0xFFF;
+  Offset   = Address & 0xFFF;
+  End      = MIN (Offset + Size, SHADOW_HEADER_SIZE);
+  if (Offset >= End) {
+    return;
+  }
+
+  //
+  // In a type 1 header, 0x18 holds the bus numbers, and 0x3E the Bridge
+  // Control register.
+  //
+  if ((((Offset < 0x1C) && (End > 0x18)) || (End > 0x3C)) &&
+      !IsDeviceHeader (Function))
+  {
+    ZeroMem (
+      mShadow->Entries,
+      mShadow->NumEntries * sizeof *mShadow->Entries
+      );
+    mShadow->Flushes++;
+    return;
+  }
+
+  for (Offset &= ~(UINTN)3; Offset < End; Offset += sizeof (UINT32)) {
+    Entry = FindEntry (Function + Offset, FALSE);
+    if (Entry != NULL) {
+      Entry->Valid = 0;
+    }
+  }
+}
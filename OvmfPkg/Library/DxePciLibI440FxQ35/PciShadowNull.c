@@ -0,0 +1,59 @@
+/** @file
+  Stub PCI configuration space shadow, for module types that must not rely on
+  boot services.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "PciShadow.h"
+
+/**
+  Locate the shadow shared by all modules, or create it if this is the first
+  module to use it. Failure is not fatal: configuration space is then accessed
+  directly.
+**/
+VOID
+PciShadowInitialize (
+  VOID
+  )
+{
+}
+
+/**
+  Read a PCI configuration register through the shadow.
+
+  @param[in] Address  The address that encodes the PCI Bus, Device, Function
+                      and Register.
+  @param[in] Size     The width of the register in bytes: 1, 2 or 4.
+  @param[out] Value   The value of the register, zero-extended.
+
+  @retval FALSE  The register is not shadowed; the caller has to access the
+                 hardware.
+**/
+BOOLEAN
+PciShadowRead (
+  IN  UINTN   Address,
+  IN  UINTN   Size,
+  OUT UINT32  *Value
+  )
+{
+  return FALSE;
+}
+
+/**
+  Drop the shadowed copy of the PCI configuration registers that a write is
+  about to change.
+
+  @param[in] Address  The address that encodes the PCI Bus, Device, Function
+                      and Register of the first byte written.
+  @param[in] Size     The number of bytes written.
+**/
+VOID
+PciShadowInvalidate (
+  IN UINTN  Address,
+  IN UINTN  Size
+  )
+{
+}
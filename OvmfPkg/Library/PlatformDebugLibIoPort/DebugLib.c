@@ -17,6 +17,7 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugPrintErrorLevelLib.h>
 #include "DebugLibDetect.h"
+#include "DebugLogRing.h"
 
 //
 // Define the maximum debug and assert message length that this library supports
@@ -94,9 +95,10 @@ DebugPrintMarker (
 
   //
   // Check if the global mask disables this message or the device is inactive
+  // and there is no debug log ring to keep it in
   //
   if (((ErrorLevel & GetDebugPrintErrorLevel ()) == 0) ||
-      !PlatformDebugLibIoPortFound ())
+      (!PlatformDebugLibIoPortFound () && !DebugLogRingFound ()))
   {
     return;
   }
@@ -111,9 +113,14 @@ DebugPrintMarker (
   }
 
   //
-  // Send the print string to the debug I/O port
+  // Log the print string, sending errors to the debug I/O port right away;
+  // without a debug log ring, send the print string to the debug I/O port
   //
-  IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, Buffer);
+  if (!DebugLogRingWrite (Buffer, Length, (ErrorLevel & DEBUG_ERROR) != 0) &&
+      PlatformDebugLibIoPortFound ())
+  {
+    IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, Buffer);
+  }
 }
 
 /**
@@ -215,9 +222,12 @@ DebugAssert (
              );
 
   //
-  // Send the print string to the debug I/O port, if present
+  // Send the print string, and anything logged before it, to the debug I/O
+  // port, if present
   //
-  if (PlatformDebugLibIoPortFound ()) {
+  if (!DebugLogRingWrite (Buffer, Length, TRUE) &&
+      PlatformDebugLibIoPortFound ())
+  {
     IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, Buffer);
   }
 
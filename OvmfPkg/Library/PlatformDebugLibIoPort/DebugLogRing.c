@@ -0,0 +1,169 @@
+/** @file
+  Debug log ring for the hypervisor debug port.
+
+  Every OUT to the debug I/O port is a hypervisor exit, and with SEV-ES, SEV-SNP
+  or TDX a #VC or #VE on top of that. The messages are collected in a ring
+  buffer in memory, set up by PlatformPei, and written out a couple of KB at a
+  time instead. Nothing here is cached in global variables: the ring is looked
+  up at its fixed address every time, so this works the same in PEI and DXE.
+  SEC never looks at it; under TDX the page is not accepted yet when SEC logs
+  its first messages.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Base.h>
+#include <Guid/DebugLogRing.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/IoLib.h>
+#include <Library/PcdLib.h>
+#include <Library/SynchronizationLib.h>
+#include "DebugLibDetect.h"
+#include "DebugLogRing.h"
+
+//
+// The number of unwritten bytes after which the ring is written to the debug
+// I/O port. The SEV-ES #VC handler passes string I/O through the GHCB shared
+// buffer, so this is about one exit per write.
+//
+#define DEBUG_LOG_FLUSH_THRESHOLD  SIZE_2KB
+
+/**
+  Return the debug log ring, if it has been set up.
+
+  @return  The debug log ring, or NULL.
+
+**/
+STATIC
+OVMF_DEBUG_LOG_RING *
+GetDebugLogRing (
+  VOID
+  )
+{
+  OVMF_DEBUG_LOG_RING  *Ring;
+
+  if (FixedPcdGet32 (PcdOvmfDebugLogSize) == 0) {
+    return NULL;
+  }
+
+  Ring = (OVMF_DEBUG_LOG_RING *)(UINTN)FixedPcdGet32 (PcdOvmfDebugLogBase);
+  if (Ring->Signature != OVMF_DEBUG_LOG_RING_SIGNATURE) {
+    return NULL;
+  }
+
+  return Ring;
+}
+
+/**
+  Write the bytes logged since the last flush to the debug I/O port.
+
+  @param[in, out] Ring  The debug log ring, locked by the caller.
+
+**/
+STATIC
+VOID
+FlushDebugLogRing (
+  IN OUT OVMF_DEBUG_LOG_RING  *Ring
+  )
+{
+  UINT8    *Data;
+  UINTN    Offset;
+  UINTN    Chunk;
+  BOOLEAN  PortFound;
+
+  Data      = (UINT8 *)(UINTN)Ring->Data;
+  PortFound = PlatformDebugLibIoPortFound ();
+
+  //
+  // Anything older than the ring has been overwritten already.
+  //
+  if (Ring->Head - Ring->Flushed > Ring->DataSize) {
+    Ring->Flushed = Ring->Head - Ring->DataSize;
+  }
+
+  while (Ring->Flushed != Ring->Head) {
+    Offset = (UINTN)(Ring->Flushed & (Ring->DataSize - 1));
+    Chunk  = (UINTN)MIN (Ring->Head - Ring->Flushed, Ring->DataSize - Offset);
+    if (PortFound) {
+      IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Chunk, Data + Offset);
+    }
+
+    Ring->Flushed += Chunk;
+  }
+}
+
+/**
+  Return whether the debug log ring has been set up.
+
+  @retval TRUE   if the debug log ring is present.
+  @retval FALSE  otherwise
+
+**/
+BOOLEAN
+EFIAPI
+DebugLogRingFound (
+  VOID
+  )
+{
+  return GetDebugLogRing () != NULL;
+}
+
+/**
+  Append a message to the debug log ring, and write the messages logged so far
+  to the debug I/O port if enough of them have collected, or if Flush is set.
+
+  @param[in] Buffer  The message.
+  @param[in] Length  The length of the message, at most
+                     MAX_DEBUG_MESSAGE_LENGTH bytes.
+  @param[in] Flush   Write the message to the debug I/O port now.
+
+  @retval TRUE   The message was logged.
+  @retval FALSE  The message was not logged, the caller should write it to
+                 the debug I/O port itself.
+
+**/
+BOOLEAN
+EFIAPI
+DebugLogRingWrite (
+  IN CONST CHAR8  *Buffer,
+  IN UINTN        Length,
+  IN BOOLEAN      Flush
+  )
+{
+  OVMF_DEBUG_LOG_RING  *Ring;
+  UINT8                *Data;
+  UINTN                Offset;
+  UINTN                Chunk;
+
+  Ring = GetDebugLogRing ();
+  if ((Ring == NULL) || (Length > Ring->DataSize)) {
+    return FALSE;
+  }
+
+  //
+  // Another processor, or the code this one interrupted, is updating the
+  // ring; don't wait for it.
+  //
+  if (InterlockedCompareExchange32 (&Ring->Lock, 0, 1) != 0) {
+    return FALSE;
+  }
+
+  Data   = (UINT8 *)(UINTN)Ring->Data;
+  Offset = (UINTN)(Ring->Head & (Ring->DataSize - 1));
+  Chunk  = MIN (Length, Ring->DataSize - Offset);
+  CopyMem (Data + Offset, Buffer, Chunk);
+  CopyMem (Data, Buffer + Chunk, Length - Chunk);
+  Ring->Head += Length;
+
+  if (Flush ||
+      ((Ring->Flags & OVMF_DEBUG_LOG_RING_WRITE_THROUGH) != 0) ||
+      (Ring->Head - Ring->Flushed >= DEBUG_LOG_FLUSH_THRESHOLD))
+  {
+    FlushDebugLogRing (Ring);
+  }
+
+  InterlockedCompareExchange32 (&Ring->Lock, 1, 0);
+  return TRUE;
+}
@@ -0,0 +1,50 @@
+/** @file
+  Memory ring buffer for the debug messages of the hypervisor debug port
+  DebugLib instances.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __DEBUG_LOG_RING_H__
+#define __DEBUG_LOG_RING_H__
+
+#include <Base.h>
+
+/**
+  Return whether the debug log ring has been set up.
+
+  @retval TRUE   if the debug log ring is present.
+  @retval FALSE  otherwise
+
+**/
+BOOLEAN
+EFIAPI
+DebugLogRingFound (
+  VOID
+  );
+
+/**
+  Append a message to the debug log ring, and write the messages logged so far
+  to the debug I/O port if enough of them have collected, or if Flush is set.
+
+  @param[in] Buffer  The message.
+  @param[in] Length  The length of the message, at most
+                     MAX_DEBUG_MESSAGE_LENGTH bytes.
+  @param[in] Flush   Write the message to the debug I/O port now.
+
+  @retval TRUE   The message was logged.
+  @retval FALSE  The message was not logged, the caller should write it to
+                 the debug I/O port itself.
+
+**/
+BOOLEAN
+EFIAPI
+DebugLogRingWrite (
+  IN CONST CHAR8  *Buffer,
+  IN UINTN        Length,
+  IN BOOLEAN      Flush
+  );
+
+#endif
@@ -0,0 +1,49 @@
+/** @file
+  Debug log ring for the hypervisor debug port.
+  Instance for the modules which must not use it: SEC, which logs before the
+  ring's page is accepted under TDX, and the modules which run after
+  ExitBootServices(), or in SMM, where the ring is out of reach.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "DebugLogRing.h"
+
+/**
+  Return whether the debug log ring has been set up.
+
+  @retval FALSE  The debug log ring is never used by this instance.
+
+**/
+BOOLEAN
+EFIAPI
+DebugLogRingFound (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+/**
+  Append a message to the debug log ring.
+
+  @param[in] Buffer  The message.
+  @param[in] Length  The length of the message.
+  @param[in] Flush   Write the message to the debug I/O port now.
+
+  @retval FALSE  The message was not logged, the caller should write it to
+                 the debug I/O port itself.
+
+**/
+BOOLEAN
+EFIAPI
+DebugLogRingWrite (
+  IN CONST CHAR8  *Buffer,
+  IN UINTN        Length,
+  IN BOOLEAN      Flush
+  )
+{
+  return FALSE;
+}
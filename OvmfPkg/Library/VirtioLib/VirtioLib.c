@@ -19,7 +19,8 @@
 
 /**
 
-  Configure a virtio ring.
+  Configure a virtio ring, using ring features that the driver negotiated with
+  the device.
 
   This function sets up internal storage (the guest-host communication area)
   and lays out several "navigation" (ie. no-ownership) pointers to parts of
@@ -29,11 +30,23 @@
   - 1.1 Virtqueues,
   - 2.3 Virtqueue Configuration.
 
+  Relevant sections from the virtio-1.1 spec:
+  - 2.6.5.3 Indirect Descriptors,
+  - 2.6.7 Used Buffer Notification Suppression,
+  - 2.7 Packed Virtqueues.
+
   @param[in]  VirtIo            The virtio device which will use the ring.
 
-  @param[in]                    The number of descriptors to allocate for the
+  @param[in]  QueueSize         The number of descriptors to allocate for the
                                 virtio ring, as requested by the host.
 
+  @param[in]  Features          The features negotiated with the device. Of
+                                these, VIRTIO_F_RING_INDIRECT_DESC,
+                                VIRTIO_F_RING_EVENT_IDX and
+                                VIRTIO_F_RING_PACKED are used on the ring by
+                                VirtioPrepare(), VirtioAppendDesc() and
+                                VirtioFlush(); the rest are ignored.
+
   @param[out] Ring              The virtio ring to set up.
 
   @return                       Status codes propagated from
@@ -46,32 +59,56 @@
 **/
 EFI_STATUS
 EFIAPI
-VirtioRingInit (
+VirtioRingInitWithFeatures (
   IN  VIRTIO_DEVICE_PROTOCOL  *VirtIo,
   IN  UINT16                  QueueSize,
+  IN  UINT64                  Features,
   OUT VRING                   *Ring
   )
 {
   EFI_STATUS      Status;
   UINTN           RingSize;
+  UINTN           IndirectOffset;
   volatile UINT8  *RingPagesPtr;
 
-  RingSize = ALIGN_VALUE (
-               sizeof *Ring->Desc            * QueueSize +
-               sizeof *Ring->Avail.Flags                 +
-               sizeof *Ring->Avail.Idx                   +
-               sizeof *Ring->Avail.Ring      * QueueSize +
-               sizeof *Ring->Avail.UsedEvent,
-               EFI_PAGE_SIZE
-               );
+  ZeroMem (Ring, sizeof *Ring);
+  Features &= VIRTIO_F_RING_INDIRECT_DESC | VIRTIO_F_RING_EVENT_IDX |
+              VIRTIO_F_RING_PACKED;
+
+  if ((Features & VIRTIO_F_RING_PACKED) != 0) {
+    RingSize = ALIGN_VALUE (
+                 sizeof (VRING_PACKED_DESC)  * QueueSize +
+                 sizeof (VRING_PACKED_EVENT) * 2,
+                 EFI_PAGE_SIZE
+                 );
+  } else {
+    RingSize = ALIGN_VALUE (
+                 sizeof *Ring->Desc            * QueueSize +
+                 sizeof *Ring->Avail.Flags                 +
+                 sizeof *Ring->Avail.Idx                   +
+                 sizeof *Ring->Avail.Ring      * QueueSize +
+                 sizeof *Ring->Avail.UsedEvent,
+                 EFI_PAGE_SIZE
+                 );
+
+    RingSize += ALIGN_VALUE (
+                  sizeof *Ring->Used.Flags                  +
+                  sizeof *Ring->Used.Idx                    +
+                  sizeof *Ring->Used.UsedElem   * QueueSize +
+                  sizeof *Ring->Used.AvailEvent,
+                  EFI_PAGE_SIZE
+                  );
+  }
 
-  RingSize += ALIGN_VALUE (
-                sizeof *Ring->Used.Flags                  +
-                sizeof *Ring->Used.Idx                    +
-                sizeof *Ring->Used.UsedElem   * QueueSize +
-                sizeof *Ring->Used.AvailEvent,
-                EFI_PAGE_SIZE
-                );
+  //
+  // The indirect descriptor table is shared with the device just like the
+  // ring, so it lives in the same pages. Split and packed descriptors have the
+  // same size.
+  //
+  IndirectOffset = RingSize;
+  if ((Features & VIRTIO_F_RING_INDIRECT_DESC) != 0) {
+    RingSize += ALIGN_VALUE (sizeof (VRING_DESC) * QueueSize, EFI_PAGE_SIZE);
+  }
 
   //
   // Allocate a shared ring buffer
@@ -89,43 +126,99 @@ VirtioRingInit (
   SetMem (Ring->Base, RingSize, 0x00);
   RingPagesPtr = Ring->Base;
 
-  Ring->Desc    = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr += sizeof *Ring->Desc * QueueSize;
+  if ((Features & VIRTIO_F_RING_PACKED) != 0) {
+    Ring->Desc    = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr += sizeof (VRING_PACKED_DESC) * QueueSize;
+
+    Ring->Avail.Flags = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr     += sizeof (VRING_PACKED_EVENT);
+
+    Ring->Used.Flags = (volatile VOID *)RingPagesPtr;
 
-  Ring->Avail.Flags = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr     += sizeof *Ring->Avail.Flags;
+    //
+    // virtio-1.1, 2.7.1 Driver and Device Ring Wrap Counters
+    //
+    Ring->PackedAvailIdx  = 0;
+    Ring->PackedAvailWrap = TRUE;
+  } else {
+    Ring->Desc    = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr += sizeof *Ring->Desc * QueueSize;
 
-  Ring->Avail.Idx = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr   += sizeof *Ring->Avail.Idx;
+    Ring->Avail.Flags = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr     += sizeof *Ring->Avail.Flags;
 
-  Ring->Avail.Ring = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr    += sizeof *Ring->Avail.Ring * QueueSize;
+    Ring->Avail.Idx = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr   += sizeof *Ring->Avail.Idx;
 
-  Ring->Avail.UsedEvent = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr         += sizeof *Ring->Avail.UsedEvent;
+    Ring->Avail.Ring = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr    += sizeof *Ring->Avail.Ring * QueueSize;
 
-  RingPagesPtr = (volatile UINT8 *)Ring->Base +
-                 ALIGN_VALUE (
-                   RingPagesPtr - (volatile UINT8 *)Ring->Base,
-                   EFI_PAGE_SIZE
-                   );
+    Ring->Avail.UsedEvent = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr         += sizeof *Ring->Avail.UsedEvent;
 
-  Ring->Used.Flags = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr    += sizeof *Ring->Used.Flags;
+    RingPagesPtr = (volatile UINT8 *)Ring->Base +
+                   ALIGN_VALUE (
+                     RingPagesPtr - (volatile UINT8 *)Ring->Base,
+                     EFI_PAGE_SIZE
+                     );
+
+    Ring->Used.Flags = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr    += sizeof *Ring->Used.Flags;
+
+    Ring->Used.Idx = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr  += sizeof *Ring->Used.Idx;
 
-  Ring->Used.Idx = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr  += sizeof *Ring->Used.Idx;
+    Ring->Used.UsedElem = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr       += sizeof *Ring->Used.UsedElem * QueueSize;
 
-  Ring->Used.UsedElem = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr       += sizeof *Ring->Used.UsedElem * QueueSize;
+    Ring->Used.AvailEvent = (volatile VOID *)RingPagesPtr;
+    RingPagesPtr         += sizeof *Ring->Used.AvailEvent;
+  }
 
-  Ring->Used.AvailEvent = (volatile VOID *)RingPagesPtr;
-  RingPagesPtr         += sizeof *Ring->Used.AvailEvent;
+  if ((Features & VIRTIO_F_RING_INDIRECT_DESC) != 0) {
+    Ring->Indirect = (volatile UINT8 *)Ring->Base + IndirectOffset;
+  }
 
+  Ring->Features  = Features;
   Ring->QueueSize = QueueSize;
   return EFI_SUCCESS;
 }
 
+/**
+
+  Configure a virtio ring.
+
+  This function sets up internal storage (the guest-host communication area)
+  and lays out several "navigation" (ie. no-ownership) pointers to parts of
+  that storage. The ring uses none of the optional ring features; see
+  VirtioRingInitWithFeatures().
+
+  @param[in]  VirtIo            The virtio device which will use the ring.
+
+  @param[in]                    The number of descriptors to allocate for the
+                                virtio ring, as requested by the host.
+
+  @param[out] Ring              The virtio ring to set up.
+
+  @return                       Status codes propagated from
+                                VirtIo->AllocateSharedPages().
+
+  @retval EFI_SUCCESS           Allocation and setup successful. Ring->Base
+                                (and nothing else) is responsible for
+                                deallocation.
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioRingInit (
+  IN  VIRTIO_DEVICE_PROTOCOL  *VirtIo,
+  IN  UINT16                  QueueSize,
+  OUT VRING                   *Ring
+  )
+{
+  return VirtioRingInitWithFeatures (VirtIo, QueueSize, 0, Ring);
+}
+
 /**
 
   Tear down the internal resources of a configured virtio ring.
@@ -169,6 +262,23 @@ VirtioPrepare (
   OUT    DESC_INDICES  *Indices
   )
 {
+  if ((Ring->Features & VIRTIO_F_RING_PACKED) != 0) {
+    volatile VRING_PACKED_EVENT  *DriverEvent;
+
+    //
+    // virtio-1.1, 2.7.10 Driver and Device Event Suppression
+    //
+    DriverEvent        = (volatile VRING_PACKED_EVENT *)Ring->Avail.Flags;
+    DriverEvent->Flags = VRING_PACKED_EVENT_F_DISABLE;
+
+    //
+    // Chains are built wherever the previous one ended on the packed ring.
+    //
+    Indices->HeadDescIdx = Ring->PackedAvailIdx;
+    Indices->NextDescIdx = Indices->HeadDescIdx;
+    return;
+  }
+
   //
   // Prepare for virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device.
   // We're going to poll the answer, the host should not send an interrupt.
@@ -233,7 +343,70 @@ VirtioAppendDesc (
   IN OUT DESC_INDICES  *Indices
   )
 {
-  volatile VRING_DESC  *Desc;
+  volatile VRING_DESC         *Desc;
+  volatile VRING_PACKED_DESC  *PackedDesc;
+  UINT16                      TableIdx;
+
+  if (Ring->Indirect != NULL) {
+    //
+    // virtio-1.1, 2.6.5.3 and 2.7.7 Indirect Descriptors: the chain is built
+    // in the indirect table, from its first entry on; VirtioFlush() puts the
+    // table on the ring.
+    //
+    TableIdx = (UINT16)(Indices->NextDescIdx++ - Indices->HeadDescIdx);
+    if ((Ring->Features & VIRTIO_F_RING_PACKED) != 0) {
+      //
+      // Packed indirect descriptors are used in order; only the write flag
+      // counts.
+      //
+      PackedDesc = (volatile VRING_PACKED_DESC *)Ring->Indirect + TableIdx;
+
+      PackedDesc->Addr  = BufferDeviceAddress;
+      PackedDesc->Len   = BufferSize;
+      PackedDesc->Id    = 0;
+      PackedDesc->Flags = Flags & VRING_DESC_F_WRITE;
+    } else {
+      Desc        = (volatile VRING_DESC *)Ring->Indirect + TableIdx;
+      Desc->Addr  = BufferDeviceAddress;
+      Desc->Len   = BufferSize;
+      Desc->Flags = Flags;
+      Desc->Next  = (UINT16)(TableIdx + 1);
+    }
+
+    return;
+  }
+
+  if ((Ring->Features & VIRTIO_F_RING_PACKED) != 0) {
+    //
+    // virtio-1.1, 2.7.13.2 Placing Available Buffers Into The Descriptor Ring
+    //
+    // Every descriptor of the chain carries the head's index as buffer ID. The
+    // head's flags make the whole chain available, so VirtioFlush() writes
+    // them last.
+    //
+    Flags &= VRING_DESC_F_NEXT | VRING_DESC_F_WRITE;
+    Flags |= Ring->PackedAvailWrap ? VRING_PACKED_DESC_F_AVAIL :
+             VRING_PACKED_DESC_F_USED;
+
+    PackedDesc       = (volatile VRING_PACKED_DESC *)Ring->Desc +
+                       Ring->PackedAvailIdx;
+    PackedDesc->Addr = BufferDeviceAddress;
+    PackedDesc->Len  = BufferSize;
+    PackedDesc->Id   = Indices->HeadDescIdx;
+    if (Indices->NextDescIdx == Indices->HeadDescIdx) {
+      Ring->PackedHeadFlags = Flags;
+    } else {
+      PackedDesc->Flags = Flags;
+    }
+
+    ++Indices->NextDescIdx;
+    if (++Ring->PackedAvailIdx == Ring->QueueSize) {
+      Ring->PackedAvailIdx  = 0;
+      Ring->PackedAvailWrap = !Ring->PackedAvailWrap;
+    }
+
+    return;
+  }
 
   Desc        = &Ring->Desc[Indices->NextDescIdx++ % Ring->QueueSize];
   Desc->Addr  = BufferDeviceAddress;
@@ -242,6 +415,217 @@ VirtioAppendDesc (
   Desc->Next  = Indices->NextDescIdx % Ring->QueueSize;
 }
 
+/**
+
+  Check whether the other side asked to be notified when its event index is
+  passed, as the ring index moves from OldIdx to NewIdx.
+
+  This is vring_need_event() from virtio-1.1, 2.6.7.1 Driver Requirements:
+  Used Buffer Notification Suppression.
+
+  @param[in] EventIdx  The event index published by the other side.
+
+  @param[in] NewIdx    The ring index after the update.
+
+  @param[in] OldIdx    The ring index before the update.
+
+  @retval TRUE   A notification is needed.
+
+  @retval FALSE  No notification is needed.
+
+**/
+STATIC
+BOOLEAN
+VirtioNeedEvent (
+  IN UINT16  EventIdx,
+  IN UINT16  NewIdx,
+  IN UINT16  OldIdx
+  )
+{
+  return (BOOLEAN)((UINT16)(NewIdx - EventIdx - 1) < (UINT16)(NewIdx - OldIdx));
+}
+
+/**
+
+  Check whether the host has used a descriptor chain.
+
+  @param[in] Ring      The virtio ring with the submitted descriptor chain.
+
+  @param[in] UsedIdx   On a split ring, the value of Ring->Used.Idx that marks
+                       the chain as used. On a packed ring, the index of the
+                       chain's head descriptor.
+
+  @param[in] UsedWrap  On a packed ring, the wrap counter that the chain's head
+                       descriptor was made available with. Ignored on a split
+                       ring.
+
+  @retval TRUE   The chain has been used.
+
+  @retval FALSE  The chain is still pending.
+
+**/
+STATIC
+BOOLEAN
+VirtioIsUsed (
+  IN VRING    *Ring,
+  IN UINT16   UsedIdx,
+  IN BOOLEAN  UsedWrap
+  )
+{
+  volatile VRING_PACKED_DESC  *PackedDesc;
+  UINT16                      Flags;
+
+  if ((Ring->Features & VIRTIO_F_RING_PACKED) == 0) {
+    return (BOOLEAN)(*Ring->Used.Idx == UsedIdx);
+  }
+
+  //
+  // A packed descriptor is used once both its AVAIL and USED flags match the
+  // wrap counter it was made available with.
+  //
+  PackedDesc = (volatile VRING_PACKED_DESC *)Ring->Desc + UsedIdx;
+  Flags      = PackedDesc->Flags;
+  return (BOOLEAN)(((Flags & VRING_PACKED_DESC_F_AVAIL) != 0) == UsedWrap &&
+                   ((Flags & VRING_PACKED_DESC_F_USED) != 0) == UsedWrap);
+}
+
+/**
+
+  Wait until the host has used a descriptor chain.
+
+  See VirtioIsUsed() for the parameters.
+
+**/
+STATIC
+VOID
+VirtioWaitUsed (
+  IN VRING    *Ring,
+  IN UINT16   UsedIdx,
+  IN BOOLEAN  UsedWrap
+  )
+{
+  UINTN  PollPeriodUsecs;
+
+  //
+  // Keep slowing down until we reach a poll period of slightly above 1 ms.
+  //
+  PollPeriodUsecs = 1;
+  MemoryFence ();
+  while (!VirtioIsUsed (Ring, UsedIdx, UsedWrap)) {
+    gBS->Stall (PollPeriodUsecs); // calls AcpiTimerLib::MicroSecondDelay
+
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+
+    MemoryFence ();
+  }
+
+  MemoryFence ();
+}
+
+/**
+
+  Notify the host about the descriptor chain just built on a packed ring, and
+  wait until the host processes it.
+
+  See VirtioFlush() for the parameters and return values.
+
+**/
+STATIC
+EFI_STATUS
+VirtioFlushPacked (
+  IN     VIRTIO_DEVICE_PROTOCOL  *VirtIo,
+  IN     UINT16                  VirtQueueId,
+  IN OUT VRING                   *Ring,
+  IN     DESC_INDICES            *Indices,
+  OUT    UINT32                  *UsedLen    OPTIONAL
+  )
+{
+  volatile VRING_PACKED_DESC   *Head;
+  volatile VRING_PACKED_EVENT  *DeviceEvent;
+  UINT16                       HeadFlags;
+  UINT16                       NumDesc;
+  UINT16                       OldAvailIdx;
+  UINT16                       EventIdx;
+  BOOLEAN                      Notify;
+  EFI_STATUS                   Status;
+
+  Head = (volatile VRING_PACKED_DESC *)Ring->Desc + Indices->HeadDescIdx;
+
+  if (Ring->Indirect != NULL) {
+    //
+    // The whole chain takes the one descriptor that points to the table.
+    //
+    NumDesc    = (UINT16)(Indices->NextDescIdx - Indices->HeadDescIdx);
+    Head->Addr = Ring->IndirectDeviceAddress;
+    Head->Len  = (UINT32)(NumDesc * sizeof (VRING_PACKED_DESC));
+    Head->Id   = Indices->HeadDescIdx;
+    HeadFlags  = (UINT16)(VRING_DESC_F_INDIRECT |
+                          (Ring->PackedAvailWrap ? VRING_PACKED_DESC_F_AVAIL :
+                           VRING_PACKED_DESC_F_USED));
+
+    NumDesc = 1;
+    if (++Ring->PackedAvailIdx == Ring->QueueSize) {
+      Ring->PackedAvailIdx  = 0;
+      Ring->PackedAvailWrap = !Ring->PackedAvailWrap;
+    }
+  } else {
+    NumDesc   = (UINT16)(Indices->NextDescIdx - Indices->HeadDescIdx);
+    HeadFlags = Ring->PackedHeadFlags;
+  }
+
+  //
+  // virtio-1.1, 2.7.13.3 Updating flags: the head descriptor's flags go last.
+  //
+  MemoryFence ();
+  Head->Flags = HeadFlags;
+
+  //
+  // virtio-1.1, 2.7.13.4 Notifying the Device, where the device may have asked
+  // for no notifications, or for one only once a given descriptor is made
+  // available (which implies VIRTIO_F_RING_EVENT_IDX).
+  //
+  MemoryFence ();
+  DeviceEvent = (volatile VRING_PACKED_EVENT *)Ring->Used.Flags;
+  if (DeviceEvent->Flags == VRING_PACKED_EVENT_F_DESC) {
+    OldAvailIdx = (UINT16)(Ring->PackedAvailIdx - NumDesc);
+    EventIdx    = (UINT16)(DeviceEvent->Desc & ~BIT15);
+    if (((DeviceEvent->Desc & BIT15) != 0) != Ring->PackedAvailWrap) {
+      EventIdx = (UINT16)(EventIdx - Ring->QueueSize);
+    }
+
+    Notify = VirtioNeedEvent (EventIdx, Ring->PackedAvailIdx, OldAvailIdx);
+  } else {
+    Notify = (BOOLEAN)(DeviceEvent->Flags != VRING_PACKED_EVENT_F_DISABLE);
+  }
+
+  if (Notify) {
+    Status = VirtIo->SetQueueNotify (VirtIo, VirtQueueId);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  //
+  // virtio-1.1, 2.7.14 Receiving Used Buffers From the Device. Due to our
+  // lock-step progress, the device writes the used descriptor over our head
+  // descriptor.
+  //
+  VirtioWaitUsed (
+    Ring,
+    Indices->HeadDescIdx,
+    (BOOLEAN)((HeadFlags & VRING_PACKED_DESC_F_AVAIL) != 0)
+    );
+
+  if (UsedLen != NULL) {
+    ASSERT (Head->Id == Indices->HeadDescIdx);
+    *UsedLen = Head->Len;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
 
   Notify the host about the descriptor chain just built, and wait until the
@@ -282,7 +666,26 @@ VirtioFlush (
   UINT16      NextAvailIdx;
   UINT16      LastUsedIdx;
   EFI_STATUS  Status;
-  UINTN       PollPeriodUsecs;
+  BOOLEAN     Notify;
+
+  if ((Ring->Features & VIRTIO_F_RING_PACKED) != 0) {
+    return VirtioFlushPacked (VirtIo, VirtQueueId, Ring, Indices, UsedLen);
+  }
+
+  if (Ring->Indirect != NULL) {
+    volatile VRING_DESC  *Desc;
+    UINT16               NumDesc;
+
+    //
+    // The whole chain takes the one descriptor that points to the table.
+    //
+    NumDesc     = (UINT16)(Indices->NextDescIdx - Indices->HeadDescIdx);
+    Desc        = &Ring->Desc[Indices->HeadDescIdx % Ring->QueueSize];
+    Desc->Addr  = Ring->IndirectDeviceAddress;
+    Desc->Len   = (UINT32)(NumDesc * sizeof (VRING_DESC));
+    Desc->Flags = VRING_DESC_F_INDIRECT;
+    Desc->Next  = 0;
+  }
 
   //
   // virtio-0.9.5, 2.4.1.2 Updating the Available Ring
@@ -300,6 +703,14 @@ VirtioFlush (
   Ring->Avail.Ring[NextAvailIdx++ % Ring->QueueSize] =
     Indices->HeadDescIdx % Ring->QueueSize;
 
+  //
+  // With VIRTIO_F_RING_EVENT_IDX, the host interrupts us only once the used
+  // index passes UsedEvent. We're going to poll, so keep it just behind.
+  //
+  if ((Ring->Features & VIRTIO_F_RING_EVENT_IDX) != 0) {
+    *Ring->Avail.UsedEvent = (UINT16)(LastUsedIdx - 1);
+  }
+
   //
   // virtio-0.9.5, 2.4.1.3 Updating the Index Field
   //
@@ -308,12 +719,24 @@ VirtioFlush (
 
   //
   // virtio-0.9.5, 2.4.1.4 Notifying the Device -- gratuitous notifications are
-  // OK.
+  // OK. With VIRTIO_F_RING_EVENT_IDX, skip those the host didn't ask for.
   //
   MemoryFence ();
-  Status = VirtIo->SetQueueNotify (VirtIo, VirtQueueId);
-  if (EFI_ERROR (Status)) {
-    return Status;
+  if ((Ring->Features & VIRTIO_F_RING_EVENT_IDX) != 0) {
+    Notify = VirtioNeedEvent (
+               *Ring->Used.AvailEvent,
+               NextAvailIdx,
+               LastUsedIdx
+               );
+  } else {
+    Notify = TRUE;
+  }
+
+  if (Notify) {
+    Status = VirtIo->SetQueueNotify (VirtIo, VirtQueueId);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
   }
 
   //
@@ -322,21 +745,7 @@ VirtioFlush (
   // condition we use for polling is greatly simplified and relies on the
   // synchronous, lock-step progress.
   //
-  // Keep slowing down until we reach a poll period of slightly above 1 ms.
-  //
-  PollPeriodUsecs = 1;
-  MemoryFence ();
-  while (*Ring->Used.Idx != NextAvailIdx) {
-    gBS->Stall (PollPeriodUsecs); // calls AcpiTimerLib::MicroSecondDelay
-
-    if (PollPeriodUsecs < 1024) {
-      PollPeriodUsecs *= 2;
-    }
-
-    MemoryFence ();
-  }
-
-  MemoryFence ();
+  VirtioWaitUsed (Ring, NextAvailIdx, FALSE);
 
   if (UsedLen != NULL) {
     volatile CONST VRING_USED_ELEM  *UsedElem;
@@ -514,7 +923,9 @@ Failed:
 
   @param[in]      VirtIo          The virtio device instance.
 
-  @param[in]      Ring            The virtio ring to map.
+  @param[in,out]  Ring            The virtio ring to map. If it uses indirect
+                                  descriptors, the device address of the
+                                  table is recorded in it.
 
   @param[out]     RingBaseShift   A resulting translation offset, to be
                                   passed to VirtIo->SetQueueAddress().
@@ -527,10 +938,10 @@ Failed:
 EFI_STATUS
 EFIAPI
 VirtioRingMap (
-  IN  VIRTIO_DEVICE_PROTOCOL  *VirtIo,
-  IN  VRING                   *Ring,
-  OUT UINT64                  *RingBaseShift,
-  OUT VOID                    **Mapping
+  IN     VIRTIO_DEVICE_PROTOCOL  *VirtIo,
+  IN OUT VRING                   *Ring,
+  OUT    UINT64                  *RingBaseShift,
+  OUT    VOID                    **Mapping
   )
 {
   EFI_STATUS            Status;
@@ -549,5 +960,11 @@ VirtioRingMap (
   }
 
   *RingBaseShift = DeviceAddress - (UINT64)(UINTN)Ring->Base;
+
+  if (Ring->Indirect != NULL) {
+    Ring->IndirectDeviceAddress = (UINT64)(UINTN)Ring->Indirect +
+                                  *RingBaseShift;
+  }
+
   return EFI_SUCCESS;
 }
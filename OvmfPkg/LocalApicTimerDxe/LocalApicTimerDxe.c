@@ -43,6 +43,13 @@ EFI_TIMER_NOTIFY  mTimerNotifyFunction;
 //
 volatile UINT64  mTimerPeriod = 0;
 
+//
+// The sum of the durations passed to mTimerNotifyFunction, in 100 ns units,
+// and the number of timer interrupts taken
+//
+volatile UINT64  mSystemTime     = 0;
+volatile UINT64  mInterruptCount = 0;
+
 //
 // Worker Functions
 //
@@ -62,16 +69,25 @@ TimerInterruptHandler (
 {
   STATIC NESTED_INTERRUPT_STATE  NestedInterruptState;
   EFI_TPL                        OriginalTPL;
+  UINT64                         Duration;
 
   OriginalTPL = NestedInterruptRaiseTPL ();
 
   SendApicEoi ();
 
+  mInterruptCount++;
+  if (FeaturePcdGet (PcdLocalApicTimerTickless)) {
+    Duration = TicklessTimerExpired ();
+  } else {
+    Duration     = mTimerPeriod;
+    mSystemTime += Duration;
+  }
+
   if (mTimerNotifyFunction != NULL) {
     //
     // @bug : This does not handle missed timer interrupts
     //
-    mTimerNotifyFunction (mTimerPeriod);
+    mTimerNotifyFunction (Duration);
   }
 
   NestedInterruptRestoreTPL (OriginalTPL, SystemContext, &NestedInterruptState);
@@ -195,10 +211,18 @@ TimerDriverSetTimerPeriod (
       TimerPeriod = 429496730;
     }
 
-    //
-    // Program the timer with the new count value
-    //
-    InitializeApicTimer (DivideValue, (UINT32)TimerCount, TRUE, LOCAL_APIC_TIMER_VECTOR);
+    if (FeaturePcdGet (PcdLocalApicTimerTickless)) {
+      //
+      // The period is the shortest time between two interrupts
+      //
+      mTimerPeriod = TimerPeriod;
+      TicklessStartTimer ();
+    } else {
+      //
+      // Program the timer with the new count value
+      //
+      InitializeApicTimer (DivideValue, (UINT32)TimerCount, TRUE, LOCAL_APIC_TIMER_VECTOR);
+    }
 
     //
     // Enable timer interrupt
@@ -278,10 +302,14 @@ TimerDriverGenerateSoftInterrupt (
     OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
 
     if (mTimerNotifyFunction != NULL) {
+      //
+      // In tickless mode, time only advances when the timer expires.
       //
       // @bug : This does not handle missed timer interrupts
       //
-      mTimerNotifyFunction (mTimerPeriod);
+      mTimerNotifyFunction (
+        FeaturePcdGet (PcdLocalApicTimerTickless) ? 0 : mTimerPeriod
+        );
     }
 
     gBS->RestoreTPL (OriginalTPL);
@@ -292,6 +320,48 @@ TimerDriverGenerateSoftInterrupt (
   return EFI_SUCCESS;
 }
 
+/**
+  Log how many timer interrupts were taken during boot.
+
+  @param Event    Event whose notification function is being invoked.
+  @param Context  Unused.
+**/
+STATIC
+VOID
+EFIAPI
+TimerExitBootServices (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  UINT64  PerSecond;
+  UINT64  PeriodicPerSecond;
+
+  PerSecond         = 0;
+  PeriodicPerSecond = 0;
+  if (mSystemTime != 0) {
+    PerSecond = DivU64x64Remainder (
+                  MultU64x32 (mInterruptCount, 10000000),
+                  mSystemTime,
+                  NULL
+                  );
+  }
+
+  if (mTimerPeriod != 0) {
+    PeriodicPerSecond = DivU64x64Remainder (10000000, mTimerPeriod, NULL);
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %Lu interrupts in %Lu ms, %Lu/s (periodic ticks: %Lu/s)\n",
+    __FUNCTION__,
+    mInterruptCount,
+    DivU64x32 (mSystemTime, 10000),
+    PerSecond,
+    PeriodicPerSecond
+    ));
+}
+
 /**
   Initialize the Timer Architectural Protocol driver
 
@@ -311,6 +381,7 @@ TimerDriverInitialize (
   )
 {
   EFI_STATUS  Status;
+  EFI_EVENT   ExitBootServicesEvent;
 
   //
   // Initialize the pointer to our notify function.
@@ -344,6 +415,19 @@ TimerDriverInitialize (
                    );
   ASSERT_EFI_ERROR (Status);
 
+  if (FeaturePcdGet (PcdLocalApicTimerTickless)) {
+    TicklessInitialize ();
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                  TPL_CALLBACK,
+                  TimerExitBootServices,
+                  NULL,
+                  &ExitBootServicesEvent
+                  );
+  ASSERT_EFI_ERROR (Status);
+
   //
   // Force the timer to be enabled at its default period
   //
@@ -32,6 +32,15 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 //
 #define LOCAL_APIC_TIMER_VECTOR  32
 
+//
+// The current period of the timer interrupt, and the sum of the durations
+// passed to the timer notification function, in 100 ns units
+//
+extern volatile UINT64  mTimerPeriod;
+extern volatile UINT64  mSystemTime;
+
+extern EFI_TIMER_NOTIFY  mTimerNotifyFunction;
+
 //
 // Function Prototypes
 //
@@ -175,4 +184,34 @@ TimerDriverGenerateSoftInterrupt (
   )
 ;
 
+/**
+  Start keeping track of the timer events armed from now on.
+**/
+VOID
+TicklessInitialize (
+  VOID
+  );
+
+/**
+  Program the local APIC timer in one-shot mode for the next deadline.
+  The timer interrupt has to be enabled separately.
+**/
+VOID
+TicklessStartTimer (
+  VOID
+  );
+
+/**
+  Account for an expiry of the one-shot timer, and arm it for the next
+  deadline.
+
+  Must be called at TPL_HIGH_LEVEL.
+
+  @return The time elapsed since the previous expiry, in 100 ns units.
+**/
+UINT64
+TicklessTimerExpired (
+  VOID
+  );
+
 #endif
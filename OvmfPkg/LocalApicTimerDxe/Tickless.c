@@ -0,0 +1,476 @@
+/** @file
+  Tickless mode of the local APIC timer.
+
+  Rather than interrupting the CPU every timer period, the timer is armed in
+  one-shot mode for the earliest deadline among the timer events armed through
+  gBS->SetTimer(), which this driver hooks to keep track of them. Deadlines
+  closer than one timer period are rounded up to it, as they would be with
+  periodic ticks, and the timer never sleeps for longer than
+  PcdLocalApicTimerMaxIdle, in case an event was armed before this driver was
+  dispatched. If more timer events are armed than can be tracked, the driver
+  falls back to interrupting every timer period.
+
+  Deadlines are kept in the time base of the DXE Core, that is, as the sum of
+  the durations passed to the timer notification function, so that they match
+  the trigger times the DXE Core computes for the same events. Before a timer
+  event is armed, the time spent in the current countdown is passed to the
+  notification function, so that the DXE Core computes its trigger time from
+  the current time rather than from that of the previous expiry.
+
+  Copyright (c) 2022, Red Hat, Inc.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Library/IoLib.h>
+
+#include "LocalApicTimerDxe.h"
+
+#define TICKLESS_MAX_TIMERS  64
+
+typedef struct {
+  EFI_EVENT    Event;
+  //
+  // In the DXE Core's time base, in 100 ns units; Period is 0 for one-shot
+  // timers.
+  //
+  UINT64       Deadline;
+  UINT64       Period;
+} TICKLESS_TIMER;
+
+STATIC TICKLESS_TIMER  mTimers[TICKLESS_MAX_TIMERS];
+STATIC UINTN           mNumTimers;
+STATIC BOOLEAN         mTimersOverflowed;
+
+//
+// The deadline the timer is armed for, the initial count of the current
+// countdown, and the timer counts elapsed since mSystemTime before the current
+// countdown was started. The latter is negative when mSystemTime has been
+// advanced by more than that during the current countdown.
+//
+STATIC UINT64  mArmedDeadline;
+STATIC UINT32  mArmedCount;
+STATIC INT64   mSpentCount;
+
+STATIC BOOLEAN  mX2Apic;
+STATIC UINTN    mApicBase;
+
+STATIC EFI_SET_TIMER    mOriginalSetTimer;
+STATIC EFI_CLOSE_EVENT  mOriginalCloseEvent;
+
+/**
+  Convert a duration to local APIC timer counts.
+
+  @param[in] Time  The duration in 100 ns units.
+
+  @return The number of timer counts, at least 1 and at most MAX_UINT32.
+**/
+STATIC
+UINT32
+TimeToCount (
+  IN UINT64  Time
+  )
+{
+  UINT64  Count;
+
+  Count = DivU64x32 (MultU64x32 (Time, PcdGet32 (PcdFSBClock)), 10000000);
+  return (UINT32)MAX (MIN (Count, MAX_UINT32), 1);
+}
+
+/**
+  Convert local APIC timer counts to a duration, rounding down.
+
+  @param[in] Count  The number of timer counts.
+
+  @return The duration in 100 ns units.
+**/
+STATIC
+UINT64
+CountToTime (
+  IN UINT64  Count
+  )
+{
+  return DivU64x32 (MultU64x64 (Count, 10000000), PcdGet32 (PcdFSBClock));
+}
+
+/**
+  Restart the countdown of the local APIC timer, without touching the rest of
+  its configuration.
+
+  @param[in] Count  The initial count of the countdown.
+**/
+STATIC
+VOID
+SetTimerInitCount (
+  IN UINT32  Count
+  )
+{
+  if (mX2Apic) {
+    AsmWriteMsr64 (
+      X2APIC_MSR_BASE_ADDRESS + (XAPIC_TIMER_INIT_COUNT_OFFSET >> 4),
+      Count
+      );
+  } else {
+    MmioWrite32 (mApicBase + XAPIC_TIMER_INIT_COUNT_OFFSET, Count);
+  }
+}
+
+/**
+  Find the tracked timer of an event.
+
+  @param[in] Event  The event.
+
+  @return The tracked timer, or NULL if the event has none.
+**/
+STATIC
+TICKLESS_TIMER *
+FindTimer (
+  IN EFI_EVENT  Event
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < mNumTimers; Index++) {
+    if (mTimers[Index].Event == Event) {
+      return &mTimers[Index];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Stop tracking a timer.
+
+  @param[in] Timer  The tracked timer.
+**/
+STATIC
+VOID
+RemoveTimer (
+  IN TICKLESS_TIMER  *Timer
+  )
+{
+  mNumTimers--;
+  *Timer = mTimers[mNumTimers];
+}
+
+/**
+  Compute when the timer has to interrupt next, dropping the one-shot timers
+  that have expired and advancing the periodic ones.
+
+  Must be called at TPL_HIGH_LEVEL.
+
+  @return The deadline, in the DXE Core's time base.
+**/
+STATIC
+UINT64
+NextDeadline (
+  VOID
+  )
+{
+  UINT64          Next;
+  UINTN           Index;
+  TICKLESS_TIMER  *Timer;
+
+  if (mTimersOverflowed) {
+    Next = mSystemTime + mTimerPeriod;
+  } else {
+    Next = mSystemTime + PcdGet32 (PcdLocalApicTimerMaxIdle);
+  }
+
+  Index = 0;
+  while (Index < mNumTimers) {
+    Timer = &mTimers[Index];
+    if (Timer->Deadline <= mSystemTime) {
+      if (Timer->Period == 0) {
+        RemoveTimer (Timer);
+        continue;
+      }
+
+      Timer->Deadline += MultU64x64 (
+                           DivU64x64Remainder (
+                             mSystemTime - Timer->Deadline,
+                             Timer->Period,
+                             NULL
+                             ) + 1,
+                           Timer->Period
+                           );
+    }
+
+    Next = MIN (Next, Timer->Deadline);
+    Index++;
+  }
+
+  return MAX (Next, mSystemTime + mTimerPeriod);
+}
+
+/**
+  Arm the timer for an earlier deadline than the one it is armed for.
+
+  Must be called at TPL_HIGH_LEVEL.
+
+  @param[in] Deadline  The deadline, in the DXE Core's time base.
+**/
+STATIC
+VOID
+ArmEarlier (
+  IN UINT64  Deadline
+  )
+{
+  UINT32  Current;
+  UINT64  Elapsed;
+  UINT32  Count;
+
+  if (mTimerPeriod == 0) {
+    return;
+  }
+
+  Deadline = MAX (Deadline, mSystemTime + mTimerPeriod);
+  if (Deadline >= mArmedDeadline) {
+    return;
+  }
+
+  //
+  // If the countdown has run out already, the interrupt is pending, and its
+  // handler will arm the timer for the new deadline.
+  //
+  Current = GetApicTimerCurrentCount ();
+  if (Current == 0) {
+    return;
+  }
+
+  Elapsed = (UINT64)(mSpentCount + mArmedCount - Current);
+  Count   = TimeToCount (Deadline - mSystemTime);
+
+  mArmedDeadline = Deadline;
+  mSpentCount    = (INT64)Elapsed;
+  mArmedCount    = (Count > Elapsed) ? (UINT32)(Count - Elapsed) : 1;
+  SetTimerInitCount (mArmedCount);
+}
+
+/**
+  Pass the time elapsed in the current countdown to the timer notification
+  function, so that the system time of the DXE Core is current.
+
+  Must be called at TPL_HIGH_LEVEL.
+**/
+STATIC
+VOID
+UpdateSystemTime (
+  VOID
+  )
+{
+  UINT32  Current;
+  UINT64  Elapsed;
+  UINT64  Duration;
+
+  if ((mTimerPeriod == 0) || (mTimerNotifyFunction == NULL)) {
+    return;
+  }
+
+  //
+  // If the countdown has run out already, the pending interrupt accounts for
+  // the time up to the deadline.
+  //
+  Current = GetApicTimerCurrentCount ();
+  if ((Current == 0) || (mArmedDeadline <= mSystemTime)) {
+    return;
+  }
+
+  Elapsed  = (UINT64)(mSpentCount + mArmedCount - Current);
+  Duration = MIN (CountToTime (Elapsed), mArmedDeadline - mSystemTime);
+  if (Duration == 0) {
+    return;
+  }
+
+  //
+  // Carry over the counts that did not add up to a whole 100 ns unit, so
+  // that the time passed on does not drift from the timer.
+  //
+  mSpentCount -= (INT64)DivU64x32 (
+                          MultU64x32 (Duration, PcdGet32 (PcdFSBClock)),
+                          10000000
+                          );
+  mSystemTime += Duration;
+  mTimerNotifyFunction (Duration);
+}
+
+/**
+  Hook of gBS->SetTimer() that tracks the deadlines of the timer events.
+
+  @param[in] Event        The timer event that is to be signaled at the
+                          specified time.
+  @param[in] Type         The type of time that is specified in TriggerTime.
+  @param[in] TriggerTime  The number of 100ns units until the timer expires.
+
+  @return The status returned by the original gBS->SetTimer().
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TicklessSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  EFI_STATUS      Status;
+  EFI_TPL         OriginalTPL;
+  TICKLESS_TIMER  *Timer;
+
+  //
+  // The DXE Core computes the trigger time from its system time, which
+  // otherwise only advances when the timer expires. It cannot be called at
+  // TPL_HIGH_LEVEL, so an interrupt may still come in between; that only
+  // advances the system time further.
+  //
+  if (Type != TimerCancel) {
+    OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+    UpdateSystemTime ();
+    gBS->RestoreTPL (OriginalTPL);
+  }
+
+  Status = mOriginalSetTimer (Event, Type, TriggerTime);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+
+  Timer = FindTimer (Event);
+  if (Type == TimerCancel) {
+    if (Timer != NULL) {
+      RemoveTimer (Timer);
+    }
+  } else if ((Timer == NULL) && (mNumTimers == TICKLESS_MAX_TIMERS)) {
+    if (!mTimersOverflowed) {
+      DEBUG ((
+        DEBUG_WARN,
+        "%a: too many timers, falling back to periodic ticks\n",
+        __FUNCTION__
+        ));
+      mTimersOverflowed = TRUE;
+    }
+  } else {
+    if (Timer == NULL) {
+      Timer        = &mTimers[mNumTimers++];
+      Timer->Event = Event;
+    }
+
+    //
+    // Like the DXE Core, fire periodic timers every timer period if they have
+    // no period of their own.
+    //
+    Timer->Deadline = mSystemTime + TriggerTime;
+    Timer->Period   = 0;
+    if (Type == TimerPeriodic) {
+      Timer->Period = MAX ((TriggerTime != 0) ? TriggerTime : mTimerPeriod, 1);
+    }
+
+    ArmEarlier (Timer->Deadline);
+  }
+
+  gBS->RestoreTPL (OriginalTPL);
+  return Status;
+}
+
+/**
+  Hook of gBS->CloseEvent() that stops tracking the timer of the event.
+
+  @param[in] Event  The event to close.
+
+  @return The status returned by the original gBS->CloseEvent().
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TicklessCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  EFI_TPL         OriginalTPL;
+  TICKLESS_TIMER  *Timer;
+
+  OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  Timer       = FindTimer (Event);
+  if (Timer != NULL) {
+    RemoveTimer (Timer);
+  }
+
+  gBS->RestoreTPL (OriginalTPL);
+
+  return mOriginalCloseEvent (Event);
+}
+
+/**
+  Start keeping track of the timer events armed from now on.
+**/
+VOID
+TicklessInitialize (
+  VOID
+  )
+{
+  EFI_TPL  OriginalTPL;
+
+  mX2Apic   = (BOOLEAN)(GetApicMode () == LOCAL_APIC_MODE_X2APIC);
+  mApicBase = GetLocalApicBaseAddress ();
+
+  OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+
+  mOriginalSetTimer   = gBS->SetTimer;
+  mOriginalCloseEvent = gBS->CloseEvent;
+  gBS->SetTimer       = TicklessSetTimer;
+  gBS->CloseEvent     = TicklessCloseEvent;
+
+  gBS->Hdr.CRC32 = 0;
+  gBS->CalculateCrc32 (gBS, gBS->Hdr.HeaderSize, &gBS->Hdr.CRC32);
+
+  gBS->RestoreTPL (OriginalTPL);
+}
+
+/**
+  Program the local APIC timer in one-shot mode for the next deadline.
+  The timer interrupt has to be enabled separately.
+**/
+VOID
+TicklessStartTimer (
+  VOID
+  )
+{
+  EFI_TPL  OriginalTPL;
+
+  OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+
+  mArmedDeadline = NextDeadline ();
+  mArmedCount    = TimeToCount (mArmedDeadline - mSystemTime);
+  mSpentCount    = 0;
+  InitializeApicTimer (1, mArmedCount, FALSE, LOCAL_APIC_TIMER_VECTOR);
+
+  gBS->RestoreTPL (OriginalTPL);
+}
+
+/**
+  Account for an expiry of the one-shot timer, and arm it for the next
+  deadline.
+
+  Must be called at TPL_HIGH_LEVEL.
+
+  @return The time elapsed since the previous expiry, in 100 ns units.
+**/
+UINT64
+TicklessTimerExpired (
+  VOID
+  )
+{
+  UINT64  Duration;
+
+  Duration    = mArmedDeadline - mSystemTime;
+  mSystemTime = mArmedDeadline;
+
+  mArmedDeadline = NextDeadline ();
+  mArmedCount    = TimeToCount (mArmedDeadline - mSystemTime);
+  mSpentCount    = 0;
+  SetTimerInitCount (mArmedCount);
+
+  return Duration;
+}
@@ -25,6 +25,11 @@
 
 #include "Platform.h"
 
+//
+// GHCB pages whose encryption mask is cleared in one batch.
+//
+#define GHCB_RANGE_BATCH  64
+
 STATIC
 UINT64
 GetHypervisorFeature (
@@ -222,6 +227,11 @@ AmdSevEsInitialize (
   IA32_DESCRIPTOR      Gdtr;
   VOID                 *Gdt;
 
+  MEM_ENCRYPT_SEV_PAGE_RANGE  Ranges[GHCB_RANGE_BATCH];
+  UINTN                       RangeCount;
+  UINT64                      PscExits;
+  UINT64                      PscUnbatchedExits;
+
   if (!MemEncryptSevEsIsEnabled ()) {
     return;
   }
@@ -243,17 +253,30 @@ AmdSevEsInitialize (
   //
   // Each vCPU gets two consecutive pages, the first is the GHCB and the
   // second is the per-CPU variable page. Loop through the allocation and
-  // only clear the encryption mask for the GHCB pages.
+  // only clear the encryption mask for the GHCB pages, a batch of them at a
+  // time.
   //
+  RangeCount = 0;
   for (PageCount = 0; PageCount < GhcbPageCount; PageCount += 2) {
-    Status = MemEncryptSevClearPageEncMask (
-               0,
-               GhcbBasePa + EFI_PAGES_TO_SIZE (PageCount),
-               1
-               );
-    ASSERT_RETURN_ERROR (Status);
+    Ranges[RangeCount].BaseAddress = GhcbBasePa + EFI_PAGES_TO_SIZE (PageCount);
+    Ranges[RangeCount].NumPages    = 1;
+    RangeCount++;
+
+    if ((RangeCount == GHCB_RANGE_BATCH) || (PageCount + 2 >= GhcbPageCount)) {
+      Status = MemEncryptSevClearPageEncMaskRanges (0, Ranges, RangeCount);
+      ASSERT_RETURN_ERROR (Status);
+      RangeCount = 0;
+    }
   }
 
+  MemEncryptSevGetPageStateChangeExits (&PscExits, &PscUnbatchedExits);
+  DEBUG ((
+    DEBUG_INFO,
+    "SEV: %Lu page state change exits, %Lu without batching\n",
+    PscExits,
+    PscUnbatchedExits
+    ));
+
   ZeroMem (GhcbBase, EFI_PAGES_TO_SIZE (GhcbPageCount));
 
   Status = PcdSet64S (PcdGhcbBase, GhcbBasePa);
@@ -0,0 +1,78 @@
+/** @file
+  Set up the debug log ring.
+
+  Copyright (C) 2022, Red Hat, Inc.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Guid/DebugLogRing.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/HobLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
+
+#include "Platform.h"
+
+/**
+  Allocate the debug log ring and publish it at PcdOvmfDebugLogBase, where
+  the DebugLib instances of the following PEIMs and DXE drivers find it.
+
+  The ring and its header are reserved memory, so that they survive
+  ExitBootServices() for the OS to read.
+
+  @param[in] PlatformInfoHob  Pointer to platform info hob.
+
+**/
+VOID
+DebugLogInitialization (
+  IN EFI_HOB_PLATFORM_INFO  *PlatformInfoHob
+  )
+{
+  OVMF_DEBUG_LOG_RING  *Ring;
+  UINT32               Pages;
+  VOID                 *Data;
+
+  if ((FixedPcdGet32 (PcdOvmfDebugLogSize) == 0) ||
+      (FixedPcdGet32 (PcdOvmfDebugLogPages) == 0) ||
+      !DebugPrintEnabled ())
+  {
+    return;
+  }
+
+  ASSERT (PlatformInfoHob->BootMode != BOOT_ON_S3_RESUME);
+
+  Pages = GetPowerOfTwo32 (FixedPcdGet32 (PcdOvmfDebugLogPages));
+  Data  = AllocateReservedPages (Pages);
+  if (Data == NULL) {
+    DEBUG ((DEBUG_WARN, "%a: out of memory for the debug log ring\n", __FUNCTION__));
+    return;
+  }
+
+  BuildMemoryAllocationHob (
+    (EFI_PHYSICAL_ADDRESS)(UINTN)FixedPcdGet32 (PcdOvmfDebugLogBase),
+    (UINT64)(UINTN)FixedPcdGet32 (PcdOvmfDebugLogSize),
+    EfiReservedMemoryType
+    );
+
+  Ring = (OVMF_DEBUG_LOG_RING *)(UINTN)FixedPcdGet32 (PcdOvmfDebugLogBase);
+  ZeroMem (Ring, sizeof (*Ring));
+  Ring->DataSize = (UINT32)EFI_PAGES_TO_SIZE (Pages);
+  Ring->Data     = (UINT64)(UINTN)Data;
+
+  //
+  // The ring must be complete before DEBUG() starts using it.
+  //
+  MemoryFence ();
+  Ring->Signature = OVMF_DEBUG_LOG_RING_SIGNATURE;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %u KB debug log ring at 0x%Lx\n",
+    __FUNCTION__,
+    Ring->DataSize / SIZE_1KB,
+    Ring->Data
+    ));
+}
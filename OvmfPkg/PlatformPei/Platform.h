@@ -78,6 +78,11 @@ InstallClearCacheCallback (
   VOID
   );
 
+VOID
+DebugLogInitialization (
+  IN EFI_HOB_PLATFORM_INFO  *PlatformInfoHob
+  );
+
 VOID
 AmdSevInitialize (
   IN EFI_HOB_PLATFORM_INFO  *PlatformInfoHob
@@ -22,6 +22,7 @@
 #include <Library/DevicePathLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/QemuFwCfgLib.h>
+#include <Library/TimerLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
 #include <Protocol/DevicePath.h>
@@ -38,6 +39,10 @@ typedef enum {
   KernelBlobTypeMax
 } KERNEL_BLOB_TYPE;
 
+//
+// A blob's size is read from fw_cfg at entry, its contents only when they are
+// first read. Data is set once the contents have been fetched and verified.
+//
 typedef struct {
   CONST CHAR16    Name[8];
   struct {
@@ -107,6 +112,189 @@ STATIC CONST SINGLE_VENMEDIA_NODE_DEVPATH  mInitrdDevicePath = {
   }
 };
 
+//
+// Utility functions.
+//
+
+/**
+  Read the size of a blob in mKernelBlob from fw_cfg.
+
+  @param[in,out] Blob  Pointer to the KERNEL_BLOB element in mKernelBlob whose
+                       size is to be read.
+**/
+STATIC
+VOID
+FetchBlobSize (
+  IN OUT KERNEL_BLOB  *Blob
+  )
+{
+  UINTN  Idx;
+
+  Blob->Size = 0;
+  for (Idx = 0; Idx < ARRAY_SIZE (Blob->FwCfgItem); Idx++) {
+    if (Blob->FwCfgItem[Idx].SizeKey == 0) {
+      break;
+    }
+
+    QemuFwCfgSelectItem (Blob->FwCfgItem[Idx].SizeKey);
+    Blob->FwCfgItem[Idx].Size = QemuFwCfgRead32 ();
+    Blob->Size               += Blob->FwCfgItem[Idx].Size;
+  }
+}
+
+/**
+  Read the contents of a blob from fw_cfg into a buffer, and verify them.
+
+  Each chunk is hashed right after it has been read, while it is still in the
+  cache, rather than the whole blob at the end.
+
+  @param[in]  Blob    Pointer to the KERNEL_BLOB element in mKernelBlob whose
+                      contents are to be read.
+
+  @param[out] Buffer  The buffer to read the contents into, of at least
+                      Blob->Size bytes. On error, the contents of Buffer must
+                      not be used.
+
+  @retval EFI_SUCCESS           The contents have been read and verified.
+
+  @retval EFI_ACCESS_DENIED     The contents could not be verified.
+
+  @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
+**/
+STATIC
+EFI_STATUS
+FetchBlobData (
+  IN  CONST KERNEL_BLOB  *Blob,
+  OUT UINT8              *Buffer
+  )
+{
+  EFI_STATUS  Status;
+  VOID        *VerifyContext;
+  UINT32      Left;
+  UINTN       Idx;
+  UINT8       *ChunkData;
+  UINT64      Start;
+  UINT64      FetchTicks;
+  UINT64      HashTicks;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: loading %Ld bytes for \"%s\"\n",
+    __FUNCTION__,
+    (INT64)Blob->Size,
+    Blob->Name
+    ));
+
+  Start  = GetPerformanceCounter ();
+  Status = VerifyBlobStart (Blob->Name, &VerifyContext);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  HashTicks  = GetPerformanceCounter () - Start;
+  FetchTicks = 0;
+
+  ChunkData = Buffer;
+  for (Idx = 0; Idx < ARRAY_SIZE (Blob->FwCfgItem); Idx++) {
+    if (Blob->FwCfgItem[Idx].DataKey == 0) {
+      break;
+    }
+
+    QemuFwCfgSelectItem (Blob->FwCfgItem[Idx].DataKey);
+
+    Left = Blob->FwCfgItem[Idx].Size;
+    while (Left > 0) {
+      UINT32  Chunk;
+
+      Chunk = (Left < SIZE_1MB) ? Left : SIZE_1MB;
+
+      Start = GetPerformanceCounter ();
+      QemuFwCfgReadBytes (Chunk, ChunkData);
+      FetchTicks += GetPerformanceCounter () - Start;
+
+      Start = GetPerformanceCounter ();
+      VerifyBlobUpdate (VerifyContext, ChunkData, Chunk);
+      HashTicks += GetPerformanceCounter () - Start;
+
+      ChunkData += Chunk;
+      Left      -= Chunk;
+      DEBUG ((
+        DEBUG_VERBOSE,
+        "%a: %Ld bytes remaining for \"%s\" (%d)\n",
+        __FUNCTION__,
+        (INT64)Left,
+        Blob->Name,
+        (INT32)Idx
+        ));
+    }
+  }
+
+  Start      = GetPerformanceCounter ();
+  Status     = VerifyBlobFinal (VerifyContext);
+  HashTicks += GetPerformanceCounter () - Start;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: \"%s\": fetched in %Lu us, verified in %Lu us: %r\n",
+    __FUNCTION__,
+    Blob->Name,
+    DivU64x32 (GetTimeInNanoSecond (FetchTicks), 1000),
+    DivU64x32 (GetTimeInNanoSecond (HashTicks), 1000),
+    Status
+    ));
+  return Status;
+}
+
+/**
+  Populate the contents of a blob in mKernelBlob, unless that has been done
+  already.
+
+  @param[in,out] Blob  Pointer to the KERNEL_BLOB element in mKernelBlob that
+                       is to be filled from fw_cfg.
+
+  @retval EFI_SUCCESS           Blob->Data is available. If the blob has a
+                                size of zero, then Blob->Data has been left
+                                NULL.
+
+  @retval EFI_ACCESS_DENIED     The contents could not be verified.
+
+  @retval EFI_OUT_OF_RESOURCES  Failed to allocate memory for Blob->Data.
+**/
+STATIC
+EFI_STATUS
+LoadBlob (
+  IN OUT KERNEL_BLOB  *Blob
+  )
+{
+  EFI_STATUS  Status;
+  UINT8       *Data;
+
+  if ((Blob->Data != NULL) || (Blob->Size == 0)) {
+    return EFI_SUCCESS;
+  }
+
+  Data = AllocatePool (Blob->Size);
+  if (Data == NULL) {
+    DEBUG ((
+      DEBUG_ERROR,
+      "%a: failed to allocate %Ld bytes for \"%s\"\n",
+      __FUNCTION__,
+      (INT64)Blob->Size,
+      Blob->Name
+      ));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = FetchBlobData (Blob, Data);
+  if (EFI_ERROR (Status)) {
+    FreePool (Data);
+    return Status;
+  }
+
+  Blob->Data = Data;
+  return EFI_SUCCESS;
+}
+
 //
 // The "file in the EFI stub filesystem" abstraction.
 //
@@ -345,6 +533,8 @@ ConvertKernelBlobTypeToFileInfo (
                                 structure. BufferSize has been updated with the
                                 size needed to complete the request, and the
                                 directory position has not been advanced.
+  @retval EFI_ACCESS_DENIED     The file contents could not be verified.
+  @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
 **/
 STATIC
 EFI_STATUS
@@ -355,9 +545,10 @@ StubFileRead (
   OUT VOID              *Buffer
   )
 {
-  STUB_FILE          *StubFile;
-  CONST KERNEL_BLOB  *Blob;
-  UINT64             Left;
+  STUB_FILE    *StubFile;
+  KERNEL_BLOB  *Blob;
+  UINT64       Left;
+  EFI_STATUS   Status;
 
   StubFile = STUB_FILE_FROM_FILE (This);
 
@@ -365,8 +556,6 @@ StubFileRead (
   // Scanning the root directory?
   //
   if (StubFile->BlobType == KernelBlobTypeMax) {
-    EFI_STATUS  Status;
-
     if (StubFile->Position == KernelBlobTypeMax) {
       //
       // Scanning complete.
@@ -401,6 +590,28 @@ StubFileRead (
     *BufferSize = (UINTN)Left;
   }
 
+  if ((Blob->Data == NULL) && (*BufferSize > 0)) {
+    if (*BufferSize == Blob->Size) {
+      //
+      // The whole file is read at once, which is what the loaders do. Fetch it
+      // straight into the caller's buffer, without keeping a copy.
+      //
+      Status = FetchBlobData (Blob, Buffer);
+      if (EFI_ERROR (Status)) {
+        ZeroMem (Buffer, Blob->Size);
+        return Status;
+      }
+
+      StubFile->Position += *BufferSize;
+      return EFI_SUCCESS;
+    }
+
+    Status = LoadBlob (Blob);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
   if (Blob->Data != NULL) {
     CopyMem (Buffer, Blob->Data + StubFile->Position, *BufferSize);
   }
@@ -884,6 +1095,7 @@ InitrdLoadFile2 (
   )
 {
   CONST KERNEL_BLOB  *InitrdBlob = &mKernelBlob[KernelBlobTypeInitrd];
+  EFI_STATUS         Status;
 
   ASSERT (InitrdBlob->Size > 0);
 
@@ -906,7 +1118,19 @@ InitrdLoadFile2 (
     return EFI_BUFFER_TOO_SMALL;
   }
 
-  CopyMem (Buffer, InitrdBlob->Data, InitrdBlob->Size);
+  if (InitrdBlob->Data == NULL) {
+    //
+    // The initrd is normally loaded exactly once, so fetch it straight into
+    // the caller's buffer.
+    //
+    Status = FetchBlobData (InitrdBlob, Buffer);
+    if (EFI_ERROR (Status)) {
+      ZeroMem (Buffer, InitrdBlob->Size);
+      return Status;
+    }
+  } else {
+    CopyMem (Buffer, InitrdBlob->Data, InitrdBlob->Size);
+  }
 
   *BufferSize = InitrdBlob->Size;
   return EFI_SUCCESS;
@@ -916,112 +1140,14 @@ STATIC CONST EFI_LOAD_FILE2_PROTOCOL  mInitrdLoadFile2 = {
   InitrdLoadFile2,
 };
 
-//
-// Utility functions.
-//
-
-/**
-  Populate a blob in mKernelBlob.
-
-  param[in,out] Blob  Pointer to the KERNEL_BLOB element in mKernelBlob that is
-                      to be filled from fw_cfg.
-
-  @retval EFI_SUCCESS           Blob has been populated. If fw_cfg reported a
-                                size of zero for the blob, then Blob->Data has
-                                been left unchanged.
-
-  @retval EFI_OUT_OF_RESOURCES  Failed to allocate memory for Blob->Data.
-**/
-STATIC
-EFI_STATUS
-FetchBlob (
-  IN OUT KERNEL_BLOB  *Blob
-  )
-{
-  UINT32  Left;
-  UINTN   Idx;
-  UINT8   *ChunkData;
-
-  //
-  // Read blob size.
-  //
-  Blob->Size = 0;
-  for (Idx = 0; Idx < ARRAY_SIZE (Blob->FwCfgItem); Idx++) {
-    if (Blob->FwCfgItem[Idx].SizeKey == 0) {
-      break;
-    }
-
-    QemuFwCfgSelectItem (Blob->FwCfgItem[Idx].SizeKey);
-    Blob->FwCfgItem[Idx].Size = QemuFwCfgRead32 ();
-    Blob->Size               += Blob->FwCfgItem[Idx].Size;
-  }
-
-  if (Blob->Size == 0) {
-    return EFI_SUCCESS;
-  }
-
-  //
-  // Read blob.
-  //
-  Blob->Data = AllocatePool (Blob->Size);
-  if (Blob->Data == NULL) {
-    DEBUG ((
-      DEBUG_ERROR,
-      "%a: failed to allocate %Ld bytes for \"%s\"\n",
-      __FUNCTION__,
-      (INT64)Blob->Size,
-      Blob->Name
-      ));
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  DEBUG ((
-    DEBUG_INFO,
-    "%a: loading %Ld bytes for \"%s\"\n",
-    __FUNCTION__,
-    (INT64)Blob->Size,
-    Blob->Name
-    ));
-
-  ChunkData = Blob->Data;
-  for (Idx = 0; Idx < ARRAY_SIZE (Blob->FwCfgItem); Idx++) {
-    if (Blob->FwCfgItem[Idx].DataKey == 0) {
-      break;
-    }
-
-    QemuFwCfgSelectItem (Blob->FwCfgItem[Idx].DataKey);
-
-    Left = Blob->FwCfgItem[Idx].Size;
-    while (Left > 0) {
-      UINT32  Chunk;
-
-      Chunk = (Left < SIZE_1MB) ? Left : SIZE_1MB;
-      QemuFwCfgReadBytes (Chunk, ChunkData + Blob->FwCfgItem[Idx].Size - Left);
-      Left -= Chunk;
-      DEBUG ((
-        DEBUG_VERBOSE,
-        "%a: %Ld bytes remaining for \"%s\" (%d)\n",
-        __FUNCTION__,
-        (INT64)Left,
-        Blob->Name,
-        (INT32)Idx
-        ));
-    }
-
-    ChunkData += Blob->FwCfgItem[Idx].Size;
-  }
-
-  return EFI_SUCCESS;
-}
-
 //
 // The entry point of the feature.
 //
 
 /**
-  Download the kernel, the initial ramdisk, and the kernel command line from
+  Look up the kernel, the initial ramdisk, and the kernel command line in
   QEMU's fw_cfg. Construct a minimal SimpleFileSystem that contains the two
-  image files.
+  image files; their contents are downloaded when they are first read.
 
   @retval EFI_NOT_FOUND         Kernel image was not found.
   @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
@@ -1056,22 +1182,18 @@ QemuKernelLoaderFsDxeEntrypoint (
   }
 
   //
-  // Fetch all blobs.
+  // Size all blobs. Their contents are fetched and verified on first read,
+  // except that empty blobs, which are never read, are verified right away.
   //
   for (BlobType = 0; BlobType < KernelBlobTypeMax; ++BlobType) {
     CurrentBlob = &mKernelBlob[BlobType];
-    Status      = FetchBlob (CurrentBlob);
-    if (EFI_ERROR (Status)) {
-      goto FreeBlobs;
-    }
+    FetchBlobSize (CurrentBlob);
 
-    Status = VerifyBlob (
-               CurrentBlob->Name,
-               CurrentBlob->Data,
-               CurrentBlob->Size
-               );
-    if (EFI_ERROR (Status)) {
-      goto FreeBlobs;
+    if (CurrentBlob->Size == 0) {
+      Status = VerifyBlob (CurrentBlob->Name, NULL, 0);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
     }
 
     mTotalBlobBytes += CurrentBlob->Size;
@@ -1079,9 +1201,8 @@ QemuKernelLoaderFsDxeEntrypoint (
 
   KernelBlob = &mKernelBlob[KernelBlobTypeKernel];
 
-  if (KernelBlob->Data == NULL) {
-    Status = EFI_NOT_FOUND;
-    goto FreeBlobs;
+  if (KernelBlob->Size == 0) {
+    return EFI_NOT_FOUND;
   }
 
   //
@@ -1104,7 +1225,7 @@ QemuKernelLoaderFsDxeEntrypoint (
       __FUNCTION__,
       Status
       ));
-    goto FreeBlobs;
+    return Status;
   }
 
   if (KernelBlob[KernelBlobTypeInitrd].Size > 0) {
@@ -1141,15 +1262,5 @@ UninstallFileSystemHandle:
                   );
   ASSERT_EFI_ERROR (Status);
 
-FreeBlobs:
-  while (BlobType > 0) {
-    CurrentBlob = &mKernelBlob[--BlobType];
-    if (CurrentBlob->Data != NULL) {
-      FreePool (CurrentBlob->Data);
-      CurrentBlob->Size = 0;
-      CurrentBlob->Data = NULL;
-    }
-  }
-
   return Status;
 }
@@ -11,6 +11,7 @@
 
 #include <PiPei.h>
 
+#include <Guid/DebugLogRing.h>
 #include <Library/PeimEntryPoint.h>
 #include <Library/BaseLib.h>
 #include <Library/DebugLib.h>
@@ -798,6 +799,20 @@ SecCoreStartupWithStack (
     Table[Index] = 0;
   }
 
+  //
+  // A warm reset or S3 resume leaves the debug log ring of the previous boot
+  // behind, pointing at memory PEI is about to reuse. Clear it before the PEI
+  // DebugLib instances look at it, so they log straight to the debug I/O port
+  // until PlatformPei sets up a new ring. SEC itself never uses the ring, and
+  // for Td guests its page has only just been accepted above.
+  //
+  if (FixedPcdGet32 (PcdOvmfDebugLogSize) != 0) {
+    Table = (UINT8 *)(UINTN)FixedPcdGet32 (PcdOvmfDebugLogBase);
+    for (Index = 0; Index < sizeof (OVMF_DEBUG_LOG_RING); ++Index) {
+      Table[Index] = 0;
+    }
+  }
+
   //
   // Initialize IDT - Since this is before library constructors are called,
   // we use a loop rather than CopyMem.
@@ -821,7 +821,8 @@ VirtioBlkInit (
 
   Features &= VIRTIO_BLK_F_BLK_SIZE | VIRTIO_BLK_F_TOPOLOGY | VIRTIO_BLK_F_RO |
               VIRTIO_BLK_F_FLUSH | VIRTIO_F_VERSION_1 |
-              VIRTIO_F_IOMMU_PLATFORM;
+              VIRTIO_F_IOMMU_PLATFORM | VIRTIO_F_RING_INDIRECT_DESC |
+              VIRTIO_F_RING_EVENT_IDX | VIRTIO_F_RING_PACKED;
 
   //
   // In virtio-1.0, feature negotiation is expected to complete before queue
@@ -853,7 +854,12 @@ VirtioBlkInit (
     goto Failed;
   }
 
-  Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
+  Status = VirtioRingInitWithFeatures (
+             Dev->VirtIo,
+             QueueSize,
+             Features,
+             &Dev->Ring
+             );
   if (EFI_ERROR (Status)) {
     goto Failed;
   }
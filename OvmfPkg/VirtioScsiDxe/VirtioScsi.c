@@ -1028,7 +1028,8 @@ VirtioScsiInit (
   }
 
   Features &= VIRTIO_SCSI_F_INOUT | VIRTIO_F_VERSION_1 |
-              VIRTIO_F_IOMMU_PLATFORM;
+              VIRTIO_F_IOMMU_PLATFORM | VIRTIO_F_RING_INDIRECT_DESC |
+              VIRTIO_F_RING_EVENT_IDX | VIRTIO_F_RING_PACKED;
 
   //
   // In virtio-1.0, feature negotiation is expected to complete before queue
@@ -1062,7 +1063,12 @@ VirtioScsiInit (
     goto Failed;
   }
 
-  Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
+  Status = VirtioRingInitWithFeatures (
+             Dev->VirtIo,
+             QueueSize,
+             Features,
+             &Dev->Ring
+             );
   if (EFI_ERROR (Status)) {
     goto Failed;
   }
@@ -31,6 +31,7 @@ typedef TCG_PCR_EVENT grub_tpm_event_t;
 
 static grub_efi_guid_t tpm_guid = EFI_TPM_GUID;
 static grub_efi_guid_t tpm2_guid = EFI_TPM2_GUID;
+static grub_efi_guid_t cc_measurement_guid = EFI_CC_MEASUREMENT_GUID;
 
 static grub_efi_handle_t *grub_tpm_handle;
 static grub_uint8_t grub_tpm_version;
@@ -38,6 +39,9 @@ static grub_uint8_t grub_tpm_version;
 static grub_int8_t tpm1_present = -1;
 static grub_int8_t tpm2_present = -1;
 
+static grub_efi_cc_protocol_t *grub_cc_protocol;
+static grub_int8_t cc_present = -1;
+
 static grub_efi_boolean_t
 grub_tpm1_present (grub_efi_tpm_protocol_t *tpm)
 {
@@ -222,6 +226,86 @@ grub_tpm2_log_event (grub_efi_handle_t tpm_handle, unsigned char *buf,
   return grub_efi_log_event_status (status);
 }
 
+static grub_efi_cc_protocol_t *
+grub_cc_protocol_find (void)
+{
+  grub_efi_status_t status;
+  grub_efi_cc_protocol_t *cc;
+  EFI_CC_BOOT_SERVICE_CAPABILITY caps;
+
+  if (cc_present != -1)
+    return grub_cc_protocol;
+
+  cc_present = 0;
+
+  cc = grub_efi_locate_protocol (&cc_measurement_guid, NULL);
+  if (cc)
+    {
+      caps.Size = (grub_uint8_t) sizeof (caps);
+      status = efi_call_2 (cc->get_capability, cc, &caps);
+
+      /* GRUB precomputes SHA-384 digests, so the firmware has to log them. */
+      if (status == GRUB_EFI_SUCCESS && caps.CcType.Type != EFI_CC_TYPE_NONE
+	  && (caps.HashAlgorithmBitmap & EFI_CC_BOOT_HASH_ALG_SHA384))
+	{
+	  grub_cc_protocol = cc;
+	  cc_present = 1;
+	}
+    }
+
+  grub_dprintf ("tpm", "cc measurement%s present\n",
+		cc_present ? "" : " NOT");
+
+  return grub_cc_protocol;
+}
+
+static grub_err_t
+grub_cc_log_event (grub_efi_cc_protocol_t *cc, unsigned char *buf,
+		   grub_size_t size, grub_uint8_t pcr,
+		   const char *description)
+{
+  EFI_CC_EVENT *event;
+  EFI_CC_MR_INDEX mr;
+  grub_efi_status_t status;
+
+  status = efi_call_3 (cc->map_pcr_to_mr_index, cc, pcr, &mr);
+  if (status != GRUB_EFI_SUCCESS)
+    return grub_efi_log_event_status (status);
+
+  event =
+    grub_zalloc (sizeof (EFI_CC_EVENT) + grub_strlen (description) + 1);
+  if (!event)
+    return grub_error (GRUB_ERR_OUT_OF_MEMORY,
+		       N_("cannot allocate CC event buffer"));
+
+  event->Header.HeaderSize = sizeof (EFI_CC_EVENT_HEADER);
+  event->Header.HeaderVersion = EFI_CC_EVENT_HEADER_VERSION;
+  event->Header.MrIndex = mr;
+  event->Header.EventType = EV_IPL;
+  event->Size =
+    sizeof (*event) - sizeof (event->Event) + grub_strlen (description) + 1;
+  grub_memcpy (event->Event, description, grub_strlen (description) + 1);
+
+  status = efi_call_5 (cc->hash_log_extend_event, cc, 0, (grub_addr_t) buf,
+		       (grub_uint64_t) size, event);
+  grub_free (event);
+
+  return grub_efi_log_event_status (status);
+}
+
+int
+grub_cc_measure_active (void)
+{
+  grub_efi_handle_t tpm_handle;
+  grub_efi_uint8_t protocol_version;
+
+  /* A real (v)TPM always takes precedence over the CC measurement registers. */
+  if (grub_tpm_handle_find (&tpm_handle, &protocol_version))
+    return 0;
+
+  return grub_cc_protocol_find () != NULL;
+}
+
 grub_err_t
 grub_tpm_measure (unsigned char *buf, grub_size_t size, grub_uint8_t pcr,
 		    const char *description)
@@ -230,7 +314,16 @@ grub_tpm_measure (unsigned char *buf, grub_size_t size, grub_uint8_t pcr,
   grub_efi_uint8_t protocol_version;
 
   if (!grub_tpm_handle_find (&tpm_handle, &protocol_version))
-    return 0;
+    {
+      grub_efi_cc_protocol_t *cc = grub_cc_protocol_find ();
+
+      if (!cc)
+	return 0;
+
+      grub_dprintf ("tpm", "cc log_event, pcr = %d, size = 0x%" PRIxGRUB_SIZE
+		    ", %s\n", pcr, size, description);
+      return grub_cc_log_event (cc, buf, size, pcr, description);
+    }
 
   grub_dprintf ("tpm", "log_event, pcr = %d, size = 0x%" PRIxGRUB_SIZE ", %s\n",
                 pcr, size, description);
@@ -18,6 +18,7 @@
  */
 
 #include <grub/mm.h>
+#include <grub/disk.h>
 #include <grub/file.h>
 #include <grub/time.h>
 #include <grub/misc.h>
@@ -25,6 +26,7 @@
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
 #include <grub/normal.h>
+#include <grub/workqueue.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -33,19 +35,80 @@ GRUB_MOD_LICENSE ("GPLv3+");
 static const struct grub_arg_option options[] =
   {
     {"size", 's', 0, N_("Specify size for each read operation"), 0, ARG_TYPE_INT},
+    {"mp-scaling", 'm', 0,
+     N_("Repeat the test with 0, 1, 2, 4, ... application processors"), 0, 0},
     {0, 0, 0, 0, 0, 0}
   };
 
+static grub_err_t
+read_file (const char *name, char *buffer, grub_ssize_t block_size,
+	   grub_disk_addr_t *total_size, grub_uint64_t *elapsed)
+{
+  grub_uint64_t start;
+  grub_file_t file;
+
+  file = grub_file_open (name, GRUB_FILE_TYPE_TESTLOAD);
+  if (file == NULL)
+    return grub_errno;
+
+  *total_size = 0;
+  start = grub_get_time_ms ();
+  while (1)
+    {
+      grub_ssize_t size = grub_file_read (file, buffer, block_size);
+      if (size <= 0)
+	break;
+      *total_size += size;
+    }
+  *elapsed = grub_get_time_ms () - start;
+  grub_file_close (file);
+
+  return grub_errno;
+}
+
+static grub_err_t
+test_mp_scaling (const char *name, char *buffer, grub_ssize_t block_size)
+{
+  unsigned int aps, max;
+  grub_disk_addr_t total_size;
+  grub_uint64_t elapsed;
+
+  max = grub_workqueue_get_aps ();
+  grub_printf_ (N_("Application processors available: %u\n"), max);
+
+  for (aps = 0; ; aps = aps ? aps * 2 : 1)
+    {
+      if (aps > max)
+	aps = max;
+
+      /* Every pass has to go to the disk, not to the previous pass's cache. */
+      grub_disk_cache_invalidate_all ();
+      grub_workqueue_set_max_aps (aps);
+      if (read_file (name, buffer, block_size, &total_size, &elapsed))
+	break;
+
+      if (elapsed)
+	grub_printf_ (N_("APs: %u Speed: %s\n"), aps,
+		      grub_get_human_size (grub_divmod64 (total_size * 100ULL
+							  * 1000ULL,
+							  elapsed, 0),
+					   GRUB_HUMAN_SIZE_SPEED));
+      if (aps == max)
+	break;
+    }
+
+  grub_workqueue_set_max_aps (~0U);
+  return grub_errno;
+}
+
 static grub_err_t
 grub_cmd_testspeed (grub_extcmd_context_t ctxt, int argc, char **args)
 {
   struct grub_arg_list *state = ctxt->state;
-  grub_uint64_t start;
-  grub_uint64_t end;
+  grub_uint64_t elapsed;
   grub_ssize_t block_size;
   grub_disk_addr_t total_size;
   char *buffer;
-  grub_file_t file;
   grub_uint64_t whole, fraction;
 
   if (argc == 0)
@@ -61,33 +124,26 @@ grub_cmd_testspeed (grub_extcmd_context_t ctxt, int argc, char **args)
   if (buffer == NULL)
     return grub_errno;
 
-  file = grub_file_open (args[0], GRUB_FILE_TYPE_TESTLOAD);
-  if (file == NULL)
-    goto quit;
-
-  total_size = 0;
-  start = grub_get_time_ms ();
-  while (1)
+  if (state[1].set)
     {
-      grub_ssize_t size = grub_file_read (file, buffer, block_size);
-      if (size <= 0)
-	break;
-      total_size += size;
+      test_mp_scaling (args[0], buffer, block_size);
+      goto quit;
     }
-  end = grub_get_time_ms ();
-  grub_file_close (file);
+
+  if (read_file (args[0], buffer, block_size, &total_size, &elapsed))
+    goto quit;
 
   grub_printf_ (N_("File size: %s\n"),
 		grub_get_human_size (total_size, GRUB_HUMAN_SIZE_NORMAL));
-  whole = grub_divmod64 (end - start, 1000, &fraction);
+  whole = grub_divmod64 (elapsed, 1000, &fraction);
   grub_printf_ (N_("Elapsed time: %d.%03d s \n"),
 		(unsigned) whole,
 		(unsigned) fraction);
 
-  if (end != start)
+  if (elapsed)
     {
       grub_uint64_t speed =
-	grub_divmod64 (total_size * 100ULL * 1000ULL, end - start, 0);
+	grub_divmod64 (total_size * 100ULL * 1000ULL, elapsed, 0);
 
       grub_printf_ (N_("Speed: %s \n"),
 		    grub_get_human_size (speed,
@@ -104,7 +160,7 @@ static grub_extcmd_t cmd;
 
 GRUB_MOD_INIT(testspeed)
 {
-  cmd = grub_register_extcmd ("testspeed", grub_cmd_testspeed, 0, N_("[-s SIZE] FILENAME"),
+  cmd = grub_register_extcmd ("testspeed", grub_cmd_testspeed, 0, N_("[-s SIZE] [-m] FILENAME"),
 			      N_("Test file read speed."),
 			      options);
 }
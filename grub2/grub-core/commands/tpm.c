@@ -19,6 +19,7 @@
  */
 
 #include <grub/err.h>
+#include <grub/crypto.h>
 #include <grub/i18n.h>
 #include <grub/misc.h>
 #include <grub/mm.h>
@@ -29,20 +30,95 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/*
+ * When measuring into the CC measurement registers GRUB hashes the file
+ * itself while it streams through the verifier framework and hands only the
+ * final SHA-384 digest to the firmware, which logs and extends that digest.
+ * The register therefore ends up extended with SHA384 (SHA384 (file)),
+ * and an attestation verifier replaying the event log has to do the same.
+ * Without a digest (TPM case) the whole file is passed to the firmware.
+ */
+struct grub_tpm_context
+{
+  const gcry_md_spec_t *hash;
+  void *hash_context;
+  char *description;
+};
+
+static void
+grub_tpm_verify_close (void *context)
+{
+  struct grub_tpm_context *ctxt = context;
+
+  grub_free (ctxt->hash_context);
+  grub_free (ctxt->description);
+  grub_free (ctxt);
+}
+
 static grub_err_t
 grub_tpm_verify_init (grub_file_t io,
 		      enum grub_file_type type __attribute__ ((unused)),
 		      void **context, enum grub_verify_flags *flags)
 {
-  *context = io->name;
-  *flags |= GRUB_VERIFY_FLAGS_SINGLE_CHUNK;
+  struct grub_tpm_context *ctxt;
+  const gcry_md_spec_t *hash = NULL;
+
+  ctxt = grub_zalloc (sizeof (*ctxt));
+  if (!ctxt)
+    return grub_errno;
+
+  ctxt->description = grub_strdup (io->name);
+  if (!ctxt->description)
+    {
+      grub_tpm_verify_close (ctxt);
+      return grub_errno;
+    }
+
+  if (grub_cc_measure_active ())
+    hash = grub_crypto_lookup_md_by_name ("sha384");
+
+  if (hash && hash->mdlen == SHA384_DIGEST_SIZE)
+    {
+      ctxt->hash_context = grub_zalloc (hash->contextsize);
+      if (!ctxt->hash_context)
+	{
+	  grub_tpm_verify_close (ctxt);
+	  return grub_errno;
+	}
+      ctxt->hash = hash;
+      hash->init (ctxt->hash_context);
+    }
+  else
+    *flags |= GRUB_VERIFY_FLAGS_SINGLE_CHUNK;
+
+  *context = ctxt;
   return GRUB_ERR_NONE;
 }
 
 static grub_err_t
 grub_tpm_verify_write (void *context, void *buf, grub_size_t size)
 {
-  return grub_tpm_measure (buf, size, GRUB_BINARY_PCR, context);
+  struct grub_tpm_context *ctxt = context;
+
+  if (!ctxt->hash)
+    return grub_tpm_measure (buf, size, GRUB_BINARY_PCR, ctxt->description);
+
+  ctxt->hash->write (ctxt->hash_context, buf, size);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_tpm_verify_fini (void *context)
+{
+  struct grub_tpm_context *ctxt = context;
+
+  if (!ctxt->hash)
+    return GRUB_ERR_NONE;
+
+  ctxt->hash->final (ctxt->hash_context);
+  return grub_tpm_measure (ctxt->hash->read (ctxt->hash_context),
+			   ctxt->hash->mdlen, GRUB_BINARY_PCR,
+			   ctxt->description);
 }
 
 static grub_err_t
@@ -81,6 +157,8 @@ struct grub_file_verifier grub_tpm_verifier = {
   .name = "tpm",
   .init = grub_tpm_verify_init,
   .write = grub_tpm_verify_write,
+  .fini = grub_tpm_verify_fini,
+  .close = grub_tpm_verify_close,
   .verify_string = grub_tpm_verify_string,
 };
 
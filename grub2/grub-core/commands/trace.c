@@ -0,0 +1,206 @@
+/* trace.c - show the trace counters.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/extcmd.h>
+#include <grub/i18n.h>
+#include <grub/trace.h>
+#ifdef GRUB_MACHINE_EFI
+#include <grub/loader.h>
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define LINE_SIZE	128
+
+static const struct grub_arg_option options[] =
+  {
+    {"reset", 'r', 0, N_("Zero all counters after showing them."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+static void
+format_header (char *line)
+{
+  grub_snprintf (line, LINE_SIZE, "%-24s %10s %14s %12s %12s %8s\n",
+		 "name", "count", "bytes", "total ms", "self ms", "MB/s");
+}
+
+static void
+format_counter (char *line, const struct grub_trace_counter *counter)
+{
+  grub_uint64_t total = grub_trace_ticks_to_us (counter->ticks);
+  grub_uint64_t self = grub_trace_ticks_to_us (counter->self_ticks);
+  grub_uint64_t total_rem, self_rem, rate = 0;
+
+  /* Bytes per microsecond are MB/s; keep one decimal.  */
+  if (total)
+    rate = grub_divmod64 (counter->bytes * 10, total, 0);
+
+  total = grub_divmod64 (total, 1000, &total_rem);
+  self = grub_divmod64 (self, 1000, &self_rem);
+  grub_snprintf (line, LINE_SIZE,
+		 "%-24s %10llu %14llu %8llu.%03u %8llu.%03u %6llu.%u\n",
+		 counter->name, (unsigned long long) counter->count,
+		 (unsigned long long) counter->bytes,
+		 (unsigned long long) total, (unsigned) total_rem,
+		 (unsigned long long) self, (unsigned) self_rem,
+		 (unsigned long long) rate / 10, (unsigned) (rate % 10));
+}
+
+static struct grub_trace_counter *
+find_counter (const char *name)
+{
+  struct grub_trace_counter *counter;
+
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    if (grub_strcmp (counter->name, name) == 0)
+      return counter;
+  return NULL;
+}
+
+/* Format N / FRAMES with one decimal.  */
+static void
+format_ratio (char *buf, grub_size_t size, grub_uint64_t n,
+	      grub_uint64_t frames)
+{
+  grub_uint64_t ratio = grub_divmod64 (n * 10, frames, 0);
+
+  grub_snprintf (buf, size, "%llu.%u", (unsigned long long) ratio / 10,
+		 (unsigned) (ratio % 10));
+}
+
+/* Each refresh of a terminfo terminal counts as a frame; show what one
+   costs on the serial line.  */
+static void
+show_frame_ratios (void)
+{
+  struct grub_trace_counter *frame, *tx, *poll;
+  char bytes[24], txed[24], polls[24];
+
+  frame = find_counter ("terminfo.frame");
+  if (! frame || ! frame->count)
+    return;
+  tx = find_counter ("ns8250.tx");
+  poll = find_counter ("ns8250.poll");
+
+  format_ratio (bytes, sizeof (bytes), frame->bytes, frame->count);
+  format_ratio (txed, sizeof (txed), tx ? tx->count : 0, frame->count);
+  format_ratio (polls, sizeof (polls), poll ? poll->count : 0, frame->count);
+  grub_printf ("per frame: %s bytes, %s UART bytes, %s LSR reads\n",
+	       bytes, txed, polls);
+}
+
+static grub_err_t
+grub_cmd_trace (grub_extcmd_context_t ctxt,
+		int argc __attribute__ ((unused)),
+		char **args __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+  struct grub_trace_counter *counter;
+  char line[LINE_SIZE];
+
+  format_header (line);
+  grub_printf ("%s", line);
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    {
+      if (! counter->count)
+	continue;
+      format_counter (line, counter);
+      grub_printf ("%s", line);
+    }
+  show_frame_ratios ();
+
+  if (state[0].set)
+    grub_trace_reset ();
+
+  return GRUB_ERR_NONE;
+}
+
+#ifdef GRUB_MACHINE_EFI
+static struct grub_preboot *preboot_hnd;
+
+/* Leave the counters in a volatile variable, where the OS finds them as
+   /sys/firmware/efi/efivars/GrubTrace-<GUID> on Linux.  */
+static grub_err_t
+grub_trace_export (int noreturn __attribute__ ((unused)))
+{
+  grub_efi_guid_t guid = GRUB_EFI_GRUB_TRACE_GUID;
+  grub_efi_uint32_t attributes = (GRUB_EFI_VARIABLE_BOOTSERVICE_ACCESS
+				  | GRUB_EFI_VARIABLE_RUNTIME_ACCESS);
+  struct grub_trace_counter *counter;
+  grub_size_t n = 1, len;
+  char *text;
+
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    n++;
+
+  text = grub_malloc (n * LINE_SIZE);
+  if (! text)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_NONE;
+    }
+
+  format_header (text);
+  len = grub_strlen (text);
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    if (counter->count)
+      {
+	format_counter (text + len, counter);
+	len += grub_strlen (text + len);
+      }
+
+  /* Failing to export must not stop the boot.  */
+  if (grub_efi_set_variable_with_attributes ("GrubTrace", &guid, text, len,
+					     attributes))
+    grub_errno = GRUB_ERR_NONE;
+  grub_free (text);
+
+  return GRUB_ERR_NONE;
+}
+#endif
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(trace)
+{
+  cmd = grub_register_extcmd ("trace", grub_cmd_trace, 0, N_("[-r]"),
+			      N_("Show the I/O, decryption and loading"
+				 " counters."),
+			      options);
+#ifdef GRUB_MACHINE_EFI
+  preboot_hnd =
+    grub_loader_register_preboot_hook (grub_trace_export, NULL,
+				       GRUB_LOADER_PREBOOT_HOOK_PRIO_NORMAL);
+#endif
+}
+
+GRUB_MOD_FINI(trace)
+{
+#ifdef GRUB_MACHINE_EFI
+  if (preboot_hnd)
+    grub_loader_unregister_preboot_hook (preboot_hnd);
+#endif
+  grub_unregister_extcmd (cmd);
+}
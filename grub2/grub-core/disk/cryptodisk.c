@@ -26,6 +26,8 @@
 #include <grub/file.h>
 #include <grub/procfs.h>
 #include <grub/partition.h>
+#include <grub/workqueue.h>
+#include <grub/trace.h>
 
 #ifdef GRUB_UTIL
 #include <grub/emu/hostdisk.h>
@@ -223,10 +225,10 @@ lrw_xor (const struct lrw_sector *sec,
 }
 
 static gcry_err_code_t
-grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
-			   grub_uint8_t * data, grub_size_t len,
-			   grub_disk_addr_t sector, grub_size_t log_sector_size,
-			   int do_encrypt)
+grub_cryptodisk_endecrypt_sectors (struct grub_cryptodisk *dev,
+				   grub_uint8_t * data, grub_size_t len,
+				   grub_disk_addr_t sector,
+				   grub_size_t log_sector_size, int do_encrypt)
 {
   grub_size_t i;
   gcry_err_code_t err;
@@ -411,6 +413,88 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
   return GPG_ERR_NO_ERROR;
 }
 
+/*
+ * Bytes handed to one processor at a time.  Sectors are independent in every
+ * mode with an IV, so larger requests are split and spread over the APs.
+ */
+#define GRUB_CRYPTODISK_WORK_SIZE (64 * 1024)
+
+struct grub_cryptodisk_work
+{
+  struct grub_cryptodisk *dev;
+  grub_uint8_t *data;
+  grub_size_t len;
+  grub_disk_addr_t sector;
+  grub_size_t log_sector_size;
+  int do_encrypt;
+  gcry_err_code_t err;
+};
+
+static void
+grub_cryptodisk_endecrypt_work (void *data, grub_size_t item)
+{
+  struct grub_cryptodisk_work *work = data;
+  grub_size_t offset, len;
+  gcry_err_code_t err;
+
+  /* Item 0 was already done by the caller. */
+  offset = (item + 1) * GRUB_CRYPTODISK_WORK_SIZE;
+  len = work->len - offset;
+  if (len > GRUB_CRYPTODISK_WORK_SIZE)
+    len = GRUB_CRYPTODISK_WORK_SIZE;
+
+  err = grub_cryptodisk_endecrypt_sectors (work->dev, work->data + offset, len,
+					   work->sector
+					   + (offset >> work->log_sector_size),
+					   work->log_sector_size,
+					   work->do_encrypt);
+  if (err)
+    work->err = err;
+}
+
+static gcry_err_code_t
+grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
+			   grub_uint8_t * data, grub_size_t len,
+			   grub_disk_addr_t sector, grub_size_t log_sector_size,
+			   int do_encrypt)
+{
+  struct grub_cryptodisk_work work;
+  grub_size_t nitems;
+
+  /*
+   * Rekeying changes the cipher state as the zone changes and the hashed
+   * IV mode allocates memory per sector, so those stay on the BSP.
+   */
+  if (len <= GRUB_CRYPTODISK_WORK_SIZE || dev->rekey
+      || dev->mode_iv == GRUB_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH
+      || grub_workqueue_get_aps () == 0)
+    return grub_cryptodisk_endecrypt_sectors (dev, data, len, sector,
+					      log_sector_size, do_encrypt);
+
+  /*
+   * Do the first chunk here: ciphers such as AES build their decryption key
+   * schedule lazily on first use, which must not race between processors.
+   */
+  work.err = grub_cryptodisk_endecrypt_sectors (dev, data,
+						GRUB_CRYPTODISK_WORK_SIZE,
+						sector, log_sector_size,
+						do_encrypt);
+  if (work.err)
+    return work.err;
+
+  work.dev = dev;
+  work.data = data;
+  work.len = len;
+  work.sector = sector;
+  work.log_sector_size = log_sector_size;
+  work.do_encrypt = do_encrypt;
+
+  nitems = ALIGN_UP (len, GRUB_CRYPTODISK_WORK_SIZE) / GRUB_CRYPTODISK_WORK_SIZE;
+  grub_workqueue_run (grub_cryptodisk_endecrypt_work, &work, nitems - 1);
+
+  return work.err;
+}
+
 gcry_err_code_t
 grub_cryptodisk_decrypt (struct grub_cryptodisk *dev,
 			 grub_uint8_t * data, grub_size_t len,
@@ -419,6 +503,66 @@ grub_cryptodisk_decrypt (struct grub_cryptodisk *dev,
   return grub_cryptodisk_endecrypt (dev, data, len, sector, log_sector_size, 0);
 }
 
+struct grub_cryptodisk_kdf_batch
+{
+  struct grub_cryptodisk_kdf *jobs;
+  volatile int cancel;
+};
+
+static void
+grub_cryptodisk_kdf_work (void *data, grub_size_t item)
+{
+  struct grub_cryptodisk_kdf_batch *batch = data;
+  struct grub_cryptodisk_kdf *job = &batch->jobs[item];
+
+  if (!job->hash)
+    return;
+
+  job->err = grub_crypto_pbkdf2_cancellable (job->hash, job->password,
+					     job->password_len, job->salt,
+					     job->salt_len, job->iterations,
+					     job->out, job->out_len,
+					     &batch->cancel);
+  if (job->err == GPG_ERR_NO_ERROR && job->expect
+      && grub_crypto_memcmp (job->out, job->expect, job->out_len) == 0)
+    {
+      job->matched = 1;
+      batch->cancel = 1;
+    }
+}
+
+grub_size_t
+grub_cryptodisk_kdf_width (void)
+{
+  return grub_workqueue_get_aps () + 1;
+}
+
+void
+grub_cryptodisk_kdf_run (struct grub_cryptodisk_kdf *jobs, grub_size_t njobs)
+{
+  static struct grub_trace_counter *trace;
+  struct grub_cryptodisk_kdf_batch batch;
+  struct grub_trace_span span;
+  grub_size_t i;
+
+  for (i = 0; i < njobs; i++)
+    {
+      jobs[i].matched = 0;
+      jobs[i].err = GPG_ERR_NO_ERROR;
+    }
+
+  batch.jobs = jobs;
+  batch.cancel = 0;
+
+  /*
+   * Each keyslot is a separate derivation, so they run side by side rather
+   * than one after another.
+   */
+  grub_trace_begin (&span, grub_trace_lookup (&trace, "cryptodisk", "kdf"));
+  grub_workqueue_run (grub_cryptodisk_kdf_work, &batch, njobs);
+  grub_trace_end (&span, 0);
+}
+
 grub_err_t
 grub_cryptodisk_setcipher (grub_cryptodisk_t crypt, const char *ciphername, const char *ciphermode)
 {
@@ -746,11 +890,14 @@ grub_cryptodisk_close (grub_disk_t disk)
   dev->source_disk = NULL;
 }
 
+static struct grub_trace_counter *trace_decrypt;
+
 static grub_err_t
 grub_cryptodisk_read (grub_disk_t disk, grub_disk_addr_t sector,
 		      grub_size_t size, char *buf)
 {
   grub_cryptodisk_t dev = (grub_cryptodisk_t) disk->data;
+  struct grub_trace_span span;
   grub_err_t err;
   gcry_err_code_t gcry_err;
 
@@ -783,9 +930,12 @@ grub_cryptodisk_read (grub_disk_t disk, grub_disk_addr_t sector,
       grub_dprintf ("cryptodisk", "grub_disk_read failed with error %d\n", err);
       return err;
     }
+  grub_trace_begin (&span, grub_trace_lookup (&trace_decrypt, "cryptodisk",
+					      "decrypt"));
   gcry_err = grub_cryptodisk_endecrypt (dev, (grub_uint8_t *) buf,
 					size << disk->log_sector_size,
 					sector, dev->log_sector_size, 0);
+  grub_trace_end (&span, size << disk->log_sector_size);
   return grub_crypto_gcry_error (gcry_err);
 }
 
@@ -1018,6 +1168,8 @@ os_password_get(char buf[], unsigned len)
 static grub_err_t
 grub_cryptodisk_scan_device_real (const char *name, grub_disk_t source)
 {
+  static struct grub_trace_counter *trace;
+  struct grub_trace_span span;
   grub_err_t err;
   grub_cryptodisk_t dev;
   grub_cryptodisk_dev_t cr;
@@ -1035,6 +1187,9 @@ grub_cryptodisk_scan_device_real (const char *name, grub_disk_t source)
     if (!dev)
       continue;
 
+    /* Includes the time waiting for a typed passphrase.  */
+    grub_trace_begin (&span, grub_trace_lookup (&trace, "cryptodisk",
+						 "unlock"));
     if (os_passwd)
       {
        err = cr->recover_key (source, dev, os_password_get);
@@ -1044,6 +1199,7 @@ grub_cryptodisk_scan_device_real (const char *name, grub_disk_t source)
       }
     else
       err = cr->recover_key (source, dev, grub_password_get);
+    grub_trace_end (&span, 0);
 
     if (err)
     {
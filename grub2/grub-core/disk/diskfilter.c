@@ -24,6 +24,7 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/partition.h>
+#include <grub/trace.h>
 #ifdef GRUB_UTIL
 #include <grub/i18n.h>
 #include <grub/util/misc.h>
@@ -56,6 +57,25 @@ static struct grub_detached_pv *detached_pv_list;
 
 #define FOR_DETACHED_PVS(var) for (var = detached_pv_list; var; var = var->next)
 
+#define MAX_PROBED 8
+
+/* A disk or partition that was probed and isn't part of any array.  It
+   isn't read again unless a new diskfilter driver shows up.  */
+struct grub_diskfilter_probed {
+  struct grub_diskfilter_probed *next;
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  grub_uint64_t sectors;
+  /* Drivers which found nothing on it.  */
+  grub_diskfilter_t drivers[MAX_PROBED];
+  unsigned ndrivers;
+  /* Disk reads the probes took.  */
+  grub_uint64_t reads;
+};
+
+static struct grub_diskfilter_probed *probed_list;
+
 static grub_err_t
 is_node_readable (const struct grub_diskfilter_node *node, int easily)
 {
@@ -134,6 +154,72 @@ is_valid_diskfilter_name (const char *name)
 	  || grub_memcmp (name, "ldm/", sizeof ("ldm/") - 1) == 0);
 }
 
+static grub_uint64_t
+count_disk_reads (void)
+{
+  static struct grub_trace_counter *trace_hits, *trace_misses;
+  struct grub_trace_counter *c;
+  grub_uint64_t reads = 0;
+
+  c = grub_trace_lookup (&trace_hits, "disk.cache", "hit");
+  if (c)
+    reads += c->count;
+  c = grub_trace_lookup (&trace_misses, "disk.cache", "miss");
+  if (c)
+    reads += c->count;
+  return reads;
+}
+
+static struct grub_diskfilter_probed *
+get_probed (grub_disk_t disk)
+{
+  struct grub_diskfilter_probed *probed;
+
+  for (probed = probed_list; probed; probed = probed->next)
+    if (probed->dev_id == disk->dev->id && probed->disk_id == disk->id
+	&& probed->start == grub_partition_get_start (disk->partition)
+	&& probed->sectors == grub_disk_native_sectors (disk))
+      return probed;
+
+  probed = grub_zalloc (sizeof (*probed));
+  if (!probed)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  probed->dev_id = disk->dev->id;
+  probed->disk_id = disk->id;
+  probed->start = grub_partition_get_start (disk->partition);
+  probed->sectors = grub_disk_native_sectors (disk);
+  probed->next = probed_list;
+  probed_list = probed;
+  return probed;
+}
+
+static int
+was_probed (struct grub_diskfilter_probed *probed, grub_diskfilter_t diskfilter)
+{
+  unsigned i;
+
+  for (i = 0; i < probed->ndrivers; i++)
+    if (probed->drivers[i] == diskfilter)
+      return 1;
+  return 0;
+}
+
+static void
+free_probed (void)
+{
+  struct grub_diskfilter_probed *probed;
+
+  while (probed_list)
+    {
+      probed = probed_list;
+      probed_list = probed->next;
+      grub_free (probed);
+    }
+}
+
 /* Helper for scan_disk.  */
 static int
 scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
@@ -144,12 +230,9 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
   struct grub_diskfilter_pv_id id;
   grub_diskfilter_t diskfilter;
   struct grub_detached_pv *pv;
-
-  grub_dprintf ("diskfilter", "Scanning for DISKFILTER devices on disk %s\n",
-		name);
-#ifdef GRUB_UTIL
-  grub_util_info ("Scanning for DISKFILTER devices on disk %s", name);
-#endif
+  struct grub_diskfilter_probed *probed;
+  grub_uint64_t reads;
+  static struct grub_trace_counter *trace_probe, *trace_saved;
 
   disk->partition = p;
   
@@ -164,8 +247,33 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
 	  return 0;
     }
 
+  /* Skip what was already probed by every driver.  */
+  probed = get_probed (disk);
+  if (probed)
+    {
+      for (diskfilter = grub_diskfilter_list; diskfilter;
+	   diskfilter = diskfilter->next)
+	if (!was_probed (probed, diskfilter))
+	  break;
+      if (!diskfilter)
+	{
+	  grub_trace_count (grub_trace_lookup (&trace_saved, "diskfilter",
+					       "saved"), probed->reads);
+	  return 0;
+	}
+    }
+
+  grub_dprintf ("diskfilter", "Scanning for DISKFILTER devices on disk %s\n",
+		name);
+#ifdef GRUB_UTIL
+  grub_util_info ("Scanning for DISKFILTER devices on disk %s", name);
+#endif
+
+  reads = count_disk_reads ();
   for (diskfilter = grub_diskfilter_list; diskfilter; diskfilter = diskfilter->next)
     {
+      if (probed && was_probed (probed, diskfilter))
+	continue;
 #ifdef GRUB_UTIL
       grub_util_info ("Scanning for %s devices on disk %s", 
 		      diskfilter->name, name);
@@ -178,7 +286,7 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
 	{
 	  if (id.uuidlen)
 	    grub_free (id.uuid);
-	  return 0;
+	  goto done;
 	}
       /*insert the special LVM PV into detached_pv_list*/
       if (!arr && (id.uuidlen > 0) && (grub_strcmp(diskfilter->name, "lvm") == 0))
@@ -205,6 +313,12 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
       if (arr && id.uuidlen)
 	grub_free (id.uuid);
 
+      /* Only remember definite answers, not e.g. read errors.  */
+      if (probed && probed->ndrivers < MAX_PROBED
+	  && (grub_errno == GRUB_ERR_NONE
+	      || grub_errno == GRUB_ERR_OUT_OF_RANGE))
+	probed->drivers[probed->ndrivers++] = diskfilter;
+
       /* This error usually means it's not diskfilter, no need to display
 	 it.  */
       if (grub_errno != GRUB_ERR_OUT_OF_RANGE)
@@ -213,6 +327,12 @@ scan_disk_partition_iter (grub_disk_t disk, grub_partition_t p, void *data)
       grub_errno = GRUB_ERR_NONE;
     }
 
+ done:
+  reads = count_disk_reads () - reads;
+  if (probed)
+    probed->reads += reads;
+  grub_trace_count (grub_trace_lookup (&trace_probe, "diskfilter", "probe"),
+		    reads);
   return 0;
 fail_id:
   if (pv->id.uuidlen)
@@ -1488,4 +1608,5 @@ GRUB_MOD_FINI(diskfilter)
 {
   grub_disk_dev_unregister (&grub_diskfilter_dev);
   free_array ();
+  free_probed ();
 }
@@ -159,8 +159,17 @@ luks_recover_key (grub_disk_t source,
   grub_size_t keysize;
   grub_uint8_t *split_key = NULL;
   char passphrase[MAX_PASSPHRASE] = "";
-  grub_uint8_t candidate_digest[sizeof (header.mkDigest)];
-  unsigned i;
+  struct grub_cryptodisk_kdf slot_kdf[ARRAY_SIZE (header.keyblock)];
+  struct grub_cryptodisk_kdf digest_kdf[ARRAY_SIZE (header.keyblock)];
+  grub_uint8_t slot_key[ARRAY_SIZE (header.keyblock)]
+		       [GRUB_CRYPTODISK_MAX_KEYLEN];
+  grub_uint8_t candidate_key[ARRAY_SIZE (header.keyblock)]
+			    [GRUB_CRYPTODISK_MAX_KEYLEN];
+  grub_uint8_t candidate_digest[ARRAY_SIZE (header.keyblock)]
+			       [sizeof (header.mkDigest)];
+  unsigned slots[ARRAY_SIZE (header.keyblock)];
+  unsigned i, j, nslots, first, n;
+  grub_size_t width;
   grub_size_t length;
   grub_err_t err;
   grub_size_t max_stripes = 1;
@@ -199,114 +208,146 @@ luks_recover_key (grub_disk_t source,
       return grub_error (GRUB_ERR_BAD_ARGUMENT, "Passphrase not supplied");
     }
 
-  /* Try to recover master key from each active keyslot.  */
+  nslots = 0;
   for (i = 0; i < ARRAY_SIZE (header.keyblock); i++)
+    if (grub_be_to_cpu32 (header.keyblock[i].active) == LUKS_KEY_ENABLED)
+      slots[nslots++] = i;
+
+  /*
+   * Derive the keys of as many keyslots at once as there are processors,
+   * and stop at the first batch holding the right one.  With a single
+   * processor this tries one keyslot after another.
+   */
+  width = grub_cryptodisk_kdf_width ();
+  for (first = 0; first < nslots; first += n)
     {
-      gcry_err_code_t gcry_err;
-      grub_uint8_t candidate_key[GRUB_CRYPTODISK_MAX_KEYLEN];
-      grub_uint8_t digest[GRUB_CRYPTODISK_MAX_KEYLEN];
-
-      /* Check if keyslot is enabled.  */
-      if (grub_be_to_cpu32 (header.keyblock[i].active) != LUKS_KEY_ENABLED)
-	continue;
-
-      grub_dprintf ("luks", "Trying keyslot %d\n", i);
-
-      /* Calculate the PBKDF2 of the user supplied passphrase.  */
-      gcry_err = grub_crypto_pbkdf2 (dev->hash, (grub_uint8_t *) passphrase,
-				     grub_strlen (passphrase),
-				     header.keyblock[i].passwordSalt,
-				     sizeof (header.keyblock[i].passwordSalt),
-				     grub_be_to_cpu32 (header.keyblock[i].
-						       passwordIterations),
-				     digest, keysize);
-
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
+      n = nslots - first;
+      if (n > width)
+	n = width;
 
-      grub_dprintf ("luks", "PBKDF2 done\n");
-
-      gcry_err = grub_cryptodisk_setkey (dev, digest, keysize); 
-      if (gcry_err)
+      for (j = 0; j < n; j++)
 	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
+	  struct grub_cryptodisk_kdf *kdf = &slot_kdf[j];
+
+	  i = slots[first + j];
+	  grub_dprintf ("luks", "Trying keyslot %d\n", i);
+
+	  kdf->hash = dev->hash;
+	  kdf->password = (grub_uint8_t *) passphrase;
+	  kdf->password_len = grub_strlen (passphrase);
+	  kdf->salt = header.keyblock[i].passwordSalt;
+	  kdf->salt_len = sizeof (header.keyblock[i].passwordSalt);
+	  kdf->iterations = grub_be_to_cpu32 (header.keyblock[i].
+					      passwordIterations);
+	  kdf->out = slot_key[j];
+	  kdf->out_len = keysize;
+	  kdf->expect = NULL;
 	}
 
-      length = (keysize * grub_be_to_cpu32 (header.keyblock[i].stripes));
+      grub_cryptodisk_kdf_run (slot_kdf, n);
 
-      /* Read and decrypt the key material from the disk.  */
-      err = grub_disk_read (source,
-			    grub_be_to_cpu32 (header.keyblock
-					      [i].keyMaterialOffset), 0,
-			    length, split_key);
-      if (err)
+      /* Merge the key material of each keyslot into a candidate master
+	 key.  */
+      for (j = 0; j < n; j++)
 	{
-	  grub_free (split_key);
-	  return err;
+	  struct grub_cryptodisk_kdf *kdf = &digest_kdf[j];
+	  gcry_err_code_t gcry_err;
+
+	  i = slots[first + j];
+	  if (slot_kdf[j].err)
+	    {
+	      grub_free (split_key);
+	      return grub_crypto_gcry_error (slot_kdf[j].err);
+	    }
+
+	  grub_dprintf ("luks", "PBKDF2 done for keyslot %d\n", i);
+
+	  gcry_err = grub_cryptodisk_setkey (dev, slot_key[j], keysize);
+	  if (gcry_err)
+	    {
+	      grub_free (split_key);
+	      return grub_crypto_gcry_error (gcry_err);
+	    }
+
+	  length = (keysize * grub_be_to_cpu32 (header.keyblock[i].stripes));
+
+	  /* Read and decrypt the key material from the disk.  */
+	  err = grub_disk_read (source,
+				grub_be_to_cpu32 (header.keyblock
+						  [i].keyMaterialOffset), 0,
+				length, split_key);
+	  if (err)
+	    {
+	      grub_free (split_key);
+	      return err;
+	    }
+
+	  gcry_err = grub_cryptodisk_decrypt (dev, split_key, length, 0,
+					      GRUB_LUKS1_LOG_SECTOR_SIZE);
+	  if (gcry_err)
+	    {
+	      grub_free (split_key);
+	      return grub_crypto_gcry_error (gcry_err);
+	    }
+
+	  /* Merge the decrypted key material to get the candidate master
+	     key.  */
+	  gcry_err = AF_merge (dev->hash, split_key, candidate_key[j], keysize,
+			       grub_be_to_cpu32 (header.keyblock[i].stripes));
+	  if (gcry_err)
+	    {
+	      grub_free (split_key);
+	      return grub_crypto_gcry_error (gcry_err);
+	    }
+
+	  grub_dprintf ("luks", "candidate key recovered\n");
+
+	  /* Calculate the PBKDF2 of the candidate master key and compare it
+	     to the digest stored in the header.  */
+	  kdf->hash = dev->hash;
+	  kdf->password = candidate_key[j];
+	  kdf->password_len = grub_be_to_cpu32 (header.keyBytes);
+	  kdf->salt = header.mkDigestSalt;
+	  kdf->salt_len = sizeof (header.mkDigestSalt);
+	  kdf->iterations = grub_be_to_cpu32 (header.mkDigestIterations);
+	  kdf->out = candidate_digest[j];
+	  kdf->out_len = sizeof (candidate_digest[j]);
+	  kdf->expect = header.mkDigest;
 	}
 
-      gcry_err = grub_cryptodisk_decrypt (dev, split_key, length, 0,
-					  GRUB_LUKS1_LOG_SECTOR_SIZE);
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
+      /* The first keyslot found to match cancels the checks of the
+	 others.  */
+      grub_cryptodisk_kdf_run (digest_kdf, n);
 
-      /* Merge the decrypted key material to get the candidate master key.  */
-      gcry_err = AF_merge (dev->hash, split_key, candidate_key, keysize,
-			   grub_be_to_cpu32 (header.keyblock[i].stripes));
-      if (gcry_err)
+      for (j = 0; j < n; j++)
 	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
+	  gcry_err_code_t gcry_err;
+
+	  if (!digest_kdf[j].matched)
+	    continue;
 
-      grub_dprintf ("luks", "candidate key recovered\n");
-
-      /* Calculate the PBKDF2 of the candidate master key.  */
-      gcry_err = grub_crypto_pbkdf2 (dev->hash, candidate_key,
-				     grub_be_to_cpu32 (header.keyBytes),
-				     header.mkDigestSalt,
-				     sizeof (header.mkDigestSalt),
-				     grub_be_to_cpu32
-				     (header.mkDigestIterations),
-				     candidate_digest,
-				     sizeof (candidate_digest));
-      if (gcry_err)
-	{
 	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
 
-      /* Compare the calculated PBKDF2 to the digest stored
-         in the header to see if it's correct.  */
-      if (grub_memcmp (candidate_digest, header.mkDigest,
-		       sizeof (header.mkDigest)) != 0)
-	{
-	  grub_dprintf ("luks", "bad digest\n");
-	  continue;
-	}
+	  /* TRANSLATORS: It's a cryptographic key slot: one element of an
+	     array where each element is either empty or holds a key.  */
+	  grub_printf_ (N_("Slot %d opened\n"), slots[first + j]);
 
-      /* TRANSLATORS: It's a cryptographic key slot: one element of an array
-	 where each element is either empty or holds a key.  */
-      grub_printf_ (N_("Slot %d opened\n"), i);
+	  /* Set the master key.  */
+	  gcry_err = grub_cryptodisk_setkey (dev, candidate_key[j], keysize);
+	  if (gcry_err)
+	    return grub_crypto_gcry_error (gcry_err);
 
-      /* Set the master key.  */
-      gcry_err = grub_cryptodisk_setkey (dev, candidate_key, keysize); 
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
+	  return GRUB_ERR_NONE;
 	}
 
-      grub_free (split_key);
+      for (j = 0; j < n; j++)
+	if (digest_kdf[j].err && digest_kdf[j].err != GPG_ERR_CANCELED)
+	  {
+	    grub_free (split_key);
+	    return grub_crypto_gcry_error (digest_kdf[j].err);
+	  }
 
-      return GRUB_ERR_NONE;
+      grub_dprintf ("luks", "bad digest\n");
     }
 
   grub_free (split_key);
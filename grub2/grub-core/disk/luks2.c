@@ -419,57 +419,65 @@ luks2_verify_key (grub_luks2_digest_t *d, grub_uint8_t *candidate_key,
   return GRUB_ERR_NONE;
 }
 
+/* The area key of a keyslot, derived before the keyslot is tried.  */
+struct luks2_area_key
+{
+  grub_uint8_t salt[GRUB_CRYPTODISK_MAX_KEYLEN];
+  grub_uint8_t key[GRUB_CRYPTODISK_MAX_KEYLEN];
+};
+
 static grub_err_t
-luks2_decrypt_key (grub_uint8_t *out_key,
-		   grub_disk_t source, grub_cryptodisk_t crypt,
-		   grub_luks2_keyslot_t *k,
+luks2_prepare_kdf (struct grub_cryptodisk_kdf *kdf,
+		   struct luks2_area_key *area_key, grub_luks2_keyslot_t *k,
 		   const grub_uint8_t *passphrase, grub_size_t passphraselen)
 {
-  grub_uint8_t area_key[GRUB_CRYPTODISK_MAX_KEYLEN];
-  grub_uint8_t salt[GRUB_CRYPTODISK_MAX_KEYLEN];
-  grub_uint8_t *split_key = NULL;
-  grub_size_t saltlen = sizeof (salt);
-  char cipher[32], *p;
-  const gcry_md_spec_t *hash;
-  gcry_err_code_t gcry_ret;
-  grub_err_t ret;
+  grub_size_t saltlen = sizeof (area_key->salt);
+  const gcry_md_spec_t *hash = NULL;
 
   if (!base64_decode (k->kdf.salt, grub_strlen (k->kdf.salt),
-		     (char *)salt, &saltlen))
-    {
-      ret = grub_error (GRUB_ERR_BAD_ARGUMENT, "Invalid keyslot salt");
-      goto err;
-    }
+		     (char *) area_key->salt, &saltlen))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "Invalid keyslot salt");
+
+  if (k->area.key_size <= 0 || k->area.key_size > GRUB_CRYPTODISK_MAX_KEYLEN)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "Invalid area key size");
 
   /* Calculate the binary area key of the user supplied passphrase. */
   switch (k->kdf.type)
     {
       case LUKS2_KDF_TYPE_ARGON2I:
-	ret = grub_error (GRUB_ERR_BAD_ARGUMENT, "Argon2 not supported");
-	goto err;
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "Argon2 not supported");
       case LUKS2_KDF_TYPE_PBKDF2:
 	hash = grub_crypto_lookup_md_by_name (k->kdf.u.pbkdf2.hash);
 	if (!hash)
-	  {
-	    ret = grub_error (GRUB_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
-			      k->kdf.u.pbkdf2.hash);
-	    goto err;
-	  }
-
-	gcry_ret = grub_crypto_pbkdf2 (hash, (grub_uint8_t *) passphrase,
-				       passphraselen,
-				       salt, saltlen,
-				       k->kdf.u.pbkdf2.iterations,
-				       area_key, k->area.key_size);
-	if (gcry_ret)
-	  {
-	    ret = grub_crypto_gcry_error (gcry_ret);
-	    goto err;
-	  }
-
+	  return grub_error (GRUB_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+			     k->kdf.u.pbkdf2.hash);
 	break;
     }
 
+  kdf->hash = hash;
+  kdf->password = passphrase;
+  kdf->password_len = passphraselen;
+  kdf->salt = area_key->salt;
+  kdf->salt_len = saltlen;
+  kdf->iterations = k->kdf.u.pbkdf2.iterations;
+  kdf->out = area_key->key;
+  kdf->out_len = k->area.key_size;
+  kdf->expect = NULL;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+luks2_decrypt_key (grub_uint8_t *out_key,
+		   grub_disk_t source, grub_cryptodisk_t crypt,
+		   grub_luks2_keyslot_t *k, grub_uint8_t *area_key)
+{
+  grub_uint8_t *split_key = NULL;
+  char cipher[32], *p;
+  const gcry_md_spec_t *hash;
+  gcry_err_code_t gcry_ret;
+  grub_err_t ret;
+
   /* Set up disk encryption parameters for the key area */
   grub_strncpy (cipher, k->area.encryption, sizeof (cipher));
   p = grub_memchr (cipher, '-', grub_strlen (cipher));
@@ -548,11 +556,14 @@ luks2_recover_key (grub_disk_t source,
   grub_uint8_t candidate_key[GRUB_CRYPTODISK_MAX_KEYLEN];
   char passphrase[MAX_PASSPHRASE], cipher[32];
   char *json_header = NULL, *part = NULL, *ptr;
-  grub_size_t candidate_key_len = 0, json_idx, size;
+  grub_size_t candidate_key_len = 0, json_idx, size = 0;
+  grub_size_t derived, width;
   grub_luks2_header_t header;
   grub_luks2_keyslot_t keyslot;
   grub_luks2_digest_t digest;
   grub_luks2_segment_t segment;
+  struct grub_cryptodisk_kdf *kdf = NULL;
+  struct luks2_area_key *area_keys = NULL;
   gcry_err_code_t gcry_ret;
   grub_json_t *json = NULL, keyslots;
   grub_err_t ret;
@@ -611,6 +622,42 @@ luks2_recover_key (grub_disk_t source,
       goto err;
     }
 
+  kdf = grub_calloc (size, sizeof (*kdf));
+  area_keys = grub_calloc (size, sizeof (*area_keys));
+  if (!kdf || !area_keys)
+    {
+      ret = grub_errno;
+      goto err;
+    }
+
+  /*
+   * Prepare the area key derivations of all keyslots; they are run in
+   * batches as the keyslots are tried in order below. Errors are reported
+   * again there.
+   */
+  for (json_idx = 0; json_idx < size; json_idx++)
+    {
+      if (luks2_get_keyslot (&keyslot, &digest, &segment, json, json_idx)
+	  || keyslot.priority == 0)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  continue;
+	}
+
+      if (luks2_prepare_kdf (&kdf[json_idx], &area_keys[json_idx], &keyslot,
+			     (const grub_uint8_t *) passphrase,
+			     grub_strlen (passphrase)))
+	{
+	  grub_dprintf ("luks2", "Can't derive the key of keyslot \"%" PRIuGRUB_UINT64_T "\": %s\n",
+			keyslot.idx, grub_errmsg);
+	  kdf[json_idx].hash = NULL;
+	  grub_errno = GRUB_ERR_NONE;
+	}
+    }
+
+  width = grub_cryptodisk_kdf_width ();
+  derived = 0;
+
   /* Try all keyslot */
   for (json_idx = 0; json_idx < size; json_idx++)
     {
@@ -718,8 +765,30 @@ luks2_recover_key (grub_disk_t source,
 	  crypt->total_sectors = max_crypt_sectors - crypt->offset_sectors;
 	}
 
+      /*
+       * Derive the area keys of as many of the following keyslots as there
+       * are processors, so that none is derived past the batch holding the
+       * right one. With a single processor this derives one at a time.
+       */
+      if (json_idx >= derived)
+	{
+	  grub_size_t n = 0;
+
+	  for (derived = json_idx; derived < size && n < width; derived++)
+	    if (kdf[derived].hash)
+	      n++;
+	  grub_cryptodisk_kdf_run (kdf + json_idx, derived - json_idx);
+	}
+
+      if (!kdf[json_idx].hash || kdf[json_idx].err)
+	{
+	  grub_dprintf ("luks2", "No key for keyslot \"%" PRIuGRUB_UINT64_T "\", skipping\n",
+			keyslot.idx);
+	  continue;
+	}
+
       ret = luks2_decrypt_key (candidate_key, source, crypt, &keyslot,
-			       (const grub_uint8_t *) passphrase, grub_strlen (passphrase));
+			       area_keys[json_idx].key);
       if (ret)
 	{
 	  grub_dprintf ("luks2", "Decryption with keyslot \"%" PRIuGRUB_UINT64_T "\" failed: %s\n",
@@ -771,6 +840,10 @@ luks2_recover_key (grub_disk_t source,
     }
 
  err:
+  if (area_keys)
+    grub_memset (area_keys, 0, size * sizeof (*area_keys));
+  grub_free (area_keys);
+  grub_free (kdf);
   grub_free (part);
   grub_free (json_header);
   grub_json_free (json);
@@ -23,7 +23,7 @@
 #include <grub/err.h>
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
-#include <grub/crypto.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -57,7 +57,7 @@ grub_raid5_recover (struct grub_diskfilter_segment *array, int disknr,
           return err;
         }
 
-      grub_crypto_xor (buf, buf, buf2, size);
+      grub_gf256_add_block (buf, buf2, size);
     }
 
   grub_free (buf2);
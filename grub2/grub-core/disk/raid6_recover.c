@@ -23,46 +23,10 @@
 #include <grub/err.h>
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
-#include <grub/crypto.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
-/* x**y.  */
-static grub_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static unsigned powx_inv[256];
-static const grub_uint8_t poly = 0x1d;
-
-static void
-grub_raid_block_mulx (unsigned mul, char *buf, grub_size_t size)
-{
-  grub_size_t i;
-  grub_uint8_t *p;
-
-  p = (grub_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
-}
-
-static void
-grub_raid6_init_table (void)
-{
-  unsigned i;
-
-  grub_uint8_t cur = 1;
-  for (i = 0; i < 255; i++)
-    {
-      powx[i] = cur;
-      powx[i + 255] = cur;
-      powx_inv[cur] = i;
-      if (cur & 0x80)
-	cur = (cur << 1) ^ poly;
-      else
-	cur <<= 1;
-    }
-}
-
 static unsigned
 mod_255 (unsigned x)
 {
@@ -123,9 +87,8 @@ grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr, int p,
         {
 	  if (!read_func (data, pos, sector, buf, size))
             {
-              grub_crypto_xor (pbuf, pbuf, buf, size);
-              grub_raid_block_mulx (c, buf, size);
-              grub_crypto_xor (qbuf, qbuf, buf, size);
+              grub_gf256_add_block (pbuf, buf, size);
+              grub_gf256_muladd_block (qbuf, buf, grub_gf256_exp (c), size);
             }
           else
             {
@@ -152,7 +115,7 @@ grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr, int p,
       /* One bad device */
       if (!read_func (data, p, sector, buf, size))
         {
-          grub_crypto_xor (buf, buf, pbuf, size);
+          grub_gf256_add_block (buf, pbuf, size);
           goto quit;
         }
 
@@ -160,9 +123,8 @@ grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr, int p,
       if (read_func (data, q, sector, buf, size))
         goto quit;
 
-      grub_crypto_xor (buf, buf, qbuf, size);
-      grub_raid_block_mulx (255 - bad1, buf,
-                           size);
+      grub_gf256_add_block (buf, qbuf, size);
+      grub_gf256_mul_block (buf, buf, grub_gf256_exp (255 - bad1), size);
     }
   else
     {
@@ -172,22 +134,21 @@ grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr, int p,
       if (read_func (data, p, sector, buf, size))
         goto quit;
 
-      grub_crypto_xor (pbuf, pbuf, buf, size);
+      grub_gf256_add_block (pbuf, buf, size);
 
       if (read_func (data, q, sector, buf, size))
         goto quit;
 
-      grub_crypto_xor (qbuf, qbuf, buf, size);
+      grub_gf256_add_block (qbuf, buf, size);
 
       c = mod_255((255 ^ bad1)
-		  + (255 ^ powx_inv[(powx[bad2 + (bad1 ^ 255)] ^ 1)]));
-      grub_raid_block_mulx (c, qbuf, size);
+		  + (255 ^ grub_gf256_log (grub_gf256_exp (bad2 + (bad1 ^ 255))
+					   ^ 1)));
+      grub_gf256_mul_block (qbuf, qbuf, grub_gf256_exp (c), size);
 
       c = mod_255((unsigned) bad2 + c);
-      grub_raid_block_mulx (c, pbuf, size);
-
-      grub_crypto_xor (pbuf, pbuf, qbuf, size);
-      grub_memcpy (buf, pbuf, size);
+      grub_gf256_mul_block (buf, pbuf, grub_gf256_exp (c), size);
+      grub_gf256_add_block (buf, qbuf, size);
     }
 
 quit:
@@ -208,7 +169,6 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
 
 GRUB_MOD_INIT(raid6rec)
 {
-  grub_raid6_init_table ();
   grub_raid6_recover_func = grub_raid6_recover;
 }
 
@@ -52,6 +52,21 @@ struct char_index_entry
   struct grub_font_glyph *glyph;
 };
 
+/* Glyph data as stored in the DATA section, followed by the bitmap.  */
+struct glyph_header
+{
+  grub_uint16_t width;
+  grub_uint16_t height;
+  grub_int16_t offset_x;
+  grub_int16_t offset_y;
+  grub_int16_t device_width;
+} GRUB_PACKED;
+
+/* Fonts with no more glyph data than this have all of it read at load
+   time and unpacked into one glyph atlas, after which the file is closed.
+   Larger fonts, such as unicode.pf2, load glyphs on demand.  */
+#define FONT_ATLAS_MAX_SIZE 0x100000
+
 #define FONT_WEIGHT_NORMAL 100
 #define FONT_WEIGHT_BOLD 200
 #define ASCII_BITMAP_SIZE 16
@@ -207,6 +222,7 @@ font_init (grub_font_t font)
   font->num_chars = 0;
   font->char_index = 0;
   font->bmp_idx = 0;
+  font->glyph_atlas = 0;
 }
 
 /* Open the next section in the file.
@@ -275,6 +291,7 @@ load_font_index (grub_file_t file, grub_uint32_t sect_length, struct
 {
   unsigned i;
   grub_uint32_t last_code;
+  grub_uint8_t *raw, *p;
 
 #if FONT_DEBUG >= 2
   grub_dprintf ("font", "load_font_index(sect_length=%d)\n", sect_length);
@@ -290,6 +307,15 @@ load_font_index (grub_file_t file, grub_uint32_t sect_length, struct
       return 1;
     }
 
+  if (file->size != GRUB_FILE_SIZE_UNKNOWN
+      && sect_length > file->size - grub_file_tell (file))
+    {
+      grub_error (GRUB_ERR_BAD_FONT,
+		  "font file format error: character index runs past "
+		  "the end of the file");
+      return 1;
+    }
+
   /* Calculate the number of characters.  */
   font->num_chars = sect_length / FONT_CHAR_INDEX_ENTRY_SIZE;
 
@@ -307,17 +333,30 @@ load_font_index (grub_file_t file, grub_uint32_t sect_length, struct
   grub_dprintf ("font", "num_chars=%d)\n", font->num_chars);
 #endif
 
+  /* Unicode fonts have tens of thousands of entries, so read the whole
+     index at once rather than entry by entry.  */
+  raw = grub_malloc (sect_length);
+  if (!raw)
+    return 1;
+  if (grub_file_read (file, raw, sect_length) != (grub_ssize_t) sect_length)
+    {
+      grub_free (raw);
+      return 1;
+    }
+
   last_code = 0;
 
   /* Load the character index data from the file.  */
-  for (i = 0; i < font->num_chars; i++)
+  for (i = 0, p = raw; i < font->num_chars;
+       i++, p += FONT_CHAR_INDEX_ENTRY_SIZE)
     {
       struct char_index_entry *entry = &font->char_index[i];
 
-      /* Read code point value; convert to native byte order.  */
-      if (grub_file_read (file, &entry->code, 4) != 4)
-	return 1;
-      entry->code = grub_be_to_cpu32 (entry->code);
+      /* Code point value, storage flags byte and glyph data offset;
+         convert to native byte order.  */
+      entry->code = grub_be_to_cpu32 (grub_get_unaligned32 (p));
+      entry->storage_flags = p[4];
+      entry->offset = grub_be_to_cpu32 (grub_get_unaligned32 (p + 5));
 
       /* Verify that characters are in ascending order.  */
       if (i != 0 && entry->code <= last_code)
@@ -325,6 +364,7 @@ load_font_index (grub_file_t file, grub_uint32_t sect_length, struct
 	  grub_error (GRUB_ERR_BAD_FONT,
 		      "font characters not in ascending order: %u <= %u",
 		      entry->code, last_code);
+	  grub_free (raw);
 	  return 1;
 	}
 
@@ -333,15 +373,6 @@ load_font_index (grub_file_t file, grub_uint32_t sect_length, struct
 
       last_code = entry->code;
 
-      /* Read storage flags byte.  */
-      if (grub_file_read (file, &entry->storage_flags, 1) != 1)
-	return 1;
-
-      /* Read glyph data offset; convert to native byte order.  */
-      if (grub_file_read (file, &entry->offset, 4) != 4)
-	return 1;
-      entry->offset = grub_be_to_cpu32 (entry->offset);
-
       /* No glyph loaded.  Will be loaded on demand and cached thereafter.  */
       entry->glyph = 0;
 
@@ -352,7 +383,117 @@ load_font_index (grub_file_t file, grub_uint32_t sect_length, struct
 #endif
     }
 
+  grub_free (raw);
+  return 0;
+}
+
+/* Size in bytes of the bitmap of a glyph of WIDTH x HEIGHT pixels.  */
+static inline grub_size_t
+glyph_bitmap_size (grub_uint16_t width, grub_uint16_t height)
+{
+  return ((grub_size_t) width * height + 7) / 8;
+}
+
+/* Fill in GLYPH of FONT from HEADER, which is in file byte order.  */
+static void
+glyph_init (struct grub_font_glyph *glyph, grub_font_t font,
+	    const struct glyph_header *header)
+{
+  glyph->font = font;
+  glyph->width = grub_be_to_cpu16 (header->width);
+  glyph->height = grub_be_to_cpu16 (header->height);
+  glyph->offset_x = grub_be_to_cpu16 (header->offset_x);
+  glyph->offset_y = grub_be_to_cpu16 (header->offset_y);
+  glyph->device_width = grub_be_to_cpu16 (header->device_width);
+}
+
+/* Load every glyph of FONT into its glyph atlas if the DATA section, which
+   FILE is positioned at, is small enough, and in that case close FILE.
+   Otherwise, or if memory is short, leave glyphs to be loaded on demand.
+   Returns 0 upon success, nonzero for failure (in which case grub_errno is
+   set appropriately).  */
+static int
+load_font_atlas (grub_file_t file, grub_font_t font)
+{
+  grub_off_t data_start = grub_file_tell (file);
+  grub_size_t data_size, atlas_size = 0, pos = 0, len, sz;
+  grub_uint8_t *data;
+  char *atlas;
+  unsigned i;
+
+  if (file->size == GRUB_FILE_SIZE_UNKNOWN || file->size < data_start
+      || file->size - data_start > FONT_ATLAS_MAX_SIZE)
+    return 0;
+  data_size = file->size - data_start;
+
+  data = grub_malloc (data_size);
+  if (!data)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  if (grub_file_read (file, data, data_size) != (grub_ssize_t) data_size)
+    {
+      grub_free (data);
+      return 1;
+    }
+
+  /* Check every glyph and add up the space they take.  */
+  for (i = 0; i < font->num_chars; i++)
+    {
+      const struct glyph_header *header;
+      grub_size_t off = font->char_index[i].offset - data_start;
+
+      if (font->char_index[i].offset < data_start
+	  || data_size < sizeof (*header)
+	  || off > data_size - sizeof (*header))
+	goto bad_glyph;
+      header = (const struct glyph_header *) (data + off);
+      len = glyph_bitmap_size (grub_be_to_cpu16 (header->width),
+			       grub_be_to_cpu16 (header->height));
+      if (len > data_size - off - sizeof (*header))
+	goto bad_glyph;
+      if (grub_add (sizeof (struct grub_font_glyph), len, &sz)
+	  || grub_add (atlas_size, ALIGN_UP (sz, sizeof (grub_addr_t)),
+		       &atlas_size))
+	goto bad_glyph;
+    }
+
+  atlas = grub_malloc (atlas_size);
+  if (!atlas)
+    {
+      grub_free (data);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  for (i = 0; i < font->num_chars; i++)
+    {
+      const struct glyph_header *header;
+      struct grub_font_glyph *glyph;
+
+      header = (const struct glyph_header *)
+	(data + font->char_index[i].offset - data_start);
+      glyph = (struct grub_font_glyph *) (atlas + pos);
+      glyph_init (glyph, font, header);
+      len = glyph_bitmap_size (glyph->width, glyph->height);
+      grub_memcpy (glyph->bitmap, header + 1, len);
+      font->char_index[i].glyph = glyph;
+      pos += ALIGN_UP (sizeof (*glyph) + len, sizeof (grub_addr_t));
+    }
+
+  grub_free (data);
+  font->glyph_atlas = atlas;
+  grub_file_close (file);
+  font->file = 0;
   return 0;
+
+ bad_glyph:
+  grub_free (data);
+  grub_error (GRUB_ERR_BAD_FONT,
+	      "font file format error: glyph of character %u is out of "
+	      "bounds", font->char_index[i].code);
+  return 1;
 }
 
 /* Read the contents of the specified section as a string, which is
@@ -416,6 +557,7 @@ grub_font_load (const char *filename)
   struct font_file_section section;
   char magic[4];
   grub_font_t font = 0;
+  int have_data = 0;
 
 #if FONT_DEBUG >= 1
   grub_dprintf ("font", "add_font(%s)\n", filename);
@@ -608,6 +750,7 @@ grub_font_load (const char *filename)
 			    sizeof (FONT_FORMAT_SECTION_NAMES_DATA) - 1) == 0)
 	{
 	  /* When the DATA section marker is reached, we stop reading.  */
+	  have_data = 1;
 	  break;
 	}
       else
@@ -646,6 +789,13 @@ grub_font_load (const char *filename)
       goto fail;
     }
 
+  if (have_data)
+    {
+      if (load_font_atlas (file, font) != 0)
+	goto fail;
+      file = font->file;
+    }
+
   /* Add the font to the global font registry.  */
   if (register_font (font) != 0)
     goto fail;
@@ -662,25 +812,6 @@ fail:
   return 0;
 }
 
-/* Read a 16-bit big-endian integer from FILE, convert it to native byte
-   order, and store it in *VALUE.
-   Returns 0 on success, 1 on failure.  */
-static int
-read_be_uint16 (grub_file_t file, grub_uint16_t * value)
-{
-  if (grub_file_read (file, value, 2) != 2)
-    return 1;
-  *value = grub_be_to_cpu16 (*value);
-  return 0;
-}
-
-static int
-read_be_int16 (grub_file_t file, grub_int16_t * value)
-{
-  /* For the signed integer version, use the same code as for unsigned.  */
-  return read_be_uint16 (file, (grub_uint16_t *) value);
-}
-
 /* Return a pointer to the character index entry for the glyph corresponding to
    the codepoint CODE in the font FONT.  If not found, return zero.  */
 static inline struct char_index_entry *
@@ -734,12 +865,8 @@ grub_font_get_glyph_internal (grub_font_t font, grub_uint32_t code)
   if (index_entry)
     {
       struct grub_font_glyph *glyph = 0;
-      grub_uint16_t width;
-      grub_uint16_t height;
-      grub_int16_t xoff;
-      grub_int16_t yoff;
-      grub_int16_t dwidth;
-      int len;
+      struct glyph_header header;
+      grub_size_t len;
 
       if (index_entry->glyph)
 	/* Return cached glyph.  */
@@ -756,17 +883,15 @@ grub_font_get_glyph_internal (grub_font_t font, grub_uint32_t code)
       grub_file_seek (font->file, index_entry->offset);
 
       /* Read the glyph width, height, and baseline.  */
-      if (read_be_uint16 (font->file, &width) != 0
-	  || read_be_uint16 (font->file, &height) != 0
-	  || read_be_int16 (font->file, &xoff) != 0
-	  || read_be_int16 (font->file, &yoff) != 0
-	  || read_be_int16 (font->file, &dwidth) != 0)
+      if (grub_file_read (font->file, &header, sizeof (header))
+	  != sizeof (header))
 	{
 	  remove_font (font);
 	  return 0;
 	}
 
-      len = (width * height + 7) / 8;
+      len = glyph_bitmap_size (grub_be_to_cpu16 (header.width),
+			       grub_be_to_cpu16 (header.height));
       glyph = grub_malloc (sizeof (struct grub_font_glyph) + len);
       if (!glyph)
 	{
@@ -774,17 +899,13 @@ grub_font_get_glyph_internal (grub_font_t font, grub_uint32_t code)
 	  return 0;
 	}
 
-      glyph->font = font;
-      glyph->width = width;
-      glyph->height = height;
-      glyph->offset_x = xoff;
-      glyph->offset_y = yoff;
-      glyph->device_width = dwidth;
+      glyph_init (glyph, font, &header);
 
       /* Don't try to read empty bitmaps (e.g., space characters).  */
       if (len != 0)
 	{
-	  if (grub_file_read (font->file, glyph->bitmap, len) != len)
+	  if (grub_file_read (font->file, glyph->bitmap, len)
+	      != (grub_ssize_t) len)
 	    {
 	      remove_font (font);
 	      grub_free (glyph);
@@ -819,6 +940,7 @@ free_font (grub_font_t font)
       grub_free (font->family);
       grub_free (font->char_index);
       grub_free (font->bmp_idx);
+      grub_free (font->glyph_atlas);
       grub_free (font);
     }
 }
@@ -27,6 +27,7 @@
 #include <grub/dl.h>
 #include <grub/charset.h>
 #include <grub/datetime.h>
+#include <grub/safemath.h>
 #ifndef MODE_EXFAT
 #include <grub/fat.h>
 #else
@@ -185,6 +186,25 @@ struct grub_fat_data
   grub_uint32_t uuid;
 };
 
+/* A run of physically contiguous clusters in a cluster chain.  */
+struct grub_fat_run
+{
+  /* First logical cluster of the run within the file.  */
+  grub_uint32_t logical;
+  grub_uint32_t cluster;
+  grub_uint32_t length;
+};
+
+/* Part of the FAT buffered while following a chain.  */
+struct grub_fat_window
+{
+  grub_uint8_t *buf;
+  grub_uint32_t start;
+  grub_uint32_t len;
+};
+
+#define GRUB_FAT_WINDOW_SIZE 4096
+
 struct grub_fshelp_node {
   grub_disk_t disk;
   struct grub_fat_data *data;
@@ -202,6 +222,17 @@ struct grub_fshelp_node {
 #ifdef MODE_EXFAT
   int is_contiguous;
 #endif
+
+  /*
+   * Opened files map their cluster chain into runs sorted by logical
+   * cluster as it is followed, so reads are one disk request per run and
+   * seeks are a binary search rather than a walk from the first cluster.
+   */
+  int use_runs;
+  int runs_complete;
+  struct grub_fat_run *runs;
+  grub_uint32_t num_runs;
+  grub_uint32_t alloc_runs;
 };
 
 static grub_dl_t my_mod;
@@ -449,6 +480,239 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+/* Read the FAT entry of CLUSTER, through WINDOW when one is given.  */
+static grub_err_t
+grub_fat_next_cluster (grub_disk_t disk, struct grub_fat_data *data,
+		       struct grub_fat_window *window, grub_uint32_t cluster,
+		       grub_uint32_t *next_cluster)
+{
+  grub_uint32_t fat_offset, fat_bytes;
+  grub_uint32_t next = 0;
+  unsigned entry_size = (data->fat_size + 7) >> 3;
+
+  switch (data->fat_size)
+    {
+    case 32:
+      fat_offset = cluster << 2;
+      break;
+    case 16:
+      fat_offset = cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = cluster + (cluster >> 1);
+      break;
+    }
+
+  if (!window)
+    {
+      /* Read the FAT.  */
+      if (grub_disk_read (disk, data->fat_sector, fat_offset, entry_size,
+			  (char *) &next))
+	return grub_errno;
+    }
+  else
+    {
+      if (fat_offset < window->start
+	  || fat_offset + entry_size > window->start + window->len)
+	{
+	  fat_bytes = data->sectors_per_fat << GRUB_DISK_SECTOR_BITS;
+	  if (fat_offset + entry_size > fat_bytes)
+	    return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u", cluster);
+
+	  window->start = fat_offset & ~(GRUB_DISK_SECTOR_SIZE - 1);
+	  window->len = fat_bytes - window->start;
+	  if (window->len > GRUB_FAT_WINDOW_SIZE)
+	    window->len = GRUB_FAT_WINDOW_SIZE;
+
+	  if (grub_disk_read (disk, data->fat_sector, window->start,
+			      window->len, window->buf))
+	    {
+	      window->len = 0;
+	      return grub_errno;
+	    }
+	}
+      grub_memcpy (&next, window->buf + (fat_offset - window->start),
+		   entry_size);
+    }
+
+  next = grub_le_to_cpu32 (next);
+  switch (data->fat_size)
+    {
+    case 16:
+      next &= 0xFFFF;
+      break;
+    case 12:
+      if (cluster & 1)
+	next >>= 4;
+
+      next &= 0x0FFF;
+      break;
+    }
+
+  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		data->fat_size, next);
+
+  *next_cluster = next;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_fat_add_run (grub_fshelp_node_t node, grub_uint32_t logical,
+		  grub_uint32_t cluster)
+{
+  if (node->num_runs == node->alloc_runs)
+    {
+      struct grub_fat_run *runs;
+      grub_size_t sz;
+      grub_uint32_t alloc = node->alloc_runs ? node->alloc_runs * 2 : 8;
+
+      if (grub_mul (alloc, sizeof (*runs), &sz))
+	return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+
+      runs = grub_realloc (node->runs, sz);
+      if (!runs)
+	return grub_errno;
+      node->runs = runs;
+      node->alloc_runs = alloc;
+    }
+
+  node->runs[node->num_runs].logical = logical;
+  node->runs[node->num_runs].cluster = cluster;
+  node->runs[node->num_runs].length = 1;
+  node->num_runs++;
+
+  return GRUB_ERR_NONE;
+}
+
+/* Follow the chain until LOGICAL_CLUSTER is mapped or the chain ends.  */
+static grub_err_t
+grub_fat_map_runs (grub_disk_t disk, grub_fshelp_node_t node,
+		   grub_uint32_t logical_cluster)
+{
+  struct grub_fat_window window;
+  struct grub_fat_run *last;
+  grub_uint32_t next_cluster;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (!node->num_runs && grub_fat_add_run (node, 0, node->file_cluster))
+    return grub_errno;
+
+  last = &node->runs[node->num_runs - 1];
+  if (node->runs_complete || logical_cluster < last->logical + last->length)
+    return GRUB_ERR_NONE;
+
+  window.buf = grub_malloc (GRUB_FAT_WINDOW_SIZE);
+  if (!window.buf)
+    return grub_errno;
+  window.start = 0;
+  window.len = 0;
+
+  while (logical_cluster >= last->logical + last->length)
+    {
+      err = grub_fat_next_cluster (disk, node->data, &window,
+				   last->cluster + last->length - 1,
+				   &next_cluster);
+      if (err)
+	break;
+
+      /* Check the end.  */
+      if (next_cluster >= node->data->cluster_eof_mark)
+	{
+	  node->runs_complete = 1;
+	  break;
+	}
+
+      if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
+	{
+	  err = grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+			    next_cluster);
+	  break;
+	}
+
+      if (next_cluster == last->cluster + last->length)
+	last->length++;
+      else
+	{
+	  err = grub_fat_add_run (node, last->logical + last->length,
+				  next_cluster);
+	  if (err)
+	    break;
+	  last = &node->runs[node->num_runs - 1];
+	}
+    }
+
+  grub_free (window.buf);
+  return err;
+}
+
+static grub_ssize_t
+grub_fat_read_runs (grub_disk_t disk, grub_fshelp_node_t node,
+		    grub_disk_read_hook_t read_hook, void *read_hook_data,
+		    grub_off_t offset, unsigned logical_cluster_bits,
+		    grub_size_t len, char *buf)
+{
+  grub_ssize_t ret = 0;
+
+  while (len)
+    {
+      grub_uint32_t logical_cluster = offset >> logical_cluster_bits;
+      grub_uint32_t lo, hi, mid;
+      grub_uint64_t avail;
+      grub_size_t size;
+      struct grub_fat_run *run;
+      grub_disk_addr_t sector;
+      grub_off_t cluster_offset;
+
+      if (grub_fat_map_runs (disk, node, logical_cluster))
+	return -1;
+
+      /* Find the last run starting at or before LOGICAL_CLUSTER.  */
+      lo = 0;
+      hi = node->num_runs;
+      while (hi - lo > 1)
+	{
+	  mid = lo + (hi - lo) / 2;
+	  if (node->runs[mid].logical <= logical_cluster)
+	    lo = mid;
+	  else
+	    hi = mid;
+	}
+      run = &node->runs[lo];
+
+      /* The chain ended before this cluster.  */
+      if (logical_cluster >= run->logical + run->length)
+	return ret;
+
+      cluster_offset = offset & ((1ULL << logical_cluster_bits) - 1);
+      avail = (((grub_uint64_t) (run->logical + run->length - logical_cluster)
+		<< logical_cluster_bits) - cluster_offset);
+      size = len;
+      if (size > avail)
+	size = avail;
+
+      /* Read the whole rest of the run at once.  */
+      sector = (node->data->cluster_sector
+		+ ((grub_disk_addr_t) (run->cluster
+				       + (logical_cluster - run->logical) - 2)
+		   << node->data->cluster_bits));
+
+      disk->read_hook = read_hook;
+      disk->read_hook_data = read_hook_data;
+      grub_disk_read (disk, sector, cluster_offset, size, buf);
+      disk->read_hook = 0;
+      if (grub_errno)
+	return -1;
+
+      len -= size;
+      buf += size;
+      ret += size;
+      offset += size;
+    }
+
+  return ret;
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -499,6 +763,11 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
   /* Calculate the logical cluster number and offset.  */
   logical_cluster_bits = (node->data->cluster_bits
 			  + GRUB_DISK_SECTOR_BITS);
+
+  if (node->use_runs)
+    return grub_fat_read_runs (disk, node, read_hook, read_hook_data,
+			       offset, logical_cluster_bits, len, buf);
+
   logical_cluster = offset >> logical_cluster_bits;
   offset &= (1ULL << logical_cluster_bits) - 1;
 
@@ -514,45 +783,11 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 	{
 	  /* Find next cluster.  */
 	  grub_uint32_t next_cluster;
-	  grub_uint32_t fat_offset;
 
-	  switch (node->data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = node->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = node->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = node->cur_cluster + (node->cur_cluster >> 1);
-	      break;
-	    }
-
-	  /* Read the FAT.  */
-	  if (grub_disk_read (disk, node->data->fat_sector, fat_offset,
-			      (node->data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
+	  if (grub_fat_next_cluster (disk, node->data, NULL, node->cur_cluster,
+				     &next_cluster))
 	    return -1;
 
-	  next_cluster = grub_le_to_cpu32 (next_cluster);
-	  switch (node->data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (node->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
-
-	  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			node->data->fat_size, next_cluster);
-
 	  /* Check the end.  */
 	  if (next_cluster >= node->data->cluster_eof_mark)
 	    return ret;
@@ -935,7 +1170,7 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 
       if (grub_strcasecmp (name, ctxt.filename) == 0)
 	{
-	  *foundnode = grub_malloc (sizeof (struct grub_fshelp_node));
+	  *foundnode = grub_zalloc (sizeof (struct grub_fshelp_node));
 	  if (!*foundnode)
 	    return grub_errno;
 	  (*foundnode)->attr = ctxt.dir.attr;
@@ -1080,6 +1315,7 @@ grub_fat_open (grub_file_t file, const char *name)
   if (err)
     goto fail;
 
+  found->use_runs = 1;
   file->data = found;
   file->size = found->file_size;
 
@@ -1110,6 +1346,7 @@ grub_fat_close (grub_file_t file)
 {
   grub_fshelp_node_t node = file->data;
 
+  grub_free (node->runs);
   grub_free (node->data);
   grub_free (node);
 
@@ -25,8 +25,12 @@
 #include <grub/dl.h>
 #include <grub/types.h>
 #include <grub/fshelp.h>
+#include <grub/partition.h>
 #include <grub/deflate.h>
 #include <grub/safemath.h>
+#include <grub/trace.h>
+#include <grub/lib/lz4.h>
+#include <grub/lib/zstd.h>
 #include <minilzo.h>
 
 #include "xz.h"
@@ -184,12 +188,36 @@ enum
     COMPRESSION_ZLIB = 1,
     COMPRESSION_LZO = 3,
     COMPRESSION_XZ = 4,
+    COMPRESSION_LZ4 = 5,
+    COMPRESSION_ZSTD = 6,
   };
 
 
 #define SQUASH_CHUNK_SIZE 0x2000
 #define XZBUFSIZ 0x2000
 
+/* Decompressed metadata chunks, data blocks and fragments are kept across
+   mounts, keyed by the disk and the position of the compressed block, and
+   the least recently used one is dropped when either limit is hit.  */
+#define SQUASH_CACHE_SLOTS 64
+#define SQUASH_CACHE_BYTES 0x400000
+
+struct grub_squash_cache_block
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_uint64_t offset;
+  /* Bytes decompressed into BUF and bytes allocated.  */
+  grub_size_t size;
+  grub_size_t alloc;
+  grub_uint64_t last_use;
+  char *buf;
+};
+
+static struct grub_squash_cache_block squash_cache[SQUASH_CACHE_SLOTS];
+static grub_size_t squash_cache_bytes;
+static grub_uint64_t squash_cache_clock;
+
 struct grub_squash_data
 {
   grub_disk_t disk;
@@ -217,6 +245,115 @@ struct grub_fshelp_node
   } stack[1];
 };
 
+static void
+squash_cache_drop (struct grub_squash_cache_block *block)
+{
+  squash_cache_bytes -= block->alloc;
+  grub_free (block->buf);
+  block->buf = NULL;
+}
+
+/* Return the contents of the compressed block of CSIZE bytes at OFFSET,
+   which decompresses to at most USIZE bytes, and store their length in
+   *LEN.  The result is valid until the next call.  */
+static const char *
+squash_cache_get (struct grub_squash_data *data, grub_uint64_t offset,
+		  grub_size_t csize, grub_size_t usize, grub_size_t *len)
+{
+  static struct grub_trace_counter *trace_hit, *trace_decompress;
+  struct grub_squash_cache_block *block, *victim, *oldest;
+  struct grub_trace_span span;
+  grub_uint64_t key;
+  grub_ssize_t ret;
+  grub_err_t err;
+  char *tmp, *out;
+  unsigned i;
+
+  key = offset + (grub_partition_get_start (data->disk->partition)
+		  << GRUB_DISK_SECTOR_BITS);
+  for (i = 0; i < SQUASH_CACHE_SLOTS; i++)
+    {
+      block = &squash_cache[i];
+      if (block->buf && block->offset == key
+	  && block->dev_id == data->disk->dev->id
+	  && block->disk_id == data->disk->id)
+	{
+	  block->last_use = ++squash_cache_clock;
+	  grub_trace_count (grub_trace_lookup (&trace_hit, "squash4", "hit"),
+			    block->size);
+	  *len = block->size;
+	  return block->buf;
+	}
+    }
+
+  tmp = grub_malloc (csize);
+  if (!tmp)
+    return NULL;
+  err = grub_disk_read (data->disk, offset >> GRUB_DISK_SECTOR_BITS,
+			offset & (GRUB_DISK_SECTOR_SIZE - 1), csize, tmp);
+  if (err)
+    {
+      grub_free (tmp);
+      return NULL;
+    }
+
+  out = grub_malloc (usize);
+  if (!out)
+    {
+      grub_free (tmp);
+      return NULL;
+    }
+
+  grub_trace_begin (&span, grub_trace_lookup (&trace_decompress, "squash4",
+					      "decompress"));
+  ret = data->decompress (tmp, csize, 0, out, usize, data);
+  grub_trace_end (&span, ret < 0 ? 0 : ret);
+  grub_free (tmp);
+  if (ret < 0)
+    {
+      grub_free (out);
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+      return NULL;
+    }
+
+  /* Evict the least recently used blocks until there is both a free slot
+     and room for this one.  A block larger than the whole cache is still
+     kept, on its own.  */
+  while (1)
+    {
+      victim = NULL;
+      oldest = NULL;
+      for (i = 0; i < SQUASH_CACHE_SLOTS; i++)
+	{
+	  block = &squash_cache[i];
+	  if (!block->buf)
+	    {
+	      if (!victim)
+		victim = block;
+	    }
+	  else if (!oldest || block->last_use < oldest->last_use)
+	    oldest = block;
+	}
+      if ((victim && squash_cache_bytes + usize <= SQUASH_CACHE_BYTES)
+	  || !oldest)
+	break;
+      squash_cache_drop (oldest);
+    }
+
+  victim->dev_id = data->disk->dev->id;
+  victim->disk_id = data->disk->id;
+  victim->offset = key;
+  victim->size = ret;
+  victim->alloc = usize;
+  victim->last_use = ++squash_cache_clock;
+  victim->buf = out;
+  squash_cache_bytes += usize;
+
+  *len = ret;
+  return out;
+}
+
 static grub_err_t
 read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	    grub_uint64_t chunk_start, grub_off_t offset)
@@ -255,29 +392,23 @@ read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	}
       else
 	{
-	  char *tmp;
-	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS; 
-	  grub_disk_addr_t a = chunk_start + 2;
-	  tmp = grub_malloc (bsize);
-	  if (!tmp)
-	    return grub_errno;
-	  /* FIXME: buffer uncompressed data.  */
-	  err = grub_disk_read (data->disk, (a >> GRUB_DISK_SECTOR_BITS),
-				a & (GRUB_DISK_SECTOR_SIZE - 1),
-				bsize, tmp);
-	  if (err)
-	    {
-	      grub_free (tmp);
-	      return err;
-	    }
+	  const char *chunk;
+	  grub_size_t chunk_len, n = 0;
+	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS;
 
-	  if (data->decompress (tmp, bsize, offset,
-				buf, csize, data) < 0)
+	  chunk = squash_cache_get (data, chunk_start + 2, bsize,
+				    SQUASH_CHUNK_SIZE, &chunk_len);
+	  if (!chunk)
+	    return grub_errno;
+	  /* The last chunk of a table may be short.  */
+	  if (offset < chunk_len)
 	    {
-	      grub_free (tmp);
-	      return grub_errno;
+	      n = chunk_len - offset;
+	      if (n > csize)
+		n = csize;
+	      grub_memcpy (buf, chunk + offset, n);
 	    }
-	  grub_free (tmp);
+	  grub_memset ((char *) buf + n, 0, csize - n);
 	}
       len -= csize;
       offset += csize;
@@ -378,6 +509,49 @@ xz_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
   return ret;
 }
 
+static grub_ssize_t
+lz4_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
+		char *outbuf, grub_size_t len, struct grub_squash_data *data)
+{
+  grub_size_t usize = data->blksz;
+  grub_ssize_t ret;
+  char *udata;
+
+  if (usize < SQUASH_CHUNK_SIZE)
+    usize = SQUASH_CHUNK_SIZE;
+
+  if (off == 0 && len >= usize)
+    return grub_lz4_decompress (inbuf, insize, outbuf, len);
+
+  udata = grub_malloc (usize);
+  if (!udata)
+    return -1;
+
+  ret = grub_lz4_decompress (inbuf, insize, udata, usize);
+  if (ret >= 0)
+    {
+      if ((grub_size_t) ret <= off)
+	ret = 0;
+      else
+	{
+	  ret -= off;
+	  if ((grub_size_t) ret > len)
+	    ret = len;
+	  grub_memcpy (outbuf, udata + off, ret);
+	}
+    }
+  grub_free (udata);
+  return ret;
+}
+
+static grub_ssize_t
+zstd_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
+		 char *outbuf, grub_size_t outsize,
+		 struct grub_squash_data *data __attribute__ ((unused)))
+{
+  return grub_zstd_decompress (inbuf, insize, off, outbuf, outsize);
+}
+
 static struct grub_squash_data *
 squash_mount (grub_disk_t disk)
 {
@@ -440,6 +614,12 @@ squash_mount (grub_disk_t disk)
 	  return NULL;
 	}
       break;
+    case grub_cpu_to_le16_compile_time (COMPRESSION_LZ4):
+      data->decompress = lz4_decompress;
+      break;
+    case grub_cpu_to_le16_compile_time (COMPRESSION_ZSTD):
+      data->decompress = zstd_decompress;
+      break;
     default:
       grub_free (data);
       grub_error (GRUB_ERR_BAD_FS, "unsupported compression %d",
@@ -854,32 +1034,19 @@ direct_read (struct grub_squash_data *data,
       else if (!(ino->block_sizes[i]
 	    & grub_cpu_to_le32_compile_time (SQUASH_BLOCK_UNCOMPRESSED)))
 	{
-	  char *block;
-	  grub_size_t csize;
+	  const char *block;
+	  grub_size_t csize, block_len;
 	  csize = grub_le_to_cpu32 (ino->block_sizes[i]) & ~SQUASH_BLOCK_FLAGS;
-	  block = grub_malloc (csize);
+	  block = squash_cache_get (data, ino->cumulated_block_sizes[i] + a,
+				    csize, data->blksz, &block_len);
 	  if (!block)
 	    return -1;
-	  err = grub_disk_read (data->disk,
-				(ino->cumulated_block_sizes[i] + a)
-				>> GRUB_DISK_SECTOR_BITS,
-				(ino->cumulated_block_sizes[i] + a)
-				& (GRUB_DISK_SECTOR_SIZE - 1),
-				csize, block);
-	  if (err)
-	    {
-	      grub_free (block);
-	      return -1;
-	    }
-	  if (data->decompress (block, csize, boff, buf, curread, data)
-	      != (grub_ssize_t) curread)
+	  if (boff + curread > block_len)
 	    {
-	      grub_free (block);
-	      if (!grub_errno)
-		grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	      grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	      return -1;
 	    }
-	  grub_free (block);
+	  grub_memcpy (buf, block + boff, curread);
 	}
       else
 	err = grub_disk_read (data->disk, 
@@ -958,32 +1125,20 @@ grub_squash_read (grub_file_t file, char *buf, grub_size_t len)
   else
     b = grub_le_to_cpu32 (ino->ino.file.offset) + off;
   
-  /* FIXME: cache uncompressed chunks.  */
   if (compressed)
     {
-      char *block;
-      block = grub_malloc (grub_le_to_cpu32 (frag.size));
+      const char *block;
+      grub_size_t block_len;
+      block = squash_cache_get (data, a, grub_le_to_cpu32 (frag.size),
+				data->blksz, &block_len);
       if (!block)
 	return -1;
-      err = grub_disk_read (data->disk,
-			    a >> GRUB_DISK_SECTOR_BITS,
-			    a & (GRUB_DISK_SECTOR_SIZE - 1),
-			    grub_le_to_cpu32 (frag.size), block);
-      if (err)
+      if (b > block_len || len > block_len - b)
 	{
-	  grub_free (block);
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	  return -1;
 	}
-      if (data->decompress (block, grub_le_to_cpu32 (frag.size),
-			    b, buf, len, data)
-	  != (grub_ssize_t) len)
-	{
-	  grub_free (block);
-	  if (!grub_errno)
-	    grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
-	  return -1;
-	}
-      grub_free (block);
+      grub_memcpy (buf, block + b, len);
     }
   else
     {
@@ -1015,6 +1170,23 @@ grub_squash_mtime (grub_device_t dev, grub_int64_t *tm)
   return GRUB_ERR_NONE;
 } 
 
+/* Give the decompressed blocks back when memory runs out.  Nothing holds
+   on to a block across an allocation.  */
+static void
+squash_cache_reclaim (void)
+{
+  unsigned i;
+
+  for (i = 0; i < SQUASH_CACHE_SLOTS; i++)
+    if (squash_cache[i].buf)
+      squash_cache_drop (&squash_cache[i]);
+}
+
+static struct grub_mm_reclaimer squash_reclaimer =
+  {
+    .reclaim = squash_cache_reclaim
+  };
+
 static struct grub_fs grub_squash_fs =
   {
     .name = "squash4",
@@ -1033,10 +1205,13 @@ static struct grub_fs grub_squash_fs =
 GRUB_MOD_INIT(squash4)
 {
   grub_fs_register (&grub_squash_fs);
+  grub_mm_register_reclaimer (&squash_reclaimer);
 }
 
 GRUB_MOD_FINI(squash4)
 {
+  grub_mm_unregister_reclaimer (&squash_reclaimer);
   grub_fs_unregister (&grub_squash_fs);
+  squash_cache_reclaim ();
 }
 
@@ -231,6 +231,24 @@ struct subvolume
   } *keyring;
 };
 
+/* Number of decoded indirect blocks kept per mount.  */
+#define ZFS_META_CACHE_BLOCKS 32
+/* At most this many data blocks, and bytes, are read ahead at once.  */
+#define ZFS_PREFETCH_BLOCKS 16
+#define ZFS_PREFETCH_MAX_SIZE (1 << 20)
+
+/*
+ * A checksummed, decrypted and decompressed block.  Blocks are never
+ * overwritten in place, so the first DVA and the birth txg identify one.
+ */
+struct zfs_cached_block
+{
+  dva_t dva;
+  grub_uint64_t birth;
+  void *buf;
+  grub_uint64_t last_use;
+};
+
 struct grub_zfs_data
 {
   /* cache for a file block of the currently zfs_open()-ed file */
@@ -245,6 +263,13 @@ struct grub_zfs_data
   grub_uint64_t dnode_end;
   grub_zfs_endian_t dnode_endian;
 
+  /* cache for indirect blocks, so dmu_read doesn't re-read the tree */
+  struct zfs_cached_block meta_cache[ZFS_META_CACHE_BLOCKS];
+  grub_uint64_t meta_cache_clock;
+
+  /* data blocks read ahead together with the one requested */
+  struct zfs_cached_block prefetch[ZFS_PREFETCH_BLOCKS];
+
   dnode_end_t mos;
   dnode_end_t dnode;
   struct subvolume subvol;
@@ -1846,79 +1871,26 @@ decode_embedded_bp_compressed(const blkptr_t *bp, void *buf)
 }
 
 /*
- * Read in a block of data, verify its checksum, decompress if needed,
- * and put the uncompressed data in buf.
+ * Verify, decrypt and decompress the block COMPBUF which was read for BP,
+ * and put the uncompressed data in buf.  COMPBUF is always consumed.
  */
 static grub_err_t
-zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf, 
-	  grub_size_t *size, struct grub_zfs_data *data)
+zio_decode (blkptr_t *bp, grub_zfs_endian_t endian, char *compbuf,
+	    grub_size_t lsize, grub_size_t psize, void **buf,
+	    struct grub_zfs_data *data)
 {
-  grub_size_t lsize, psize;
   unsigned int comp, encrypted;
-  char *compbuf = NULL;
-  grub_err_t err;
+  grub_err_t err = GRUB_ERR_NONE;
   zio_cksum_t zc = bp->blk_cksum;
   grub_uint32_t checksum;
 
-  *buf = NULL;
-
   checksum = (grub_zfs_to_cpu64((bp)->blk_prop, endian) >> 40) & 0xff;
   comp = (grub_zfs_to_cpu64((bp)->blk_prop, endian)>>32) & 0x7f;
   encrypted = ((grub_zfs_to_cpu64((bp)->blk_prop, endian) >> 60) & 3);
-  if (BP_IS_EMBEDDED(bp))
-    {
-      if (BPE_GET_ETYPE(bp) != BP_EMBEDDED_TYPE_DATA)
-	return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-			   "unsupported embedded BP (type=%llu)\n",
-			   (long long unsigned int) BPE_GET_ETYPE(bp));
-      lsize = BPE_GET_LSIZE(bp);
-      psize = BF64_GET_SB(grub_zfs_to_cpu64 ((bp)->blk_prop, endian), 25, 7, 0, 1);
-    }
-  else
-    {
-      lsize = (BP_IS_HOLE(bp) ? 0 :
-	       (((grub_zfs_to_cpu64 ((bp)->blk_prop, endian) & 0xffff) + 1)
-	        << SPA_MINBLOCKSHIFT));
-      psize = get_psize (bp, endian);
-    }
-  grub_dprintf("zfs", "zio_read: E %d: size %" PRIdGRUB_SSIZE "/%"
-	       PRIdGRUB_SSIZE "\n", (int)BP_IS_EMBEDDED(bp), lsize, psize);
 
-  if (size)
-    *size = lsize;
-
-  if (comp >= ZIO_COMPRESS_FUNCTIONS)
-    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-		       "compression algorithm %u not supported\n", (unsigned int) comp);
-
-  if (comp != ZIO_COMPRESS_OFF && decomp_table[comp].decomp_func == NULL)
-    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-		       "compression algorithm %s not supported\n", decomp_table[comp].name);
-
-  if (comp != ZIO_COMPRESS_OFF)
-    /* It's not really necessary to align to 16, just for safety.  */
-    compbuf = grub_malloc (ALIGN_UP (psize, 16));
-  else
-    compbuf = *buf = grub_malloc (lsize);
-  if (! compbuf)
-    return grub_errno;
-
-  grub_dprintf ("zfs", "endian = %d\n", endian);
-  if (BP_IS_EMBEDDED(bp))
-    err = decode_embedded_bp_compressed(bp, compbuf);
-  else
-    {
-      err = zio_read_data (bp, endian, compbuf, data);
-      /* FIXME is it really necessary? */
-      if (comp != ZIO_COMPRESS_OFF)
-	grub_memset (compbuf + psize, 0, ALIGN_UP (psize, 16) - psize);
-    }
-  if (err)
-    {
-      grub_free (compbuf);
-      *buf = NULL;
-      return err;
-    }
+  *buf = NULL;
+  if (comp == ZIO_COMPRESS_OFF)
+    *buf = compbuf;
 
   if (!BP_IS_EMBEDDED(bp))
     {
@@ -2002,21 +1974,325 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
   return GRUB_ERR_NONE;
 }
 
+/*
+ * Read in a block of data, verify its checksum, decompress if needed,
+ * and put the uncompressed data in buf.
+ */
+static grub_err_t
+zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf, 
+	  grub_size_t *size, struct grub_zfs_data *data)
+{
+  grub_size_t lsize, psize;
+  unsigned int comp;
+  char *compbuf = NULL;
+  grub_err_t err;
+
+  *buf = NULL;
+
+  comp = (grub_zfs_to_cpu64((bp)->blk_prop, endian)>>32) & 0x7f;
+  if (BP_IS_EMBEDDED(bp))
+    {
+      if (BPE_GET_ETYPE(bp) != BP_EMBEDDED_TYPE_DATA)
+	return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+			   "unsupported embedded BP (type=%llu)\n",
+			   (long long unsigned int) BPE_GET_ETYPE(bp));
+      lsize = BPE_GET_LSIZE(bp);
+      psize = BF64_GET_SB(grub_zfs_to_cpu64 ((bp)->blk_prop, endian), 25, 7, 0, 1);
+    }
+  else
+    {
+      lsize = (BP_IS_HOLE(bp) ? 0 :
+	       (((grub_zfs_to_cpu64 ((bp)->blk_prop, endian) & 0xffff) + 1)
+	        << SPA_MINBLOCKSHIFT));
+      psize = get_psize (bp, endian);
+    }
+  grub_dprintf("zfs", "zio_read: E %d: size %" PRIdGRUB_SSIZE "/%"
+	       PRIdGRUB_SSIZE "\n", (int)BP_IS_EMBEDDED(bp), lsize, psize);
+
+  if (size)
+    *size = lsize;
+
+  if (comp >= ZIO_COMPRESS_FUNCTIONS)
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       "compression algorithm %u not supported\n", (unsigned int) comp);
+
+  if (comp != ZIO_COMPRESS_OFF && decomp_table[comp].decomp_func == NULL)
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       "compression algorithm %s not supported\n", decomp_table[comp].name);
+
+  if (comp != ZIO_COMPRESS_OFF)
+    /* It's not really necessary to align to 16, just for safety.  */
+    compbuf = grub_malloc (ALIGN_UP (psize, 16));
+  else
+    compbuf = *buf = grub_malloc (lsize);
+  if (! compbuf)
+    return grub_errno;
+
+  grub_dprintf ("zfs", "endian = %d\n", endian);
+  if (BP_IS_EMBEDDED(bp))
+    err = decode_embedded_bp_compressed(bp, compbuf);
+  else
+    {
+      err = zio_read_data (bp, endian, compbuf, data);
+      /* FIXME is it really necessary? */
+      if (comp != ZIO_COMPRESS_OFF)
+	grub_memset (compbuf + psize, 0, ALIGN_UP (psize, 16) - psize);
+    }
+  if (err)
+    {
+      grub_free (compbuf);
+      *buf = NULL;
+      return err;
+    }
+
+  return zio_decode (bp, endian, compbuf, lsize, psize, buf, data);
+}
+
+static inline grub_uint64_t
+dva_get_asize (const dva_t *dva, grub_zfs_endian_t endian)
+{
+  return BF64_GET_SB (grub_zfs_to_cpu64 (dva->dva_word[0], endian),
+		      0, 24, SPA_MINBLOCKSHIFT, 0);
+}
+
+static int
+zfs_block_matches (const struct zfs_cached_block *cb, const blkptr_t *bp)
+{
+  return (cb->buf
+	  && cb->dva.dva_word[0] == bp->blk_dva[0].dva_word[0]
+	  && cb->dva.dva_word[1] == bp->blk_dva[0].dva_word[1]
+	  && cb->birth == bp->blk_birth);
+}
+
+/*
+ * Like zio_read, but for indirect blocks: the result is kept in a small
+ * per-mount cache and must not be freed by the caller.  It stays valid
+ * until the next call.
+ */
+static grub_err_t
+zio_read_cached (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
+		 struct grub_zfs_data *data)
+{
+  struct zfs_cached_block *cb, *victim = &data->meta_cache[0];
+  grub_err_t err;
+  void *out;
+  unsigned i;
+
+  for (i = 0; i < ZFS_META_CACHE_BLOCKS; i++)
+    {
+      cb = &data->meta_cache[i];
+      if (zfs_block_matches (cb, bp))
+	{
+	  cb->last_use = ++data->meta_cache_clock;
+	  *buf = cb->buf;
+	  return GRUB_ERR_NONE;
+	}
+      if (!victim->buf)
+	continue;
+      if (!cb->buf || cb->last_use < victim->last_use)
+	victim = cb;
+    }
+
+  err = zio_read (bp, endian, &out, 0, data);
+  if (err)
+    return err;
+
+  grub_free (victim->buf);
+  victim->dva = bp->blk_dva[0];
+  victim->birth = bp->blk_birth;
+  victim->buf = out;
+  victim->last_use = ++data->meta_cache_clock;
+  *buf = out;
+  return GRUB_ERR_NONE;
+}
+
+static void
+zfs_prefetch_flush (struct grub_zfs_data *data)
+{
+  unsigned i;
+
+  for (i = 0; i < ZFS_PREFETCH_BLOCKS; i++)
+    {
+      grub_free (data->prefetch[i].buf);
+      data->prefetch[i].buf = NULL;
+    }
+}
+
+/* Whether BP may be fetched as part of a larger contiguous read.  */
+static int
+zfs_can_read_ahead (blkptr_t *bp, grub_zfs_endian_t endian)
+{
+  unsigned int comp;
+
+  if (BP_IS_HOLE (bp) || BP_IS_EMBEDDED (bp))
+    return 0;
+  if ((grub_zfs_to_cpu64 (bp->blk_dva[0].dva_word[1], endian) >> 63) & 1)
+    return 0;
+  comp = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 32) & 0x7f;
+  if (comp >= ZIO_COMPRESS_FUNCTIONS
+      || (comp != ZIO_COMPRESS_OFF && decomp_table[comp].decomp_func == NULL))
+    return 0;
+  return get_psize (bp, endian) <= dva_get_asize (&bp->blk_dva[0], endian);
+}
+
+/* Decode the block for BP from its on-disk image RAW.  */
+static grub_err_t
+zio_decode_copy (blkptr_t *bp, grub_zfs_endian_t endian, const char *raw,
+		 void **buf, struct grub_zfs_data *data)
+{
+  grub_size_t lsize, psize;
+  unsigned int comp;
+  char *compbuf;
+
+  lsize = (((grub_zfs_to_cpu64 (bp->blk_prop, endian) & 0xffff) + 1)
+	   << SPA_MINBLOCKSHIFT);
+  psize = get_psize (bp, endian);
+  comp = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 32) & 0x7f;
+
+  if (comp != ZIO_COMPRESS_OFF)
+    {
+      compbuf = grub_malloc (ALIGN_UP (psize, 16));
+      if (!compbuf)
+	return grub_errno;
+      grub_memset (compbuf + psize, 0, ALIGN_UP (psize, 16) - psize);
+    }
+  else
+    {
+      if (lsize != psize)
+	return grub_error (GRUB_ERR_BAD_FS, "uncompressed block size mismatch");
+      compbuf = grub_malloc (lsize);
+      if (!compbuf)
+	return grub_errno;
+    }
+  grub_memcpy (compbuf, raw, psize);
+
+  return zio_decode (bp, endian, compbuf, lsize, psize, buf, data);
+}
+
+/*
+ * Read the data block BP_ARRAY[IDX] of a file.  Following blocks of the
+ * same parent which lie directly behind it on the same leaf or mirror
+ * vdev are fetched in the same disk read and parked in data->prefetch,
+ * so sequential reads of a file don't pay one I/O per record.
+ */
+static grub_err_t
+zio_read_ahead (blkptr_t *bp_array, grub_size_t nbp, grub_size_t idx,
+		grub_zfs_endian_t endian, void **buf,
+		struct grub_zfs_data *data)
+{
+  blkptr_t *bp = &bp_array[idx];
+  struct grub_zfs_device_desc *desc = NULL;
+  grub_uint64_t start, vdev;
+  grub_size_t n, i, total, off;
+  grub_err_t err;
+  void *primary = NULL;
+  char *raw;
+
+  for (i = 0; i < ZFS_PREFETCH_BLOCKS; i++)
+    if (zfs_block_matches (&data->prefetch[i], bp))
+      {
+	*buf = data->prefetch[i].buf;
+	data->prefetch[i].buf = NULL;
+	return GRUB_ERR_NONE;
+      }
+
+  if (!zfs_can_read_ahead (bp, endian))
+    return zio_read (bp, endian, buf, 0, data);
+
+  vdev = BF64_GET (grub_zfs_to_cpu64 (bp->blk_dva[0].dva_word[0], endian),
+		   32, 32);
+  for (i = 0; i < data->n_devices_attached; i++)
+    if (data->devices_attached[i].id == vdev)
+      {
+	desc = &data->devices_attached[i];
+	break;
+      }
+  if (!desc || desc->type == DEVICE_RAIDZ)
+    return zio_read (bp, endian, buf, 0, data);
+
+  start = dva_get_offset (&bp->blk_dva[0], endian);
+  total = dva_get_asize (&bp->blk_dva[0], endian);
+  for (n = 1; idx + n < nbp && n <= ZFS_PREFETCH_BLOCKS; n++)
+    {
+      blkptr_t *next = &bp_array[idx + n];
+      grub_uint64_t asize;
+
+      if (!zfs_can_read_ahead (next, endian)
+	  || BF64_GET (grub_zfs_to_cpu64 (next->blk_dva[0].dva_word[0],
+					  endian), 32, 32) != vdev
+	  || dva_get_offset (&next->blk_dva[0], endian) != start + total)
+	break;
+      asize = dva_get_asize (&next->blk_dva[0], endian);
+      if (total + asize > ZFS_PREFETCH_MAX_SIZE)
+	break;
+      total += asize;
+    }
+  if (n == 1)
+    return zio_read (bp, endian, buf, 0, data);
+
+  raw = grub_malloc (total);
+  if (!raw || read_device (start, desc, total, raw))
+    {
+      grub_free (raw);
+      grub_errno = GRUB_ERR_NONE;
+      return zio_read (bp, endian, buf, 0, data);
+    }
+  grub_dprintf ("zfs", "read ahead %" PRIuGRUB_SIZE " blocks, %"
+		PRIuGRUB_SIZE " bytes\n", n, total);
+
+  zfs_prefetch_flush (data);
+  for (i = 0, off = 0; i < n; i++)
+    {
+      blkptr_t *cur = &bp_array[idx + i];
+      void *out;
+
+      err = zio_decode_copy (cur, endian, raw + off, &out, data);
+      off += dva_get_asize (&cur->blk_dva[0], endian);
+      /* A bad block is simply read again, from another DVA if need be.  */
+      if (i == 0)
+	{
+	  if (!err)
+	    primary = out;
+	  grub_errno = GRUB_ERR_NONE;
+	  continue;
+	}
+      if (err)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  continue;
+	}
+      data->prefetch[i - 1].dva = cur->blk_dva[0];
+      data->prefetch[i - 1].birth = cur->blk_birth;
+      data->prefetch[i - 1].buf = out;
+    }
+  grub_free (raw);
+
+  if (!primary)
+    return zio_read (bp, endian, buf, 0, data);
+  *buf = primary;
+  return GRUB_ERR_NONE;
+}
+
 /*
  * Get the block from a block id.
  * push the block onto the stack.
  *
+ * Indirect blocks come from the metadata cache.  With READ_AHEAD set,
+ * data blocks are read in contiguous runs, see zio_read_ahead.
  */
 static grub_err_t
-dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf, 
-	  grub_zfs_endian_t *endian_out, struct grub_zfs_data *data)
+dmu_read_real (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
+	       grub_zfs_endian_t *endian_out, int read_ahead,
+	       struct grub_zfs_data *data)
 {
   int level;
   grub_off_t idx;
   blkptr_t *bp_array = dn->dn.dn_blkptr;
+  grub_size_t nbp = dn->dn.dn_nblkptr;
   int epbs = dn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
   blkptr_t *bp;
   void *tmpbuf = 0;
+  void *owned = 0;
   grub_zfs_endian_t endian;
   grub_err_t err = GRUB_ERR_NONE;
 
@@ -2024,17 +2300,13 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
   if (!bp)
     return grub_errno;
 
+  *buf = NULL;
   endian = dn->endian;
   for (level = dn->dn.dn_nlevels - 1; level >= 0; level--)
     {
       grub_dprintf ("zfs", "endian = %d\n", endian);
       idx = (blkid >> (epbs * level)) & ((1 << epbs) - 1);
       *bp = bp_array[idx];
-      if (bp_array != dn->dn.dn_blkptr)
-	{
-	  grub_free (bp_array);
-	  bp_array = 0;
-	}
 
       if (BP_IS_HOLE (bp))
 	{
@@ -2054,19 +2326,31 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
       if (level == 0)
 	{
 	  grub_dprintf ("zfs", "endian = %d\n", endian);
-	  err = zio_read (bp, endian, buf, 0, data);
+	  if (read_ahead)
+	    err = zio_read_ahead (bp_array, nbp, idx, endian, buf, data);
+	  else
+	    err = zio_read (bp, endian, buf, 0, data);
 	  endian = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 63) & 1;
 	  break;
 	}
       grub_dprintf ("zfs", "endian = %d\n", endian);
-      err = zio_read (bp, endian, &tmpbuf, 0, data);
+      grub_free (owned);
+      owned = 0;
+      /* Embedded block pointers carry their payload and aren't cached.  */
+      if (BP_IS_EMBEDDED (bp))
+	{
+	  err = zio_read (bp, endian, &tmpbuf, 0, data);
+	  owned = tmpbuf;
+	}
+      else
+	err = zio_read_cached (bp, endian, &tmpbuf, data);
       endian = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 63) & 1;
       if (err)
 	break;
       bp_array = tmpbuf;
+      nbp = (grub_size_t) 1 << epbs;
     }
-  if (bp_array != dn->dn.dn_blkptr)
-    grub_free (bp_array);
+  grub_free (owned);
   if (endian_out)
     *endian_out = endian;
 
@@ -2074,6 +2358,13 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
   return err;
 }
 
+static grub_err_t
+dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf, 
+	  grub_zfs_endian_t *endian_out, struct grub_zfs_data *data)
+{
+  return dmu_read_real (dn, blkid, buf, endian_out, 0, data);
+}
+
 /*
  * mzap_lookup: Looks up property described by "name" and returns the value
  * in "value".
@@ -3625,6 +3916,9 @@ zfs_unmount (struct grub_zfs_data *data)
   grub_free (data->dnode_buf);
   grub_free (data->dnode_mdn);
   grub_free (data->file_buf);
+  for (i = 0; i < ZFS_META_CACHE_BLOCKS; i++)
+    grub_free (data->meta_cache[i].buf);
+  zfs_prefetch_flush (data);
   for (i = 0; i < data->subvol.nkeys; i++)
     grub_crypto_cipher_close (data->subvol.keyring[i].cipher);
   grub_free (data->subvol.keyring);
@@ -3925,8 +4219,8 @@ grub_zfs_read (grub_file_t file, char *buf, grub_size_t len)
       grub_free (data->file_buf);
       data->file_buf = 0;
 
-      err = dmu_read (&(data->dnode), blkid, &t,
-		      0, data);
+      err = dmu_read_real (&(data->dnode), blkid, &t,
+			   0, 1, data);
       data->file_buf = t;
       if (err)
 	{
@@ -60,17 +60,56 @@ fletcher_2(const void *buf, grub_uint64_t size, grub_zfs_endian_t endian,
   zcp->zc_word[3] = grub_cpu_to_zfs64 (b1, endian);
 }
 
+/*
+ * Fletcher-4 over four interleaved lanes, each summing every fourth word,
+ * so the four dependency chains can run in parallel.  The lane sums are
+ * folded back into the serial a, b, c and d at the end; any words past the
+ * last full group of four are then added the serial way.
+ */
 void
 fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
 	    zio_cksum_t *zcp)
 {
   const grub_uint32_t *ip = buf;
   const grub_uint32_t *ipend = ip + (size / sizeof (grub_uint32_t));
+  const grub_uint32_t *ipend4 = ip + ((size / sizeof (grub_uint32_t)) & ~3);
+  grub_uint64_t a0, a1, a2, a3, b0, b1, b2, b3;
+  grub_uint64_t c0, c1, c2, c3, d0, d1, d2, d3;
   grub_uint64_t a, b, c, d;
-  
-  for (a = b = c = d = 0; ip < ipend; ip++) 
+
+  a0 = a1 = a2 = a3 = b0 = b1 = b2 = b3 = 0;
+  c0 = c1 = c2 = c3 = d0 = d1 = d2 = d3 = 0;
+
+  for (; ip < ipend4; ip += 4)
+    {
+      a0 += grub_zfs_to_cpu32 (ip[0], endian);
+      a1 += grub_zfs_to_cpu32 (ip[1], endian);
+      a2 += grub_zfs_to_cpu32 (ip[2], endian);
+      a3 += grub_zfs_to_cpu32 (ip[3], endian);
+      b0 += a0;
+      b1 += a1;
+      b2 += a2;
+      b3 += a3;
+      c0 += b0;
+      c1 += b1;
+      c2 += b2;
+      c3 += b3;
+      d0 += c0;
+      d1 += c1;
+      d2 += c2;
+      d3 += c3;
+    }
+
+  a = a0 + a1 + a2 + a3;
+  b = 4 * (b0 + b1 + b2 + b3) - a1 - 2 * a2 - 3 * a3;
+  c = 16 * (c0 + c1 + c2 + c3) - 6 * b0 - 10 * b1 - 14 * b2 - 18 * b3
+    + a2 + 3 * a3;
+  d = 64 * (d0 + d1 + d2 + d3) - 48 * c0 - 64 * c1 - 80 * c2 - 96 * c3
+    + 4 * b0 + 10 * b1 + 20 * b2 + 34 * b3 - a3;
+
+  for (; ip < ipend; ip++) 
     {
-      a += grub_zfs_to_cpu32 (ip[0], endian);;
+      a += grub_zfs_to_cpu32 (ip[0], endian);
       b += a;
       c += b;
       d += c;
@@ -81,4 +120,3 @@ fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian,
   zcp->zc_word[2] = grub_cpu_to_zfs64 (c, endian);
   zcp->zc_word[3] = grub_cpu_to_zfs64 (d, endian);
 }
-
@@ -25,6 +25,7 @@
 #include <grub/time.h>
 #include <grub/file.h>
 #include <grub/i18n.h>
+#include <grub/trace.h>
 
 #define	GRUB_CACHE_TIMEOUT	2
 
@@ -36,15 +37,23 @@ struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
 void (*grub_disk_firmware_fini) (void);
 int grub_disk_firmware_is_tainted;
 
-#if DISK_CACHE_STATS
-static unsigned long grub_disk_cache_hits;
-static unsigned long grub_disk_cache_misses;
+static struct grub_trace_counter *trace_cache_hits;
+static struct grub_trace_counter *trace_cache_misses;
+static struct grub_trace_counter *trace_copy;
+
+/* Bytes which pass through a buffer of ours on their way to the caller.  */
+static inline void
+grub_disk_count_copy (grub_size_t size)
+{
+  grub_trace_count (grub_trace_lookup (&trace_copy, "copy", "disk"), size);
+}
 
+#if DISK_CACHE_STATS
 void
 grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
 {
-  *hits = grub_disk_cache_hits;
-  *misses = grub_disk_cache_misses;
+  *hits = trace_cache_hits ? trace_cache_hits->count : 0;
+  *misses = trace_cache_misses ? trace_cache_misses->count : 0;
 }
 #endif
 
@@ -86,15 +95,13 @@ grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
       && cache->sector == sector)
     {
       cache->lock = 1;
-#if DISK_CACHE_STATS
-      grub_disk_cache_hits++;
-#endif
+      grub_trace_count (grub_trace_lookup (&trace_cache_hits, "disk.cache",
+					   "hit"), 0);
       return cache->data;
     }
 
-#if DISK_CACHE_STATS
-  grub_disk_cache_misses++;
-#endif
+  grub_trace_count (grub_trace_lookup (&trace_cache_misses, "disk.cache",
+				       "miss"), 0);
 
   return 0;
 }
@@ -310,6 +317,24 @@ grub_disk_close (grub_disk_t disk)
   grub_free (disk);
 }
 
+/* Read NUM native sectors from the device itself, starting at SECTOR (in
+   GRUB_DISK_SECTOR_SIZE units).  */
+static grub_err_t
+grub_disk_dev_read (grub_disk_t disk, grub_disk_addr_t sector,
+		    grub_size_t num, char *buf)
+{
+  struct grub_trace_span span;
+  grub_err_t err;
+
+  grub_trace_begin (&span, grub_trace_lookup (&disk->trace, "disk",
+					      disk->name));
+  err = (disk->dev->disk_read) (disk, transform_sector (disk, sector),
+				num, buf);
+  grub_trace_end (&span,
+		  err ? 0 : (grub_uint64_t) num << disk->log_sector_size);
+  return err;
+}
+
 /* Small read (less than cache size and not pass across cache unit boundaries).
    sector is already adjusted and is divisible by cache unit size.
  */
@@ -325,6 +350,7 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
   if (data)
     {
       /* Just copy it!  */
+      grub_disk_count_copy (size);
       grub_memcpy (buf, data + offset, size);
       grub_disk_cache_unlock (disk->dev->id, disk->id, sector);
       return GRUB_ERR_NONE;
@@ -341,13 +367,14 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
       < (disk->total_sectors << (disk->log_sector_size - GRUB_DISK_SECTOR_BITS)))
     {
       grub_err_t err;
-      err = (disk->dev->disk_read) (disk, transform_sector (disk, sector),
-				    1U << (GRUB_DISK_CACHE_BITS
-					   + GRUB_DISK_SECTOR_BITS
-					   - disk->log_sector_size), tmp_buf);
+      err = grub_disk_dev_read (disk, sector,
+				1U << (GRUB_DISK_CACHE_BITS
+				       + GRUB_DISK_SECTOR_BITS
+				       - disk->log_sector_size), tmp_buf);
       if (!err)
 	{
 	  /* Copy it and store it in the disk cache.  */
+	  grub_disk_count_copy (size);
 	  grub_memcpy (buf, tmp_buf + offset, size);
 	  grub_disk_cache_store (disk->dev->id, disk->id,
 				 sector, tmp_buf);
@@ -377,8 +404,7 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
     if (!tmp_buf)
       return grub_errno;
     
-    if ((disk->dev->disk_read) (disk, transform_sector (disk, aligned_sector),
-				num, tmp_buf))
+    if (grub_disk_dev_read (disk, aligned_sector, num, tmp_buf))
       {
 	grub_error_push ();
 	grub_dprintf ("disk", "%s read failed\n", disk->name);
@@ -386,6 +412,7 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
 	grub_free (tmp_buf);
 	return grub_errno;
       }
+    grub_disk_count_copy (size);
     grub_memcpy (buf, tmp_buf + offset, size);
     grub_free (tmp_buf);
     return GRUB_ERR_NONE;
@@ -470,6 +497,7 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 
       if (data)
 	{
+	  grub_disk_count_copy (GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS);
 	  grub_memcpy ((char *) buf
 		       + (agglomerate << (GRUB_DISK_CACHE_BITS
 					  + GRUB_DISK_SECTOR_BITS)),
@@ -483,11 +511,11 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 	{
 	  grub_disk_addr_t i;
 
-	  err = (disk->dev->disk_read) (disk, transform_sector (disk, sector),
-					agglomerate << (GRUB_DISK_CACHE_BITS
-							+ GRUB_DISK_SECTOR_BITS
-							- disk->log_sector_size),
-					buf);
+	  err = grub_disk_dev_read (disk, sector,
+				    agglomerate << (GRUB_DISK_CACHE_BITS
+						    + GRUB_DISK_SECTOR_BITS
+						    - disk->log_sector_size),
+				    buf);
 	  if (err)
 	    return err;
 	  
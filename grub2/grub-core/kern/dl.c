@@ -32,6 +32,7 @@
 #include <grub/env.h>
 #include <grub/cache.h>
 #include <grub/i18n.h>
+#include <grub/trace.h>
 
 /* Platforms where modules are in a readonly area of memory.  */
 #if defined(GRUB_MACHINE_QEMU)
@@ -674,22 +675,277 @@ grub_dl_load_core_noinit (void *addr, grub_size_t size)
 grub_dl_t
 grub_dl_load_core (void *addr, grub_size_t size)
 {
+  static struct grub_trace_counter *trace;
+  struct grub_trace_span span;
   grub_dl_t mod;
 
   grub_boot_time ("Parsing module");
 
+  grub_trace_begin (&span, grub_trace_lookup (&trace, "dl", "load"));
   mod = grub_dl_load_core_noinit (addr, size);
 
   if (!mod)
-    return NULL;
+    {
+      grub_trace_end (&span, 0);
+      return NULL;
+    }
 
   grub_boot_time ("Initing module %s", mod->name);
   grub_dl_init (mod);
   grub_boot_time ("Module %s inited", mod->name);
+  grub_trace_end (&span, size);
 
   return mod;
 }
 
+#if defined (__i386__) || defined (__x86_64__)
+static grub_err_t
+grub_dl_bundle_apply_fixup (char *image, const struct grub_dl_bundle_fixup *f,
+			    const grub_addr_t *imports,
+			    const struct grub_dl_bundle_header *h)
+{
+  void *field = image + f->offset;
+  grub_addr_t target;
+  grub_uint64_t value;
+
+  if (f->symbol == GRUB_DL_BUNDLE_NONE)
+    target = (grub_addr_t) image;
+  else if (f->symbol < h->nimports)
+    target = imports[f->symbol];
+  else
+    return grub_error (GRUB_ERR_BAD_MODULE, "invalid bundle fixup symbol");
+
+  value = target + f->addend;
+  if (f->type == GRUB_DL_BUNDLE_FIXUP_PC32
+      || f->type == GRUB_DL_BUNDLE_FIXUP_PC64)
+    value -= (grub_addr_t) field;
+
+  switch (f->type)
+    {
+    case GRUB_DL_BUNDLE_FIXUP_ABS64:
+    case GRUB_DL_BUNDLE_FIXUP_PC64:
+      if (f->offset + 8 > h->image_size)
+	break;
+      grub_set_unaligned64 (field, value);
+      return GRUB_ERR_NONE;
+
+    case GRUB_DL_BUNDLE_FIXUP_ABS32:
+    case GRUB_DL_BUNDLE_FIXUP_ABS32S:
+    case GRUB_DL_BUNDLE_FIXUP_PC32:
+      if (f->offset + 4 > h->image_size)
+	break;
+#if GRUB_CPU_SIZEOF_VOID_P == 8
+      if (f->type == GRUB_DL_BUNDLE_FIXUP_ABS32
+	  ? value != (grub_uint32_t) value
+	  : (grub_int64_t) value != (grub_int32_t) value)
+	return grub_error (GRUB_ERR_BAD_MODULE, "relocation out of range");
+#endif
+      grub_set_unaligned32 (field, value);
+      return GRUB_ERR_NONE;
+
+    default:
+      return grub_error (GRUB_ERR_BAD_MODULE, "unknown bundle fixup type %u",
+			 f->type);
+    }
+
+  return grub_error (GRUB_ERR_BAD_MODULE, "bundle fixup is out of the image");
+}
+
+/* Undo the part of loading MOD from a bundle that happened before its
+   init ran.  */
+static void
+grub_dl_bundle_free_mod (grub_dl_t mod)
+{
+  grub_dl_dep_t dep, depn;
+
+  grub_dl_unregister_symbols (mod);
+  for (dep = mod->dep; dep; dep = depn)
+    {
+      depn = dep->next;
+      grub_dl_unref (dep->mod);
+      grub_free (dep);
+    }
+  grub_free (mod->name);
+  grub_free (mod);
+}
+
+/*
+ * Load a prelinked bundle from core memory.  The modules in it were
+ * relocated against each other by grub-mkimage, so all that's left here is
+ * to copy the image, patch in its address and the kernel symbols it uses,
+ * and run the init functions in dependency order.
+ */
+grub_err_t
+grub_dl_load_bundle (void *addr, grub_size_t size)
+{
+  struct grub_dl_bundle_header *h = addr;
+  struct grub_dl_bundle_module *mods;
+  struct grub_dl_bundle_symbol *syms;
+  struct grub_dl_bundle_fixup *fixups;
+  grub_uint32_t *import_names;
+  grub_addr_t *imports;
+  const char *strtab;
+  char *image;
+  grub_dl_t mod;
+  grub_uint32_t i, j;
+
+  grub_boot_time ("Loading prelinked bundle");
+
+  if (size < sizeof (*h) || h->magic != GRUB_DL_BUNDLE_MAGIC
+      || h->image_offset > size || size - h->image_offset < h->image_size
+      || h->mods_offset > size
+      || (size - h->mods_offset) / sizeof (*mods) < h->nmods
+      || h->syms_offset > size
+      || (size - h->syms_offset) / sizeof (*syms) < h->nsyms
+      || h->imports_offset > size
+      || (size - h->imports_offset) / sizeof (*import_names) < h->nimports
+      || h->fixups_offset > size
+      || (size - h->fixups_offset) / sizeof (*fixups) < h->nfixups
+      || h->strtab_offset > size || size - h->strtab_offset < h->strtab_size
+      || h->strtab_size == 0
+      || ((char *) addr)[h->strtab_offset + h->strtab_size - 1] != 0)
+    return grub_error (GRUB_ERR_BAD_MODULE, "invalid prelinked bundle");
+
+  mods = (struct grub_dl_bundle_module *) ((char *) addr + h->mods_offset);
+  syms = (struct grub_dl_bundle_symbol *) ((char *) addr + h->syms_offset);
+  import_names = (grub_uint32_t *) ((char *) addr + h->imports_offset);
+  fixups = (struct grub_dl_bundle_fixup *) ((char *) addr + h->fixups_offset);
+  strtab = (char *) addr + h->strtab_offset;
+
+  image = grub_memalign (h->align ? : 1, h->image_size);
+  if (!image)
+    return grub_errno;
+  grub_memcpy (image, (char *) addr + h->image_offset, h->image_size);
+
+  imports = grub_calloc (h->nimports, sizeof (*imports));
+  if (!imports && h->nimports)
+    goto fail_image;
+  for (i = 0; i < h->nimports; i++)
+    {
+      grub_symbol_t nsym;
+
+      if (import_names[i] >= h->strtab_size)
+	{
+	  grub_error (GRUB_ERR_BAD_MODULE, "invalid prelinked bundle");
+	  goto fail_imports;
+	}
+      nsym = grub_dl_resolve_symbol (strtab + import_names[i]);
+      if (!nsym)
+	{
+	  grub_error (GRUB_ERR_BAD_MODULE, N_("symbol `%s' not found"),
+		      strtab + import_names[i]);
+	  goto fail_imports;
+	}
+      imports[i] = (grub_addr_t) nsym->addr;
+    }
+
+  for (i = 0; i < h->nfixups; i++)
+    if (grub_dl_bundle_apply_fixup (image, &fixups[i], imports, h))
+      goto fail_imports;
+  grub_free (imports);
+
+  grub_arch_sync_caches (image, h->image_size);
+
+  grub_boot_time ("Prelinked bundle: %u modules, %u imports, %u fixups",
+		  h->nmods, h->nimports, h->nfixups);
+
+  for (i = 0, j = 0; i < h->nmods; i++)
+    {
+      const char *dep;
+
+      if (mods[i].name >= h->strtab_size || mods[i].deps >= h->strtab_size
+	  || mods[i].start > h->image_size
+	  || h->image_size - mods[i].start < mods[i].size
+	  || (mods[i].init != GRUB_DL_BUNDLE_NONE
+	      && mods[i].init >= h->image_size)
+	  || (mods[i].fini != GRUB_DL_BUNDLE_NONE
+	      && mods[i].fini >= h->image_size))
+	{
+	  grub_error (GRUB_ERR_BAD_MODULE, "invalid prelinked bundle");
+	  goto fail;
+	}
+
+      mod = grub_zalloc (sizeof (*mod));
+      if (!mod)
+	goto fail;
+      mod->name = grub_strdup (strtab + mods[i].name);
+      if (!mod->name)
+	goto fail_mod;
+      mod->ref_count = 1;
+      /* The image is shared by every module in the bundle.  */
+      mod->persistent = 1;
+      mod->base = image + mods[i].start;
+      mod->sz = mods[i].size;
+      if (mods[i].init != GRUB_DL_BUNDLE_NONE)
+	mod->init = (void (*) (grub_dl_t)) (image + mods[i].init);
+      if (mods[i].fini != GRUB_DL_BUNDLE_NONE)
+	mod->fini = (void (*) (void)) (image + mods[i].fini);
+
+      if (grub_dl_add (mod))
+	goto fail_mod;
+
+      for (dep = strtab + mods[i].deps;
+	   dep < strtab + h->strtab_size && *dep;
+	   dep += grub_strlen (dep) + 1)
+	{
+	  grub_dl_dep_t d;
+	  grub_dl_t m;
+
+	  m = grub_dl_get (dep);
+	  if (!m)
+	    {
+	      grub_error (GRUB_ERR_BAD_MODULE,
+			  "dependency `%s' of `%s' isn't loaded",
+			  dep, mod->name);
+	      goto fail_mod;
+	    }
+
+	  d = grub_malloc (sizeof (*d));
+	  if (!d)
+	    goto fail_mod;
+	  grub_dl_ref (m);
+	  d->mod = m;
+	  d->next = mod->dep;
+	  mod->dep = d;
+	}
+
+      for (; j < h->nsyms && syms[j].module == i; j++)
+	{
+	  if (syms[j].name >= h->strtab_size
+	      || syms[j].offset > h->image_size)
+	    {
+	      grub_error (GRUB_ERR_BAD_MODULE, "invalid prelinked bundle");
+	      goto fail_mod;
+	    }
+	  if (grub_dl_register_symbol (strtab + syms[j].name,
+				       image + syms[j].offset,
+				       syms[j].isfunc, mod))
+	    goto fail_mod;
+	}
+
+      grub_boot_time ("Initing module %s", mod->name);
+      grub_dl_init (mod);
+      grub_boot_time ("Module %s inited", mod->name);
+    }
+
+  return GRUB_ERR_NONE;
+
+ fail_mod:
+  grub_dl_bundle_free_mod (mod);
+ fail:
+  /* Modules that already ran their init live in the image, keep it then.  */
+  if (i == 0)
+    grub_free (image);
+  return grub_errno;
+
+ fail_imports:
+  grub_free (imports);
+ fail_image:
+  grub_free (image);
+  return grub_errno;
+}
+#endif
+
 /* Load a module from the file FILENAME.  */
 grub_dl_t
 grub_dl_load_file (const char *filename)
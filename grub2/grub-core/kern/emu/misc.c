@@ -171,6 +171,16 @@ grub_get_time_ms (void)
   return (tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+grub_uint64_t
+grub_util_get_time_us (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, 0);
+
+  return ((grub_uint64_t) tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
 size_t
 grub_util_get_image_size (const char *path)
 {
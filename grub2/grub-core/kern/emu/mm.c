@@ -21,10 +21,60 @@
 #include <grub/types.h>
 #include <grub/err.h>
 #include <grub/mm.h>
+#include <grub/emu/misc.h>
 #include <stdlib.h>
 #include <string.h>
 #include <grub/i18n.h>
 
+#ifdef HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+
+static grub_size_t mm_in_use, mm_peak;
+
+static void
+account_alloc (void *ptr)
+{
+  if (! ptr)
+    return;
+  mm_in_use += malloc_usable_size (ptr);
+  if (mm_in_use > mm_peak)
+    mm_peak = mm_in_use;
+}
+
+static void
+account_free (void *ptr)
+{
+  grub_size_t size = malloc_usable_size (ptr);
+
+  /* Memory from plain malloc may be released with grub_free.  */
+  mm_in_use = mm_in_use > size ? mm_in_use - size : 0;
+}
+#else
+static const grub_size_t mm_in_use, mm_peak;
+#define account_alloc(ptr)
+#define account_free(ptr)
+#endif
+
+grub_size_t
+grub_util_mm_in_use (void)
+{
+  return mm_in_use;
+}
+
+grub_size_t
+grub_util_mm_peak (void)
+{
+  return mm_peak;
+}
+
+void
+grub_util_mm_reset_peak (void)
+{
+#ifdef HAVE_MALLOC_USABLE_SIZE
+  mm_peak = mm_in_use;
+#endif
+}
+
 void *
 grub_calloc (grub_size_t nmemb, grub_size_t size)
 {
@@ -32,6 +82,7 @@ grub_calloc (grub_size_t nmemb, grub_size_t size)
   ret = calloc (nmemb, size);
   if (!ret)
     grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+  account_alloc (ret);
   return ret;
 }
 
@@ -42,6 +93,7 @@ grub_malloc (grub_size_t size)
   ret = malloc (size);
   if (!ret)
     grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+  account_alloc (ret);
   return ret;
 }
 
@@ -61,15 +113,29 @@ void
 grub_free (void *ptr)
 {
   if (ptr)
-    free (ptr);
+    {
+      account_free (ptr);
+      free (ptr);
+    }
 }
 
 void *
 grub_realloc (void *ptr, grub_size_t size)
 {
   void *ret;
+#ifdef HAVE_MALLOC_USABLE_SIZE
+  grub_size_t old_size = ptr ? malloc_usable_size (ptr) : 0;
+#endif
+
   ret = realloc (ptr, size);
   if (!ret)
-    grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+    {
+      grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+      return ret;
+    }
+#ifdef HAVE_MALLOC_USABLE_SIZE
+  mm_in_use = mm_in_use > old_size ? mm_in_use - old_size : 0;
+#endif
+  account_alloc (ret);
   return ret;
 }
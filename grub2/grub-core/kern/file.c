@@ -25,6 +25,7 @@
 #include <grub/fs.h>
 #include <grub/device.h>
 #include <grub/i18n.h>
+#include <grub/trace.h>
 
 void (*EXPORT_VAR (grub_grubnet_fini)) (void);
 
@@ -149,6 +150,7 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
   grub_ssize_t res;
   grub_disk_read_hook_t read_hook;
   void *read_hook_data;
+  struct grub_trace_span span;
 
   if (file->offset > file->size)
     {
@@ -177,7 +179,10 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
       file->read_hook_data = file;
       file->progress_offset = file->offset;
     }
+  grub_trace_begin (&span, grub_trace_lookup (&file->fs->trace, "file",
+					      file->fs->name));
   res = (file->fs->fs_read) (file, buf, len);
+  grub_trace_end (&span, res > 0 ? res : 0);
   file->read_hook = read_hook;
   file->read_hook_data = read_hook_data;
   if (res > 0)
@@ -58,6 +58,16 @@ grub_load_modules (void)
   struct grub_module_header *header;
   FOR_MODULES (header)
   {
+#if defined (__i386__) || defined (__x86_64__)
+    if (header->type == OBJ_TYPE_PRELINKED)
+      {
+	if (grub_dl_load_bundle ((char *) header + sizeof (struct grub_module_header),
+				 (header->size - sizeof (struct grub_module_header))))
+	  grub_fatal ("%s", grub_errmsg);
+	continue;
+      }
+#endif
+
     /* Not an ELF module, skip.  */
     if (header->type != OBJ_TYPE_ELF)
       continue;
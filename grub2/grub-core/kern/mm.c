@@ -56,6 +56,15 @@
   For safety, both allocated blocks and free ones are marked by magic
   numbers. Whenever anything unexpected is detected, GRUB aborts the
   operation.
+
+  Walking the free ring costs time proportional to the number of free
+  blocks, which grows as the heap fragments. So small blocks, up to
+  GRUB_MM_CACHE_CLASSES cells, are instead taken from and returned to
+  a cache per size, each a stack of free blocks of that size. Caches are
+  refilled by carving a batch of blocks out of one larger allocation;
+  every carved block has its own header and is a block like any other,
+  so a cache can be given back to the regions block by block when memory
+  runs short.
  */
 
 #include <config.h>
@@ -64,6 +73,7 @@
 #include <grub/disk.h>
 #include <grub/dl.h>
 #include <grub/mm_private.h>
+#include <grub/list.h>
 
 #ifdef MM_DEBUG
 # undef grub_calloc
@@ -78,6 +88,19 @@
 
 grub_mm_region_t grub_mm_base;
 
+static grub_mm_reclaimer_t grub_mm_reclaimers;
+
+struct grub_mm_cache
+{
+  /* Free blocks, linked through their headers.  */
+  grub_mm_header_t free;
+  grub_size_t cached;
+  grub_size_t used;
+};
+
+/* Indexed by block size in cells, minus one.  */
+static struct grub_mm_cache mm_caches[GRUB_MM_CACHE_CLASSES];
+
 /* Get a header from the pointer PTR, and set *P and *R to a pointer
    to the header and a pointer to its region, respectively. PTR must
    be allocated.  */
@@ -96,9 +119,11 @@ get_header_from_pointer (void *ptr, grub_mm_header_t *p, grub_mm_region_t *r)
     grub_fatal ("out of range pointer %p", ptr);
 
   *p = (grub_mm_header_t) ptr - 1;
-  if ((*p)->magic == GRUB_MM_FREE_MAGIC)
+  if ((*p)->magic == GRUB_MM_FREE_MAGIC
+      || (*p)->magic == GRUB_MM_CACHE_MAGIC)
     grub_fatal ("double free at %p", *p);
-  if ((*p)->magic != GRUB_MM_ALLOC_MAGIC)
+  if ((*p)->magic != GRUB_MM_ALLOC_MAGIC
+      && (*p)->magic != GRUB_MM_SLAB_MAGIC)
     grub_fatal ("alloc magic is broken at %p: %lx", *p,
 		(unsigned long) (*p)->magic);
 }
@@ -312,6 +337,60 @@ grub_real_malloc (grub_mm_header_t *first, grub_size_t n, grub_size_t align)
   return 0;
 }
 
+static void free_block (grub_mm_header_t p, grub_mm_region_t r);
+
+/* Take a block of N cells from its size-class cache, refilling the cache
+   first if it is empty.  */
+static void *
+cache_alloc (grub_size_t n)
+{
+  struct grub_mm_cache *c = &mm_caches[n - 1];
+  grub_mm_header_t p;
+
+  if (! c->free)
+    {
+      grub_mm_region_t r;
+      grub_size_t count, i;
+      void *batch = 0;
+
+      count = (GRUB_MM_CACHE_BATCH >> GRUB_MM_ALIGN_LOG2) / n;
+      for (r = grub_mm_base; r; r = r->next)
+	{
+	  batch = grub_real_malloc (&(r->first), count * n, 1);
+	  if (! batch)
+	    continue;
+	  /* A full region is marked by its first block being an allocated
+	     one, which must not be carved up.  */
+	  if (r->first != (grub_mm_header_t) batch - 1)
+	    break;
+	  free_block ((grub_mm_header_t) batch - 1, r);
+	  batch = 0;
+	}
+      if (! batch)
+	return 0;
+
+      /* Carve it up, keeping the blocks in address order.  */
+      p = (grub_mm_header_t) batch - 1;
+      for (i = count; i > 0; i--)
+	{
+	  grub_mm_header_t h = p + (i - 1) * n;
+
+	  h->size = n;
+	  h->magic = GRUB_MM_CACHE_MAGIC;
+	  h->next = c->free;
+	  c->free = h;
+	}
+      c->cached += count;
+    }
+
+  p = c->free;
+  c->free = p->next;
+  c->cached--;
+  c->used++;
+  p->magic = GRUB_MM_SLAB_MAGIC;
+  return p + 1;
+}
+
 /* Allocate SIZE bytes with the alignment ALIGN and return the pointer.  */
 void *
 grub_memalign (grub_size_t align, grub_size_t size)
@@ -336,6 +415,15 @@ grub_memalign (grub_size_t align, grub_size_t size)
   if (align == 0)
     align = 1;
 
+  if (align == 1 && n <= GRUB_MM_CACHE_CLASSES)
+    {
+      void *p;
+
+      p = cache_alloc (n);
+      if (p)
+	return p;
+    }
+
  again:
 
   for (r = grub_mm_base; r; r = r->next)
@@ -356,8 +444,26 @@ grub_memalign (grub_size_t align, grub_size_t size)
       count++;
       goto again;
 
-#if 0
     case 1:
+      /* Give the free blocks of the size-class caches back.  */
+      grub_mm_flush_caches ();
+      count++;
+      goto again;
+
+    case 2:
+      {
+	grub_mm_reclaimer_t reclaimer;
+
+	/* Drop the caches kept by modules.  */
+	FOR_LIST_ELEMENTS (reclaimer, grub_mm_reclaimers)
+	  reclaimer->reclaim ();
+	grub_mm_flush_caches ();
+	count++;
+	goto again;
+      }
+
+#if 0
+    case 3:
       /* Unload unneeded modules.  */
       grub_dl_unload_unneeded ();
       count++;
@@ -393,18 +499,10 @@ grub_zalloc (grub_size_t size)
   return ret;
 }
 
-/* Deallocate the pointer PTR.  */
-void
-grub_free (void *ptr)
+/* Return the block P to the free ring of its region R.  */
+static void
+free_block (grub_mm_header_t p, grub_mm_region_t r)
 {
-  grub_mm_header_t p;
-  grub_mm_region_t r;
-
-  if (! ptr)
-    return;
-
-  get_header_from_pointer (ptr, &p, &r);
-
   if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
     {
       p->magic = GRUB_MM_FREE_MAGIC;
@@ -463,6 +561,65 @@ grub_free (void *ptr)
     }
 }
 
+/* Deallocate the pointer PTR.  */
+void
+grub_free (void *ptr)
+{
+  grub_mm_header_t p;
+  grub_mm_region_t r;
+
+  if (! ptr)
+    return;
+
+  get_header_from_pointer (ptr, &p, &r);
+
+  if (p->magic == GRUB_MM_SLAB_MAGIC)
+    {
+      struct grub_mm_cache *c = &mm_caches[p->size - 1];
+
+      p->magic = GRUB_MM_CACHE_MAGIC;
+      p->next = c->free;
+      c->free = p;
+      c->cached++;
+      c->used--;
+      return;
+    }
+
+  free_block (p, r);
+}
+
+void
+grub_mm_flush_caches (void)
+{
+  unsigned i;
+
+  for (i = 0; i < GRUB_MM_CACHE_CLASSES; i++)
+    while (mm_caches[i].free)
+      {
+	grub_mm_header_t p = mm_caches[i].free;
+	grub_mm_region_t r;
+
+	mm_caches[i].free = p->next;
+	mm_caches[i].cached--;
+	p->magic = GRUB_MM_ALLOC_MAGIC;
+	get_header_from_pointer (p + 1, &p, &r);
+	free_block (p, r);
+      }
+}
+
+void
+grub_mm_register_reclaimer (grub_mm_reclaimer_t reclaimer)
+{
+  grub_list_push (GRUB_AS_LIST_P (&grub_mm_reclaimers),
+		  GRUB_AS_LIST (reclaimer));
+}
+
+void
+grub_mm_unregister_reclaimer (grub_mm_reclaimer_t reclaimer)
+{
+  grub_list_remove (GRUB_AS_LIST (reclaimer));
+}
+
 /* Reallocate SIZE bytes and return the pointer. The contents will be
    the same as that of PTR.  */
 void *
@@ -532,6 +689,7 @@ void
 grub_mm_dump (unsigned lineno)
 {
   grub_mm_region_t r;
+  unsigned i;
 
   grub_printf ("called at line %u\n", lineno);
   for (r = grub_mm_base; r; r = r->next)
@@ -550,12 +708,22 @@ grub_mm_dump (unsigned lineno)
 			   p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2, p->next);
 	      break;
 	    case GRUB_MM_ALLOC_MAGIC:
+	    case GRUB_MM_SLAB_MAGIC:
 	      grub_printf ("A:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
 	      break;
+	    case GRUB_MM_CACHE_MAGIC:
+	      grub_printf ("C:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
+	      break;
 	    }
 	}
     }
 
+  for (i = 0; i < GRUB_MM_CACHE_CLASSES; i++)
+    if (mm_caches[i].used || mm_caches[i].cached)
+      grub_printf ("cache %u: %" PRIuGRUB_SIZE " used, %" PRIuGRUB_SIZE
+		   " cached\n", (i + 1) << GRUB_MM_ALIGN_LOG2,
+		   mm_caches[i].used, mm_caches[i].cached);
+
   grub_printf ("\n");
 }
 
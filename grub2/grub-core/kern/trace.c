@@ -0,0 +1,134 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/trace.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/time.h>
+
+#if defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)
+#include <grub/emu/misc.h>
+#elif defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/tsc.h>
+#define TRACE_USE_TSC	1
+#endif
+
+/* Sorted by name.  */
+struct grub_trace_counter *grub_trace_counters;
+
+/* Ticks spent in spans which ended inside the innermost running one.  */
+grub_uint64_t grub_trace_nested;
+
+static int
+name_matches (const char *full, const char *layer, const char *name)
+{
+  grub_size_t len = grub_strlen (layer);
+
+  if (grub_strncmp (full, layer, len) != 0)
+    return 0;
+  if (! name)
+    return full[len] == '\0';
+  return full[len] == '.' && grub_strcmp (full + len + 1, name) == 0;
+}
+
+struct grub_trace_counter *
+grub_trace_counter_get (const char *layer, const char *name)
+{
+  struct grub_trace_counter *counter, **prev;
+
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    if (name_matches (counter->name, layer, name))
+      return counter;
+
+  grub_error_push ();
+  counter = grub_zalloc (sizeof (*counter));
+  if (! counter)
+    goto fail;
+  if (name)
+    counter->name = grub_xasprintf ("%s.%s", layer, name);
+  else
+    counter->name = grub_strdup (layer);
+  if (! counter->name)
+    goto fail;
+
+  for (prev = &grub_trace_counters; *prev; prev = &(*prev)->next)
+    if (grub_strcmp ((*prev)->name, counter->name) > 0)
+      break;
+  counter->next = *prev;
+  *prev = counter;
+  grub_error_pop ();
+  return counter;
+
+ fail:
+  /* Tracing must never make the traced operation fail.  */
+  grub_free (counter);
+  grub_errno = GRUB_ERR_NONE;
+  grub_error_pop ();
+  return NULL;
+}
+
+grub_uint64_t
+grub_trace_clock (void)
+{
+#ifdef TRACE_USE_TSC
+  /* Unlike grub_get_tsc this does not serialize with CPUID, which would
+     trap to the hypervisor on every call in a VM.  */
+  if (grub_tsc_rate)
+    {
+      grub_uint32_t lo, hi;
+
+      asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+      return (((grub_uint64_t) hi) << 32) | lo;
+    }
+#elif defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)
+  return grub_util_get_time_us ();
+#endif
+  return grub_get_time_ms ();
+}
+
+grub_uint64_t
+grub_trace_ticks_to_us (grub_uint64_t ticks)
+{
+#ifdef TRACE_USE_TSC
+  if (grub_tsc_rate)
+    {
+      /* The rate is in ms per 2^32 ticks.  */
+      grub_uint64_t lo = (ticks & 0xffffffff) * grub_tsc_rate;
+
+      return (ticks >> 32) * grub_tsc_rate * 1000
+	+ (lo >> 32) * 1000 + (((lo & 0xffffffff) * 1000) >> 32);
+    }
+#elif defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)
+  return ticks;
+#endif
+  return ticks * 1000;
+}
+
+void
+grub_trace_reset (void)
+{
+  struct grub_trace_counter *counter;
+
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    {
+      counter->count = 0;
+      counter->bytes = 0;
+      counter->ticks = 0;
+      counter->self_ticks = 0;
+    }
+}
@@ -21,15 +21,31 @@
 #include <grub/file.h>
 #include <grub/verify.h>
 #include <grub/dl.h>
+#include <grub/trace.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
 struct grub_file_verifier *grub_file_verifiers;
 
+/*
+ * Verifiers which accept multiple chunks are fed while the file is read,
+ * so hashing happens on data that is still hot in the cache.
+ */
+#define VERIFY_CHUNK_SIZE (1 << 20)
+
 struct grub_verified
 {
   grub_file_t file;
   void *buf;
+  enum grub_file_type type;
+  /*
+   * For GRUB_FILE_TYPE_READ_ONCE files the first verifier is set up at open
+   * time but only fed once the caller reads, so that the data is verified
+   * in the caller's buffer rather than copied there from ours.
+   */
+  struct grub_file_verifier *ver;
+  void *context;
+  enum grub_verify_flags flags;
 };
 typedef struct grub_verified *grub_verified_t;
 
@@ -38,16 +54,194 @@ verified_free (grub_verified_t verified)
 {
   if (verified)
     {
+      if (verified->ver && verified->ver->close)
+	verified->ver->close (verified->context);
       grub_free (verified->buf);
       grub_free (verified);
     }
 }
 
+/* Set up the first verifier which wants to check IO, if any.  */
+static grub_err_t
+find_verifier (grub_file_t io, enum grub_file_type type,
+	       struct grub_file_verifier **found, void **context,
+	       enum grub_verify_flags *flags)
+{
+  struct grub_file_verifier *ver;
+  grub_err_t err;
+  int defer = 0;
+
+  FOR_LIST_ELEMENTS(ver, grub_file_verifiers)
+    {
+      *flags = 0;
+      err = ver->init (io, type, context, flags);
+      if (err)
+	return err;
+      if (*flags & GRUB_VERIFY_FLAGS_DEFER_AUTH)
+	{
+	  defer = 1;
+	  continue;
+	}
+      if (!(*flags & GRUB_VERIFY_FLAGS_SKIP_VERIFICATION))
+	break;
+    }
+
+  if (!ver && defer)
+    return grub_error (GRUB_ERR_ACCESS_DENIED,
+		       N_("verification requested but nobody cares: %s"),
+		       io->name);
+
+  *found = ver;
+  return GRUB_ERR_NONE;
+}
+
+/*
+ * Read all of IO into BUF while feeding it to VER, which find_verifier set
+ * up, and then let every later verifier check BUF.  VER's context is closed
+ * on return.
+ */
+static grub_err_t
+verify_into (grub_file_t io, enum grub_file_type type, void *buf,
+	     grub_size_t size, struct grub_file_verifier *ver, void *context,
+	     enum grub_verify_flags flags)
+{
+  grub_size_t off, len;
+  grub_err_t err;
+
+  if (grub_file_seek (io, 0) == (grub_off_t) -1)
+    {
+      err = grub_errno;
+      goto fail;
+    }
+
+  off = 0;
+  do
+    {
+      len = size - off;
+      if (!(flags & GRUB_VERIFY_FLAGS_SINGLE_CHUNK) && len > VERIFY_CHUNK_SIZE)
+	len = VERIFY_CHUNK_SIZE;
+
+      if (grub_file_read (io, (char *) buf + off, len) != (grub_ssize_t) len)
+	{
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
+			io->name);
+	  err = grub_errno;
+	  goto fail;
+	}
+
+      err = ver->write (context, (char *) buf + off, len);
+      if (err)
+	goto fail;
+
+      off += len;
+    }
+  while (off < size);
+
+  err = ver->fini ? ver->fini (context) : GRUB_ERR_NONE;
+  if (err)
+    goto fail;
+
+  if (ver->close)
+    ver->close (context);
+
+  FOR_LIST_ELEMENTS_NEXT(ver, grub_file_verifiers)
+    {
+      flags = 0;
+      err = ver->init (io, type, &context, &flags);
+      if (err)
+	return err;
+      if (flags & GRUB_VERIFY_FLAGS_SKIP_VERIFICATION ||
+	  /* Verification done earlier. So, we are happy here. */
+	  flags & GRUB_VERIFY_FLAGS_DEFER_AUTH)
+	continue;
+      err = ver->write (context, buf, size);
+      if (err)
+	goto fail;
+
+      err = ver->fini ? ver->fini (context) : GRUB_ERR_NONE;
+      if (err)
+	goto fail;
+
+      if (ver->close)
+	ver->close (context);
+    }
+
+  return GRUB_ERR_NONE;
+
+ fail:
+  if (ver->close)
+    ver->close (context);
+  return err;
+}
+
+/* Read and verify the whole file into a buffer of our own.  */
+static grub_err_t
+verified_buffer (grub_verified_t verified, grub_size_t size)
+{
+  struct grub_file_verifier *ver = verified->ver;
+  void *context = verified->context;
+  enum grub_verify_flags flags = verified->flags;
+  grub_err_t err;
+
+  /* The context was used up by a read straight into the caller's buffer.  */
+  verified->ver = NULL;
+  if (!ver)
+    {
+      err = find_verifier (verified->file, verified->type, &ver, &context,
+			   &flags);
+      if (err)
+	return err;
+      if (!ver)
+	return grub_error (GRUB_ERR_BUG, "verifier went away: %s",
+			   verified->file->name);
+    }
+
+  verified->buf = grub_malloc (size);
+  if (!verified->buf)
+    {
+      if (ver->close)
+	ver->close (context);
+      return grub_errno;
+    }
+
+  err = verify_into (verified->file, verified->type, verified->buf, size,
+		     ver, context, flags);
+  if (err)
+    {
+      grub_free (verified->buf);
+      verified->buf = NULL;
+    }
+  return err;
+}
+
 static grub_ssize_t
 verified_read (struct grub_file *file, char *buf, grub_size_t len)
 {
+  static struct grub_trace_counter *trace;
   grub_verified_t verified = file->data;
+  struct grub_file_verifier *ver = verified->ver;
 
+  if (!verified->buf)
+    {
+      if (ver && file->offset == 0 && len == file->size)
+	{
+	  verified->ver = NULL;
+	  if (verify_into (verified->file, verified->type, buf, len, ver,
+			   verified->context, verified->flags))
+	    {
+	      /* Leave nothing unverified behind.  */
+	      grub_memset (buf, 0, len);
+	      return -1;
+	    }
+	  return len;
+	}
+
+      if (verified_buffer (verified, file->size))
+	return -1;
+    }
+
+  grub_trace_count (grub_trace_lookup (&trace, "copy", "verify"), len);
   grub_memcpy (buf, (char *) verified->buf + file->offset, len);
   return len;
 }
@@ -83,7 +277,7 @@ grub_verifiers_open (grub_file_t io, enum grub_file_type type)
   void *context;
   grub_file_t ret = 0;
   grub_err_t err;
-  int defer = 0;
+  enum grub_verify_flags flags;
 
   grub_dprintf ("verify", "file: %s type: %d\n", io->name, type);
 
@@ -97,33 +291,12 @@ grub_verifiers_open (grub_file_t io, enum grub_file_type type)
        || io->device->disk->dev->id == GRUB_DISK_DEVICE_PROCFS_ID))
     return io;
 
-  FOR_LIST_ELEMENTS(ver, grub_file_verifiers)
-    {
-      enum grub_verify_flags flags = 0;
-      err = ver->init (io, type, &context, &flags);
-      if (err)
-	goto fail_noclose;
-      if (flags & GRUB_VERIFY_FLAGS_DEFER_AUTH)
-	{
-	  defer = 1;
-	  continue;
-	}
-      if (!(flags & GRUB_VERIFY_FLAGS_SKIP_VERIFICATION))
-	break;
-    }
+  if (find_verifier (io, type, &ver, &context, &flags))
+    return NULL;
 
+  /* No verifiers wanted to verify. Just return underlying file. */
   if (!ver)
-    {
-      if (defer)
-	{
-	  grub_error (GRUB_ERR_ACCESS_DENIED,
-		      N_("verification requested but nobody cares: %s"), io->name);
-	  goto fail_noclose;
-	}
-
-      /* No verifiers wanted to verify. Just return underlying file. */
-      return io;
-    }
+    return io;
 
   ret = grub_malloc (sizeof (*ret));
   if (!ret)
@@ -140,58 +313,37 @@ grub_verifiers_open (grub_file_t io, enum grub_file_type type)
 		  N_("big file signature isn't implemented yet"));
       goto fail;
     }
-  verified = grub_malloc (sizeof (*verified));
+  verified = grub_zalloc (sizeof (*verified));
   if (!verified)
     {
       goto fail;
     }
-  verified->buf = grub_malloc (ret->size);
-  if (!verified->buf)
+  verified->file = io;
+  verified->type = type;
+
+  /*
+   * grub_file_read() never calls verified_read() for an empty file, so one
+   * is verified right here like any other file.
+   */
+  if ((type & GRUB_FILE_TYPE_READ_ONCE) && ret->size)
     {
-      goto fail;
+      verified->ver = ver;
+      verified->context = context;
+      verified->flags = flags;
+      ret->data = verified;
+      return ret;
     }
-  if (grub_file_read (io, verified->buf, ret->size) != (grub_ssize_t) ret->size)
+
+  verified->buf = grub_malloc (ret->size);
+  if (!verified->buf)
     {
-      if (!grub_errno)
-	grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
-		    io->name);
       goto fail;
     }
 
-  err = ver->write (context, verified->buf, ret->size);
-  if (err)
-    goto fail;
-
-  err = ver->fini ? ver->fini (context) : GRUB_ERR_NONE;
+  err = verify_into (io, type, verified->buf, ret->size, ver, context, flags);
   if (err)
-    goto fail;
-
-  if (ver->close)
-    ver->close (context);
+    goto fail_noclose;
 
-  FOR_LIST_ELEMENTS_NEXT(ver, grub_file_verifiers)
-    {
-      enum grub_verify_flags flags = 0;
-      err = ver->init (io, type, &context, &flags);
-      if (err)
-	goto fail_noclose;
-      if (flags & GRUB_VERIFY_FLAGS_SKIP_VERIFICATION ||
-	  /* Verification done earlier. So, we are happy here. */
-	  flags & GRUB_VERIFY_FLAGS_DEFER_AUTH)
-	continue;
-      err = ver->write (context, verified->buf, ret->size);
-      if (err)
-	goto fail;
-
-      err = ver->fini ? ver->fini (context) : GRUB_ERR_NONE;
-      if (err)
-	goto fail;
-
-      if (ver->close)
-	ver->close (context);
-    }
-
-  verified->file = io;
   ret->data = verified;
   return ret;
 
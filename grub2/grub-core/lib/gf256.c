@@ -0,0 +1,485 @@
+/* gf256.c - arithmetic on blocks of GF(2^8) elements.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+#include <grub/gf256.h>
+#if defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* x**y, twice so that sums of two logarithms need no reduction.  */
+static grub_uint8_t powx[255 * 2];
+/* Such an s that x**s = y */
+static unsigned powx_inv[256];
+static const grub_uint8_t poly = 0x1d;
+
+grub_uint8_t
+grub_gf256_exp (unsigned n)
+{
+  return powx[n % 255];
+}
+
+unsigned
+grub_gf256_log (grub_uint8_t a)
+{
+  return powx_inv[a];
+}
+
+grub_uint8_t
+grub_gf256_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  if (! a || ! b)
+    return 0;
+  return powx[powx_inv[a] + powx_inv[b]];
+}
+
+static void
+gf256_init_table (void)
+{
+  unsigned i;
+
+  grub_uint8_t cur = 1;
+  for (i = 0; i < 255; i++)
+    {
+      powx[i] = cur;
+      powx[i + 255] = cur;
+      powx_inv[cur] = i;
+      if (cur & 0x80)
+	cur = (cur << 1) ^ poly;
+      else
+	cur <<= 1;
+    }
+}
+
+static int
+gf256_supported_scalar (void)
+{
+  return 1;
+}
+
+static void
+gf256_add_scalar (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t size)
+{
+  grub_crypto_xor (dst, dst, src, size);
+}
+
+/* Blocks shorter than this are multiplied element by element instead of
+   through a table of all 256 products.  */
+#define GF256_MUL_TABLE_MIN	256
+
+static void
+gf256_mul_scalar (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		  grub_size_t size)
+{
+  grub_uint8_t table[256];
+  grub_size_t i;
+
+  if (size < GF256_MUL_TABLE_MIN)
+    {
+      for (i = 0; i < size; i++)
+	dst[i] = grub_gf256_mul (c, src[i]);
+      return;
+    }
+
+  for (i = 0; i < 256; i++)
+    table[i] = grub_gf256_mul (c, i);
+  for (i = 0; i < size; i++)
+    dst[i] = table[src[i]];
+}
+
+static void
+gf256_muladd_scalar (grub_uint8_t *dst, const grub_uint8_t *src,
+		     grub_uint8_t c, grub_size_t size)
+{
+  grub_uint8_t table[256];
+  grub_size_t i;
+
+  if (size < GF256_MUL_TABLE_MIN)
+    {
+      for (i = 0; i < size; i++)
+	dst[i] ^= grub_gf256_mul (c, src[i]);
+      return;
+    }
+
+  for (i = 0; i < 256; i++)
+    table[i] = grub_gf256_mul (c, i);
+  for (i = 0; i < size; i++)
+    dst[i] ^= table[src[i]];
+}
+
+static const struct grub_gf256_impl gf256_scalar =
+  {
+    .name = "scalar",
+    .supported = gf256_supported_scalar,
+    .add = gf256_add_scalar,
+    .mul = gf256_mul_scalar,
+    .muladd = gf256_muladd_scalar
+  };
+
+#if defined (__i386__) || defined (__x86_64__)
+
+/* GRUB is built without SSE, so the vector kernels enable it per function
+   and are only selected once the CPU and the firmware or OS have been
+   checked to support the instructions and register state they use.  */
+
+static void
+gf256_cpuid (grub_uint32_t leaf, grub_uint32_t regs[4])
+{
+  asm volatile ("cpuid"
+		: "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+		: "0" (leaf), "2" (0));
+}
+
+static int
+gf256_cpu_has (grub_uint32_t leaf, int reg, int bit)
+{
+  grub_uint32_t regs[4];
+
+#ifdef __i386__
+  if (! grub_cpu_is_cpuid_supported ())
+    return 0;
+#endif
+
+  gf256_cpuid (leaf & 0x80000000, regs);
+  if (regs[0] < leaf)
+    return 0;
+
+  gf256_cpuid (leaf, regs);
+  return !! (regs[reg] & (1U << bit));
+}
+
+enum { CPUID_EAX, CPUID_EBX, CPUID_ECX, CPUID_EDX };
+
+/* Whether SSE instructions may be used at all, i.e. CR4.OSFXSR is set.  */
+static int
+gf256_sse_enabled (void)
+{
+#if defined (GRUB_UTIL) || defined (GRUB_MACHINE_EMU) \
+    || defined (GRUB_MACHINE_XEN)
+  /* Not running in ring 0, but the OS or hypervisor enables SSE.  */
+  return 1;
+#else
+  grub_addr_t cr4;
+
+  asm volatile ("mov %%cr4, %0" : "=r" (cr4));
+  return !! (cr4 & (1 << 9));
+#endif
+}
+
+static int
+gf256_supported_sse2 (void)
+{
+  return gf256_cpu_has (1, CPUID_EDX, 26) && gf256_sse_enabled ();
+}
+
+static int
+gf256_supported_ssse3 (void)
+{
+  return gf256_supported_sse2 () && gf256_cpu_has (1, CPUID_ECX, 9);
+}
+
+static int
+gf256_supported_avx2 (void)
+{
+  grub_uint32_t xcr0, edx;
+
+  /* OSXSAVE, AVX, then the YMM state being enabled in XCR0.  */
+  if (! gf256_supported_ssse3 () || ! gf256_cpu_has (1, CPUID_ECX, 27)
+      || ! gf256_cpu_has (1, CPUID_ECX, 28))
+    return 0;
+
+  asm volatile ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+  if ((xcr0 & 6) != 6)
+    return 0;
+
+  return gf256_cpu_has (7, CPUID_EBX, 5);
+}
+
+typedef grub_uint8_t gf256_v16 __attribute__ ((vector_size (16)));
+typedef grub_int8_t gf256_v16s __attribute__ ((vector_size (16)));
+typedef grub_uint16_t gf256_v16w __attribute__ ((vector_size (16)));
+typedef char gf256_v16c __attribute__ ((vector_size (16)));
+typedef grub_uint8_t gf256_v32 __attribute__ ((vector_size (32)));
+typedef grub_uint16_t gf256_v32w __attribute__ ((vector_size (32)));
+typedef char gf256_v32c __attribute__ ((vector_size (32)));
+
+struct gf256_unaligned16
+{
+  gf256_v16 v;
+} GRUB_PACKED __attribute__ ((may_alias));
+
+struct gf256_unaligned32
+{
+  gf256_v32 v;
+} GRUB_PACKED __attribute__ ((may_alias));
+
+#define LOAD16(p)	(((const struct gf256_unaligned16 *) (p))->v)
+#define STORE16(p, x)	(((struct gf256_unaligned16 *) (p))->v = (x))
+#define LOAD32(p)	(((const struct gf256_unaligned32 *) (p))->v)
+#define STORE32(p, x)	(((struct gf256_unaligned32 *) (p))->v = (x))
+
+/* Products of C with all low and all high nibbles, for PSHUFB.  */
+static void
+gf256_nibble_tables (grub_uint8_t c, grub_uint8_t lo[16], grub_uint8_t hi[16])
+{
+  unsigned i;
+
+  for (i = 0; i < 16; i++)
+    {
+      lo[i] = grub_gf256_mul (c, i);
+      hi[i] = grub_gf256_mul (c, i << 4);
+    }
+}
+
+static void __attribute__ ((target ("sse2")))
+gf256_add_sse2 (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t size)
+{
+  for (; size >= 64; size -= 64, dst += 64, src += 64)
+    {
+      STORE16 (dst, LOAD16 (dst) ^ LOAD16 (src));
+      STORE16 (dst + 16, LOAD16 (dst + 16) ^ LOAD16 (src + 16));
+      STORE16 (dst + 32, LOAD16 (dst + 32) ^ LOAD16 (src + 32));
+      STORE16 (dst + 48, LOAD16 (dst + 48) ^ LOAD16 (src + 48));
+    }
+  for (; size >= 16; size -= 16, dst += 16, src += 16)
+    STORE16 (dst, LOAD16 (dst) ^ LOAD16 (src));
+
+  gf256_add_scalar (dst, src, size);
+}
+
+/* Without PSHUFB, multiply by C bit by bit, doubling V in between.  */
+static inline gf256_v16 __attribute__ ((target ("sse2"), always_inline))
+gf256_mul16_sse2 (gf256_v16 v, grub_uint8_t c)
+{
+  const gf256_v16s zero = { 0 };
+  gf256_v16 acc = { 0 }, mask;
+
+  while (1)
+    {
+      if (c & 1)
+	acc ^= v;
+      c >>= 1;
+      if (! c)
+	return acc;
+      mask = (gf256_v16) ((gf256_v16s) v < zero);
+      v = (v + v) ^ (mask & poly);
+    }
+}
+
+static void __attribute__ ((target ("sse2")))
+gf256_mul_sse2 (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		grub_size_t size)
+{
+  for (; size >= 16; size -= 16, dst += 16, src += 16)
+    STORE16 (dst, gf256_mul16_sse2 (LOAD16 (src), c));
+
+  gf256_mul_scalar (dst, src, c, size);
+}
+
+static void __attribute__ ((target ("sse2")))
+gf256_muladd_sse2 (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		   grub_size_t size)
+{
+  for (; size >= 16; size -= 16, dst += 16, src += 16)
+    STORE16 (dst, LOAD16 (dst) ^ gf256_mul16_sse2 (LOAD16 (src), c));
+
+  gf256_muladd_scalar (dst, src, c, size);
+}
+
+static inline gf256_v16 __attribute__ ((target ("ssse3"), always_inline))
+gf256_mul16_ssse3 (gf256_v16 v, gf256_v16 lo, gf256_v16 hi)
+{
+  gf256_v16 l, h;
+
+  l = v & 0x0f;
+  h = (gf256_v16) ((gf256_v16w) v >> 4) & 0x0f;
+
+  return (gf256_v16) __builtin_ia32_pshufb128 ((gf256_v16c) lo, (gf256_v16c) l)
+    ^ (gf256_v16) __builtin_ia32_pshufb128 ((gf256_v16c) hi, (gf256_v16c) h);
+}
+
+static void __attribute__ ((target ("ssse3")))
+gf256_mul_ssse3 (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		 grub_size_t size)
+{
+  grub_uint8_t tlo[16], thi[16];
+  gf256_v16 lo, hi;
+
+  gf256_nibble_tables (c, tlo, thi);
+  lo = LOAD16 (tlo);
+  hi = LOAD16 (thi);
+
+  for (; size >= 16; size -= 16, dst += 16, src += 16)
+    STORE16 (dst, gf256_mul16_ssse3 (LOAD16 (src), lo, hi));
+
+  gf256_mul_scalar (dst, src, c, size);
+}
+
+static void __attribute__ ((target ("ssse3")))
+gf256_muladd_ssse3 (grub_uint8_t *dst, const grub_uint8_t *src,
+		    grub_uint8_t c, grub_size_t size)
+{
+  grub_uint8_t tlo[16], thi[16];
+  gf256_v16 lo, hi;
+
+  gf256_nibble_tables (c, tlo, thi);
+  lo = LOAD16 (tlo);
+  hi = LOAD16 (thi);
+
+  for (; size >= 16; size -= 16, dst += 16, src += 16)
+    STORE16 (dst, LOAD16 (dst) ^ gf256_mul16_ssse3 (LOAD16 (src), lo, hi));
+
+  gf256_muladd_scalar (dst, src, c, size);
+}
+
+static void __attribute__ ((target ("avx2")))
+gf256_add_avx2 (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t size)
+{
+  for (; size >= 128; size -= 128, dst += 128, src += 128)
+    {
+      STORE32 (dst, LOAD32 (dst) ^ LOAD32 (src));
+      STORE32 (dst + 32, LOAD32 (dst + 32) ^ LOAD32 (src + 32));
+      STORE32 (dst + 64, LOAD32 (dst + 64) ^ LOAD32 (src + 64));
+      STORE32 (dst + 96, LOAD32 (dst + 96) ^ LOAD32 (src + 96));
+    }
+  for (; size >= 32; size -= 32, dst += 32, src += 32)
+    STORE32 (dst, LOAD32 (dst) ^ LOAD32 (src));
+
+  gf256_add_scalar (dst, src, size);
+}
+
+static inline gf256_v32 __attribute__ ((target ("avx2"), always_inline))
+gf256_mul32_avx2 (gf256_v32 v, gf256_v32 lo, gf256_v32 hi)
+{
+  gf256_v32 l, h;
+
+  l = v & 0x0f;
+  h = (gf256_v32) ((gf256_v32w) v >> 4) & 0x0f;
+
+  return (gf256_v32) __builtin_ia32_pshufb256 ((gf256_v32c) lo, (gf256_v32c) l)
+    ^ (gf256_v32) __builtin_ia32_pshufb256 ((gf256_v32c) hi, (gf256_v32c) h);
+}
+
+/* VPSHUFB looks up within each 128-bit lane, so both lanes get the
+   tables.  */
+static void
+gf256_nibble_tables32 (grub_uint8_t c, grub_uint8_t lo[32], grub_uint8_t hi[32])
+{
+  gf256_nibble_tables (c, lo, hi);
+  grub_memcpy (lo + 16, lo, 16);
+  grub_memcpy (hi + 16, hi, 16);
+}
+
+static void __attribute__ ((target ("avx2")))
+gf256_mul_avx2 (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		grub_size_t size)
+{
+  grub_uint8_t tlo[32], thi[32];
+  gf256_v32 lo, hi;
+
+  gf256_nibble_tables32 (c, tlo, thi);
+  lo = LOAD32 (tlo);
+  hi = LOAD32 (thi);
+
+  for (; size >= 32; size -= 32, dst += 32, src += 32)
+    STORE32 (dst, gf256_mul32_avx2 (LOAD32 (src), lo, hi));
+
+  gf256_mul_scalar (dst, src, c, size);
+}
+
+static void __attribute__ ((target ("avx2")))
+gf256_muladd_avx2 (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		   grub_size_t size)
+{
+  grub_uint8_t tlo[32], thi[32];
+  gf256_v32 lo, hi;
+
+  gf256_nibble_tables32 (c, tlo, thi);
+  lo = LOAD32 (tlo);
+  hi = LOAD32 (thi);
+
+  for (; size >= 32; size -= 32, dst += 32, src += 32)
+    STORE32 (dst, LOAD32 (dst) ^ gf256_mul32_avx2 (LOAD32 (src), lo, hi));
+
+  gf256_muladd_scalar (dst, src, c, size);
+}
+
+static const struct grub_gf256_impl gf256_sse2 =
+  {
+    .name = "sse2",
+    .supported = gf256_supported_sse2,
+    .add = gf256_add_sse2,
+    .mul = gf256_mul_sse2,
+    .muladd = gf256_muladd_sse2
+  };
+
+static const struct grub_gf256_impl gf256_ssse3 =
+  {
+    .name = "ssse3",
+    .supported = gf256_supported_ssse3,
+    .add = gf256_add_sse2,
+    .mul = gf256_mul_ssse3,
+    .muladd = gf256_muladd_ssse3
+  };
+
+static const struct grub_gf256_impl gf256_avx2 =
+  {
+    .name = "avx2",
+    .supported = gf256_supported_avx2,
+    .add = gf256_add_avx2,
+    .mul = gf256_mul_avx2,
+    .muladd = gf256_muladd_avx2
+  };
+
+#endif
+
+/* In order of preference.  */
+const struct grub_gf256_impl *const grub_gf256_impls[] =
+  {
+    &gf256_scalar,
+#if defined (__i386__) || defined (__x86_64__)
+    &gf256_sse2,
+    &gf256_ssse3,
+    &gf256_avx2,
+#endif
+    NULL
+  };
+
+const struct grub_gf256_impl *grub_gf256 = &gf256_scalar;
+
+GRUB_MOD_INIT(gf256)
+{
+  unsigned i;
+
+  gf256_init_table ();
+
+  for (i = 1; grub_gf256_impls[i]; i++)
+    if (grub_gf256_impls[i]->supported ())
+      grub_gf256 = grub_gf256_impls[i];
+
+  grub_dprintf ("gf256", "using %s\n", grub_gf256->name);
+}
+
+GRUB_MOD_FINI(gf256)
+{
+}
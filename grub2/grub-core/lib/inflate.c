@@ -0,0 +1,773 @@
+/* inflate.c - decode DEFLATE streams  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bits are taken from a 64-bit buffer which is refilled eight bytes at a
+ * time while the input lasts, so that a whole literal/length code, its
+ * extra bits, the distance code and its extra bits can be decoded after a
+ * single refill.  Huffman codes of up to FAST_BITS bits are decoded with
+ * one table lookup; longer ones, which are rare, are decoded canonically
+ * from the code length counts.
+ *
+ * The output goes to a linear window, four times the history a match may
+ * reach back, which slides only when it is nearly full.  Decoded data is
+ * handed out in place from there.
+ */
+
+#include <grub/inflate.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/dl.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MAX_BITS	15
+#define FAST_BITS	10
+#define FAST_MASK	((1 << FAST_BITS) - 1)
+/* Table entries are (length << FAST_SHIFT) | symbol, 0 if not a code.  */
+#define FAST_SHIFT	9
+
+#define MAX_LCODES	286
+#define MAX_DCODES	30
+#define MAX_CODES	(MAX_LCODES + MAX_DCODES)
+#define FIX_LCODES	288
+
+#define MAX_MATCH	258
+#define WINDOW_SIZE	(4 * GRUB_INFLATE_HISTORY)
+
+struct huffman
+{
+  grub_uint16_t fast[1 << FAST_BITS];
+  /* Number of codes of each length, and the symbols ordered by code.  */
+  grub_uint16_t count[MAX_BITS + 1];
+  grub_uint16_t symbol[FIX_LCODES];
+};
+
+enum inflate_state
+  {
+    STATE_HEADER,
+    STATE_STORED,
+    STATE_CODES,
+    STATE_DONE
+  };
+
+struct grub_inflate
+{
+  grub_inflate_fill_t fill;
+  void *fill_data;
+  grub_inflate_block_hook_t hook;
+  void *hook_data;
+
+  /* Input not in the bit buffer yet.  */
+  const grub_uint8_t *in;
+  const grub_uint8_t *in_end;
+  /* Bytes returned by the fill callback so far.  */
+  grub_uint64_t in_total;
+  int eof;
+  int error;
+
+  grub_uint64_t bitbuf;
+  unsigned bitcnt;
+  /* Zero bits added to the buffer past the end of the input.  */
+  unsigned pad_bits;
+
+  enum inflate_state state;
+  int last;
+  int fixed;
+  grub_size_t stored_left;
+
+  /* Output: window[rp..wp) is decoded but not consumed, window[0] is at
+     window_off in the decompressed data.  */
+  grub_uint8_t *window;
+  grub_size_t rp;
+  grub_size_t wp;
+  grub_uint64_t window_off;
+
+  struct huffman lencode;
+  struct huffman distcode;
+};
+
+static const grub_uint16_t len_base[29] =
+  {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+  };
+
+static const grub_uint8_t len_extra[29] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+  };
+
+static const grub_uint16_t dist_base[30] =
+  {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+  };
+
+static const grub_uint8_t dist_extra[30] =
+  {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+  };
+
+/* Order of the code length code lengths.  */
+static const grub_uint8_t clen_order[19] =
+  {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+  };
+
+/* Top up the bit buffer to at least 56 bits, with zeros past the end of
+   the input.  */
+static void
+refill_slow (struct grub_inflate *inf)
+{
+  while (inf->bitcnt <= 56)
+    {
+      if (inf->in == inf->in_end && ! inf->eof)
+	{
+	  grub_ssize_t n = inf->fill (inf->fill_data, &inf->in);
+
+	  if (n <= 0)
+	    {
+	      if (n < 0)
+		inf->error = 1;
+	      inf->eof = 1;
+	      inf->in = inf->in_end = NULL;
+	    }
+	  else
+	    {
+	      inf->in_end = inf->in + n;
+	      inf->in_total += n;
+	    }
+	}
+      if (inf->in != inf->in_end)
+	inf->bitbuf |= (grub_uint64_t) *inf->in++ << inf->bitcnt;
+      else
+	inf->pad_bits += 8;
+      inf->bitcnt += 8;
+    }
+}
+
+static inline void
+refill (struct grub_inflate *inf)
+{
+  if (inf->bitcnt > 56)
+    return;
+  if (inf->in_end - inf->in >= 8)
+    {
+      inf->bitbuf |= grub_le_to_cpu64 (grub_get_unaligned64 (inf->in))
+	<< inf->bitcnt;
+      inf->in += (63 - inf->bitcnt) >> 3;
+      inf->bitcnt |= 56;
+    }
+  else
+    refill_slow (inf);
+}
+
+/* Take N bits, N <= 32, refilled by the caller.  */
+static inline unsigned
+take_bits (struct grub_inflate *inf, unsigned n)
+{
+  unsigned val = inf->bitbuf & ((1ULL << n) - 1);
+
+  inf->bitbuf >>= n;
+  inf->bitcnt -= n;
+  return val;
+}
+
+static inline grub_uint32_t
+reverse_bits (grub_uint32_t code, unsigned len)
+{
+  grub_uint32_t rev = 0;
+
+  while (len--)
+    {
+      rev = (rev << 1) | (code & 1);
+      code >>= 1;
+    }
+  return rev;
+}
+
+/* Build a decoding table from the code lengths.  Incomplete codes are
+   allowed, their unused codes fail to decode.  */
+static grub_err_t
+build_huffman (struct huffman *h, const grub_uint8_t *lengths, unsigned n)
+{
+  grub_uint16_t offs[MAX_BITS + 2];
+  grub_uint32_t code = 0;
+  unsigned sym, len;
+  int left = 1;
+
+  grub_memset (h->count, 0, sizeof (h->count));
+  grub_memset (h->fast, 0, sizeof (h->fast));
+  for (sym = 0; sym < n; sym++)
+    h->count[lengths[sym]]++;
+
+  for (len = 1; len <= MAX_BITS; len++)
+    {
+      left = (left << 1) - h->count[len];
+      if (left < 0)
+	return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			   "oversubscribed Huffman code");
+    }
+
+  offs[1] = 0;
+  for (len = 1; len <= MAX_BITS; len++)
+    offs[len + 1] = offs[len] + h->count[len];
+
+  /* Canonical codes are assigned in symbol order within each length.  */
+  for (len = 1; len <= MAX_BITS; len++)
+    {
+      for (sym = 0; sym < n; sym++)
+	{
+	  grub_uint32_t rev, step;
+
+	  if (lengths[sym] != len)
+	    continue;
+	  h->symbol[offs[len]++] = sym;
+	  if (len <= FAST_BITS)
+	    {
+	      /* Codes are sent most significant bit first.  */
+	      rev = reverse_bits (code, len);
+	      for (step = rev; step < (1 << FAST_BITS); step += 1 << len)
+		h->fast[step] = (len << FAST_SHIFT) | sym;
+	    }
+	  code++;
+	}
+      code <<= 1;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Decode a code longer than FAST_BITS, or an invalid one.  */
+static int
+decode_slow (struct grub_inflate *inf, const struct huffman *h)
+{
+  int code = 0, first = 0, index = 0;
+  grub_uint64_t bits = inf->bitbuf;
+  unsigned len;
+
+  for (len = 1; len <= MAX_BITS; len++)
+    {
+      int count = h->count[len];
+
+      code |= bits & 1;
+      bits >>= 1;
+      if (code - count < first)
+	{
+	  inf->bitbuf = bits;
+	  inf->bitcnt -= len;
+	  return h->symbol[index + (code - first)];
+	}
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+  return -1;
+}
+
+static inline int
+decode (struct grub_inflate *inf, const struct huffman *h)
+{
+  unsigned entry = h->fast[inf->bitbuf & FAST_MASK];
+
+  if (entry)
+    {
+      inf->bitbuf >>= entry >> FAST_SHIFT;
+      inf->bitcnt -= entry >> FAST_SHIFT;
+      return entry & ((1 << FAST_SHIFT) - 1);
+    }
+  return decode_slow (inf, h);
+}
+
+static grub_err_t
+init_fixed_block (struct grub_inflate *inf)
+{
+  grub_uint8_t lengths[FIX_LCODES];
+  unsigned i;
+
+  /* Consecutive fixed blocks are common, keep the tables.  */
+  if (inf->fixed)
+    return GRUB_ERR_NONE;
+
+  for (i = 0; i < 144; i++)
+    lengths[i] = 8;
+  for (; i < 256; i++)
+    lengths[i] = 9;
+  for (; i < 280; i++)
+    lengths[i] = 7;
+  for (; i < FIX_LCODES; i++)
+    lengths[i] = 8;
+  if (build_huffman (&inf->lencode, lengths, FIX_LCODES))
+    return grub_errno;
+
+  for (i = 0; i < MAX_DCODES; i++)
+    lengths[i] = 5;
+  if (build_huffman (&inf->distcode, lengths, MAX_DCODES))
+    return grub_errno;
+
+  inf->fixed = 1;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+init_dynamic_block (struct grub_inflate *inf)
+{
+  grub_uint8_t lengths[MAX_CODES];
+  unsigned nlen, ndist, ncode, i;
+
+  inf->fixed = 0;
+
+  refill (inf);
+  nlen = take_bits (inf, 5) + 257;
+  ndist = take_bits (inf, 5) + 1;
+  ncode = take_bits (inf, 4) + 4;
+  if (nlen > MAX_LCODES || ndist > MAX_DCODES)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "too many length or distance codes");
+
+  /* At most 57 bits, in two refills.  */
+  for (i = 0; i < ncode; i++)
+    {
+      if (i == 10)
+	refill (inf);
+      lengths[clen_order[i]] = take_bits (inf, 3);
+    }
+  for (; i < 19; i++)
+    lengths[clen_order[i]] = 0;
+  if (build_huffman (&inf->lencode, lengths, 19))
+    return grub_errno;
+
+  for (i = 0; i < nlen + ndist; )
+    {
+      int sym;
+      unsigned len = 0, rep;
+
+      refill (inf);
+      sym = decode (inf, &inf->lencode);
+      if (sym < 0)
+	return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			   "invalid code length code");
+      if (sym < 16)
+	{
+	  lengths[i++] = sym;
+	  continue;
+	}
+      if (sym == 16)
+	{
+	  if (i == 0)
+	    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			       "repeat with no first length");
+	  len = lengths[i - 1];
+	  rep = 3 + take_bits (inf, 2);
+	}
+      else if (sym == 17)
+	rep = 3 + take_bits (inf, 3);
+      else
+	rep = 11 + take_bits (inf, 7);
+      if (i + rep > nlen + ndist)
+	return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			   "too many code lengths");
+      while (rep--)
+	lengths[i++] = len;
+    }
+
+  if (lengths[256] == 0)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "missing end-of-block code");
+
+  if (build_huffman (&inf->lencode, lengths, nlen))
+    return grub_errno;
+  return build_huffman (&inf->distcode, lengths + nlen, ndist);
+}
+
+static grub_err_t
+init_stored_block (struct grub_inflate *inf)
+{
+  unsigned len, nlen;
+
+  inf->fixed = 0;
+
+  refill (inf);
+  take_bits (inf, inf->bitcnt & 7);
+  len = take_bits (inf, 16);
+  nlen = take_bits (inf, 16);
+  if (len != (~nlen & 0xffff))
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       "stored block length mismatch");
+  inf->stored_left = len;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+read_block_header (struct grub_inflate *inf)
+{
+  unsigned type;
+
+  if (inf->last)
+    {
+      inf->state = STATE_DONE;
+      return GRUB_ERR_NONE;
+    }
+
+  if (inf->hook && inf->window_off + inf->wp)
+    inf->hook (inf, inf->window_off + inf->wp, inf->hook_data);
+
+  refill (inf);
+  inf->last = take_bits (inf, 1);
+  type = take_bits (inf, 2);
+  switch (type)
+    {
+    case 0:
+      inf->state = STATE_STORED;
+      return init_stored_block (inf);
+    case 1:
+      inf->state = STATE_CODES;
+      return init_fixed_block (inf);
+    case 2:
+      inf->state = STATE_CODES;
+      return init_dynamic_block (inf);
+    default:
+      return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			 "unknown block type");
+    }
+}
+
+/* Copy a stored block, first what is left in the bit buffer, which is
+   byte aligned, then straight from the input.  */
+static void
+inflate_stored (struct grub_inflate *inf)
+{
+  while (inf->stored_left && inf->wp < WINDOW_SIZE)
+    {
+      grub_size_t n;
+
+      if (inf->bitcnt - inf->pad_bits >= 8)
+	{
+	  inf->window[inf->wp++] = take_bits (inf, 8);
+	  inf->stored_left--;
+	  continue;
+	}
+      if (inf->in == inf->in_end)
+	{
+	  if (inf->eof)
+	    return;
+	  refill_slow (inf);
+	  continue;
+	}
+      /* The buffer is empty, but may hold copies of the bytes ahead.  */
+      inf->bitbuf = 0;
+      n = inf->in_end - inf->in;
+      if (n > inf->stored_left)
+	n = inf->stored_left;
+      if (n > WINDOW_SIZE - inf->wp)
+	n = WINDOW_SIZE - inf->wp;
+      grub_memcpy (inf->window + inf->wp, inf->in, n);
+      inf->in += n;
+      inf->wp += n;
+      inf->stored_left -= n;
+    }
+  if (! inf->stored_left)
+    inf->state = STATE_HEADER;
+}
+
+/* Decode literals and matches until the end of the block or until the
+   window is full.  */
+static grub_err_t
+inflate_codes (struct grub_inflate *inf)
+{
+  grub_uint8_t *window = inf->window;
+  grub_size_t wp = inf->wp;
+
+  while (wp <= WINDOW_SIZE - MAX_MATCH)
+    {
+      int sym;
+      unsigned len, dist;
+
+      refill (inf);
+      sym = decode (inf, &inf->lencode);
+      if (sym < 256)
+	{
+	  if (sym < 0)
+	    goto invalid;
+	  window[wp++] = sym;
+	  continue;
+	}
+      if (sym == 256)
+	{
+	  inf->state = STATE_HEADER;
+	  break;
+	}
+
+      sym -= 257;
+      if (sym >= 29)
+	goto invalid;
+      len = len_base[sym] + take_bits (inf, len_extra[sym]);
+
+      /* At most 15 + 5 bits since the refill, 15 + 13 more are left.  */
+      sym = decode (inf, &inf->distcode);
+      if (sym < 0 || sym >= 30)
+	goto invalid;
+      dist = dist_base[sym] + take_bits (inf, dist_extra[sym]);
+      if (dist > inf->window_off + wp)
+	{
+	  inf->wp = wp;
+	  return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			     "distance too far back");
+	}
+
+      if (dist >= len && len >= 16)
+	grub_memcpy (window + wp, window + wp - dist, len);
+      else
+	{
+	  const grub_uint8_t *src = window + wp - dist;
+	  grub_uint8_t *dst = window + wp;
+	  unsigned i;
+
+	  /* Overlapping copies repeat the last DIST bytes.  */
+	  for (i = 0; i < len; i++)
+	    dst[i] = src[i];
+	}
+      wp += len;
+    }
+
+  inf->wp = wp;
+  return GRUB_ERR_NONE;
+
+ invalid:
+  inf->wp = wp;
+  return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid Huffman code");
+}
+
+/* Keep the last GRUB_INFLATE_HISTORY bytes, all consumed, and make room
+   for more.  */
+static void
+slide_window (struct grub_inflate *inf)
+{
+  grub_size_t keep = inf->wp;
+
+  if (keep > GRUB_INFLATE_HISTORY)
+    keep = GRUB_INFLATE_HISTORY;
+  grub_memmove (inf->window, inf->window + inf->wp - keep, keep);
+  inf->window_off += inf->wp - keep;
+  inf->wp = inf->rp = keep;
+}
+
+/* Decode until there is something to consume, the stream ends or an
+   error occurs.  */
+static grub_err_t
+inflate_more (struct grub_inflate *inf)
+{
+  if (WINDOW_SIZE - inf->wp < GRUB_INFLATE_HISTORY)
+    slide_window (inf);
+
+  while (inf->rp == inf->wp && inf->state != STATE_DONE)
+    {
+      grub_err_t err = GRUB_ERR_NONE;
+
+      switch (inf->state)
+	{
+	case STATE_HEADER:
+	  err = read_block_header (inf);
+	  break;
+	case STATE_STORED:
+	  inflate_stored (inf);
+	  if (inf->stored_left && inf->in == inf->in_end && inf->eof
+	      && ! inf->error)
+	    err = grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			      N_("premature end of compressed"));
+	  break;
+	case STATE_CODES:
+	  err = inflate_codes (inf);
+	  break;
+	case STATE_DONE:
+	  break;
+	}
+      if (err)
+	return err;
+      if (inf->error)
+	return grub_errno ? : grub_error (GRUB_ERR_READ_ERROR,
+					  "cannot read compressed data");
+      if (inf->pad_bits > inf->bitcnt)
+	return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			   N_("premature end of compressed"));
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+void
+grub_inflate_reset (struct grub_inflate *inf)
+{
+  inf->in = inf->in_end = NULL;
+  inf->in_total = 0;
+  inf->eof = 0;
+  inf->error = 0;
+  inf->bitbuf = 0;
+  inf->bitcnt = 0;
+  inf->pad_bits = 0;
+  inf->state = STATE_HEADER;
+  inf->last = 0;
+  inf->fixed = 0;
+  inf->stored_left = 0;
+  inf->rp = inf->wp = 0;
+  inf->window_off = 0;
+}
+
+struct grub_inflate *
+grub_inflate_new (grub_inflate_fill_t fill, void *data)
+{
+  struct grub_inflate *inf;
+
+  inf = grub_zalloc (sizeof (*inf));
+  if (! inf)
+    return NULL;
+
+  inf->window = grub_malloc (WINDOW_SIZE);
+  if (! inf->window)
+    {
+      grub_free (inf);
+      return NULL;
+    }
+
+  inf->fill = fill;
+  inf->fill_data = data;
+  grub_inflate_reset (inf);
+  return inf;
+}
+
+void
+grub_inflate_free (struct grub_inflate *inf)
+{
+  if (! inf)
+    return;
+  grub_free (inf->window);
+  grub_free (inf);
+}
+
+void
+grub_inflate_set_block_hook (struct grub_inflate *inf,
+			     grub_inflate_block_hook_t hook, void *data)
+{
+  inf->hook = hook;
+  inf->hook_data = data;
+}
+
+grub_ssize_t
+grub_inflate_peek (struct grub_inflate *inf, const grub_uint8_t **buf)
+{
+  if (inf->rp == inf->wp && inflate_more (inf))
+    return -1;
+
+  *buf = inf->window + inf->rp;
+  return inf->wp - inf->rp;
+}
+
+void
+grub_inflate_consume (struct grub_inflate *inf, grub_size_t size)
+{
+  inf->rp += size;
+}
+
+grub_ssize_t
+grub_inflate_read (struct grub_inflate *inf, void *buf, grub_size_t size)
+{
+  grub_size_t done = 0;
+
+  while (done < size)
+    {
+      const grub_uint8_t *data;
+      grub_ssize_t n;
+
+      n = grub_inflate_peek (inf, &data);
+      if (n < 0)
+	return -1;
+      if (n == 0)
+	break;
+      if ((grub_size_t) n > size - done)
+	n = size - done;
+      if (buf)
+	grub_memcpy ((grub_uint8_t *) buf + done, data, n);
+      grub_inflate_consume (inf, n);
+      done += n;
+    }
+
+  return done;
+}
+
+grub_uint64_t
+grub_inflate_tell (struct grub_inflate *inf)
+{
+  return inf->window_off + inf->rp;
+}
+
+grub_err_t
+grub_inflate_save_point (struct grub_inflate *inf,
+			 struct grub_inflate_point *point)
+{
+  grub_uint64_t consumed;
+  grub_size_t hist = inf->wp;
+
+  /* Bits taken from the input, less those still in the buffer.  */
+  consumed = (inf->in_total - (inf->in_end - inf->in)) * 8
+    + inf->pad_bits - inf->bitcnt;
+
+  if (hist > GRUB_INFLATE_HISTORY)
+    hist = GRUB_INFLATE_HISTORY;
+  point->history = grub_malloc (hist);
+  if (! point->history)
+    return grub_errno;
+  grub_memcpy (point->history, inf->window + inf->wp - hist, hist);
+
+  point->out_off = inf->window_off + inf->wp;
+  point->in_off = consumed >> 3;
+  point->in_bits = consumed & 7;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_inflate_restore_point (struct grub_inflate *inf,
+			    const struct grub_inflate_point *point)
+{
+  grub_size_t hist = point->out_off;
+
+  if (hist > GRUB_INFLATE_HISTORY)
+    hist = GRUB_INFLATE_HISTORY;
+
+  grub_inflate_reset (inf);
+  inf->in_total = point->in_off;
+  grub_memcpy (inf->window, point->history, hist);
+  inf->rp = inf->wp = hist;
+  inf->window_off = point->out_off - hist;
+
+  if (point->in_bits)
+    {
+      refill (inf);
+      take_bits (inf, point->in_bits);
+      if (inf->error)
+	return grub_errno;
+    }
+  return GRUB_ERR_NONE;
+}
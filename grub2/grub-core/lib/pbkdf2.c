@@ -19,12 +19,32 @@
 /* Imported from gnulib.  */
 
 #include <grub/crypto.h>
-#include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/dl.h>
+#include <grub/trace.h>
 
 GRUB_MOD_LICENSE ("GPLv2+");
 
+/* Large enough for the block of every digest GRUB has.  */
+#define PBKDF2_MAX_BLOCKSIZE	128
+
+/* Iterations between two looks at the cancel flag.  */
+#define PBKDF2_CANCEL_INTERVAL	1024
+
+/* Finish the HMAC whose inner hash is in CTX, reusing CTX for the outer
+   hash, which starts from the state OUTER.  */
+static void
+hmac_finish (const struct gcry_md_spec *md, void *ctx, const void *outer,
+	     grub_uint8_t *out)
+{
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+  grub_memcpy (ctx, outer, md->contextsize);
+  md->write (ctx, out, md->mdlen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+}
+
 /* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is HMAC variant
    of digest supplied by MD.  Inputs are the password P of length PLEN,
    the salt S of length SLEN, the iteration counter C (> 0), and the
@@ -33,27 +53,36 @@ GRUB_MOD_LICENSE ("GPLv2+");
    be filled with the derived data.  */
 
 gcry_err_code_t
-grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
-		    const grub_uint8_t *P, grub_size_t Plen,
-		    const grub_uint8_t *S, grub_size_t Slen,
-		    unsigned int c,
-		    grub_uint8_t *DK, grub_size_t dkLen)
+grub_crypto_pbkdf2_cancellable (const struct gcry_md_spec *md,
+				const grub_uint8_t *P, grub_size_t Plen,
+				const grub_uint8_t *S, grub_size_t Slen,
+				unsigned int c,
+				grub_uint8_t *DK, grub_size_t dkLen,
+				const volatile int *cancel)
 {
-  unsigned int hLen = md->mdlen;
+  GRUB_PROPERLY_ALIGNED_ARRAY (inner, GRUB_CRYPTO_MAX_MD_CONTEXT_SIZE);
+  GRUB_PROPERLY_ALIGNED_ARRAY (outer, GRUB_CRYPTO_MAX_MD_CONTEXT_SIZE);
+  GRUB_PROPERLY_ALIGNED_ARRAY (ctx, GRUB_CRYPTO_MAX_MD_CONTEXT_SIZE);
+  grub_uint8_t pad[PBKDF2_MAX_BLOCKSIZE];
+  grub_uint8_t key[GRUB_CRYPTO_MAX_MDLEN];
   grub_uint8_t U[GRUB_CRYPTO_MAX_MDLEN];
   grub_uint8_t T[GRUB_CRYPTO_MAX_MDLEN];
+  grub_uint8_t count[4];
+  unsigned int hLen = md->mdlen;
   unsigned int u;
   unsigned int l;
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  gcry_err_code_t rc;
-  grub_uint8_t *tmp;
-  grub_size_t tmplen = Slen + 4;
+  gcry_err_code_t rc = GPG_ERR_NO_ERROR;
 
   if (md->mdlen > GRUB_CRYPTO_MAX_MDLEN || md->mdlen == 0)
     return GPG_ERR_INV_ARG;
 
+  if (md->contextsize > GRUB_CRYPTO_MAX_MD_CONTEXT_SIZE
+      || md->blocksize > PBKDF2_MAX_BLOCKSIZE || md->mdlen > md->blocksize)
+    return GPG_ERR_INV_ARG;
+
   if (c == 0)
     return GPG_ERR_INV_ARG;
 
@@ -66,35 +95,52 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   l = ((dkLen - 1) / hLen) + 1;
   r = dkLen - (l - 1) * hLen;
 
-  tmp = grub_malloc (tmplen);
-  if (tmp == NULL)
-    return GPG_ERR_OUT_OF_MEMORY;
+  if (Plen > md->blocksize)
+    {
+      grub_crypto_hash (md, key, P, Plen);
+      P = key;
+      Plen = hLen;
+    }
 
-  grub_memcpy (tmp, S, Slen);
+  /* Every HMAC of the derivation starts by hashing the same two padded
+     keys, so hash them once and start each HMAC from a copy of the
+     states.  This halves the work per iteration.  */
+  grub_memset (pad, 0x36, md->blocksize);
+  for (k = 0; k < Plen; k++)
+    pad[k] ^= P[k];
+  md->init (inner);
+  md->write (inner, pad, md->blocksize);
+
+  grub_memset (pad, 0x5c, md->blocksize);
+  for (k = 0; k < Plen; k++)
+    pad[k] ^= P[k];
+  md->init (outer);
+  md->write (outer, pad, md->blocksize);
 
   for (i = 1; i - 1 < l; i++)
     {
-      grub_memset (T, 0, hLen);
-
-      for (u = 0; u < c; u++)
+      count[0] = (i & 0xff000000) >> 24;
+      count[1] = (i & 0x00ff0000) >> 16;
+      count[2] = (i & 0x0000ff00) >> 8;
+      count[3] = (i & 0x000000ff) >> 0;
+
+      grub_memcpy (ctx, inner, md->contextsize);
+      md->write (ctx, S, Slen);
+      md->write (ctx, count, sizeof (count));
+      hmac_finish (md, ctx, outer, U);
+      grub_memcpy (T, U, hLen);
+
+      for (u = 1; u < c; u++)
 	{
-	  if (u == 0)
+	  if (cancel && u % PBKDF2_CANCEL_INTERVAL == 0 && *cancel)
 	    {
-	      tmp[Slen + 0] = (i & 0xff000000) >> 24;
-	      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
-
-	      rc = grub_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
+	      rc = GPG_ERR_CANCELED;
+	      goto out;
 	    }
-	  else
-	    rc = grub_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
 
-	  if (rc != GPG_ERR_NO_ERROR)
-	    {
-	      grub_free (tmp);
-	      return rc;
-	    }
+	  grub_memcpy (ctx, inner, md->contextsize);
+	  md->write (ctx, U, hLen);
+	  hmac_finish (md, ctx, outer, U);
 
 	  for (k = 0; k < hLen; k++)
 	    T[k] ^= U[k];
@@ -103,7 +149,33 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
       grub_memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
     }
 
-  grub_free (tmp);
+ out:
+  grub_memset (inner, 0, sizeof (inner));
+  grub_memset (outer, 0, sizeof (outer));
+  grub_memset (ctx, 0, sizeof (ctx));
+  grub_memset (pad, 0, sizeof (pad));
+  grub_memset (key, 0, sizeof (key));
+  grub_memset (U, 0, sizeof (U));
+  grub_memset (T, 0, sizeof (T));
+
+  return rc;
+}
+
+gcry_err_code_t
+grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
+		    const grub_uint8_t *P, grub_size_t Plen,
+		    const grub_uint8_t *S, grub_size_t Slen,
+		    unsigned int c,
+		    grub_uint8_t *DK, grub_size_t dkLen)
+{
+  static struct grub_trace_counter *trace;
+  struct grub_trace_span span;
+  gcry_err_code_t rc;
+
+  grub_trace_begin (&span, grub_trace_lookup (&trace, "kdf", "pbkdf2"));
+  rc = grub_crypto_pbkdf2_cancellable (md, P, Plen, S, Slen, c, DK, dkLen,
+				       NULL);
+  grub_trace_end (&span, 0);
 
-  return GPG_ERR_NO_ERROR;
+  return rc;
 }
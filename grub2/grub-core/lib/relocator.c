@@ -586,6 +586,9 @@ malloc_in_range (struct grub_relocator *rel,
 #endif
 #endif
 
+  /* Blocks sitting in the size-class caches may be in the way.  */
+  grub_mm_flush_caches ();
+
   /* No malloc from this point.  */
   base_saved = grub_mm_base;
   grub_mm_base = NULL;
@@ -0,0 +1,154 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/workqueue.h>
+#ifdef GRUB_MACHINE_EFI
+#include <grub/efi/api.h>
+#include <grub/efi/efi.h>
+#include <grub/efi/mp.h>
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+struct grub_workqueue_job
+{
+  grub_workqueue_func_t func;
+  void *data;
+  grub_size_t nitems;
+  grub_size_t next;
+  unsigned int joined;
+  unsigned int max_aps;
+};
+
+static unsigned int max_aps = ~0U;
+
+/* Set while a job runs, so nested jobs stay on the current processor. */
+static volatile int busy;
+
+static void
+workqueue_drain (struct grub_workqueue_job *job)
+{
+  grub_size_t item;
+
+  while ((item = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED))
+	 < job->nitems)
+    job->func (job->data, item);
+}
+
+#ifdef GRUB_MACHINE_EFI
+static grub_efi_guid_t mp_services_guid = GRUB_EFI_MP_SERVICES_PROTOCOL_GUID;
+static grub_efi_mp_services_protocol_t *mp;
+static grub_efi_uintn_t enabled_aps;
+static int mp_probed;
+
+static void
+workqueue_mp_probe (void)
+{
+  grub_efi_uintn_t cpus, enabled;
+  grub_efi_status_t status;
+
+  if (mp_probed)
+    return;
+  mp_probed = 1;
+
+  mp = grub_efi_locate_protocol (&mp_services_guid, NULL);
+  if (!mp)
+    return;
+
+  status = efi_call_3 (mp->get_number_of_processors, mp, &cpus, &enabled);
+  if (status != GRUB_EFI_SUCCESS || enabled < 2)
+    {
+      mp = NULL;
+      return;
+    }
+
+  enabled_aps = enabled - 1;
+  grub_dprintf ("workqueue", "%" PRIuGRUB_SIZE " APs enabled\n",
+		(grub_size_t) enabled_aps);
+}
+
+static void GRUB_EFI_AP_PROCEDURE_ABI
+workqueue_ap_procedure (void *buffer)
+{
+  struct grub_workqueue_job *job = buffer;
+
+  if (__atomic_fetch_add (&job->joined, 1, __ATOMIC_RELAXED) >= job->max_aps)
+    return;
+
+  workqueue_drain (job);
+}
+#endif
+
+unsigned int
+grub_workqueue_get_aps (void)
+{
+#ifdef GRUB_MACHINE_EFI
+  workqueue_mp_probe ();
+  if (mp)
+    return enabled_aps < max_aps ? enabled_aps : max_aps;
+#endif
+  return 0;
+}
+
+void
+grub_workqueue_set_max_aps (unsigned int max)
+{
+  max_aps = max;
+}
+
+void
+grub_workqueue_run (grub_workqueue_func_t func, void *data,
+		    grub_size_t nitems)
+{
+  struct grub_workqueue_job job = {
+    .func = func,
+    .data = data,
+    .nitems = nitems,
+    .next = 0,
+    .joined = 0,
+    .max_aps = 0
+  };
+
+  if (nitems > 1 && !busy)
+    job.max_aps = grub_workqueue_get_aps ();
+
+#ifdef GRUB_MACHINE_EFI
+  if (job.max_aps)
+    {
+      grub_efi_status_t status;
+
+      /*
+       * Blocking mode: the BSP polls the APs inside the firmware, which
+       * joins far quicker than waiting for the firmware's completion event.
+       */
+      busy = 1;
+      status = efi_call_7 (mp->startup_all_aps, mp, workqueue_ap_procedure,
+			   0, NULL, 0, &job, NULL);
+      busy = 0;
+      if (status != GRUB_EFI_SUCCESS)
+	grub_dprintf ("workqueue", "StartupAllAPs failed: %" PRIxGRUB_SIZE "\n",
+		      (grub_size_t) status);
+    }
+#endif
+
+  /* Whatever the APs did not pick up, including everything without them. */
+  workqueue_drain (&job);
+}
@@ -5,6 +5,7 @@
 #include <grub/file.h>
 #include <grub/mm.h>
 #include <grub/safemath.h>
+#include <grub/trace.h>
 
 struct newc_head
 {
@@ -214,7 +215,8 @@ grub_initrd_init (int argc, char *argv[],
 	}
       initrd_ctx->components[i].file = grub_file_open (fname,
 						       GRUB_FILE_TYPE_LINUX_INITRD
-						       | GRUB_FILE_TYPE_NO_DECOMPRESS);
+						       | GRUB_FILE_TYPE_NO_DECOMPRESS
+						       | GRUB_FILE_TYPE_READ_ONCE);
       if (!initrd_ctx->components[i].file)
 	{
 	  grub_initrd_close (initrd_ctx);
@@ -273,6 +275,7 @@ grub_err_t
 grub_initrd_load (struct grub_linux_initrd_context *initrd_ctx,
 		  char *argv[], void *target)
 {
+  static struct grub_trace_counter *trace;
   grub_uint8_t *ptr = target;
   int i;
   int newc = 0;
@@ -321,6 +324,9 @@ grub_initrd_load (struct grub_linux_initrd_context *initrd_ctx,
 	  grub_initrd_close (initrd_ctx);
 	  return grub_errno;
 	}
+      /* Compare with the copy.* counters to see what was copied twice.  */
+      grub_trace_count (grub_trace_lookup (&trace, "loader", "initrd"),
+			cursize);
       ptr += cursize;
     }
   if (newc)
@@ -25,6 +25,7 @@
 #include <grub/net/netbuff.h>
 #include <grub/net.h>
 #include <grub/time.h>
+#include <grub/trace.h>
 #include <grub/net/arp.h>
 
 #define LLCADDRMASK 0x7f
@@ -49,6 +50,9 @@ struct snaphdr
   grub_uint16_t type;
 } GRUB_PACKED;
 
+static struct grub_trace_counter *trace_rx;
+static struct grub_trace_counter *trace_tx;
+
 grub_err_t
 send_ethernet_packet (struct grub_net_network_level_interface *inf,
 		      struct grub_net_buff *nb,
@@ -97,6 +101,8 @@ send_ethernet_packet (struct grub_net_network_level_interface *inf,
       grub_memcpy ((char *) nb->data + etherhdr_size - 4, (char *) &(inf->vlantag), 2);
     }
 
+  grub_trace_count (grub_trace_lookup (&trace_tx, "net", "tx"),
+		    nb->tail - nb->data);
   return inf->card->driver->send (inf->card, nb);
 }
 
@@ -114,6 +120,8 @@ grub_net_recv_ethernet_packet (struct grub_net_buff *nb,
   grub_uint8_t etherhdr_size = sizeof (*eth);
   grub_uint16_t vlantag = 0;
 
+  grub_trace_count (grub_trace_lookup (&trace_rx, "net", "rx"),
+		    nb->tail - nb->data);
 
   /* Check if a vlan-tag is present. If so, the ethernet header is 4 bytes */
   /* longer than the original one. The vlantag id is extracted and the header */
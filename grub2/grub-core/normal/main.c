@@ -106,6 +106,87 @@ read_config_file_getline (char **line, int cont __attribute__ ((unused)),
   return GRUB_ERR_NONE;
 }
 
+/* Helper for read_config_file_compiled.  */
+static char *
+read_config_file_contents (grub_file_t file, grub_size_t *size)
+{
+  char *buf;
+
+  if (grub_file_size (file) == GRUB_FILE_SIZE_UNKNOWN
+      || grub_file_size (file) > GRUB_UINT_MAX)
+    return NULL;
+
+  *size = grub_file_size (file);
+  buf = grub_malloc (*size + 1);
+  if (! buf)
+    return NULL;
+
+  if (grub_file_read (file, buf, *size) != (grub_ssize_t) *size)
+    {
+      grub_free (buf);
+      return NULL;
+    }
+
+  return buf;
+}
+
+/* Helper for read_config_file.  Run CONFIG from its compiled form, if one
+   made from the current contents of FILE exists next to it.  Return 0 if
+   FILE still has to be parsed.  */
+static int
+read_config_file_compiled (const char *config, grub_file_t file)
+{
+  struct grub_script_compiled *compiled = NULL;
+  grub_file_t cfile;
+  char *name, *data = NULL, *source = NULL;
+  grub_size_t size, source_size;
+
+  name = grub_xasprintf ("%s.compiled", config);
+  if (! name)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  /* The compiled file goes through the same verifiers as CONFIG.  */
+  cfile = grub_file_open (name, GRUB_FILE_TYPE_CONFIG);
+  if (! cfile)
+    {
+      grub_free (name);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  data = read_config_file_contents (cfile, &size);
+  grub_file_close (cfile);
+  if (data)
+    source = read_config_file_contents (file, &source_size);
+  if (source)
+    compiled = grub_script_compiled_load (data, size, source, source_size);
+
+  grub_free (data);
+  grub_free (source);
+
+  if (! compiled)
+    {
+      grub_dprintf ("scripting", "not using %s: %s\n", name,
+		    grub_errno ? grub_errmsg : "read error");
+      grub_free (name);
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (file, 0);
+      return 0;
+    }
+
+  grub_free (name);
+
+  grub_script_compiled_execute (compiled);
+  grub_script_compiled_unref (compiled);
+  grub_print_error ();
+  grub_errno = GRUB_ERR_NONE;
+
+  return 1;
+}
+
 static grub_menu_t
 read_config_file (const char *config)
 {
@@ -168,20 +249,21 @@ read_config_file (const char *config)
   grub_env_export ("config_file");
   grub_env_export ("config_directory");
 
-  while (1)
-    {
-      char *line;
+  if (! read_config_file_compiled (config, file))
+    while (1)
+      {
+	char *line;
 
-      /* Print an error, if any.  */
-      grub_print_error ();
-      grub_errno = GRUB_ERR_NONE;
+	/* Print an error, if any.  */
+	grub_print_error ();
+	grub_errno = GRUB_ERR_NONE;
 
-      if ((read_config_file_getline (&line, 0, file)) || (! line))
-	break;
+	if ((read_config_file_getline (&line, 0, file)) || (! line))
+	  break;
 
-      grub_normal_parse_line (line, read_config_file_getline, file);
-      grub_free (line);
-    }
+	grub_normal_parse_line (line, read_config_file_getline, file);
+	grub_free (line);
+      }
 
   if (old_file)
     grub_env_set ("config_file", old_file);
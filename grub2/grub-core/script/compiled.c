@@ -0,0 +1,869 @@
+/* compiled.c -- Load and store pre-parsed GRUB scripts.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/err.h>
+#include <grub/i18n.h>
+#include <grub/safemath.h>
+#include <grub/script_sh.h>
+
+/* A compiled script is a header followed by a stream of little-endian
+   32-bit words:
+
+     chunk   := nfuncs { name cmds }* cmds
+     cmds    := count { tag payload }*
+     arglist := count arg*
+     arg     := count { type string hasscript [cmds] }*
+     string  := length bytes NUL, padded to 4 bytes
+
+   Each chunk holds what one top-level grub_script_parse call returns,
+   together with the functions it defined, so that replaying the chunks
+   in order is equivalent to reading the source line by line.  Within
+   `cmds', every node is followed by its `next' sibling, except for a
+   command list whose `next' points to its contents: that node is always
+   last and is followed by the contents.  */
+
+/* Nesting limit for blocks, conditionals and loops, which bounds the
+   recursion of both the loader and the writer.  */
+#define COMPILED_MAX_DEPTH	64
+
+#define COMPILED_ALIGN		sizeof (grub_uint64_t)
+
+struct load_ctx
+{
+  const grub_uint8_t *ptr;
+  const grub_uint8_t *end;
+
+  /* Where the structures are built, or NULL while sizing the allocation.  */
+  char *arena;
+  grub_size_t used;
+
+  unsigned depth;
+  int err;
+
+  struct grub_script_compiled *compiled;
+
+  /* While sizing, structures are built here and thrown away.  */
+  union
+  {
+    struct grub_script script;
+    struct grub_script_cmd cmd;
+    struct grub_script_cmdline cmdline;
+    struct grub_script_cmdif cmdif;
+    struct grub_script_cmdfor cmdfor;
+    struct grub_script_cmdwhile cmdwhile;
+    struct grub_script_arg arg;
+    struct grub_script_arglist arglist;
+    struct grub_script_compiled compiled;
+    struct grub_script_compiled_chunk chunk;
+    struct grub_script_compiled_func func;
+  } scratch;
+};
+
+static struct grub_script_cmd *load_cmds (struct load_ctx *ctx);
+
+grub_uint64_t
+grub_script_compiled_hash (const char *source, grub_size_t size)
+{
+  grub_uint64_t hash = 0xcbf29ce484222325ULL;
+  grub_size_t i;
+
+  /* 64-bit FNV-1a.  */
+  for (i = 0; i < size; i++)
+    {
+      hash ^= (grub_uint8_t) source[i];
+      hash *= 0x100000001b3ULL;
+    }
+
+  return hash;
+}
+
+static void
+load_fail (struct load_ctx *ctx)
+{
+  if (! ctx->err)
+    grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("invalid compiled script"));
+  ctx->err = 1;
+}
+
+static void *
+load_alloc (struct load_ctx *ctx, grub_size_t size)
+{
+  char *ret;
+
+  ctx->used = ALIGN_UP (ctx->used, COMPILED_ALIGN);
+  ret = ctx->arena ? ctx->arena + ctx->used : (char *) &ctx->scratch;
+  ctx->used += size;
+
+  return ret;
+}
+
+static grub_uint32_t
+load_u32 (struct load_ctx *ctx)
+{
+  grub_uint32_t val;
+
+  if (ctx->err || ctx->end - ctx->ptr < 4)
+    {
+      load_fail (ctx);
+      return 0;
+    }
+
+  val = grub_le_to_cpu32 (grub_get_unaligned32 (ctx->ptr));
+  ctx->ptr += 4;
+
+  return val;
+}
+
+/* Read an element count, each element taking at least one word.  */
+static grub_uint32_t
+load_count (struct load_ctx *ctx)
+{
+  grub_uint32_t count = load_u32 (ctx);
+
+  if (count > (grub_size_t) (ctx->end - ctx->ptr) / 4)
+    {
+      load_fail (ctx);
+      return 0;
+    }
+
+  return count;
+}
+
+static char *
+load_string (struct load_ctx *ctx)
+{
+  grub_uint32_t len = load_u32 (ctx);
+  grub_size_t padded = ALIGN_UP ((grub_size_t) len + 1, 4);
+  char *ret = NULL;
+
+  if (ctx->err || padded > (grub_size_t) (ctx->end - ctx->ptr)
+      || ctx->ptr[len] != '\0')
+    {
+      load_fail (ctx);
+      return NULL;
+    }
+
+  if (ctx->arena)
+    {
+      ret = ctx->arena + ctx->used;
+      grub_memcpy (ret, ctx->ptr, len + 1);
+    }
+  ctx->used += len + 1;
+  ctx->ptr += padded;
+
+  return ret;
+}
+
+static struct grub_script *
+load_script (struct load_ctx *ctx)
+{
+  struct grub_script *script;
+
+  script = load_alloc (ctx, sizeof (*script));
+  script->refcnt = 0;
+  script->mem = 0;
+  script->next_siblings = 0;
+  script->children = 0;
+  script->compiled = ctx->compiled;
+  script->cmd = load_cmds (ctx);
+
+  return script;
+}
+
+static struct grub_script_arg *
+load_arg (struct load_ctx *ctx)
+{
+  struct grub_script_arg *first = NULL, *prev = NULL, *part;
+  grub_uint32_t count, i;
+
+  count = load_count (ctx);
+  if (count == 0)
+    load_fail (ctx);
+
+  for (i = 0; i < count && ! ctx->err; i++)
+    {
+      part = load_alloc (ctx, sizeof (*part));
+      part->next = 0;
+      if (prev)
+	prev->next = part;
+      else
+	first = part;
+      prev = part;
+
+      part->type = load_u32 (ctx);
+      if (part->type > GRUB_SCRIPT_ARG_TYPE_BLOCK)
+	load_fail (ctx);
+      part->str = load_string (ctx);
+      part->script = load_u32 (ctx) ? load_script (ctx) : 0;
+    }
+
+  return first;
+}
+
+static struct grub_script_arglist *
+load_arglist (struct load_ctx *ctx)
+{
+  struct grub_script_arglist *first = NULL, *prev = NULL, *link;
+  grub_uint32_t count, i;
+
+  count = load_count (ctx);
+
+  for (i = 0; i < count && ! ctx->err; i++)
+    {
+      link = load_alloc (ctx, sizeof (*link));
+      link->next = 0;
+      link->argcount = i ? 0 : count;
+      if (prev)
+	prev->next = link;
+      else
+	first = link;
+      prev = link;
+
+      link->arg = load_arg (ctx);
+    }
+
+  return first;
+}
+
+static struct grub_script_cmd *
+load_node (struct load_ctx *ctx, grub_uint32_t tag)
+{
+  switch (tag)
+    {
+    case GRUB_SCRIPT_COMPILED_CMDLINE:
+      {
+	struct grub_script_cmdline *cmd = load_alloc (ctx, sizeof (*cmd));
+
+	cmd->cmd.exec = grub_script_execute_cmdline;
+	cmd->cmd.next = 0;
+	cmd->arglist = load_arglist (ctx);
+	return &cmd->cmd;
+      }
+
+    case GRUB_SCRIPT_COMPILED_CMDIF:
+      {
+	struct grub_script_cmdif *cmd = load_alloc (ctx, sizeof (*cmd));
+
+	cmd->cmd.exec = grub_script_execute_cmdif;
+	cmd->cmd.next = 0;
+	cmd->exec_to_evaluate = load_cmds (ctx);
+	cmd->exec_on_true = load_cmds (ctx);
+	cmd->exec_on_false = load_cmds (ctx);
+	return &cmd->cmd;
+      }
+
+    case GRUB_SCRIPT_COMPILED_CMDFOR:
+      {
+	struct grub_script_cmdfor *cmd = load_alloc (ctx, sizeof (*cmd));
+
+	cmd->cmd.exec = grub_script_execute_cmdfor;
+	cmd->cmd.next = 0;
+	cmd->name = load_arg (ctx);
+	cmd->words = load_arglist (ctx);
+	cmd->list = load_cmds (ctx);
+	return &cmd->cmd;
+      }
+
+    case GRUB_SCRIPT_COMPILED_CMDWHILE:
+      {
+	struct grub_script_cmdwhile *cmd = load_alloc (ctx, sizeof (*cmd));
+
+	cmd->cmd.exec = grub_script_execute_cmdwhile;
+	cmd->cmd.next = 0;
+	cmd->until = !! load_u32 (ctx);
+	cmd->cond = load_cmds (ctx);
+	cmd->list = load_cmds (ctx);
+	return &cmd->cmd;
+      }
+    }
+
+  load_fail (ctx);
+  return NULL;
+}
+
+static struct grub_script_cmd *
+load_cmds (struct load_ctx *ctx)
+{
+  struct grub_script_cmd *first = NULL, *prev = NULL, *cmd;
+  grub_uint32_t count, tag, i;
+
+  count = load_count (ctx);
+  if (count && ++ctx->depth > COMPILED_MAX_DEPTH)
+    load_fail (ctx);
+
+  for (i = 0; i < count && ! ctx->err; i++)
+    {
+      tag = load_u32 (ctx);
+      if (tag == GRUB_SCRIPT_COMPILED_CMDLIST)
+	{
+	  cmd = load_alloc (ctx, sizeof (*cmd));
+	  cmd->exec = grub_script_execute_cmdlist;
+	  cmd->next = 0;
+	}
+      else
+	cmd = load_node (ctx, tag);
+
+      if (prev)
+	prev->next = cmd;
+      else
+	first = cmd;
+      prev = cmd;
+
+      if (tag == GRUB_SCRIPT_COMPILED_CMDLIST)
+	{
+	  if (i + 1 != count)
+	    load_fail (ctx);
+	  cmd->next = load_cmds (ctx);
+	}
+    }
+
+  if (count)
+    ctx->depth--;
+
+  return first;
+}
+
+static void
+load_chunks (struct load_ctx *ctx, grub_uint32_t nchunks)
+{
+  struct grub_script_compiled_chunk *chunk, *prev_chunk = NULL;
+  struct grub_script_compiled_func *func, *prev_func;
+  grub_uint32_t nfuncs, i, j;
+
+  ctx->compiled->chunks = 0;
+
+  for (i = 0; i < nchunks && ! ctx->err; i++)
+    {
+      chunk = load_alloc (ctx, sizeof (*chunk));
+      chunk->next = 0;
+      chunk->funcs = 0;
+      if (prev_chunk)
+	prev_chunk->next = chunk;
+      else
+	ctx->compiled->chunks = chunk;
+      prev_chunk = chunk;
+
+      nfuncs = load_count (ctx);
+      prev_func = NULL;
+      for (j = 0; j < nfuncs && ! ctx->err; j++)
+	{
+	  func = load_alloc (ctx, sizeof (*func));
+	  func->next = 0;
+	  if (prev_func)
+	    prev_func->next = func;
+	  else
+	    chunk->funcs = func;
+	  prev_func = func;
+
+	  func->name = load_string (ctx);
+	  func->script = load_script (ctx);
+	}
+
+      chunk->script = load_script (ctx);
+    }
+
+  if (ctx->ptr != ctx->end)
+    load_fail (ctx);
+}
+
+/* Load the compiled script in DATA, provided it was compiled from
+   SOURCE.  The result is built in a single allocation.  */
+struct grub_script_compiled *
+grub_script_compiled_load (const void *data, grub_size_t size,
+			   const char *source, grub_size_t source_size)
+{
+  const struct grub_script_compiled_header *hdr = data;
+  struct load_ctx ctx;
+  grub_uint32_t nchunks;
+  int pass;
+
+  if (size < sizeof (*hdr)
+      || grub_le_to_cpu32 (hdr->magic) != GRUB_SCRIPT_COMPILED_MAGIC
+      || grub_le_to_cpu32 (hdr->version) != GRUB_SCRIPT_COMPILED_VERSION)
+    {
+      grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("invalid compiled script"));
+      return NULL;
+    }
+
+  if (source
+      && (grub_le_to_cpu32 (hdr->source_size) != source_size
+	  || grub_le_to_cpu64 (hdr->source_hash)
+	     != grub_script_compiled_hash (source, source_size)))
+    {
+      grub_error (GRUB_ERR_BAD_FILE_TYPE,
+		  N_("compiled script does not match its source"));
+      return NULL;
+    }
+
+  nchunks = grub_le_to_cpu32 (hdr->nchunks);
+
+  /* The first pass validates the input and sizes the allocation, the
+     second one builds the structures.  */
+  grub_memset (&ctx, 0, sizeof (ctx));
+  for (pass = 0; pass < 2; pass++)
+    {
+      ctx.ptr = (const grub_uint8_t *) data + sizeof (*hdr);
+      ctx.end = (const grub_uint8_t *) data + size;
+      ctx.used = 0;
+      ctx.depth = 0;
+
+      ctx.compiled = load_alloc (&ctx, sizeof (*ctx.compiled));
+      ctx.compiled->refcnt = 1;
+      ctx.compiled->source_size = grub_le_to_cpu32 (hdr->source_size);
+      ctx.compiled->source_hash = grub_le_to_cpu64 (hdr->source_hash);
+
+      load_chunks (&ctx, nchunks);
+      if (ctx.err)
+	{
+	  grub_free (ctx.arena);
+	  return NULL;
+	}
+
+      if (! ctx.arena)
+	{
+	  ctx.arena = grub_malloc (ctx.used);
+	  if (! ctx.arena)
+	    return NULL;
+	}
+    }
+
+  grub_dprintf ("scripting", "loaded compiled script: %u chunks, %"
+		PRIuGRUB_SIZE " bytes\n", nchunks, ctx.used);
+
+  return ctx.compiled;
+}
+
+/* Define the functions and execute the commands of COMPILED, printing
+   errors between chunks like read_config_file does between lines.  */
+grub_err_t
+grub_script_compiled_execute (struct grub_script_compiled *compiled)
+{
+  struct grub_script_compiled_chunk *chunk;
+  struct grub_script_compiled_func *func;
+
+  for (chunk = compiled->chunks; chunk; chunk = chunk->next)
+    {
+      grub_print_error ();
+      grub_errno = GRUB_ERR_NONE;
+
+      for (func = chunk->funcs; func; func = func->next)
+	{
+	  struct grub_script_arg name = {
+	    .type = GRUB_SCRIPT_ARG_TYPE_TEXT,
+	    .str = func->name
+	  };
+
+	  /* The function holds a reference until it is redefined or
+	     removed.  */
+	  compiled->refcnt++;
+	  if (! grub_script_function_create (&name, func->script))
+	    grub_script_free (func->script);
+	}
+
+      grub_script_execute (chunk->script);
+    }
+
+  return grub_errno;
+}
+
+void
+grub_script_compiled_unref (struct grub_script_compiled *compiled)
+{
+  if (compiled && --compiled->refcnt == 0)
+    grub_free (compiled);
+}
+
+#ifdef GRUB_UTIL
+
+struct store_ctx
+{
+  char *buf;
+  grub_size_t len;
+  grub_size_t alloc;
+  unsigned depth;
+};
+
+static grub_err_t store_cmds (struct store_ctx *ctx,
+			      struct grub_script_cmd *cmd);
+
+static grub_err_t
+store_bytes (struct store_ctx *ctx, const void *data, grub_size_t len)
+{
+  grub_size_t need, padded;
+
+  if (grub_add (len, 3, &padded) || grub_add (ctx->len, padded & ~3, &need))
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+
+  if (need > ctx->alloc)
+    {
+      grub_size_t alloc = ctx->alloc ? : 4096;
+      char *buf;
+
+      while (alloc < need)
+	alloc *= 2;
+      buf = grub_realloc (ctx->buf, alloc);
+      if (! buf)
+	return grub_errno;
+      ctx->buf = buf;
+      ctx->alloc = alloc;
+    }
+
+  grub_memcpy (ctx->buf + ctx->len, data, len);
+  grub_memset (ctx->buf + ctx->len + len, 0, (padded & ~3) - len);
+  ctx->len = need;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+store_u32 (struct store_ctx *ctx, grub_uint32_t val)
+{
+  grub_uint32_t le = grub_cpu_to_le32 (val);
+
+  return store_bytes (ctx, &le, sizeof (le));
+}
+
+static grub_err_t
+store_string (struct store_ctx *ctx, const char *str)
+{
+  grub_size_t len = grub_strlen (str);
+
+  if (len >= GRUB_UINT_MAX)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+
+  if (store_u32 (ctx, len) || store_bytes (ctx, str, len + 1))
+    return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+store_script (struct store_ctx *ctx, struct grub_script *script)
+{
+  return store_cmds (ctx, script ? script->cmd : NULL);
+}
+
+static grub_err_t
+store_arg (struct store_ctx *ctx, struct grub_script_arg *arg)
+{
+  struct grub_script_arg *part;
+  grub_uint32_t count = 0;
+
+  for (part = arg; part; part = part->next)
+    count++;
+  if (store_u32 (ctx, count))
+    return grub_errno;
+
+  for (part = arg; part; part = part->next)
+    if (store_u32 (ctx, part->type)
+	|| store_string (ctx, part->str)
+	|| store_u32 (ctx, !! part->script)
+	|| (part->script && store_script (ctx, part->script)))
+      return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+store_arglist (struct store_ctx *ctx, struct grub_script_arglist *arglist)
+{
+  struct grub_script_arglist *link;
+  grub_uint32_t count = 0;
+
+  for (link = arglist; link; link = link->next)
+    count++;
+  if (store_u32 (ctx, count))
+    return grub_errno;
+
+  for (link = arglist; link; link = link->next)
+    if (store_arg (ctx, link->arg))
+      return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+store_cmds (struct store_ctx *ctx, struct grub_script_cmd *cmd)
+{
+  struct grub_script_cmd *c;
+  grub_uint32_t count = 0;
+  int err = 0;
+
+  for (c = cmd; c; c = c->next)
+    {
+      count++;
+      if (c->exec == grub_script_execute_cmdlist)
+	break;
+    }
+  if (store_u32 (ctx, count))
+    return grub_errno;
+  if (! count)
+    return GRUB_ERR_NONE;
+
+  if (++ctx->depth > COMPILED_MAX_DEPTH)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("script is nested too deeply"));
+
+  for (c = cmd; c && ! err; c = c->next)
+    {
+      if (c->exec == grub_script_execute_cmdlist)
+	{
+	  err = store_u32 (ctx, GRUB_SCRIPT_COMPILED_CMDLIST)
+	    || store_cmds (ctx, c->next);
+	  break;
+	}
+      else if (c->exec == grub_script_execute_cmdline)
+	{
+	  struct grub_script_cmdline *line = (struct grub_script_cmdline *) c;
+
+	  err = store_u32 (ctx, GRUB_SCRIPT_COMPILED_CMDLINE)
+	    || store_arglist (ctx, line->arglist);
+	}
+      else if (c->exec == grub_script_execute_cmdif)
+	{
+	  struct grub_script_cmdif *cmdif = (struct grub_script_cmdif *) c;
+
+	  err = store_u32 (ctx, GRUB_SCRIPT_COMPILED_CMDIF)
+	    || store_cmds (ctx, cmdif->exec_to_evaluate)
+	    || store_cmds (ctx, cmdif->exec_on_true)
+	    || store_cmds (ctx, cmdif->exec_on_false);
+	}
+      else if (c->exec == grub_script_execute_cmdfor)
+	{
+	  struct grub_script_cmdfor *cmdfor = (struct grub_script_cmdfor *) c;
+
+	  err = store_u32 (ctx, GRUB_SCRIPT_COMPILED_CMDFOR)
+	    || store_arg (ctx, cmdfor->name)
+	    || store_arglist (ctx, cmdfor->words)
+	    || store_cmds (ctx, cmdfor->list);
+	}
+      else if (c->exec == grub_script_execute_cmdwhile)
+	{
+	  struct grub_script_cmdwhile *cmdwhile
+	    = (struct grub_script_cmdwhile *) c;
+
+	  err = store_u32 (ctx, GRUB_SCRIPT_COMPILED_CMDWHILE)
+	    || store_u32 (ctx, cmdwhile->until)
+	    || store_cmds (ctx, cmdwhile->cond)
+	    || store_cmds (ctx, cmdwhile->list);
+	}
+      else
+	return grub_error (GRUB_ERR_BUG, "unknown script command");
+    }
+
+  ctx->depth--;
+
+  return err ? grub_errno : GRUB_ERR_NONE;
+}
+
+static grub_err_t
+store_header (struct store_ctx *ctx, grub_size_t source_size,
+	      grub_uint64_t source_hash)
+{
+  struct grub_script_compiled_header hdr;
+
+  if (source_size > GRUB_UINT_MAX)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+
+  hdr.magic = grub_cpu_to_le32_compile_time (GRUB_SCRIPT_COMPILED_MAGIC);
+  hdr.version = grub_cpu_to_le32_compile_time (GRUB_SCRIPT_COMPILED_VERSION);
+  hdr.source_size = grub_cpu_to_le32 (source_size);
+  hdr.nchunks = 0;
+  hdr.source_hash = grub_cpu_to_le64 (source_hash);
+
+  return store_bytes (ctx, &hdr, sizeof (hdr));
+}
+
+static void
+store_finish (struct store_ctx *ctx, grub_uint32_t nchunks,
+	      void **out, grub_size_t *out_size)
+{
+  struct grub_script_compiled_header *hdr = (void *) ctx->buf;
+
+  hdr->nchunks = grub_cpu_to_le32 (nchunks);
+  *out = ctx->buf;
+  *out_size = ctx->len;
+}
+
+/* Store the functions defined by the chunk just parsed.  */
+static grub_err_t
+store_functions (struct store_ctx *ctx)
+{
+  grub_script_function_t func;
+  grub_uint32_t count = 0;
+
+  FOR_SCRIPT_FUNCTIONS (func)
+    count++;
+  if (store_u32 (ctx, count))
+    return grub_errno;
+
+  FOR_SCRIPT_FUNCTIONS (func)
+    if (store_string (ctx, func->name) || store_script (ctx, func->func))
+      return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+/* Source reader mirroring grub_file_getline and read_config_file_getline,
+   so that chunks end where they would when reading the file in GRUB.  */
+struct compile_src
+{
+  const char *ptr;
+  const char *end;
+};
+
+static grub_err_t
+compile_getline (char **line, int cont __attribute__ ((unused)), void *data)
+{
+  struct compile_src *src = data;
+
+  while (1)
+    {
+      char *buf;
+      grub_size_t pos = 0;
+      const char *p;
+      int have_newline = 0;
+
+      *line = 0;
+      if (src->ptr == src->end)
+	return GRUB_ERR_NONE;
+
+      for (p = src->ptr; p < src->end && *p != '\n'; p++);
+      if (p < src->end)
+	have_newline = 1;
+
+      buf = grub_malloc (p - src->ptr + 1);
+      if (! buf)
+	return grub_errno;
+      for (; src->ptr < p; src->ptr++)
+	if (*src->ptr != '\r')
+	  buf[pos++] = *src->ptr;
+      buf[pos] = '\0';
+      src->ptr += have_newline;
+
+      if (buf[0] != '#')
+	{
+	  *line = buf;
+	  return GRUB_ERR_NONE;
+	}
+      grub_free (buf);
+    }
+}
+
+/* Parse SOURCE and return its compiled form in OUT.  */
+grub_err_t
+grub_script_compile (const char *source, grub_size_t size,
+		     void **out, grub_size_t *out_size)
+{
+  struct store_ctx ctx = { 0 };
+  struct compile_src src = { source, source + size };
+  grub_script_function_t saved_functions = grub_script_function_list;
+  struct grub_script *script;
+  grub_uint32_t nchunks = 0;
+  char *line;
+
+  /* Collect the functions defined by each chunk on an empty list.  */
+  grub_script_function_list = 0;
+
+  if (store_header (&ctx, size, grub_script_compiled_hash (source, size)))
+    goto fail;
+
+  while (1)
+    {
+      if (compile_getline (&line, 0, &src) || ! line)
+	break;
+
+      script = grub_script_parse (line, compile_getline, &src);
+      grub_free (line);
+      if (! script)
+	{
+	  if (! grub_errno)
+	    grub_error (GRUB_ERR_BAD_ARGUMENT, N_("syntax error"));
+	  goto fail;
+	}
+
+      if (grub_script_function_list || script->cmd)
+	{
+	  if (store_functions (&ctx) || store_script (&ctx, script))
+	    {
+	      grub_script_free (script);
+	      goto fail;
+	    }
+	  nchunks++;
+	}
+
+      grub_script_free (script);
+      while (grub_script_function_list)
+	grub_script_function_remove (grub_script_function_list->name);
+    }
+
+  if (grub_errno)
+    goto fail;
+
+  grub_script_function_list = saved_functions;
+  store_finish (&ctx, nchunks, out, out_size);
+  return GRUB_ERR_NONE;
+
+ fail:
+  while (grub_script_function_list)
+    grub_script_function_remove (grub_script_function_list->name);
+  grub_script_function_list = saved_functions;
+  grub_free (ctx.buf);
+  return grub_errno;
+}
+
+/* Store a loaded compiled script again, which must reproduce the data
+   it was loaded from.  */
+grub_err_t
+grub_script_compiled_store (struct grub_script_compiled *compiled,
+			    void **out, grub_size_t *out_size)
+{
+  struct store_ctx ctx = { 0 };
+  struct grub_script_compiled_chunk *chunk;
+  struct grub_script_compiled_func *func;
+  grub_uint32_t nchunks = 0, nfuncs;
+
+  if (store_header (&ctx, compiled->source_size, compiled->source_hash))
+    goto fail;
+
+  for (chunk = compiled->chunks; chunk; chunk = chunk->next)
+    {
+      nfuncs = 0;
+      for (func = chunk->funcs; func; func = func->next)
+	nfuncs++;
+      if (store_u32 (&ctx, nfuncs))
+	goto fail;
+      for (func = chunk->funcs; func; func = func->next)
+	if (store_string (&ctx, func->name) || store_script (&ctx, func->script))
+	  goto fail;
+      if (store_script (&ctx, chunk->script))
+	goto fail;
+      nchunks++;
+    }
+
+  store_finish (&ctx, nchunks, out, out_size);
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (ctx.buf);
+  return grub_errno;
+}
+
+#endif
@@ -100,6 +100,12 @@ grub_script_free (struct grub_script *script)
   if (! script)
     return;
 
+  if (script->compiled)
+    {
+      grub_script_compiled_unref (script->compiled);
+      return;
+    }
+
   if (script->mem)
     grub_script_mem_free (script->mem);
 
@@ -333,6 +339,7 @@ grub_script_create (struct grub_script_cmd *cmd, struct grub_script_mem *mem)
   parsed->refcnt = 0;
   parsed->children = 0;
   parsed->next_siblings = 0;
+  parsed->compiled = 0;
 
   return parsed;
 }
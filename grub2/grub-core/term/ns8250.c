@@ -25,6 +25,7 @@
 #include <grub/mm.h>
 #include <grub/time.h>
 #include <grub/i18n.h>
+#include <grub/trace.h>
 
 #ifdef GRUB_MACHINE_PCBIOS
 #include <grub/machine/memory.h>
@@ -125,6 +126,14 @@ do_real_config (struct grub_serial_port *port)
       grub_outb (UART_ENABLE_DTRRTS | UART_ENABLE_OUT2, port->port + UART_MCR);
     }
 
+  /* A plain 8250 or 16450 has no FIFO and ignores the FCR write.  */
+  if ((grub_inb (port->port + UART_IIR) & UART_IIR_FIFO_ENABLED)
+      == UART_IIR_FIFO_ENABLED)
+    port->fifo_size = UART_FIFO_SIZE;
+  else
+    port->fifo_size = 1;
+  port->tx_room = 0;
+
   /* Drain the input buffer.  */
   endtime = grub_get_time_ms () + 1000;
   while (grub_inb (port->port + UART_LSR) & UART_DATA_READY)
@@ -155,31 +164,45 @@ serial_hw_fetch (struct grub_serial_port *port)
 static void
 serial_hw_put (struct grub_serial_port *port, const int c)
 {
+  static struct grub_trace_counter *tx_counter, *poll_counter;
   grub_uint64_t endtime;
 
   do_real_config (port);
 
-  if (port->broken > 5)
-    endtime = grub_get_time_ms ();
-  else if (port->broken > 1)
-    endtime = grub_get_time_ms () + 50;
-  else
-    endtime = grub_get_time_ms () + 200;
-  /* Wait until the transmitter holding register is empty.  */
-  while ((grub_inb (port->port + UART_LSR) & UART_EMPTY_TRANSMITTER) == 0)
+  /* Once the transmitter is seen empty, a whole FIFO worth of bytes can be
+     written without looking at LSR, which is an I/O exit on a VM.  */
+  if (port->tx_room == 0)
     {
-      if (grub_get_time_ms () > endtime)
+      if (port->broken > 5)
+	endtime = grub_get_time_ms ();
+      else if (port->broken > 1)
+	endtime = grub_get_time_ms () + 50;
+      else
+	endtime = grub_get_time_ms () + 200;
+      /* Wait until the transmitter holding register is empty.  */
+      for (;;)
 	{
-	  port->broken++;
-	  /* There is something wrong. But what can I do?  */
-	  return;
+	  grub_trace_count (grub_trace_lookup (&poll_counter,
+					       "ns8250", "poll"), 0);
+	  if (grub_inb (port->port + UART_LSR) & UART_EMPTY_TRANSMITTER)
+	    break;
+	  if (grub_get_time_ms () > endtime)
+	    {
+	      port->broken++;
+	      /* There is something wrong. But what can I do?  */
+	      return;
+	    }
 	}
-    }
 
-  if (port->broken)
-    port->broken--;
+      if (port->broken)
+	port->broken--;
+
+      port->tx_room = port->fifo_size;
+    }
 
   grub_outb (c, port->port + UART_TX);
+  port->tx_room--;
+  grub_trace_count (grub_trace_lookup (&tx_counter, "ns8250", "tx"), 1);
 }
 
 /* Initialize a serial device. PORT is the port number for a serial device.
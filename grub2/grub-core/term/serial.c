@@ -135,6 +135,7 @@ static struct grub_term_output grub_serial_term_output =
   .cls = grub_terminfo_cls,
   .setcolorstate = grub_terminfo_setcolorstate,
   .setcursor = grub_terminfo_setcursor,
+  .refresh = grub_terminfo_refresh,
   .flags = GRUB_TERM_CODE_TYPE_ASCII,
   .data = &grub_serial_terminfo_output,
   .progress_update_divisor = GRUB_PROGRESS_SLOW
@@ -298,6 +299,9 @@ grub_cmd_serial (grub_extcmd_context_t ctxt, int argc, char **args)
 	  grub_term_register_input ("serial", &grub_serial_term_input);
 	  grub_term_register_output ("serial", &grub_serial_term_output);
 	}
+      /* Another UART doesn't show what was sent to the previous one.  */
+      if (registered && grub_serial_terminfo_output.port != port)
+	grub_terminfo_invalidate (&grub_serial_term_output);
       grub_serial_terminfo_output.port = port;
       grub_serial_terminfo_input.port = port;
       registered = 1;
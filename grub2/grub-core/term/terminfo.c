@@ -33,6 +33,7 @@
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
 #include <grub/time.h>
+#include <grub/trace.h>
 #if defined(__powerpc__) && defined(GRUB_MACHINE_IEEE1275)
 #include <grub/ieee1275/ieee1275.h>
 #endif
@@ -77,6 +78,28 @@ grub_terminfo_all_free (struct grub_term_output *term)
   grub_terminfo_free (&data->cursor_off);
 }
 
+/* Forget what is on the screen, e.g. after it scrolled.  */
+static void
+invalidate_screen (struct grub_terminfo_output_state *data)
+{
+  if (data->shadow)
+    grub_memset (data->shadow, 0, (grub_size_t) data->shadow_size.x
+		 * data->shadow_size.y * sizeof (data->shadow[0]));
+  data->cursor_known = 0;
+}
+
+/* Forget what is on the screen and which colors are set, e.g. when the
+   output goes to another terminal from now on.  */
+void
+grub_terminfo_invalidate (struct grub_term_output *term)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  invalidate_screen (data);
+  data->sent_color = 0;
+}
+
 /* Set current terminfo type.  */
 grub_err_t
 grub_terminfo_set_current (struct grub_term_output *term,
@@ -102,6 +125,7 @@ grub_terminfo_set_current (struct grub_term_output *term,
    */
 
   grub_terminfo_all_free (term);
+  grub_terminfo_invalidate (term);
 
   if (grub_strcmp ("vt100", str) == 0)
     {
@@ -190,14 +214,20 @@ grub_terminfo_output_register (struct grub_term_output *term,
 			       const char *type)
 {
   grub_err_t err;
-  struct grub_terminfo_output_state *data;
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  /* The state may have been copied from a terminal already in use.  */
+  data->shadow = NULL;
+  data->shadow_size.x = data->shadow_size.y = 0;
+  data->cursor_hidden = 0;
+  data->color = 0;
 
   err = grub_terminfo_set_current (term, type);
 
   if (err)
     return err;
 
-  data = (struct grub_terminfo_output_state *) term->data;
   data->next = terminfo_outputs;
   terminfo_outputs = term;
 
@@ -214,20 +244,69 @@ grub_terminfo_output_unregister (struct grub_term_output *term)
     if (*ptr == term)
       {
 	grub_terminfo_all_free (term);
+	grub_free (((struct grub_terminfo_output_state *) term->data)->shadow);
+	((struct grub_terminfo_output_state *) term->data)->shadow = NULL;
 	*ptr = ((struct grub_terminfo_output_state *) (*ptr)->data)->next;
 	return GRUB_ERR_NONE;
       }
   return grub_error (GRUB_ERR_BUG, "terminal not found");
 }
 
+static void
+term_put (struct grub_term_output *term, const int c)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  data->frame_bytes++;
+  data->put (term, c);
+}
+
 /* Wrapper for grub_putchar to write strings.  */
 static void
 putstr (struct grub_term_output *term, const char *str)
+{
+  while (*str)
+    term_put (term, *str++);
+}
+
+static int
+get_shadow (struct grub_term_output *term)
 {
   struct grub_terminfo_output_state *data
     = (struct grub_terminfo_output_state *) term->data;
-  while (*str)
-    data->put (term, *str++);
+
+  if (data->shadow && data->shadow_size.x == data->size.x
+      && data->shadow_size.y == data->size.y)
+    return 1;
+
+  grub_free (data->shadow);
+  data->shadow_size = data->size;
+  data->shadow = grub_calloc ((grub_size_t) data->size.x * data->size.y,
+			      sizeof (data->shadow[0]));
+  if (!data->shadow)
+    grub_errno = GRUB_ERR_NONE;
+  return data->shadow != NULL;
+}
+
+/* Move the terminal's cursor to where the next character goes.  */
+static void
+flush_cursor (struct grub_term_output *term)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  if (!data->gotoxy)
+    return;
+
+  if (data->cursor_known && data->cursor.x == data->pos.x
+      && data->cursor.y == data->pos.y)
+    return;
+
+  putstr (term, grub_terminfo_tparm (data->gotoxy, data->pos.y, data->pos.x));
+  data->cursor = data->pos;
+  /* Past the last column the terminal puts the cursor where it likes.  */
+  data->cursor_known = data->pos.x < grub_term_width (term);
 }
 
 struct grub_term_coordinate
@@ -252,31 +331,21 @@ grub_terminfo_gotoxy (struct grub_term_output *term,
       return;
     }
 
-  if (data->gotoxy)
-    putstr (term, grub_terminfo_tparm (data->gotoxy, pos.y, pos.x));
-  else
+  if (!data->gotoxy)
     {
       if ((pos.y == data->pos.y) && (pos.x == data->pos.x - 1))
-	data->put (term, '\b');
+	term_put (term, '\b');
     }
 
   data->pos = pos;
-}
 
-/* Clear the screen.  */
-void
-grub_terminfo_cls (struct grub_term_output *term)
-{
-  struct grub_terminfo_output_state *data
-    = (struct grub_terminfo_output_state *) term->data;
-
-  putstr (term, grub_terminfo_tparm (data->cls));
-  grub_terminfo_gotoxy (term, (struct grub_term_coordinate) { 0, 0 });
+  /* While the cursor is hidden it is only moved before output.  */
+  if (!data->cursor_hidden)
+    flush_cursor (term);
 }
 
-void
-grub_terminfo_setcolorstate (struct grub_term_output *term,
-			     const grub_term_color_state state)
+static void
+send_color (struct grub_term_output *term, const grub_term_color_state state)
 {
   struct grub_terminfo_output_state *data
     = (struct grub_terminfo_output_state *) term->data;
@@ -331,6 +400,60 @@ grub_terminfo_setcolorstate (struct grub_term_output *term,
     }
 }
 
+static void
+flush_color (struct grub_term_output *term)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  if (data->color && data->color != data->sent_color)
+    {
+      send_color (term, data->color_state);
+      data->sent_color = data->color;
+    }
+}
+
+/* Clear the screen.  */
+void
+grub_terminfo_cls (struct grub_term_output *term)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  /* The screen is cleared to the current background.  */
+  flush_color (term);
+  putstr (term, grub_terminfo_tparm (data->cls));
+  invalidate_screen (data);
+  grub_terminfo_gotoxy (term, (struct grub_term_coordinate) { 0, 0 });
+}
+
+void
+grub_terminfo_setcolorstate (struct grub_term_output *term,
+			     const grub_term_color_state state)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  /* Remember the colors the state stands for now, so that a cell is only
+     sent again if it is drawn in other colors.  */
+  switch (state)
+    {
+    case GRUB_TERM_COLOR_STANDARD:
+    case GRUB_TERM_COLOR_NORMAL:
+      data->color = 0x100 | grub_term_normal_color;
+      break;
+    case GRUB_TERM_COLOR_HIGHLIGHT:
+      data->color = 0x200 | grub_term_highlight_color;
+      break;
+    default:
+      return;
+    }
+  data->color_state = state;
+
+  if (!data->gotoxy)
+    flush_color (term);
+}
+
 void
 grub_terminfo_setcursor (struct grub_term_output *term, const int on)
 {
@@ -338,25 +461,37 @@ grub_terminfo_setcursor (struct grub_term_output *term, const int on)
     = (struct grub_terminfo_output_state *) term->data;
 
   if (on)
-    putstr (term, grub_terminfo_tparm (data->cursor_on));
+    {
+      flush_cursor (term);
+      putstr (term, grub_terminfo_tparm (data->cursor_on));
+    }
   else
     putstr (term, grub_terminfo_tparm (data->cursor_off));
+  data->cursor_hidden = !on;
 }
 
-/* The terminfo version of putchar.  */
+/* Account the bytes sent since the last refresh to a frame.  */
 void
-grub_terminfo_putchar (struct grub_term_output *term,
-		       const struct grub_unicode_glyph *c)
+grub_terminfo_refresh (struct grub_term_output *term)
 {
+  static struct grub_trace_counter *frame_counter;
   struct grub_terminfo_output_state *data
     = (struct grub_terminfo_output_state *) term->data;
 
-  /* Keep track of the cursor.  */
-  switch (c->base)
-    {
-    case '\a':
-      break;
+  grub_trace_count (grub_trace_lookup (&frame_counter, "terminfo", "frame"),
+		    data->frame_bytes);
+  data->frame_bytes = 0;
+}
 
+/* Keep track of the cursor.  */
+static void
+track_control (struct grub_term_output *term, const int c)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  switch (c)
+    {
     case '\b':
     case 127:
       if (data->pos.x > 0)
@@ -371,6 +506,27 @@ grub_terminfo_putchar (struct grub_term_output *term,
     case '\r':
       data->pos.x = 0;
       break;
+    }
+}
+
+static void
+putchar_dumb (struct grub_term_output *term,
+	      const struct grub_unicode_glyph *c)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+
+  switch (c->base)
+    {
+    case '\a':
+      break;
+
+    case '\b':
+    case 127:
+    case '\n':
+    case '\r':
+      track_control (term, c->base);
+      break;
 
     default:
       if ((int) data->pos.x + c->estimated_width >= (int) grub_term_width (term) + 1)
@@ -378,14 +534,112 @@ grub_terminfo_putchar (struct grub_term_output *term,
 	  data->pos.x = 0;
 	  if (data->pos.y < grub_term_height (term) - 1)
 	    data->pos.y++;
-	  data->put (term, '\r');
-	  data->put (term, '\n');
+	  term_put (term, '\r');
+	  term_put (term, '\n');
 	}
       data->pos.x += c->estimated_width;
       break;
     }
 
-  data->put (term, c->base);
+  term_put (term, c->base);
+}
+
+/* The terminfo version of putchar.  */
+void
+grub_terminfo_putchar (struct grub_term_output *term,
+		       const struct grub_unicode_glyph *c)
+{
+  struct grub_terminfo_output_state *data
+    = (struct grub_terminfo_output_state *) term->data;
+  struct grub_terminfo_cell *cell = NULL;
+  unsigned x;
+
+  /* Without cursor addressing everything is sent as it comes.  */
+  if (!data->gotoxy)
+    {
+      putchar_dumb (term, c);
+      return;
+    }
+
+  switch (c->base)
+    {
+    case '\a':
+      term_put (term, c->base);
+      return;
+
+    case '\b':
+    case 127:
+    case '\n':
+    case '\r':
+      flush_color (term);
+      flush_cursor (term);
+      if (c->base == '\n' && data->pos.y >= grub_term_height (term) - 1)
+	invalidate_screen (data);
+      track_control (term, c->base);
+      term_put (term, c->base);
+      data->cursor = data->pos;
+      data->cursor_known = (data->pos.x < grub_term_width (term)
+			    && c->base != 127);
+      return;
+    }
+
+  if ((int) data->pos.x + c->estimated_width >= (int) grub_term_width (term) + 1)
+    {
+      if (data->pos.y < grub_term_height (term) - 1)
+	{
+	  /* Just move on to the next line.  */
+	  data->pos.x = 0;
+	  data->pos.y++;
+	}
+      else
+	{
+	  /* Scroll.  */
+	  flush_color (term);
+	  flush_cursor (term);
+	  term_put (term, '\r');
+	  term_put (term, '\n');
+	  invalidate_screen (data);
+	  data->pos.x = 0;
+	  data->cursor = data->pos;
+	  data->cursor_known = 1;
+	}
+    }
+
+  if (data->cursor_hidden && c->estimated_width == 1
+      && c->base >= 0x20 && c->base < 0x7f
+      && data->pos.y < grub_term_height (term) && get_shadow (term))
+    {
+      cell = &data->shadow[data->pos.y * data->shadow_size.x + data->pos.x];
+      if (cell->code == c->base
+	  && cell->color == (data->color ? data->color : data->sent_color))
+	{
+	  data->pos.x++;
+	  return;
+	}
+    }
+
+  /* Bytes continuing a character must not be split by escapes.  */
+  if (c->estimated_width)
+    {
+      flush_color (term);
+      flush_cursor (term);
+    }
+  term_put (term, c->base);
+
+  if (cell)
+    {
+      cell->code = c->base;
+      cell->color = data->sent_color;
+    }
+  else if (data->shadow && data->shadow_size.x == grub_term_width (term)
+	   && data->pos.y < data->shadow_size.y)
+    for (x = c->estimated_width ? data->pos.x : data->pos.x - 1;
+	 x < data->pos.x + c->estimated_width && x < data->shadow_size.x; x++)
+      data->shadow[data->pos.y * data->shadow_size.x + x].code = 0;
+
+  data->pos.x += c->estimated_width;
+  data->cursor = data->pos;
+  data->cursor_known = data->pos.x < grub_term_width (term);
 }
 
 struct grub_term_coordinate
@@ -0,0 +1,254 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/font.h>
+#include <grub/fontformat.h>
+#include <grub/procfs.h>
+#include <grub/time.h>
+#include <grub/trace.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define FONT_NAME "Font Test Regular 12"
+
+/* Loading unicode.pf2 used to take three reads per character; now it
+   should only take a few per section.  */
+#define MAX_LOAD_READS 64
+
+static const grub_uint32_t test_codes[] =
+  {
+    ' ', '!', '0', 'A', 'Z', 'a', 'z', '~', 0xa3, 0x3a9, 0x263a, 0x4e00,
+    0xfffd, 0x10000, 0x1f600
+  };
+
+#define N_CODES ARRAY_SIZE (test_codes)
+
+struct test_glyph
+{
+  grub_uint16_t width;
+  grub_uint16_t height;
+  grub_int16_t offset_x;
+  grub_int16_t offset_y;
+  grub_int16_t device_width;
+};
+
+/* Glyphs are made up from their code point.  */
+static void
+make_glyph (grub_uint32_t code, struct test_glyph *g)
+{
+  g->width = code == ' ' ? 0 : code % 11 + 1;
+  g->height = code == ' ' ? 0 : code % 13 + 2;
+  g->offset_x = (grub_int16_t) (code % 5) - 2;
+  g->offset_y = (grub_int16_t) (code % 7) - 3;
+  g->device_width = g->width + 1;
+}
+
+static grub_uint8_t
+glyph_byte (grub_uint32_t code, grub_size_t i)
+{
+  return (code * 31 + i * 7) & 0xff;
+}
+
+static grub_size_t
+glyph_bitmap_len (const struct test_glyph *g)
+{
+  return ((grub_size_t) g->width * g->height + 7) / 8;
+}
+
+static char *
+put_be (char *p, grub_uint32_t v, int bytes)
+{
+  while (bytes--)
+    *p++ = v >> (8 * bytes);
+  return p;
+}
+
+static char *
+put_section (char *p, const char *name, grub_uint32_t len)
+{
+  grub_memcpy (p, name, 4);
+  return put_be (p + 4, len, 4);
+}
+
+static char *
+put_short_section (char *p, const char *name, grub_int16_t v)
+{
+  p = put_section (p, name, 2);
+  return put_be (p, (grub_uint16_t) v, 2);
+}
+
+/* Build a PF2 font holding the test glyphs.  */
+static char *
+get_test_font (grub_size_t *sz)
+{
+  struct test_glyph g;
+  grub_size_t size, data_start, off, i, j;
+  char *font, *p;
+
+  data_start = 8 + 4 + 8 + sizeof (FONT_NAME) - 1 + 5 * (8 + 2)
+    + 8 + N_CODES * 9 + 8;
+  size = data_start;
+  for (i = 0; i < N_CODES; i++)
+    {
+      make_glyph (test_codes[i], &g);
+      size += 10 + glyph_bitmap_len (&g);
+    }
+
+  font = grub_malloc (size);
+  if (!font)
+    return NULL;
+
+  p = put_section (font, FONT_FORMAT_SECTION_NAMES_FILE, 4);
+  grub_memcpy (p, FONT_FORMAT_PFF2_MAGIC, 4);
+  p += 4;
+  p = put_section (p, FONT_FORMAT_SECTION_NAMES_FONT_NAME,
+		   sizeof (FONT_NAME) - 1);
+  grub_memcpy (p, FONT_NAME, sizeof (FONT_NAME) - 1);
+  p += sizeof (FONT_NAME) - 1;
+  p = put_short_section (p, FONT_FORMAT_SECTION_NAMES_POINT_SIZE, 12);
+  p = put_short_section (p, FONT_FORMAT_SECTION_NAMES_MAX_CHAR_WIDTH, 12);
+  p = put_short_section (p, FONT_FORMAT_SECTION_NAMES_MAX_CHAR_HEIGHT, 15);
+  p = put_short_section (p, FONT_FORMAT_SECTION_NAMES_ASCENT, 11);
+  p = put_short_section (p, FONT_FORMAT_SECTION_NAMES_DESCENT, 4);
+
+  p = put_section (p, FONT_FORMAT_SECTION_NAMES_CHAR_INDEX, N_CODES * 9);
+  for (i = 0, off = data_start; i < N_CODES; i++)
+    {
+      make_glyph (test_codes[i], &g);
+      p = put_be (p, test_codes[i], 4);
+      *p++ = 0;
+      p = put_be (p, off, 4);
+      off += 10 + glyph_bitmap_len (&g);
+    }
+
+  p = put_section (p, FONT_FORMAT_SECTION_NAMES_DATA, 0xffffffff);
+  for (i = 0; i < N_CODES; i++)
+    {
+      make_glyph (test_codes[i], &g);
+      p = put_be (p, g.width, 2);
+      p = put_be (p, g.height, 2);
+      p = put_be (p, (grub_uint16_t) g.offset_x, 2);
+      p = put_be (p, (grub_uint16_t) g.offset_y, 2);
+      p = put_be (p, (grub_uint16_t) g.device_width, 2);
+      for (j = 0; j < glyph_bitmap_len (&g); j++)
+	*p++ = glyph_byte (test_codes[i], j);
+    }
+
+  *sz = size;
+  return font;
+}
+
+static struct grub_procfs_entry test_font =
+{
+  .name = "font_test.pf2",
+  .get_contents = get_test_font
+};
+
+static void
+check_glyphs (grub_font_t font)
+{
+  struct grub_font_glyph *glyph;
+  struct test_glyph g;
+  grub_size_t i, j;
+
+  for (i = 0; i < N_CODES; i++)
+    {
+      make_glyph (test_codes[i], &g);
+      glyph = grub_font_get_glyph (font, test_codes[i]);
+      grub_test_assert (glyph && glyph->font == font,
+			"no glyph for U+%04x", test_codes[i]);
+      if (!glyph || glyph->font != font)
+	continue;
+      grub_test_assert (glyph->width == g.width && glyph->height == g.height
+			&& glyph->offset_x == g.offset_x
+			&& glyph->offset_y == g.offset_y
+			&& glyph->device_width == g.device_width,
+			"wrong metrics for U+%04x", test_codes[i]);
+      for (j = 0; j < glyph_bitmap_len (&g); j++)
+	if (glyph->bitmap[j] != glyph_byte (test_codes[i], j))
+	  break;
+      grub_test_assert (j == glyph_bitmap_len (&g),
+			"wrong bitmap for U+%04x", test_codes[i]);
+    }
+
+  /* Characters just before, between and after the ones in the font.  */
+  glyph = grub_font_get_glyph (font, 0x1f);
+  grub_test_assert (!glyph || glyph->font != font, "glyph for U+001f");
+  glyph = grub_font_get_glyph (font, 0x4e01);
+  grub_test_assert (!glyph || glyph->font != font, "glyph for U+4e01");
+  glyph = grub_font_get_glyph (font, 0x10001);
+  grub_test_assert (!glyph || glyph->font != font, "glyph for U+10001");
+  glyph = grub_font_get_glyph (font, 0x1f601);
+  grub_test_assert (!glyph || glyph->font != font, "glyph for U+1f601");
+}
+
+static void
+font_test (void)
+{
+  struct grub_trace_counter *reads;
+  struct grub_font_glyph *glyph;
+  grub_uint64_t reads_before, start, end;
+  grub_font_t font;
+
+  /* A small font is unpacked into its glyph atlas at load.  */
+  grub_procfs_register ("font_test.pf2", &test_font);
+  font = grub_font_load ("(proc)/font_test.pf2");
+  grub_procfs_unregister (&test_font);
+  grub_test_assert (font != NULL, "couldn't load test font: %s", grub_errmsg);
+  if (font)
+    {
+      grub_test_assert (grub_strcmp (grub_font_get_name (font),
+				     FONT_NAME) == 0,
+			"wrong font name %s", grub_font_get_name (font));
+      grub_test_assert (font->glyph_atlas != NULL && font->file == NULL,
+			"test font glyphs weren't loaded together");
+      check_glyphs (font);
+    }
+  grub_errno = GRUB_ERR_NONE;
+
+  /* unicode.pf2 is too large for that, but its index is read at once.  */
+  reads = grub_trace_counter_get ("file", "bufio");
+  reads_before = reads ? reads->count : 0;
+  start = grub_get_time_ms ();
+  font = grub_font_load ("unicode");
+  end = grub_get_time_ms ();
+  if (!font)
+    {
+      grub_test_assert (0, "unicode font not found: %s", grub_errmsg);
+      return;
+    }
+  grub_printf ("font_test: unicode.pf2, %u characters, loaded in %"
+	       PRIuGRUB_UINT64_T " ms with %" PRIuGRUB_UINT64_T " reads\n",
+	       font->num_chars, end - start,
+	       reads ? reads->count - reads_before : 0);
+  grub_test_assert (reads && reads->count - reads_before <= MAX_LOAD_READS,
+		    "loading unicode.pf2 took %" PRIuGRUB_UINT64_T " reads",
+		    reads ? reads->count - reads_before : 0);
+  glyph = grub_font_get_glyph (font, 'A');
+  grub_test_assert (glyph && glyph->font == font,
+		    "unicode.pf2 has no glyph for A");
+  glyph = grub_font_get_glyph (font, 0x263a);
+  grub_test_assert (glyph && glyph->font == font,
+		    "unicode.pf2 has no glyph for U+263a");
+}
+
+GRUB_FUNCTIONAL_TEST (font_test, font_test);
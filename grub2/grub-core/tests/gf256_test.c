@@ -0,0 +1,138 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/gf256.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MAXSIZE	4200
+
+/* Odd sizes and sizes around the vector widths and the table threshold.  */
+static grub_size_t sizes[] = { 1, 15, 16, 17, 33, 255, 256, 1000, 4096 };
+
+static grub_uint8_t
+ref_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  grub_uint8_t r = 0;
+
+  while (b)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1d : 0);
+      b >>= 1;
+    }
+  return r;
+}
+
+static void
+fill (grub_uint8_t *buf, grub_size_t size, grub_uint32_t *seed)
+{
+  grub_size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      *seed = *seed * 1103515245 + 12345;
+      buf[i] = *seed >> 16;
+    }
+}
+
+static void
+test_impl (const struct grub_gf256_impl *impl, grub_uint8_t *src,
+	   grub_uint8_t *dst, grub_uint8_t *expect)
+{
+  grub_uint32_t seed = 1;
+  unsigned c, s, off;
+  grub_size_t i, size;
+
+  for (s = 0; s < ARRAY_SIZE (sizes); s++)
+    for (off = 0; off < 3; off++)
+      {
+	size = sizes[s];
+	fill (src + off, size, &seed);
+
+	for (c = 0; c < 256; c++)
+	  {
+	    for (i = 0; i < size; i++)
+	      expect[i] = ref_mul (src[off + i], c);
+	    impl->mul (dst + off, src + off, c, size);
+	    grub_test_assert (grub_memcmp (dst + off, expect, size) == 0,
+			      "%s: mul by %u, size %" PRIuGRUB_SIZE
+			      ", offset %u", impl->name, c, size, off);
+
+	    fill (dst + off, size, &seed);
+	    for (i = 0; i < size; i++)
+	      expect[i] = dst[off + i] ^ ref_mul (src[off + i], c);
+	    impl->muladd (dst + off, src + off, c, size);
+	    grub_test_assert (grub_memcmp (dst + off, expect, size) == 0,
+			      "%s: muladd by %u, size %" PRIuGRUB_SIZE
+			      ", offset %u", impl->name, c, size, off);
+	  }
+
+	/* In place, as raid6 does with the Q block.  */
+	grub_memcpy (dst + off, src + off, size);
+	for (i = 0; i < size; i++)
+	  expect[i] = ref_mul (src[off + i], 0x8e);
+	impl->mul (dst + off, dst + off, 0x8e, size);
+	grub_test_assert (grub_memcmp (dst + off, expect, size) == 0,
+			  "%s: in-place mul, size %" PRIuGRUB_SIZE
+			  ", offset %u", impl->name, size, off);
+
+	fill (dst + off, size, &seed);
+	for (i = 0; i < size; i++)
+	  expect[i] = dst[off + i] ^ src[off + i];
+	impl->add (dst + off, src + off, size);
+	grub_test_assert (grub_memcmp (dst + off, expect, size) == 0,
+			  "%s: add, size %" PRIuGRUB_SIZE ", offset %u",
+			  impl->name, size, off);
+      }
+}
+
+static void
+gf256_test (void)
+{
+  grub_uint8_t *src, *dst, *expect;
+  unsigned i;
+
+  for (i = 1; i < 255; i++)
+    {
+      grub_test_assert (grub_gf256_exp (grub_gf256_log (i)) == i,
+			"exp (log (%u)) != %u", i, i);
+      grub_test_assert (grub_gf256_mul (i, 255 - i) == ref_mul (i, 255 - i),
+			"%u * %u is wrong", i, 255 - i);
+    }
+
+  src = grub_malloc (MAXSIZE);
+  dst = grub_malloc (MAXSIZE);
+  expect = grub_malloc (MAXSIZE);
+  grub_test_assert (src && dst && expect, "out of memory");
+  if (src && dst && expect)
+    for (i = 0; grub_gf256_impls[i]; i++)
+      if (grub_gf256_impls[i]->supported ())
+	test_impl (grub_gf256_impls[i], src, dst, expect);
+
+  grub_free (src);
+  grub_free (dst);
+  grub_free (expect);
+}
+
+GRUB_FUNCTIONAL_TEST (gf256_test, gf256_test);
@@ -0,0 +1,448 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/deflate.h>
+#include <grub/inflate.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* More than the decoder's window, so that it slides.  */
+#define DATA_SIZE	(300 * 1024)
+#define STREAM_SIZE	(2 * DATA_SIZE)
+#define MAX_POINTS	8
+
+/* The stream is written by a small encoder here, which uses stored blocks,
+   fixed Huffman blocks with matches of every length and distance, and
+   dynamic Huffman blocks with codes of every length from 1 to 15 bits.  */
+struct encoder
+{
+  grub_uint8_t *stream;
+  grub_size_t stream_len;
+  grub_uint32_t bits;
+  unsigned nbits;
+  /* What the stream decompresses to.  */
+  grub_uint8_t *data;
+  grub_size_t data_len;
+  grub_uint32_t seed;
+};
+
+struct code
+{
+  grub_uint8_t lengths[288];
+  grub_uint16_t codes[288];
+};
+
+static const grub_uint16_t len_base[29] =
+  {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+  };
+
+static const grub_uint8_t len_extra[29] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+  };
+
+static const grub_uint16_t dist_base[30] =
+  {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+  };
+
+static const grub_uint8_t dist_extra[30] =
+  {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+  };
+
+static const grub_uint8_t clen_order[19] =
+  {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+  };
+
+static grub_uint32_t
+rnd (struct encoder *e, grub_uint32_t n)
+{
+  e->seed = e->seed * 1103515245 + 12345;
+  return (e->seed >> 16) % n;
+}
+
+static void
+put_bits (struct encoder *e, grub_uint32_t val, unsigned n)
+{
+  e->bits |= val << e->nbits;
+  e->nbits += n;
+  while (e->nbits >= 8)
+    {
+      e->stream[e->stream_len++] = e->bits;
+      e->bits >>= 8;
+      e->nbits -= 8;
+    }
+}
+
+/* Huffman codes go most significant bit first.  */
+static void
+put_code (struct encoder *e, const struct code *c, unsigned sym)
+{
+  grub_uint32_t rev = 0;
+  unsigned i;
+
+  for (i = 0; i < c->lengths[sym]; i++)
+    rev |= ((c->codes[sym] >> i) & 1) << (c->lengths[sym] - 1 - i);
+  put_bits (e, rev, c->lengths[sym]);
+}
+
+static void
+make_codes (struct code *c, unsigned n)
+{
+  grub_uint16_t count[16], next[16];
+  unsigned i, code = 0;
+
+  grub_memset (count, 0, sizeof (count));
+  for (i = 0; i < n; i++)
+    count[c->lengths[i]]++;
+  count[0] = 0;
+  for (i = 1; i < 16; i++)
+    {
+      code = (code + count[i - 1]) << 1;
+      next[i] = code;
+    }
+  for (i = 0; i < n; i++)
+    if (c->lengths[i])
+      c->codes[i] = next[c->lengths[i]]++;
+}
+
+static void
+put_literal (struct encoder *e, const struct code *lit, grub_uint8_t byte)
+{
+  put_code (e, lit, byte);
+  e->data[e->data_len++] = byte;
+}
+
+static void
+put_match (struct encoder *e, const struct code *lit, const struct code *dist,
+	   unsigned len, unsigned d)
+{
+  unsigned i;
+
+  i = 28;
+  while (len_base[i] > len)
+    i--;
+  put_code (e, lit, 257 + i);
+  put_bits (e, len - len_base[i], len_extra[i]);
+
+  i = 29;
+  while (dist_base[i] > d)
+    i--;
+  put_code (e, dist, i);
+  put_bits (e, d - dist_base[i], dist_extra[i]);
+
+  for (i = 0; i < len; i++, e->data_len++)
+    e->data[e->data_len] = e->data[e->data_len - d];
+}
+
+static void
+put_stored_block (struct encoder *e, int last, unsigned len)
+{
+  unsigned i;
+
+  put_bits (e, last, 1);
+  put_bits (e, 0, 2);
+  if (e->nbits)
+    put_bits (e, 0, 8 - e->nbits);
+  put_bits (e, len, 16);
+  put_bits (e, len ^ 0xffff, 16);
+  for (i = 0; i < len; i++)
+    {
+      e->data[e->data_len] = rnd (e, 256);
+      e->stream[e->stream_len++] = e->data[e->data_len++];
+    }
+}
+
+static void
+put_fixed_block (struct encoder *e, int last, unsigned nsyms)
+{
+  static const unsigned dists[] = { 1, 2, 3, 4, 5, 258, 4096, 32768 };
+  static const unsigned lens[] = { 3, 4, 10, 11, 257, 258 };
+  struct code lit, dist;
+  unsigned i;
+
+  for (i = 0; i < 288; i++)
+    lit.lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+  make_codes (&lit, 288);
+  for (i = 0; i < 30; i++)
+    dist.lengths[i] = 5;
+  make_codes (&dist, 30);
+
+  put_bits (e, last, 1);
+  put_bits (e, 1, 2);
+  for (i = 0; i < nsyms; i++)
+    {
+      unsigned len, d;
+
+      if (e->data_len == 0 || rnd (e, 3) == 0)
+	{
+	  put_literal (e, &lit, rnd (e, 256));
+	  continue;
+	}
+      d = rnd (e, 2) ? dists[rnd (e, ARRAY_SIZE (dists))] : rnd (e, 32768) + 1;
+      if (d > e->data_len)
+	d = e->data_len;
+      len = rnd (e, 2) ? lens[rnd (e, ARRAY_SIZE (lens))] : rnd (e, 256) + 3;
+      put_match (e, &lit, &dist, len, d);
+    }
+  put_code (e, &lit, 256);
+}
+
+/* Literals 'a' to 'n' have codes of 1 to 14 bits; the end of block and
+   a match of 3 at distance 1 have 15 bits, which completes the code.  */
+static void
+put_dynamic_block (struct encoder *e, int last, unsigned nsyms)
+{
+  struct code lit, dist, clen;
+  unsigned i, run;
+  grub_uint8_t lengths[286 + 1];
+
+  grub_memset (lit.lengths, 0, sizeof (lit.lengths));
+  for (i = 0; i < 14; i++)
+    lit.lengths['a' + i] = i + 1;
+  lit.lengths[256] = 15;
+  lit.lengths[257] = 15;
+  make_codes (&lit, 286);
+  grub_memset (dist.lengths, 0, sizeof (dist.lengths));
+  dist.lengths[0] = 1;
+  make_codes (&dist, 1);
+  /* A complete code: 13 lengths of 4 bits and 6 of 5 bits.  */
+  for (i = 0; i < 19; i++)
+    clen.lengths[i] = i < 13 ? 4 : 5;
+  make_codes (&clen, 19);
+
+  put_bits (e, last, 1);
+  put_bits (e, 2, 2);
+  put_bits (e, 286 - 257, 5);
+  put_bits (e, 0, 5);
+  put_bits (e, 19 - 4, 4);
+  for (i = 0; i < 19; i++)
+    put_bits (e, clen.lengths[clen_order[i]], 3);
+
+  grub_memcpy (lengths, lit.lengths, 286);
+  lengths[286] = dist.lengths[0];
+  for (i = 0; i < 287; i += run)
+    {
+      run = 0;
+      while (i + run < 287 && lengths[i + run] == 0 && run < 138)
+	run++;
+      if (run >= 11)
+	{
+	  put_code (e, &clen, 18);
+	  put_bits (e, run - 11, 7);
+	}
+      else if (run >= 3)
+	{
+	  put_code (e, &clen, 17);
+	  put_bits (e, run - 3, 3);
+	}
+      else
+	{
+	  put_code (e, &clen, lengths[i]);
+	  run = 1;
+	}
+    }
+
+  for (i = 0; i < nsyms; i++)
+    {
+      unsigned sym = rnd (e, 15);
+
+      if (sym == 14 && e->data_len)
+	put_match (e, &lit, &dist, 3, 1);
+      else
+	put_literal (e, &lit, 'a' + sym % 14);
+    }
+  put_code (e, &lit, 256);
+}
+
+/* Write a zlib stream, two bytes of header and the DEFLATE data.  */
+static void
+encode (struct encoder *e)
+{
+  int last = 0;
+
+  e->stream[0] = 0x78;
+  e->stream[1] = 0x01;
+  e->stream_len = 2;
+  e->seed = 1;
+
+  while (! last)
+    {
+      last = e->data_len > DATA_SIZE - 8 * 4096;
+      switch (rnd (e, 4))
+	{
+	case 0:
+	  put_stored_block (e, last, rnd (e, 4) ? rnd (e, 4096) : 0);
+	  break;
+	case 1:
+	  put_dynamic_block (e, last, rnd (e, 4096));
+	  break;
+	default:
+	  /* Each symbol writes at most 258 bytes.  */
+	  put_fixed_block (e, last, rnd (e, 4096 / 258 * 4));
+	  break;
+	}
+    }
+  if (e->nbits)
+    put_bits (e, 0, 8 - e->nbits);
+}
+
+struct test_input
+{
+  const grub_uint8_t *stream;
+  grub_size_t len, pos, chunk;
+};
+
+static grub_ssize_t
+test_fill (void *data, const grub_uint8_t **buf)
+{
+  struct test_input *in = data;
+  grub_size_t n = in->len - in->pos;
+
+  if (n > in->chunk)
+    n = in->chunk;
+  *buf = in->stream + in->pos;
+  in->pos += n;
+  return n;
+}
+
+struct test_points
+{
+  struct grub_inflate_point point[MAX_POINTS];
+  unsigned n;
+};
+
+static void
+test_hook (struct grub_inflate *inflate, grub_uint64_t out_off, void *data)
+{
+  struct test_points *p = data;
+
+  if (p->n < MAX_POINTS && out_off >= (p->n + 1) * (DATA_SIZE / (MAX_POINTS + 1)))
+    if (grub_inflate_save_point (inflate, &p->point[p->n]) == GRUB_ERR_NONE)
+      p->n++;
+}
+
+static void
+inflate_test (void)
+{
+  struct encoder e;
+  struct test_input in;
+  struct test_points points;
+  struct grub_inflate *inflate;
+  grub_uint8_t *out;
+  grub_ssize_t ret;
+  unsigned i;
+
+  grub_memset (&e, 0, sizeof (e));
+  grub_memset (&points, 0, sizeof (points));
+  e.stream = grub_malloc (STREAM_SIZE);
+  e.data = grub_malloc (DATA_SIZE);
+  out = grub_malloc (DATA_SIZE);
+  grub_test_assert (e.stream && e.data && out, "out of memory");
+  if (! e.stream || ! e.data || ! out)
+    goto fail;
+
+  encode (&e);
+
+  ret = grub_zlib_decompress ((char *) e.stream, e.stream_len, 0,
+			      (char *) out, DATA_SIZE);
+  grub_test_assert (ret == (grub_ssize_t) e.data_len
+		    && grub_memcmp (out, e.data, e.data_len) == 0,
+		    "zlib stream decompressed wrong");
+
+  for (i = 0; i < 16; i++)
+    {
+      grub_off_t off = rnd (&e, e.data_len);
+      grub_size_t size = e.data_len - off;
+
+      if (size > 5000)
+	size = 5000;
+      ret = grub_deflate_decompress ((char *) e.stream + 2, e.stream_len - 2,
+				     off, (char *) out, size);
+      grub_test_assert (ret == (grub_ssize_t) size
+			&& grub_memcmp (out, e.data + off, size) == 0,
+			"wrong data at offset %" PRIuGRUB_UINT64_T,
+			(grub_uint64_t) off);
+    }
+
+  /* Byte by byte, saving a few points to resume from.  */
+  in.stream = e.stream + 2;
+  in.len = e.stream_len - 2;
+  in.pos = 0;
+  in.chunk = 1;
+  inflate = grub_inflate_new (test_fill, &in);
+  grub_test_assert (inflate != NULL, "out of memory");
+  if (! inflate)
+    goto fail;
+  grub_inflate_set_block_hook (inflate, test_hook, &points);
+  ret = grub_inflate_read (inflate, out, DATA_SIZE);
+  grub_test_assert (ret == (grub_ssize_t) e.data_len
+		    && grub_memcmp (out, e.data, e.data_len) == 0,
+		    "stream read byte by byte decompressed wrong");
+  grub_test_assert (points.n == MAX_POINTS, "only %u points", points.n);
+
+  in.chunk = 4096;
+  for (i = 0; i < points.n; i++)
+    {
+      grub_uint64_t off = points.point[i].out_off;
+      grub_size_t size = e.data_len - off;
+
+      if (size > 4096)
+	size = 4096;
+      in.pos = points.point[i].in_off;
+      grub_inflate_restore_point (inflate, &points.point[i]);
+      ret = grub_inflate_read (inflate, out, size);
+      grub_test_assert (ret == (grub_ssize_t) size
+			&& grub_memcmp (out, e.data + off, size) == 0
+			&& grub_inflate_tell (inflate) == off + size,
+			"wrong data after point at %" PRIuGRUB_UINT64_T, off);
+      grub_free (points.point[i].history);
+    }
+  grub_inflate_free (inflate);
+
+  ret = grub_deflate_decompress ((char *) e.stream + 2, e.stream_len / 2, 0,
+				 (char *) out, DATA_SIZE);
+  grub_test_assert (ret < 0 && grub_errno == GRUB_ERR_BAD_COMPRESSED_DATA,
+		    "truncated stream not detected");
+  grub_errno = GRUB_ERR_NONE;
+
+  e.stream[1] = 0x02;
+  ret = grub_zlib_decompress ((char *) e.stream, e.stream_len, 0,
+			      (char *) out, DATA_SIZE);
+  grub_test_assert (ret < 0, "bad zlib header not detected");
+  grub_errno = GRUB_ERR_NONE;
+
+ fail:
+  grub_free (e.stream);
+  grub_free (e.data);
+  grub_free (out);
+}
+
+GRUB_FUNCTIONAL_TEST (inflate_test, inflate_test);
@@ -0,0 +1,189 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/mm_private.h>
+#include <grub/time.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define N_BLOCKS 2048
+
+/* Holes punched into the heap before the timed allocations.  */
+#define N_HOLES 4096
+
+#define SMALL_ROUNDS 256
+#define LARGE_ROUNDS 16
+#define BATCH 256
+
+static grub_uint8_t *blocks[N_BLOCKS];
+static void *holes[2 * N_HOLES];
+static void *batch[BATCH];
+
+/* Sizes span the size-class caches and the blocks beyond them.  */
+static grub_size_t
+block_size (unsigned i)
+{
+  return (i * 37) % (i % 8 ? 600 : 5000);
+}
+
+static void
+fill_block (unsigned i)
+{
+  grub_size_t j;
+
+  for (j = 0; j < block_size (i); j++)
+    blocks[i][j] = i + j;
+}
+
+static int
+check_block (unsigned i)
+{
+  grub_size_t j;
+
+  for (j = 0; j < block_size (i); j++)
+    if (blocks[i][j] != (grub_uint8_t) (i + j))
+      return 0;
+  return 1;
+}
+
+static void
+check_blocks (void)
+{
+  unsigned i;
+  grub_uint8_t *p;
+
+  for (i = 0; i < N_BLOCKS; i++)
+    {
+      blocks[i] = grub_malloc (block_size (i));
+      grub_test_assert (blocks[i] != NULL, "couldn't allocate block %u", i);
+      if (blocks[i])
+	fill_block (i);
+    }
+
+  /* Free every other block and allocate it again, partly aligned.  */
+  for (i = 0; i < N_BLOCKS; i += 2)
+    {
+      grub_free (blocks[i]);
+      if (i % 3)
+	blocks[i] = grub_malloc (block_size (i));
+      else
+	{
+	  blocks[i] = grub_memalign (1 << (i % 13), block_size (i));
+	  grub_test_assert (((grub_addr_t) blocks[i] & ((1 << (i % 13)) - 1))
+			    == 0, "block %u is misaligned", i);
+	}
+      grub_test_assert (blocks[i] != NULL, "couldn't allocate block %u", i);
+      if (blocks[i])
+	fill_block (i);
+    }
+
+  for (i = 0; i < N_BLOCKS; i++)
+    if (blocks[i])
+      grub_test_assert (check_block (i), "block %u was overwritten", i);
+
+  /* Growing a small block must keep its contents.  */
+  p = grub_realloc (blocks[1], 3000);
+  grub_test_assert (p != NULL, "couldn't grow block 1");
+  if (p)
+    {
+      blocks[1] = p;
+      grub_test_assert (check_block (1), "block 1 changed when grown");
+    }
+
+  p = grub_zalloc (100);
+  grub_test_assert (p != NULL, "couldn't allocate a cleared block");
+  if (p)
+    {
+      for (i = 0; i < 100; i++)
+	if (p[i])
+	  break;
+      grub_test_assert (i == 100, "cleared block isn't clear");
+      grub_free (p);
+    }
+
+  for (i = 0; i < N_BLOCKS; i++)
+    grub_free (blocks[i]);
+}
+
+/* Allocate and free BATCH blocks of SIZE bytes, or of small mixed sizes if
+   SIZE is 0, ROUNDS times and return the milliseconds that took.  With
+   BYPASS set the blocks are aligned to two cells, which the size-class
+   caches never serve, so every allocation walks the regions.  */
+static grub_uint64_t
+churn (unsigned rounds, grub_size_t size, int bypass)
+{
+  grub_uint64_t start;
+  unsigned i, j;
+
+  start = grub_get_time_ms ();
+  for (i = 0; i < rounds; i++)
+    {
+      for (j = 0; j < BATCH; j++)
+	{
+	  grub_size_t sz = size ? : 16 + (j * 37) % 400;
+
+	  batch[j] = bypass ? grub_memalign (2 * GRUB_MM_ALIGN, sz)
+	    : grub_malloc (sz);
+	}
+      for (j = 0; j < BATCH; j++)
+	grub_free (batch[j]);
+    }
+  return grub_get_time_ms () - start;
+}
+
+static void
+mm_test (void)
+{
+  grub_uint64_t small_ms, bypass_ms, large_ms;
+  unsigned i;
+
+  check_blocks ();
+
+  /* Fragment the heap, leaving holes too small for the large blocks.  */
+  for (i = 0; i < 2 * N_HOLES; i++)
+    holes[i] = grub_malloc (600);
+  for (i = 1; i < 2 * N_HOLES; i += 2)
+    {
+      grub_free (holes[i]);
+      holes[i] = NULL;
+    }
+
+  small_ms = churn (SMALL_ROUNDS, 0, 0);
+#ifndef GRUB_MACHINE_EMU
+  grub_mm_flush_caches ();
+#endif
+  bypass_ms = churn (SMALL_ROUNDS, 0, 1);
+  large_ms = churn (LARGE_ROUNDS, 1000, 0);
+  grub_printf ("mm_test: %u small malloc/free pairs in %" PRIuGRUB_UINT64_T
+	       " ms (%" PRIuGRUB_UINT64_T " ms without the caches), %u large in %"
+	       PRIuGRUB_UINT64_T " ms\n", SMALL_ROUNDS * BATCH, small_ms,
+	       bypass_ms, LARGE_ROUNDS * BATCH, large_ms);
+
+  for (i = 0; i < 2 * N_HOLES; i++)
+    grub_free (holes[i]);
+
+  grub_test_assert (grub_errno == GRUB_ERR_NONE, "allocation failed: %s",
+		    grub_errmsg);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+GRUB_FUNCTIONAL_TEST (mm_test, mm_test);
@@ -91,6 +91,20 @@ pbkdf2_test (void)
       grub_test_assert (grub_memcmp (DK, vectors[i].DK, vectors[i].dkLen) == 0,
 			"PBKDF2 mismatch");
     }
+
+  /* A derivation cancelled before it starts gives up at the first check.  */
+  {
+    const grub_uint8_t *P = (const grub_uint8_t *) vectors[2].P;
+    const grub_uint8_t *S = (const grub_uint8_t *) vectors[2].S;
+    const int cancel = 1;
+    gcry_err_code_t err;
+    grub_uint8_t DK[32];
+
+    err = grub_crypto_pbkdf2_cancellable (GRUB_MD_SHA1, P, vectors[2].Plen,
+					  S, vectors[2].Slen, vectors[2].c,
+					  DK, vectors[2].dkLen, &cancel);
+    grub_test_assert (err == GPG_ERR_CANCELED, "gcry error %d", err);
+  }
 }
 
 /* Register example_test method as a functional test.  */
@@ -0,0 +1,159 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/term.h>
+#include <grub/terminfo.h>
+#include <grub/unicode.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define WIDTH 20
+#define HEIGHT 6
+
+/* What the terminal was sent since the last reset_output.  */
+static char output[4096];
+static grub_size_t output_len;
+
+static void
+capture_put (struct grub_term_output *term __attribute__ ((unused)),
+	     const int c)
+{
+  if (output_len < sizeof (output) - 1)
+    output[output_len++] = c;
+  output[output_len] = '\0';
+}
+
+static struct grub_terminfo_output_state capture_data =
+  {
+    .put = capture_put,
+    .size = { WIDTH, HEIGHT }
+  };
+
+static struct grub_term_output capture_term =
+  {
+    .name = "terminfo_test",
+    .putchar = grub_terminfo_putchar,
+    .getwh = grub_terminfo_getwh,
+    .getxy = grub_terminfo_getxy,
+    .gotoxy = grub_terminfo_gotoxy,
+    .cls = grub_terminfo_cls,
+    .setcolorstate = grub_terminfo_setcolorstate,
+    .setcursor = grub_terminfo_setcursor,
+    .flags = GRUB_TERM_CODE_TYPE_UTF8_LOGICAL,
+    .data = &capture_data
+  };
+
+static void
+reset_output (void)
+{
+  output_len = 0;
+  output[0] = '\0';
+}
+
+/* Send STR at X, Y the way a UTF-8 terminal gets it: bytes continuing a
+   character have no width.  */
+static void
+put_string (unsigned x, unsigned y, const char *str)
+{
+  struct grub_unicode_glyph c;
+
+  grub_terminfo_gotoxy (&capture_term, (struct grub_term_coordinate) { x, y });
+  for (; *str; str++)
+    {
+      grub_memset (&c, 0, sizeof (c));
+      c.base = (grub_uint8_t) *str;
+      c.estimated_width = ((*str & 0xc0) == 0x80) ? 0 : 1;
+      grub_terminfo_putchar (&capture_term, &c);
+    }
+}
+
+/* Draw a menu the way the menu code does on every countdown tick.  */
+static void
+draw_menu (const char *timeout)
+{
+  char line[WIDTH + 1];
+
+  grub_terminfo_setcursor (&capture_term, 0);
+  reset_output ();
+
+  grub_terminfo_setcolorstate (&capture_term, GRUB_TERM_COLOR_NORMAL);
+  put_string (0, 0, "GNU GRUB");
+  grub_terminfo_setcolorstate (&capture_term, GRUB_TERM_COLOR_HIGHLIGHT);
+  put_string (1, 2, "*Linux           ");
+  grub_terminfo_setcolorstate (&capture_term, GRUB_TERM_COLOR_NORMAL);
+  put_string (1, 3, " Linux recovery  ");
+  grub_snprintf (line, sizeof (line), "Booting in %ss", timeout);
+  put_string (0, HEIGHT - 1, line);
+}
+
+static void
+terminfo_test (void)
+{
+  grub_err_t err;
+
+  err = grub_terminfo_output_register (&capture_term, "vt100");
+  grub_test_assert (err == GRUB_ERR_NONE, "couldn't register: %s",
+		    grub_errmsg);
+  if (err)
+    return;
+
+  draw_menu ("5");
+  grub_test_assert (grub_strstr (output, "GNU GRUB") != NULL,
+		    "first frame wasn't drawn: %s", output);
+
+  /* Only the changed digit goes out, after one cursor escape.  */
+  draw_menu ("4");
+  grub_test_assert (grub_strcmp (output, "\e[6;12H4") == 0,
+		    "tick sent more than the digit: %s", output);
+
+  draw_menu ("4");
+  grub_test_assert (output_len == 0, "unchanged frame sent %s", output);
+
+  /* Past the last column of the bottom row the screen scrolls, so the
+     next frame is drawn in full.  */
+  put_string (0, HEIGHT - 1, "012345678901234567890");
+  grub_test_assert (grub_strstr (output, "\r\n") != NULL,
+		    "bottom row didn't scroll: %s", output);
+  draw_menu ("3");
+  grub_test_assert (grub_strstr (output, "GNU GRUB") != NULL,
+		    "frame after a scroll wasn't redrawn: %s", output);
+
+  draw_menu ("3");
+  grub_terminfo_cls (&capture_term);
+  draw_menu ("3");
+  grub_test_assert (grub_strstr (output, "GNU GRUB") != NULL,
+		    "frame after cls wasn't redrawn: %s", output);
+
+  /* Multibyte characters aren't remembered, so they're sent every time,
+     but no escape may come between their bytes.  */
+  draw_menu ("2");
+  put_string (1, 4, "Caf\xc3\xa9!");
+  grub_test_assert (grub_strstr (output, "\xc3\xa9!") != NULL,
+		    "UTF-8 character was split: %s", output);
+  draw_menu ("2");
+  put_string (1, 4, "Caf\xc3\xa9!");
+  grub_test_assert (grub_strcmp (output, "\e[5;5H\xc3\xa9") == 0,
+		    "UTF-8 redraw sent %s", output);
+
+  grub_terminfo_output_unregister (&capture_term);
+}
+
+GRUB_FUNCTIONAL_TEST (terminfo_test, terminfo_test);
@@ -23,6 +23,7 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/bufio.h>
+#include <grub/inflate.h>
 #include <grub/safemath.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
@@ -64,38 +65,17 @@ enum
 #define Z_DEFLATED		8
 #define Z_FLAG_DICT		32
 
-#define INFLATE_STORED		0
-#define INFLATE_FIXED		1
-#define INFLATE_DYNAMIC		2
-
-#define WSIZE			0x8000
-
-#define DEFLATE_HCLEN_BASE	4
-#define DEFLATE_HCLEN_MAX	19
-#define DEFLATE_HLIT_BASE	257
-#define DEFLATE_HLIT_MAX	288
-#define DEFLATE_HDIST_BASE	1
-#define DEFLATE_HDIST_MAX	30
-
-#define DEFLATE_HUFF_LEN	16
+#define PNG_INBUFSIZ		0x1000
 
 #ifdef PNG_DEBUG
 static grub_command_t cmd;
 #endif
 
-struct huff_table
-{
-  int *values, *maxval, *offset;
-  int num_values, max_length;
-};
-
 struct grub_png_data
 {
   grub_file_t file;
   struct grub_video_bitmap **bitmap;
 
-  int bit_count, bit_save;
-
   grub_uint32_t next_offset;
 
   unsigned image_width, image_height;
@@ -104,24 +84,17 @@ struct grub_png_data
   int row_bytes, color_bits;
   grub_uint8_t *image_data;
 
-  int inside_idat, idat_remain;
-
-  int code_values[DEFLATE_HLIT_MAX];
-  int code_maxval[DEFLATE_HUFF_LEN];
-  int code_offset[DEFLATE_HUFF_LEN];
+  /* Image data left in the current IDAT chunk, and whether all of it has
+     been decoded.  */
+  int idat_remain, idat_done;
 
-  int dist_values[DEFLATE_HDIST_MAX];
-  int dist_maxval[DEFLATE_HUFF_LEN];
-  int dist_offset[DEFLATE_HUFF_LEN];
+  /* Image data read but not passed to the decoder yet.  */
+  grub_uint8_t inbuf[PNG_INBUFSIZ];
+  const grub_uint8_t *in_pos;
+  grub_size_t in_len;
 
   grub_uint8_t palette[256][3];
 
-  struct huff_table code_table;
-  struct huff_table dist_table;
-
-  grub_uint8_t slide[WSIZE];
-  int wp;
-
   grub_uint8_t *cur_rgb;
 
   int cur_column, cur_filter, first_line;
@@ -143,85 +116,12 @@ grub_png_get_byte (struct grub_png_data *data)
 {
   grub_uint8_t r;
 
-  if ((data->inside_idat) && (data->idat_remain == 0))
-    {
-      grub_uint32_t len, type;
-
-      do
-	{
-          /* Skip crc checksum.  */
-	  grub_png_get_dword (data);
-
-          if (data->file->offset != data->next_offset)
-            {
-              grub_error (GRUB_ERR_BAD_FILE_TYPE,
-                          "png: chunk size error");
-              return 0;
-            }
-
-	  len = grub_png_get_dword (data);
-	  type = grub_png_get_dword (data);
-	  if (type != PNG_CHUNK_IDAT)
-	    {
-	      grub_error (GRUB_ERR_BAD_FILE_TYPE,
-			  "png: unexpected end of data");
-	      return 0;
-	    }
-
-          data->next_offset = data->file->offset + len + 4;
-	}
-      while (len == 0);
-      data->idat_remain = len;
-    }
-
   r = 0;
   grub_file_read (data->file, &r, 1);
 
-  if (data->inside_idat)
-    data->idat_remain--;
-
   return r;
 }
 
-static int
-grub_png_get_bits (struct grub_png_data *data, int num)
-{
-  int code, shift;
-
-  if (data->bit_count == 0)
-    {
-      data->bit_save = grub_png_get_byte (data);
-      data->bit_count = 8;
-    }
-
-  code = 0;
-  shift = 0;
-  while (grub_errno == 0)
-    {
-      int n;
-
-      n = data->bit_count;
-      if (n > num)
-	n = num;
-
-      code += (int) (data->bit_save & ((1 << n) - 1)) << shift;
-      num -= n;
-      if (!num)
-	{
-	  data->bit_count -= n;
-	  data->bit_save >>= n;
-	  break;
-	}
-
-      shift += n;
-
-      data->bit_save = grub_png_get_byte (data);
-      data->bit_count = 8;
-    }
-
-  return code;
-}
-
 static grub_err_t
 grub_png_decode_image_palette (struct grub_png_data *data,
 			       unsigned len)
@@ -355,234 +255,6 @@ grub_png_decode_image_header (struct grub_png_data *data)
   return grub_errno;
 }
 
-/* Order of the bit length code lengths.  */
-static const grub_uint8_t bitorder[] = {
-  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
-};
-
-/* Copy lengths for literal codes 257..285.  */
-static const int cplens[] = {
-  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
-  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0
-};
-
-/* Extra bits for literal codes 257..285.  */
-static const grub_uint8_t cplext[] = {
-  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
-  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 99, 99
-};				/* 99==invalid  */
-
-/* Copy offsets for distance codes 0..29.  */
-static const int cpdist[] = {
-  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
-  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
-  8193, 12289, 16385, 24577
-};
-
-/* Extra bits for distance codes.  */
-static const grub_uint8_t cpdext[] = {
-  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
-  7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
-  12, 12, 13, 13
-};
-
-static void
-grub_png_init_huff_table (struct huff_table *ht, int cur_maxlen,
-			  int *cur_values, int *cur_maxval, int *cur_offset)
-{
-  ht->values = cur_values;
-  ht->maxval = cur_maxval;
-  ht->offset = cur_offset;
-  ht->num_values = 0;
-  ht->max_length = cur_maxlen;
-  grub_memset (cur_maxval, 0, sizeof (int) * cur_maxlen);
-}
-
-static void
-grub_png_insert_huff_item (struct huff_table *ht, int code, int len)
-{
-  int i, n;
-
-  if (len == 0)
-    return;
-
-  if (len > ht->max_length)
-    {
-      grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid code length");
-      return;
-    }
-
-  n = 0;
-  for (i = len; i < ht->max_length; i++)
-    n += ht->maxval[i];
-
-  for (i = 0; i < n; i++)
-    ht->values[ht->num_values - i] = ht->values[ht->num_values - i - 1];
-
-  ht->values[ht->num_values - n] = code;
-  ht->num_values++;
-  ht->maxval[len - 1]++;
-}
-
-static void
-grub_png_build_huff_table (struct huff_table *ht)
-{
-  int base, ofs, i;
-
-  base = 0;
-  ofs = 0;
-  for (i = 0; i < ht->max_length; i++)
-    {
-      base += ht->maxval[i];
-      ofs += ht->maxval[i];
-
-      ht->maxval[i] = base;
-      ht->offset[i] = ofs - base;
-
-      base <<= 1;
-    }
-}
-
-static int
-grub_png_get_huff_code (struct grub_png_data *data, struct huff_table *ht)
-{
-  int code, i;
-
-  code = 0;
-  for (i = 0; i < ht->max_length; i++)
-    {
-      code = (code << 1) + grub_png_get_bits (data, 1);
-      if (code < ht->maxval[i])
-	return ht->values[code + ht->offset[i]];
-    }
-  return 0;
-}
-
-static grub_err_t
-grub_png_init_fixed_block (struct grub_png_data *data)
-{
-  int i;
-
-  grub_png_init_huff_table (&data->code_table, DEFLATE_HUFF_LEN,
-			    data->code_values, data->code_maxval,
-			    data->code_offset);
-
-  for (i = 0; i < 144; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 8);
-
-  for (; i < 256; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 9);
-
-  for (; i < 280; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 7);
-
-  for (; i < DEFLATE_HLIT_MAX; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 8);
-
-  grub_png_build_huff_table (&data->code_table);
-
-  grub_png_init_huff_table (&data->dist_table, DEFLATE_HUFF_LEN,
-			    data->dist_values, data->dist_maxval,
-			    data->dist_offset);
-
-  for (i = 0; i < DEFLATE_HDIST_MAX; i++)
-    grub_png_insert_huff_item (&data->dist_table, i, 5);
-
-  grub_png_build_huff_table (&data->dist_table);
-
-  return grub_errno;
-}
-
-static grub_err_t
-grub_png_init_dynamic_block (struct grub_png_data *data)
-{
-  int nl, nd, nb, i, prev;
-  struct huff_table cl;
-  int cl_values[sizeof (bitorder)];
-  int cl_maxval[8];
-  int cl_offset[8];
-  grub_uint8_t lens[DEFLATE_HCLEN_MAX];
-
-  nl = DEFLATE_HLIT_BASE + grub_png_get_bits (data, 5);
-  nd = DEFLATE_HDIST_BASE + grub_png_get_bits (data, 5);
-  nb = DEFLATE_HCLEN_BASE + grub_png_get_bits (data, 4);
-
-  if ((nl > DEFLATE_HLIT_MAX) || (nd > DEFLATE_HDIST_MAX) ||
-      (nb > DEFLATE_HCLEN_MAX))
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: too much data");
-
-  grub_png_init_huff_table (&cl, 8, cl_values, cl_maxval, cl_offset);
-
-  for (i = 0; i < nb; i++)
-    lens[bitorder[i]] = grub_png_get_bits (data, 3);
-
-  for (; i < DEFLATE_HCLEN_MAX; i++)
-    lens[bitorder[i]] = 0;
-
-  for (i = 0; i < DEFLATE_HCLEN_MAX; i++)
-    grub_png_insert_huff_item (&cl, i, lens[i]);
-
-  grub_png_build_huff_table (&cl);
-
-  grub_png_init_huff_table (&data->code_table, DEFLATE_HUFF_LEN,
-			    data->code_values, data->code_maxval,
-			    data->code_offset);
-
-  grub_png_init_huff_table (&data->dist_table, DEFLATE_HUFF_LEN,
-			    data->dist_values, data->dist_maxval,
-			    data->dist_offset);
-
-  prev = 0;
-  for (i = 0; i < nl + nd; i++)
-    {
-      int n, code;
-      struct huff_table *ht;
-
-      if (grub_errno)
-	return grub_errno;
-
-      if (i < nl)
-	{
-	  ht = &data->code_table;
-	  code = i;
-	}
-      else
-	{
-	  ht = &data->dist_table;
-	  code = i - nl;
-	}
-
-      n = grub_png_get_huff_code (data, &cl);
-      if (n < 16)
-	{
-	  grub_png_insert_huff_item (ht, code, n);
-	  prev = n;
-	}
-      else if (n == 16)
-	{
-	  int c;
-
-	  c = 3 + grub_png_get_bits (data, 2);
-	  while (c > 0)
-	    {
-	      grub_png_insert_huff_item (ht, code++, prev);
-	      i++;
-	      c--;
-	    }
-	  i--;
-	}
-      else if (n == 17)
-	i += 3 + grub_png_get_bits (data, 3) - 1;
-      else
-	i += 11 + grub_png_get_bits (data, 7) - 1;
-    }
-
-  grub_png_build_huff_table (&data->code_table);
-  grub_png_build_huff_table (&data->dist_table);
-
-  return grub_errno;
-}
-
 static grub_err_t
 grub_png_output_byte (struct grub_png_data *data, grub_uint8_t n)
 {
@@ -694,130 +366,122 @@ grub_png_output_byte (struct grub_png_data *data, grub_uint8_t n)
   return grub_errno;
 }
 
-static grub_err_t
-grub_png_read_dynamic_block (struct grub_png_data *data)
+/* Read the next image data into the input buffer.  The image data goes on
+   from one IDAT chunk to the next, return 0 at the first other chunk.  */
+static grub_ssize_t
+grub_png_read_idat (struct grub_png_data *data)
 {
-  while (grub_errno == 0)
+  grub_ssize_t len;
+
+  while (data->idat_remain == 0)
     {
-      int n;
+      grub_uint32_t type;
 
-      n = grub_png_get_huff_code (data, &data->code_table);
-      if (n < 256)
-	{
-	  data->slide[data->wp] = n;
-	  grub_png_output_byte (data, n);
+      /* Skip crc checksum.  */
+      grub_png_get_dword (data);
 
-	  data->wp++;
-	  if (data->wp >= WSIZE)
-	    data->wp = 0;
-	}
-      else if (n == 256)
-	break;
-      else
+      if (data->file->offset != data->next_offset)
 	{
-	  int len, dist, pos;
-
-	  n -= 257;
-	  len = cplens[n];
-	  if (cplext[n])
-	    len += grub_png_get_bits (data, cplext[n]);
+	  grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: chunk size error");
+	  return -1;
+	}
 
-	  n = grub_png_get_huff_code (data, &data->dist_table);
-	  dist = cpdist[n];
-	  if (cpdext[n])
-	    dist += grub_png_get_bits (data, cpdext[n]);
+      len = grub_png_get_dword (data);
+      type = grub_png_get_dword (data);
+      if (type != PNG_CHUNK_IDAT)
+	{
+	  /* Leave the chunk to grub_png_decode_png.  */
+	  grub_file_seek (data->file, data->next_offset);
+	  return 0;
+	}
 
-	  pos = data->wp - dist;
-	  if (pos < 0)
-	    pos += WSIZE;
+      data->next_offset = data->file->offset + len + 4;
+      data->idat_remain = len;
+    }
 
-	  while (len > 0)
-	    {
-	      data->slide[data->wp] = data->slide[pos];
-	      grub_png_output_byte (data, data->slide[data->wp]);
+  len = data->idat_remain;
+  if (len > PNG_INBUFSIZ)
+    len = PNG_INBUFSIZ;
+  if (grub_file_read (data->file, data->inbuf, len) != len)
+    {
+      if (! grub_errno)
+	grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: unexpected end of data");
+      return -1;
+    }
+  data->idat_remain -= len;
 
-	      data->wp++;
-	      if (data->wp >= WSIZE)
-		data->wp = 0;
+  data->in_pos = data->inbuf;
+  data->in_len = len;
+  return len;
+}
 
-	      pos++;
-	      if (pos >= WSIZE)
-		pos = 0;
+static grub_ssize_t
+grub_png_fill (void *ptr, const grub_uint8_t **buf)
+{
+  struct grub_png_data *data = ptr;
+  grub_ssize_t len;
 
-	      len--;
-	    }
-	}
-    }
+  if (! data->in_len && grub_png_read_idat (data) < 0)
+    return -1;
 
-  return grub_errno;
+  *buf = data->in_pos;
+  len = data->in_len;
+  data->in_len = 0;
+  return len;
 }
 
 static grub_err_t
 grub_png_decode_image_data (struct grub_png_data *data)
 {
-  grub_uint8_t cmf, flg;
-  int final;
+  struct grub_inflate *inflate;
+  grub_uint8_t hdr[2];
+  int i;
 
-  cmf = grub_png_get_byte (data);
-  flg = grub_png_get_byte (data);
+  for (i = 0; i < 2; i++)
+    {
+      if (! data->in_len && grub_png_read_idat (data) <= 0)
+	return grub_errno ? : grub_error (GRUB_ERR_BAD_FILE_TYPE,
+					  "png: unexpected end of data");
+      hdr[i] = *data->in_pos++;
+      data->in_len--;
+    }
 
-  if ((cmf & 0xF) != Z_DEFLATED)
+  if ((hdr[0] & 0xF) != Z_DEFLATED)
     return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 		       "png: only support deflate compression method");
 
-  if (flg & Z_FLAG_DICT)
+  if (hdr[1] & Z_FLAG_DICT)
     return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 		       "png: dictionary not supported");
 
-  do
-    {
-      int block_type;
-
-      final = grub_png_get_bits (data, 1);
-      block_type = grub_png_get_bits (data, 2);
-
-      switch (block_type)
-	{
-	case INFLATE_STORED:
-	  {
-	    grub_uint16_t i, len;
-
-	    data->bit_count = 0;
-	    len = grub_png_get_byte (data);
-	    len += ((grub_uint16_t) grub_png_get_byte (data)) << 8;
-
-            /* Skip NLEN field.  */
-	    grub_png_get_byte (data);
-	    grub_png_get_byte (data);
-
-	    for (i = 0; i < len; i++)
-	      grub_png_output_byte (data, grub_png_get_byte (data));
+  inflate = grub_inflate_new (grub_png_fill, data);
+  if (! inflate)
+    return grub_errno;
 
-	    break;
-	  }
+  while (grub_errno == GRUB_ERR_NONE)
+    {
+      const grub_uint8_t *out;
+      grub_ssize_t n, j;
 
-	case INFLATE_FIXED:
-          grub_png_init_fixed_block (data);
-	  grub_png_read_dynamic_block (data);
-	  break;
+      n = grub_inflate_peek (inflate, &out);
+      if (n <= 0)
+	break;
 
-	case INFLATE_DYNAMIC:
-	  grub_png_init_dynamic_block (data);
-	  grub_png_read_dynamic_block (data);
+      for (j = 0; j < n; j++)
+	if (grub_png_output_byte (data, out[j]))
 	  break;
 
-	default:
-	  return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-			     "png: unknown block type");
-	}
+      grub_inflate_consume (inflate, n);
     }
-  while ((!final) && (grub_errno == 0));
 
-  /* Skip adler checksum.  */
-  grub_png_get_dword (data);
+  grub_inflate_free (inflate);
+  if (grub_errno)
+    return grub_errno;
 
-  /* Skip crc checksum.  */
-  grub_png_get_dword (data);
+  /* Skip adler checksum, and the rest of the chunk with its crc.  */
+  data->idat_done = 1;
+  data->idat_remain = 0;
+  grub_file_seek (data->file, data->next_offset);
 
   return grub_errno;
 }
@@ -1058,13 +722,16 @@ grub_png_decode_png (struct grub_png_data *data)
 	  break;
 
 	case PNG_CHUNK_IDAT:
-	  data->inside_idat = 1;
+	  /* The image data is decoded at once, from the first IDAT chunk
+	     through the last.  Skip what is left of a zlib stream.  */
+	  if (data->idat_done)
+	    {
+	      grub_file_seek (data->file, data->next_offset);
+	      break;
+	    }
 	  data->idat_remain = len;
-	  data->bit_count = 0;
 
 	  grub_png_decode_image_data (data);
-
-	  data->inside_idat = 0;
 	  break;
 
 	case PNG_CHUNK_IEND:
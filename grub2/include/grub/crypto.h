@@ -34,6 +34,7 @@ typedef enum
     GPG_ERR_BAD_MPI,
     GPG_ERR_BAD_SECKEY,
     GPG_ERR_BAD_SIGNATURE,
+    GPG_ERR_CANCELED,
     GPG_ERR_CIPHER_ALGO,
     GPG_ERR_CONFLICT,
     GPG_ERR_DECRYPT_FAILED,
@@ -392,6 +393,17 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
 		    unsigned int c,
 		    grub_uint8_t *DK, grub_size_t dkLen);
 
+/* The same, but without allocating memory or touching grub_errno, so that
+   it may run as a workqueue item.  When CANCEL is not NULL and becomes
+   non-zero the derivation stops early and GPG_ERR_CANCELED is returned.  */
+gcry_err_code_t
+grub_crypto_pbkdf2_cancellable (const struct gcry_md_spec *md,
+				const grub_uint8_t *P, grub_size_t Plen,
+				const grub_uint8_t *S, grub_size_t Slen,
+				unsigned int c,
+				grub_uint8_t *DK, grub_size_t dkLen,
+				const volatile int *cancel);
+
 int
 grub_crypto_memcmp (const void *a, const void *b, grub_size_t n);
 
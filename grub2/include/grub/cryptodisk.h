@@ -161,6 +161,34 @@ grub_cryptodisk_decrypt (struct grub_cryptodisk *dev,
 grub_err_t
 grub_cryptodisk_insert (grub_cryptodisk_t newdev, const char *name,
 			grub_disk_t source);
+
+/* One PBKDF2 derivation for grub_cryptodisk_kdf_run.  */
+struct grub_cryptodisk_kdf
+{
+  /* Jobs without a hash are skipped.  */
+  const gcry_md_spec_t *hash;
+  const grub_uint8_t *password;
+  grub_size_t password_len;
+  const grub_uint8_t *salt;
+  grub_size_t salt_len;
+  unsigned int iterations;
+  grub_uint8_t *out;
+  grub_size_t out_len;
+  /* When not NULL, OUT is compared with it; a match sets MATCHED and
+     cancels the jobs of the same run which are still going.  */
+  const grub_uint8_t *expect;
+  int matched;
+  gcry_err_code_t err;
+};
+
+/* Run the NJOBS derivations of JOBS, spread over all processors.  */
+void
+grub_cryptodisk_kdf_run (struct grub_cryptodisk_kdf *jobs, grub_size_t njobs);
+
+/* Number of derivations grub_cryptodisk_kdf_run runs side by side.  Callers
+   which stop at the first good keyslot run batches of at most this many.  */
+grub_size_t
+grub_cryptodisk_kdf_width (void);
 #ifdef GRUB_UTIL
 grub_err_t
 grub_cryptodisk_cheat_insert (grub_cryptodisk_t newdev, const char *name,
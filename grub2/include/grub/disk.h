@@ -147,6 +147,9 @@ struct grub_disk
 
   /* Device-specific data.  */
   void *data;
+
+  /* Counts the reads which reach the device.  */
+  struct grub_trace_counter *trace;
 };
 typedef struct grub_disk *grub_disk_t;
 
@@ -207,7 +210,7 @@ grub_disk_from_native_sector (grub_disk_t disk, grub_disk_addr_t sector)
 }
 
 /* This is called from the memory manager.  */
-void grub_disk_cache_invalidate_all (void);
+void EXPORT_FUNC(grub_disk_cache_invalidate_all) (void);
 
 void EXPORT_FUNC(grub_disk_dev_register) (grub_disk_dev_t dev);
 void EXPORT_FUNC(grub_disk_dev_unregister) (grub_disk_dev_t dev);
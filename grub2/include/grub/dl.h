@@ -163,6 +163,77 @@ typedef struct grub_dl_segment *grub_dl_segment_t;
 
 struct grub_dl;
 
+/*
+ * A prelinked bundle, as produced by grub-mkimage --prelink.  It carries
+ * the allocated sections of several modules laid out in one image, with
+ * every relocation that stays inside the bundle already applied.  What is
+ * left are FIXUPS against the load address or against kernel symbols
+ * listed in IMPORTS.  Offsets are relative to the bundle header.
+ */
+#define GRUB_DL_BUNDLE_MAGIC	0x4b4c5250	/* "PRLK" */
+#define GRUB_DL_BUNDLE_NONE	0xffffffff
+
+struct grub_dl_bundle_header
+{
+  grub_uint32_t magic;
+  grub_uint32_t align;
+  grub_uint32_t image_offset;
+  grub_uint32_t image_size;
+  grub_uint32_t mods_offset;
+  grub_uint32_t nmods;
+  grub_uint32_t syms_offset;
+  grub_uint32_t nsyms;
+  grub_uint32_t imports_offset;
+  grub_uint32_t nimports;
+  grub_uint32_t fixups_offset;
+  grub_uint32_t nfixups;
+  grub_uint32_t strtab_offset;
+  grub_uint32_t strtab_size;
+};
+
+struct grub_dl_bundle_module
+{
+  /* Name and NUL-separated, double-NUL-terminated dependency list, as
+     offsets into the string table.  */
+  grub_uint32_t name;
+  grub_uint32_t deps;
+  /* Offsets into the image, GRUB_DL_BUNDLE_NONE for no init/fini.  */
+  grub_uint32_t start;
+  grub_uint32_t size;
+  grub_uint32_t init;
+  grub_uint32_t fini;
+};
+
+/* A global symbol defined by a bundled module, sorted by module.  */
+struct grub_dl_bundle_symbol
+{
+  grub_uint32_t name;
+  grub_uint32_t offset;
+  grub_uint16_t module;
+  grub_uint16_t isfunc;
+};
+
+enum
+  {
+    GRUB_DL_BUNDLE_FIXUP_ABS64,
+    GRUB_DL_BUNDLE_FIXUP_ABS32,
+    GRUB_DL_BUNDLE_FIXUP_ABS32S,
+    GRUB_DL_BUNDLE_FIXUP_PC32,
+    GRUB_DL_BUNDLE_FIXUP_PC64
+  };
+
+/* Store TARGET + ADDEND at OFFSET in the image, minus the address of the
+   field for the PC-relative types.  TARGET is the import with index
+   SYMBOL, or the image load address for GRUB_DL_BUNDLE_NONE.  */
+struct grub_dl_bundle_fixup
+{
+  grub_uint32_t offset;
+  grub_uint32_t symbol;
+  grub_uint32_t type;
+  grub_uint32_t reserved;
+  grub_uint64_t addend;
+};
+
 struct grub_dl_dep
 {
   struct grub_dl_dep *next;
@@ -201,6 +272,9 @@ typedef struct grub_dl *grub_dl_t;
 grub_dl_t grub_dl_load_file (const char *filename);
 grub_dl_t EXPORT_FUNC(grub_dl_load) (const char *name);
 grub_dl_t grub_dl_load_core (void *addr, grub_size_t size);
+#if defined (__i386__) || defined (__x86_64__)
+grub_err_t grub_dl_load_bundle (void *addr, grub_size_t size);
+#endif
 grub_dl_t EXPORT_FUNC(grub_dl_load_core_noinit) (void *addr, grub_size_t size);
 int EXPORT_FUNC(grub_dl_unload) (grub_dl_t mod);
 extern void grub_dl_unload_unneeded (void);
@@ -379,6 +379,11 @@
       { 0x89, 0x29, 0x48, 0xbc, 0xd9, 0x0a, 0xd3, 0x1a } \
   }
 
+#define GRUB_EFI_GRUB_TRACE_GUID \
+  { 0x3b8f0c6e, 0x5d21, 0x4a9e, \
+      { 0x8c, 0x47, 0x1f, 0x92, 0x6b, 0xd3, 0x0e, 0x55 } \
+  }
+
 struct grub_efi_sal_system_table
 {
   grub_uint32_t signature;
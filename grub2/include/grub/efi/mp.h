@@ -0,0 +1,88 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_EFI_MP_HEADER
+#define GRUB_EFI_MP_HEADER 1
+
+#include <grub/efi/api.h>
+
+#define GRUB_EFI_MP_SERVICES_PROTOCOL_GUID \
+  { 0x3fdda605, 0xa76e, 0x4f46, \
+    { 0xad, 0x29, 0x12, 0xf4, 0x53, 0x1b, 0x3d, 0x08 } \
+  }
+
+/*
+ * The firmware calls AP procedures directly, so on x86_64 they have to
+ * follow the Microsoft calling convention rather than the one GRUB uses.
+ */
+#if defined (__x86_64__) && !defined (__MINGW64__) && !defined (__CYGWIN__)
+#define GRUB_EFI_AP_PROCEDURE_ABI __attribute__ ((ms_abi))
+#else
+#define GRUB_EFI_AP_PROCEDURE_ABI
+#endif
+
+typedef void (GRUB_EFI_AP_PROCEDURE_ABI *grub_efi_ap_procedure_t) (void *buffer);
+
+struct grub_efi_mp_services_protocol
+{
+  grub_efi_status_t
+  (*get_number_of_processors) (struct grub_efi_mp_services_protocol *this,
+			       grub_efi_uintn_t *number_of_processors,
+			       grub_efi_uintn_t *number_of_enabled_processors);
+
+  grub_efi_status_t
+  (*get_processor_info) (struct grub_efi_mp_services_protocol *this,
+			 grub_efi_uintn_t processor_number,
+			 void *processor_info_buffer);
+
+  grub_efi_status_t
+  (*startup_all_aps) (struct grub_efi_mp_services_protocol *this,
+		      grub_efi_ap_procedure_t procedure,
+		      grub_efi_boolean_t single_thread,
+		      grub_efi_event_t wait_event,
+		      grub_efi_uintn_t timeout_in_microseconds,
+		      void *procedure_argument,
+		      grub_efi_uintn_t **failed_cpu_list);
+
+  grub_efi_status_t
+  (*startup_this_ap) (struct grub_efi_mp_services_protocol *this,
+		      grub_efi_ap_procedure_t procedure,
+		      grub_efi_uintn_t processor_number,
+		      grub_efi_event_t wait_event,
+		      grub_efi_uintn_t timeout_in_microseconds,
+		      void *procedure_argument,
+		      grub_efi_boolean_t *finished);
+
+  grub_efi_status_t
+  (*switch_bsp) (struct grub_efi_mp_services_protocol *this,
+		 grub_efi_uintn_t processor_number,
+		 grub_efi_boolean_t enable_old_bsp);
+
+  grub_efi_status_t
+  (*enable_disable_ap) (struct grub_efi_mp_services_protocol *this,
+			grub_efi_uintn_t processor_number,
+			grub_efi_boolean_t enable_ap,
+			grub_efi_uint32_t *health_flag);
+
+  grub_efi_status_t
+  (*who_am_i) (struct grub_efi_mp_services_protocol *this,
+	       grub_efi_uintn_t *processor_number);
+};
+typedef struct grub_efi_mp_services_protocol grub_efi_mp_services_protocol_t;
+
+#endif /* ! GRUB_EFI_MP_HEADER */
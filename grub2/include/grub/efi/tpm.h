@@ -21,6 +21,7 @@
 
 #define EFI_TPM_GUID {0xf541796d, 0xa62e, 0x4954, {0xa7, 0x75, 0x95, 0x84, 0xf6, 0x1b, 0x9c, 0xdd }};
 #define EFI_TPM2_GUID {0x607f766c, 0x7455, 0x42be, {0x93, 0x0b, 0xe4, 0xd7, 0x6d, 0xb2, 0x72, 0x0f }};
+#define EFI_CC_MEASUREMENT_GUID {0x96751a3d, 0x72f4, 0x41a6, {0xa7, 0x94, 0xed, 0x5d, 0x0e, 0x67, 0xae, 0x6b }};
 
 #define TCG_ALG_SHA 0x00000004
 
@@ -195,4 +196,86 @@ struct grub_efi_tpm2_protocol
 
 typedef struct grub_efi_tpm2_protocol grub_efi_tpm2_protocol_t;
 
+/* These structs are as defined in the UEFI 2.10 CC Measurement Protocol. */
+
+#define EFI_CC_EVENT_HEADER_VERSION 1
+
+#define EFI_CC_TYPE_NONE 0
+#define EFI_CC_TYPE_SEV  1
+#define EFI_CC_TYPE_TDX  2
+
+#define EFI_CC_BOOT_HASH_ALG_SHA384 0x00000004
+
+typedef grub_efi_uint32_t EFI_CC_EVENT_LOG_BITMAP;
+typedef grub_efi_uint32_t EFI_CC_EVENT_LOG_FORMAT;
+typedef grub_efi_uint32_t EFI_CC_EVENT_ALGORITHM_BITMAP;
+typedef grub_efi_uint32_t EFI_CC_MR_INDEX;
+
+struct tdEFI_CC_VERSION
+{
+  grub_efi_uint8_t Major;
+  grub_efi_uint8_t Minor;
+} GRUB_PACKED;
+typedef struct tdEFI_CC_VERSION EFI_CC_VERSION;
+
+struct tdEFI_CC_TYPE
+{
+  grub_efi_uint8_t Type;
+  grub_efi_uint8_t SubType;
+} GRUB_PACKED;
+typedef struct tdEFI_CC_TYPE EFI_CC_TYPE;
+
+struct tdEFI_CC_BOOT_SERVICE_CAPABILITY
+{
+  grub_efi_uint8_t              Size;
+  EFI_CC_VERSION                StructureVersion;
+  EFI_CC_VERSION                ProtocolVersion;
+  EFI_CC_EVENT_ALGORITHM_BITMAP HashAlgorithmBitmap;
+  EFI_CC_EVENT_LOG_BITMAP       SupportedEventLogs;
+  EFI_CC_TYPE                   CcType;
+};
+typedef struct tdEFI_CC_BOOT_SERVICE_CAPABILITY EFI_CC_BOOT_SERVICE_CAPABILITY;
+
+struct tdEFI_CC_EVENT_HEADER
+{
+  grub_efi_uint32_t HeaderSize;
+  grub_efi_uint16_t HeaderVersion;
+  EFI_CC_MR_INDEX   MrIndex;
+  TCG_EVENTTYPE     EventType;
+} GRUB_PACKED;
+typedef struct tdEFI_CC_EVENT_HEADER EFI_CC_EVENT_HEADER;
+
+struct tdEFI_CC_EVENT
+{
+  grub_efi_uint32_t   Size;
+  EFI_CC_EVENT_HEADER Header;
+  grub_efi_uint8_t    Event[1];
+} GRUB_PACKED;
+typedef struct tdEFI_CC_EVENT EFI_CC_EVENT;
+
+struct grub_efi_cc_protocol
+{
+  grub_efi_status_t (*get_capability) (struct grub_efi_cc_protocol *this,
+				       EFI_CC_BOOT_SERVICE_CAPABILITY *
+				       ProtocolCapability);
+  grub_efi_status_t (*get_event_log) (struct grub_efi_cc_protocol *this,
+				      EFI_CC_EVENT_LOG_FORMAT EventLogFormat,
+				      grub_efi_physical_address_t *
+				      EventLogLocation,
+				      grub_efi_physical_address_t *
+				      EventLogLastEntry,
+				      grub_efi_boolean_t * EventLogTruncated);
+  grub_efi_status_t (*hash_log_extend_event) (struct grub_efi_cc_protocol *
+					      this, grub_efi_uint64_t Flags,
+					      grub_efi_physical_address_t
+					      DataToHash,
+					      grub_efi_uint64_t DataToHashLen,
+					      EFI_CC_EVENT *EfiCcEvent);
+  grub_efi_status_t (*map_pcr_to_mr_index) (struct grub_efi_cc_protocol *
+					    this, TCG_PCRINDEX PcrIndex,
+					    EFI_CC_MR_INDEX *MrIndex);
+};
+
+typedef struct grub_efi_cc_protocol grub_efi_cc_protocol_t;
+
 #endif
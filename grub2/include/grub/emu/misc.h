@@ -61,6 +61,13 @@ void EXPORT_FUNC(grub_util_set_kexecute) (void);
 int EXPORT_FUNC(grub_util_get_kexecute) (void) WARN_UNUSED_RESULT;
 
 grub_uint64_t EXPORT_FUNC (grub_util_get_cpu_time_ms) (void);
+grub_uint64_t EXPORT_FUNC (grub_util_get_time_us) (void);
+
+/* Bytes allocated with grub_malloc and friends, now and at most since the
+   last reset.  Zero where the C library can't tell allocation sizes.  */
+grub_size_t EXPORT_FUNC (grub_util_mm_in_use) (void);
+grub_size_t EXPORT_FUNC (grub_util_mm_peak) (void);
+void EXPORT_FUNC (grub_util_mm_reset_peak) (void);
 
 #ifdef HAVE_DEVICE_MAPPER
 int grub_device_mapper_supported (void);
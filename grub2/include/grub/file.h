@@ -135,7 +135,10 @@ enum grub_file_type
 
     /* --skip-sig is specified.  */
     GRUB_FILE_TYPE_SKIP_SIGNATURE = 0x10000,
-    GRUB_FILE_TYPE_NO_DECOMPRESS = 0x20000
+    GRUB_FILE_TYPE_NO_DECOMPRESS = 0x20000,
+    /* The whole file is read once, in a single read from the start, so
+       verifiers may check it in the caller's buffer.  */
+    GRUB_FILE_TYPE_READ_ONCE = 0x40000
   };
 
 /* File description.  */
@@ -45,6 +45,8 @@ struct grub_font
   grub_uint32_t num_chars;
   struct char_index_entry *char_index;
   grub_uint16_t *bmp_idx;
+  /* All glyphs of the font, if they were loaded together.  */
+  char *glyph_atlas;
 };
 
 /* Font type used to access font functions.  */
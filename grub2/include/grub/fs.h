@@ -83,6 +83,9 @@ struct grub_fs
   /* Get writing time of filesystem. */
   grub_err_t (*fs_mtime) (grub_device_t device, grub_int64_t *timebuf);
 
+  /* Counts the reads of files on this filesystem.  */
+  struct grub_trace_counter *trace;
+
 #ifdef GRUB_UTIL
   /* Determine sectors available for embedding.  */
   grub_err_t (*fs_embed) (grub_device_t device, unsigned int *nsectors,
@@ -0,0 +1,78 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_GF256_HEADER
+#define GRUB_GF256_HEADER	1
+
+#include <grub/types.h>
+
+/* Arithmetic on blocks of GF(2^8) elements, using the RAID-6 polynomial
+   x^8 + x^4 + x^3 + x^2 + 1.  */
+
+struct grub_gf256_impl
+{
+  const char *name;
+
+  /* Whether the running CPU supports this implementation.  */
+  int (*supported) (void);
+
+  /* DST ^= SRC.  */
+  void (*add) (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t size);
+
+  /* DST = C * SRC.  DST may be SRC.  */
+  void (*mul) (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+	       grub_size_t size);
+
+  /* DST ^= C * SRC.  */
+  void (*muladd) (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+		  grub_size_t size);
+};
+
+/* All implementations, the scalar one first, terminated by NULL.  */
+extern const struct grub_gf256_impl *const grub_gf256_impls[];
+
+/* The fastest supported implementation, selected when loading.  */
+extern const struct grub_gf256_impl *grub_gf256;
+
+/* x**N.  */
+grub_uint8_t grub_gf256_exp (unsigned n);
+/* Such an N that x**N = A, for nonzero A.  */
+unsigned grub_gf256_log (grub_uint8_t a);
+grub_uint8_t grub_gf256_mul (grub_uint8_t a, grub_uint8_t b);
+
+static inline void
+grub_gf256_add_block (void *dst, const void *src, grub_size_t size)
+{
+  grub_gf256->add (dst, src, size);
+}
+
+static inline void
+grub_gf256_mul_block (void *dst, const void *src, grub_uint8_t c,
+		      grub_size_t size)
+{
+  grub_gf256->mul (dst, src, c, size);
+}
+
+static inline void
+grub_gf256_muladd_block (void *dst, const void *src, grub_uint8_t c,
+			 grub_size_t size)
+{
+  grub_gf256->muladd (dst, src, c, size);
+}
+
+#endif /* ! GRUB_GF256_HEADER */
@@ -0,0 +1,95 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_INFLATE_HEADER
+#define GRUB_INFLATE_HEADER	1
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+/* A decoder of raw DEFLATE (RFC 1951) streams, shared by gzio, the PNG
+   reader and the in-memory zlib decompression.  Compressed data is pulled
+   through a callback; decompressed data is handed out in place, from the
+   decoder's window.  */
+
+/* How far back a match may reach.  */
+#define GRUB_INFLATE_HISTORY	0x8000
+
+struct grub_inflate;
+
+/* Point *BUF at the next compressed bytes and return how many there are,
+   0 at the end of the input, or -1 with grub_errno set on error.  */
+typedef grub_ssize_t (*grub_inflate_fill_t) (void *data,
+					      const grub_uint8_t **buf);
+
+/* Called before each block but the first, with the offset in the
+   decompressed data the block starts at.  grub_inflate_save_point may be
+   used from here.  */
+typedef void (*grub_inflate_block_hook_t) (struct grub_inflate *inflate,
+					   grub_uint64_t out_off, void *data);
+
+/* A position from which decoding can resume without the data before it,
+   always the start of a block.  */
+struct grub_inflate_point
+{
+  /* Offset in the decompressed data.  */
+  grub_uint64_t out_off;
+  /* Offset from the start of the stream of the compressed byte the block
+     starts in, and how many bits of it belong to the previous block.  */
+  grub_uint64_t in_off;
+  unsigned in_bits;
+  /* The MIN (out_off, GRUB_INFLATE_HISTORY) bytes preceding out_off.  */
+  grub_uint8_t *history;
+};
+
+struct grub_inflate *grub_inflate_new (grub_inflate_fill_t fill, void *data);
+void grub_inflate_free (struct grub_inflate *inflate);
+
+void grub_inflate_set_block_hook (struct grub_inflate *inflate,
+				  grub_inflate_block_hook_t hook, void *data);
+
+/* Start over with a new stream.  The caller rewinds its input.  */
+void grub_inflate_reset (struct grub_inflate *inflate);
+
+/* Point *BUF at the decompressed bytes not consumed yet, decoding more if
+   there are none, and return how many there are.  Returns 0 at the end of
+   the stream and -1 on error.  The bytes stay valid until they are
+   consumed.  */
+grub_ssize_t grub_inflate_peek (struct grub_inflate *inflate,
+				const grub_uint8_t **buf);
+void grub_inflate_consume (struct grub_inflate *inflate, grub_size_t size);
+
+/* Copy the next SIZE decompressed bytes to BUF, or skip them if BUF is
+   NULL.  Returns fewer only at the end of the stream, and -1 on error.  */
+grub_ssize_t grub_inflate_read (struct grub_inflate *inflate, void *buf,
+				grub_size_t size);
+
+/* The offset in the decompressed data of the next byte to consume.  */
+grub_uint64_t grub_inflate_tell (struct grub_inflate *inflate);
+
+/* Record the current position in POINT, allocating POINT->history.  Only
+   valid from a block hook.  */
+grub_err_t grub_inflate_save_point (struct grub_inflate *inflate,
+				    struct grub_inflate_point *point);
+
+/* Resume decoding at POINT.  The caller has positioned its input at
+   POINT->in_off.  */
+grub_err_t grub_inflate_restore_point (struct grub_inflate *inflate,
+				       const struct grub_inflate_point *point);
+
+#endif /* ! GRUB_INFLATE_HEADER */
@@ -31,7 +31,8 @@ enum
   OBJ_TYPE_GPG_PUBKEY,
   OBJ_TYPE_X509_PUBKEY,
   OBJ_TYPE_DTB,
-  OBJ_TYPE_DISABLE_SHIM_LOCK
+  OBJ_TYPE_DISABLE_SHIM_LOCK,
+  OBJ_TYPE_PRELINKED
 };
 
 /* The module header.  */
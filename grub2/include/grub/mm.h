@@ -68,6 +68,32 @@ grub_calloc (grub_size_t nmemb, grub_size_t size)
 void *EXPORT_FUNC(grub_calloc) (grub_size_t nmemb, grub_size_t size);
 #endif
 
+/* A module cache which is dropped when an allocation fails.  */
+struct grub_mm_reclaimer
+{
+  struct grub_mm_reclaimer *next;
+  struct grub_mm_reclaimer **prev;
+  /* Free whatever the cache holds.  Must not allocate memory.  */
+  void (*reclaim) (void);
+};
+typedef struct grub_mm_reclaimer *grub_mm_reclaimer_t;
+
+#if !defined(GRUB_UTIL) && !defined (GRUB_MACHINE_EMU)
+void EXPORT_FUNC(grub_mm_register_reclaimer) (grub_mm_reclaimer_t reclaimer);
+void EXPORT_FUNC(grub_mm_unregister_reclaimer) (grub_mm_reclaimer_t reclaimer);
+#else
+/* The host allocator has no use for them.  */
+static inline void
+grub_mm_register_reclaimer (grub_mm_reclaimer_t reclaimer __attribute__ ((unused)))
+{
+}
+
+static inline void
+grub_mm_unregister_reclaimer (grub_mm_reclaimer_t reclaimer __attribute__ ((unused)))
+{
+}
+#endif
+
 void grub_mm_check_real (const char *file, int line);
 #define grub_mm_check() grub_mm_check_real (GRUB_FILE, __LINE__);
 
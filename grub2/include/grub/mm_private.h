@@ -24,6 +24,9 @@
 /* Magic words.  */
 #define GRUB_MM_FREE_MAGIC	0x2d3c2808
 #define GRUB_MM_ALLOC_MAGIC	0x6db08fa4
+/* Allocated from, and sitting in, a size-class cache.  */
+#define GRUB_MM_SLAB_MAGIC	0x51ab0c8e
+#define GRUB_MM_CACHE_MAGIC	0x2e7b64f1
 
 typedef struct grub_mm_header
 {
@@ -48,6 +51,12 @@ typedef struct grub_mm_header
 
 #define GRUB_MM_ALIGN	(1 << GRUB_MM_ALIGN_LOG2)
 
+/* Blocks of up to this many cells, header included, are kept in
+   size-class caches, which are refilled a batch of this many bytes at
+   a time.  */
+#define GRUB_MM_CACHE_CLASSES	16
+#define GRUB_MM_CACHE_BATCH	0x1000
+
 typedef struct grub_mm_region
 {
   struct grub_mm_header *first;
@@ -59,6 +68,9 @@ typedef struct grub_mm_region
 
 #ifndef GRUB_MACHINE_EMU
 extern grub_mm_region_t EXPORT_VAR (grub_mm_base);
+
+/* Give the blocks in the size-class caches back to their regions.  */
+void EXPORT_FUNC (grub_mm_flush_caches) (void);
 #endif
 
 #endif
@@ -36,6 +36,12 @@
 #define UART_MSR	6
 #define UART_SR		7
 
+/* For IIR bits.  */
+#define UART_IIR_FIFO_ENABLED	0xC0
+
+/* The depth of the transmit FIFO of a 16550.  */
+#define UART_FIFO_SIZE	16
+
 /* For LSR bits.  */
 #define UART_DATA_READY		0x01
 #define UART_EMPTY_TRANSMITTER	0x20
@@ -26,6 +26,7 @@
 #include <grub/command.h>
 
 struct grub_script_mem;
+struct grub_script_compiled;
 
 /* The generic header for each scripting command or structure.  */
 struct grub_script_cmd
@@ -47,6 +48,10 @@ struct grub_script
   /* grub_scripts from block arguments.  */
   struct grub_script *next_siblings;
   struct grub_script *children;
+
+  /* Set if this script lives in a loaded compiled script, in which case
+     its memory is owned by that object instead of MEM.  */
+  struct grub_script_compiled *compiled;
 };
 
 typedef enum
@@ -382,6 +387,71 @@ grub_err_t grub_script_function_call (grub_script_function_t func,
 char **
 grub_script_execute_arglist_to_argv (struct grub_script_arglist *arglist, int *count);
 
+
+/* Compiled scripts.  A compiled script is the pre-parsed form of a
+   configuration file, keyed by the size and hash of its source.  All
+   fields are little-endian.  */
+#define GRUB_SCRIPT_COMPILED_MAGIC	0x43534247	/* "GBSC" */
+#define GRUB_SCRIPT_COMPILED_VERSION	1
+
+struct grub_script_compiled_header
+{
+  grub_uint32_t magic;
+  grub_uint32_t version;
+  grub_uint32_t source_size;
+  grub_uint32_t nchunks;
+  grub_uint64_t source_hash;
+} GRUB_PACKED;
+
+enum
+  {
+    GRUB_SCRIPT_COMPILED_CMDLINE = 1,
+    GRUB_SCRIPT_COMPILED_CMDLIST,
+    GRUB_SCRIPT_COMPILED_CMDIF,
+    GRUB_SCRIPT_COMPILED_CMDFOR,
+    GRUB_SCRIPT_COMPILED_CMDWHILE
+  };
+
+/* A function defined while parsing a chunk.  */
+struct grub_script_compiled_func
+{
+  struct grub_script_compiled_func *next;
+  char *name;
+  struct grub_script *script;
+};
+
+/* The result of one top-level grub_script_parse call.  */
+struct grub_script_compiled_chunk
+{
+  struct grub_script_compiled_chunk *next;
+  struct grub_script_compiled_func *funcs;
+  struct grub_script *script;
+};
+
+/* A loaded compiled script.  Everything it points to is part of the same
+   allocation, which is released when the last reference is dropped.  */
+struct grub_script_compiled
+{
+  unsigned refcnt;
+  grub_uint32_t source_size;
+  grub_uint64_t source_hash;
+  struct grub_script_compiled_chunk *chunks;
+};
+
+grub_uint64_t grub_script_compiled_hash (const char *source, grub_size_t size);
+struct grub_script_compiled *
+grub_script_compiled_load (const void *data, grub_size_t size,
+			   const char *source, grub_size_t source_size);
+grub_err_t grub_script_compiled_execute (struct grub_script_compiled *compiled);
+void grub_script_compiled_unref (struct grub_script_compiled *compiled);
+
+#ifdef GRUB_UTIL
+grub_err_t grub_script_compile (const char *source, grub_size_t size,
+				void **out, grub_size_t *out_size);
+grub_err_t grub_script_compiled_store (struct grub_script_compiled *compiled,
+				       void **out, grub_size_t *out_size);
+#endif
+
 grub_err_t
 grub_normal_parse_line (char *line,
 			grub_reader_getline_t getline_func,
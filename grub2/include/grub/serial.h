@@ -87,7 +87,13 @@ struct grub_serial_port
   union
   {
 #if defined(__mips__) || defined (__i386__) || defined (__x86_64__)
-    grub_port_t port;
+    struct
+    {
+      grub_port_t port;
+      /* Bytes that fit in the transmitter before checking LSR again.  */
+      unsigned tx_room;
+      unsigned fifo_size;
+    };
 #endif
     struct
     {
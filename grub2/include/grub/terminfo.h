@@ -39,6 +39,13 @@ struct grub_terminfo_input_state
   int (*readkey) (struct grub_term_input *term);
 };
 
+struct grub_terminfo_cell
+{
+  /* 0 if not known.  */
+  grub_uint8_t code;
+  grub_uint16_t color;
+};
+
 struct grub_terminfo_output_state
 {
   struct grub_term_output *next;
@@ -57,6 +64,21 @@ struct grub_terminfo_output_state
   struct grub_term_coordinate pos;
 
   void (*put) (struct grub_term_output *term, const int c);
+
+  /* What is on the screen, so that only changed cells are sent.  POS and
+     COLOR are only sent to the terminal when a character needs them;
+     CURSOR and SENT_COLOR are what the terminal was last told.  */
+  struct grub_terminfo_cell *shadow;
+  struct grub_term_coordinate shadow_size;
+  struct grub_term_coordinate cursor;
+  int cursor_known;
+  int cursor_hidden;
+  grub_term_color_state color_state;
+  grub_uint16_t color;
+  grub_uint16_t sent_color;
+
+  /* Bytes sent since the last refresh.  */
+  grub_uint64_t frame_bytes;
 };
 
 grub_err_t EXPORT_FUNC(grub_terminfo_output_init) (struct grub_term_output *term);
@@ -68,6 +90,8 @@ void EXPORT_FUNC (grub_terminfo_setcursor) (struct grub_term_output *term,
 					    const int on);
 void EXPORT_FUNC (grub_terminfo_setcolorstate) (struct grub_term_output *term,
 				  const grub_term_color_state state);
+void EXPORT_FUNC (grub_terminfo_refresh) (struct grub_term_output *term);
+void EXPORT_FUNC (grub_terminfo_invalidate) (struct grub_term_output *term);
 
 
 grub_err_t EXPORT_FUNC (grub_terminfo_input_init) (struct grub_term_input *term);
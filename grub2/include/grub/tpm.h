@@ -34,6 +34,14 @@
 
 #define EV_IPL 0x0d
 
+#define SHA384_DIGEST_SIZE 48
+
 grub_err_t grub_tpm_measure (unsigned char *buf, grub_size_t size,
 			     grub_uint8_t pcr, const char *description);
+
+/*
+ * Returns non-zero when measurements go to the confidential-computing
+ * measurement registers (e.g. TDX RTMRs) rather than to a TPM.
+ */
+int grub_cc_measure_active (void);
 #endif
@@ -0,0 +1,111 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_TRACE_HEADER
+#define GRUB_TRACE_HEADER	1
+
+#include <grub/types.h>
+#include <grub/symbol.h>
+
+/* Named counters of events, bytes and time, kept by the kernel for as long
+   as GRUB runs.  Counters are looked up once and cached by the caller, so
+   updating one is a few additions; a module being unloaded keeps what it
+   has counted.  */
+struct grub_trace_counter
+{
+  struct grub_trace_counter *next;
+  char *name;
+  grub_uint64_t count;
+  grub_uint64_t bytes;
+  /* Clock ticks spent in spans of this counter, with and without the time
+     spent in spans nested in them.  */
+  grub_uint64_t ticks;
+  grub_uint64_t self_ticks;
+};
+
+struct grub_trace_span
+{
+  struct grub_trace_counter *counter;
+  grub_uint64_t start;
+  grub_uint64_t saved_nested;
+};
+
+extern struct grub_trace_counter *EXPORT_VAR (grub_trace_counters);
+extern grub_uint64_t EXPORT_VAR (grub_trace_nested);
+
+/* Find or create the counter called LAYER.NAME, or just LAYER if NAME is
+   NULL.  Returns NULL when out of memory, which the functions below accept
+   and ignore.  */
+struct grub_trace_counter *
+EXPORT_FUNC (grub_trace_counter_get) (const char *layer, const char *name);
+
+/* A clock cheap enough to read around every disk request.  */
+grub_uint64_t EXPORT_FUNC (grub_trace_clock) (void);
+grub_uint64_t EXPORT_FUNC (grub_trace_ticks_to_us) (grub_uint64_t ticks);
+
+void EXPORT_FUNC (grub_trace_reset) (void);
+
+static inline struct grub_trace_counter *
+grub_trace_lookup (struct grub_trace_counter **slot, const char *layer,
+		   const char *name)
+{
+  if (! *slot)
+    *slot = grub_trace_counter_get (layer, name);
+  return *slot;
+}
+
+static inline void
+grub_trace_count (struct grub_trace_counter *counter, grub_uint64_t bytes)
+{
+  if (! counter)
+    return;
+  counter->count++;
+  counter->bytes += bytes;
+}
+
+/* Spans may nest but must end in the reverse order they began.  Time spent
+   in a nested span is subtracted from the self time of the enclosing one,
+   so that e.g. decompression and the disk reads it causes are told
+   apart.  */
+static inline void
+grub_trace_begin (struct grub_trace_span *span,
+		  struct grub_trace_counter *counter)
+{
+  span->counter = counter;
+  span->saved_nested = grub_trace_nested;
+  grub_trace_nested = 0;
+  span->start = grub_trace_clock ();
+}
+
+static inline void
+grub_trace_end (struct grub_trace_span *span, grub_uint64_t bytes)
+{
+  grub_uint64_t elapsed = grub_trace_clock () - span->start;
+
+  if (span->counter)
+    {
+      span->counter->count++;
+      span->counter->bytes += bytes;
+      span->counter->ticks += elapsed;
+      if (elapsed > grub_trace_nested)
+	span->counter->self_ticks += elapsed - grub_trace_nested;
+    }
+  grub_trace_nested = span->saved_nested + elapsed;
+}
+
+#endif /* ! GRUB_TRACE_HEADER */
@@ -67,6 +67,8 @@
       N_("SBAT metadata"), 0 },						\
   { "disable-shim-lock", GRUB_INSTALL_OPTIONS_DISABLE_SHIM_LOCK, 0, 0,	\
       N_("disable shim_lock verifier"), 0 },				\
+  { "prelink", GRUB_INSTALL_OPTIONS_PRELINK, 0, 0,			\
+      N_("embed the modules as one bundle relocated at build time (i386 and x86_64 only)"), 0 }, \
   { "x509key",   'x', N_("FILE"), 0,					\
       N_("embed FILE as an x509 certificate for signature checking"), 0}, \
   { "appended-signature-size", GRUB_INSTALL_OPTIONS_APPENDED_SIGNATURE_SIZE,\
@@ -135,7 +137,8 @@ enum grub_install_options {
   GRUB_INSTALL_OPTIONS_DTB,
   GRUB_INSTALL_OPTIONS_SBAT,
   GRUB_INSTALL_OPTIONS_DISABLE_SHIM_LOCK,
-  GRUB_INSTALL_OPTIONS_APPENDED_SIGNATURE_SIZE
+  GRUB_INSTALL_OPTIONS_APPENDED_SIGNATURE_SIZE,
+  GRUB_INSTALL_OPTIONS_PRELINK
 };
 
 extern char *grub_install_source_directory;
@@ -198,7 +201,8 @@ grub_install_generate_image (const char *dir, const char *prefix,
 			     const struct grub_install_image_target_desc *image_target,
 			     int note, size_t appsig_size,
 			     grub_compression_t comp, const char *dtb_file,
-			     const char *sbat_path, const int disable_shim_lock);
+			     const char *sbat_path, const int disable_shim_lock,
+			     int prelink);
 
 const struct grub_install_image_target_desc *
 grub_install_get_image_target (const char *arg);
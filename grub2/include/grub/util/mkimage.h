@@ -49,6 +49,15 @@ grub_mkimage_load_image64 (const char *kernel_path,
 			   size_t total_module_size,
 			   struct grub_mkimage_layout *layout,
 			   const struct grub_install_image_target_desc *image_target);
+struct grub_util_path_list;
+char *
+grub_mkimage_prelink_modules32 (struct grub_util_path_list *path_list,
+				const struct grub_install_image_target_desc *image_target,
+				size_t *bundle_size);
+char *
+grub_mkimage_prelink_modules64 (struct grub_util_path_list *path_list,
+				const struct grub_install_image_target_desc *image_target,
+				size_t *bundle_size);
 void
 grub_mkimage_generate_elf32 (const struct grub_install_image_target_desc *image_target,
 			     int note, size_t appsig_size, char **core_img, size_t *core_size,
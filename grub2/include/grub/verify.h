@@ -52,9 +52,9 @@ struct grub_file_verifier
 		      void **context, enum grub_verify_flags *flags);
 
   /*
-   * Right now we pass the whole file in one call but it may
-   * change in the future. If you insist on single buffer you
-   * need to set GRUB_VERIFY_FLAGS_SINGLE_CHUNK in verify_flags.
+   * The file is passed in chunks as it is read. If you insist on
+   * single buffer you need to set GRUB_VERIFY_FLAGS_SINGLE_CHUNK
+   * in verify_flags.
    */
   grub_err_t (*write) (void *context, void *buf, grub_size_t size);
 
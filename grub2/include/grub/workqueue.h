@@ -0,0 +1,45 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_WORKQUEUE_HEADER
+#define GRUB_WORKQUEUE_HEADER	1
+
+#include <grub/types.h>
+
+/*
+ * A work item may run on an application processor inside firmware context.
+ * It must not allocate memory, print, set grub_errno or call into the
+ * firmware, and it must only write to memory owned by its own item.
+ */
+typedef void (*grub_workqueue_func_t) (void *data, grub_size_t item);
+
+/*
+ * Run FUNC for every item in [0, NITEMS) and return once all of them are
+ * done.  Items are spread over the enabled application processors when
+ * the platform provides them, and run on the calling processor otherwise.
+ */
+void grub_workqueue_run (grub_workqueue_func_t func, void *data,
+			 grub_size_t nitems);
+
+/* Number of application processors grub_workqueue_run may use. */
+unsigned int grub_workqueue_get_aps (void);
+
+/* Limit the number of application processors used; 0 disables them. */
+void grub_workqueue_set_max_aps (unsigned int max);
+
+#endif /* ! GRUB_WORKQUEUE_HEADER */
@@ -0,0 +1,209 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2022 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/script_sh.h>
+#include <grub/test.h>
+
+#define NENTRIES	200
+#define ITERATIONS	50
+
+/* Build a grub.cfg shaped like a grub-mkconfig generated one.  */
+static char *
+make_config (void)
+{
+  size_t alloc = 4096 + NENTRIES * 1024, len = 0;
+  char *cfg = malloc (alloc);
+  int i;
+
+  len += sprintf (cfg + len,
+		  "# Generated for the compiled script benchmark\n"
+		  "set timeout=5\n"
+		  "if [ -s $prefix/grubenv ]; then\n"
+		  "  load_env\n"
+		  "fi\n"
+		  "function savedefault {\n"
+		  "  if [ -z \"${boot_once}\" ]; then\n"
+		  "    saved_entry=\"${chosen}\"\n"
+		  "    save_env saved_entry\n"
+		  "  fi\n"
+		  "}\n"
+		  "function load_video {\n"
+		  "  for mod in efi_gop efi_uga all_video; do\n"
+		  "    insmod $mod\n"
+		  "  done\n"
+		  "}\n");
+
+  for (i = 0; i < NENTRIES; i++)
+    len += sprintf (cfg + len,
+		    "menuentry 'Linux 5.%d.0-%d' --class gnu-linux --class os"
+		    " $menuentry_id_option 'gnulinux-5.%d-advanced' {\n"
+		    "\tload_video\n"
+		    "\tset gfxpayload=keep\n"
+		    "\tinsmod gzio\n"
+		    "\tinsmod part_gpt\n"
+		    "\tif [ x$feature_platform_search_hint = xy ]; then\n"
+		    "\t  search --no-floppy --fs-uuid --set=root abcd-%04d\n"
+		    "\telse\n"
+		    "\t  search --no-floppy --fs-uuid --set=root abcd-%04d\n"
+		    "\tfi\n"
+		    "\techo 'Loading Linux 5.%d.0-%d ...'\n"
+		    "\tlinux /vmlinuz-5.%d.0-%d root=/dev/sda2 ro quiet\n"
+		    "\tinitrd /initrd.img-5.%d.0-%d\n"
+		    "}\n",
+		    i, i, i, i, i, i, i, i, i, i, i);
+
+  cfg[len] = '\0';
+  return cfg;
+}
+
+static grub_err_t
+config_getline (char **line, int cont __attribute__ ((unused)), void *data)
+{
+  const char **source = data;
+  const char *p;
+
+  *line = 0;
+  while (*source && ! *line)
+    {
+      p = strchr (*source, '\n');
+      *line = p ? grub_strndup (*source, p - *source) : grub_strdup (*source);
+      *source = p ? p + 1 : 0;
+      if (**line == '#')
+	{
+	  grub_free (*line);
+	  *line = 0;
+	}
+    }
+
+  return 0;
+}
+
+static void
+drop_functions (void)
+{
+  while (grub_script_function_list)
+    grub_script_function_remove (grub_script_function_list->name);
+}
+
+/* What read_config_file does without a compiled script.  */
+static int
+parse_config (const char *cfg)
+{
+  struct grub_script *script;
+  int nchunks = 0;
+  char *line;
+
+  while (1)
+    {
+      config_getline (&line, 0, &cfg);
+      if (! line)
+	break;
+      script = grub_script_parse (line, config_getline, &cfg);
+      grub_free (line);
+      if (! script)
+	return -1;
+      nchunks++;
+      grub_script_free (script);
+    }
+
+  drop_functions ();
+  return nchunks;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+script_compiled_test (void)
+{
+  struct grub_script_compiled *compiled;
+  char *cfg = make_config ();
+  grub_size_t cfg_size = strlen (cfg);
+  void *data, *stored;
+  grub_size_t size, stored_size;
+  double start, parse_time, load_time;
+  int i;
+
+  grub_test_assert (grub_script_compile (cfg, cfg_size, &data, &size) == 0,
+		    "compiling failed: %s", grub_errmsg);
+  if (grub_errno)
+    return;
+
+  compiled = grub_script_compiled_load (data, size, cfg, cfg_size);
+  grub_test_assert (compiled != NULL, "loading failed: %s", grub_errmsg);
+  if (! compiled)
+    return;
+
+  /* Storing what was loaded must give back the same data.  */
+  grub_test_assert (grub_script_compiled_store (compiled, &stored,
+						&stored_size) == 0,
+		    "storing failed: %s", grub_errmsg);
+  grub_test_assert (stored_size == size && memcmp (stored, data, size) == 0,
+		    "stored script differs from the loaded one");
+  grub_free (stored);
+  grub_script_compiled_unref (compiled);
+
+  /* A changed source must not match.  */
+  cfg[cfg_size / 2] ^= 1;
+  grub_test_assert (grub_script_compiled_load (data, size, cfg,
+					       cfg_size) == NULL,
+		    "compiled script loaded for a different source");
+  cfg[cfg_size / 2] ^= 1;
+  grub_errno = GRUB_ERR_NONE;
+
+  /* A truncated one must not load either.  */
+  grub_test_assert (grub_script_compiled_load (data, size - 4, cfg,
+					       cfg_size) == NULL,
+		    "truncated compiled script loaded");
+  grub_errno = GRUB_ERR_NONE;
+
+  start = now ();
+  for (i = 0; i < ITERATIONS; i++)
+    grub_test_assert (parse_config (cfg) > NENTRIES, "parsing failed");
+  parse_time = (now () - start) / ITERATIONS;
+
+  start = now ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      compiled = grub_script_compiled_load (data, size, cfg, cfg_size);
+      grub_script_compiled_unref (compiled);
+    }
+  load_time = (now () - start) / ITERATIONS;
+
+  printf ("%d entries, %" PRIuGRUB_SIZE " bytes source, %" PRIuGRUB_SIZE
+	  " bytes compiled: parse %.3f ms, load %.3f ms\n", NENTRIES,
+	  cfg_size, size, parse_time * 1e3, load_time * 1e3);
+
+  grub_free (data);
+  free (cfg);
+}
+
+GRUB_UNIT_TEST ("script_compiled_unit_test", script_compiled_test);
@@ -35,10 +35,13 @@
 #include <grub/i18n.h>
 #include <grub/zfs/zfs.h>
 #include <grub/emu/hostfile.h>
+#include <grub/trace.h>
 
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "progname.h"
 #pragma GCC diagnostic ignored "-Wmissing-prototypes"
@@ -69,7 +72,8 @@ enum {
   CMD_BLOCKLIST,
   CMD_TESTLOAD,
   CMD_ZFSINFO,
-  CMD_XNU_UUID
+  CMD_XNU_UUID,
+  CMD_BENCH
 };
 #define BUF_SIZE  32256
 
@@ -367,6 +371,216 @@ cmd_crc (char *pathname)
   free (crc32_context);
 }
 
+#define BENCH_BUF_SIZE	(1 << 20)
+
+struct bench_ctx
+{
+  grub_device_t dev;
+  grub_fs_t fs;
+  /* The device part of the paths, like "(loop0)", or empty.  */
+  const char *device;
+  const char *dir;
+  char *buf;
+  grub_uint64_t files;
+  grub_uint64_t bytes;
+};
+
+static void
+bench_file (const char *name, struct bench_ctx *ctx)
+{
+  grub_file_t file;
+  grub_ssize_t sz;
+  char *path;
+
+  path = xasprintf ("%s%s", ctx->device, name);
+  file = grub_file_open (path, ((uncompress == 0)
+				? GRUB_FILE_TYPE_NO_DECOMPRESS
+				: GRUB_FILE_TYPE_NONE)
+			 | GRUB_FILE_TYPE_FSTEST);
+  if (!file)
+    grub_util_error (_("cannot open `%s': %s"), path, grub_errmsg);
+  while ((sz = grub_file_read (file, ctx->buf, BENCH_BUF_SIZE)) > 0)
+    ctx->bytes += sz;
+  if (sz < 0)
+    grub_util_error (_("cannot read `%s': %s"), path, grub_errmsg);
+  grub_file_close (file);
+  ctx->files++;
+  free (path);
+}
+
+static int
+bench_dir_hook (const char *name, const struct grub_dirhook_info *info,
+		void *data)
+{
+  struct bench_ctx *ctx = data;
+  const char *dir = ctx->dir;
+  grub_size_t len = strlen (dir);
+  char *path;
+
+  if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+    return 0;
+
+  path = xasprintf ("%s%s%s", dir, (len && dir[len - 1] == '/') ? "" : "/",
+		    name);
+  if (info->dir)
+    {
+      ctx->dir = path;
+      if ((ctx->fs->fs_dir) (ctx->dev, path, bench_dir_hook, ctx))
+	grub_util_error (_("cannot open `%s': %s"), path, grub_errmsg);
+      ctx->dir = dir;
+    }
+  else
+    bench_file (path, ctx);
+  free (path);
+
+  return 0;
+}
+
+/* Read PATH, or every file under it if it is a directory.  */
+static void
+bench_path (const char *path, struct bench_ctx *ctx)
+{
+  char *device_name, *device;
+  const char *name = path;
+
+  device_name = grub_file_get_device_name (path);
+  ctx->dev = grub_device_open (device_name);
+  if (!ctx->dev)
+    grub_util_error ("%s", grub_errmsg);
+  ctx->fs = grub_fs_probe (ctx->dev);
+  if (!ctx->fs)
+    grub_util_error ("%s", grub_errmsg);
+
+  if (path[0] == '(' && strchr (path, ')'))
+    name = strchr (path, ')') + 1;
+  device = xstrdup (path);
+  device[name - path] = '\0';
+  ctx->device = device;
+
+  ctx->dir = name;
+  if ((ctx->fs->fs_dir) (ctx->dev, name, bench_dir_hook, ctx))
+    {
+      if (grub_errno != GRUB_ERR_BAD_FILE_TYPE)
+	grub_util_error (_("cannot open `%s': %s"), path, grub_errmsg);
+      /* Not a directory.  */
+      grub_errno = GRUB_ERR_NONE;
+      bench_file (name, ctx);
+    }
+
+  free (device);
+  grub_device_close (ctx->dev);
+  grub_free (device_name);
+}
+
+/* Drop what the host has cached of the images, so that a cold pass really
+   reads them.  */
+static void
+bench_drop_host_cache (char **images, int num_images)
+{
+#if defined (HAVE_POSIX_FADVISE) && defined (POSIX_FADV_DONTNEED)
+  int i, fd;
+
+  for (i = 0; i < num_images; i++)
+    {
+      fd = open (images[i], O_RDONLY);
+      if (fd < 0)
+	continue;
+      posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+      close (fd);
+    }
+#else
+  (void) images;
+  (void) num_images;
+#endif
+}
+
+/* Report how long cryptomount took to unlock the devices, before the
+   passes reset the counters.  */
+static void
+bench_unlock (void)
+{
+  struct grub_trace_counter *counter;
+  grub_uint64_t devices = 0, unlock_us = 0, kdf_runs = 0, kdf_us = 0;
+
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    if (strcmp (counter->name, "cryptodisk.unlock") == 0)
+      {
+	devices = counter->count;
+	unlock_us = grub_trace_ticks_to_us (counter->ticks);
+      }
+    else if (strcmp (counter->name, "cryptodisk.kdf") == 0)
+      {
+	kdf_runs = counter->count;
+	kdf_us = grub_trace_ticks_to_us (counter->ticks);
+      }
+
+  printf ("pass=unlock devices=%" GRUB_HOST_PRIuLONG_LONG
+	  " usec=%" GRUB_HOST_PRIuLONG_LONG
+	  " kdf_runs=%" GRUB_HOST_PRIuLONG_LONG
+	  " kdf_usec=%" GRUB_HOST_PRIuLONG_LONG "\n",
+	  (unsigned long long) devices, (unsigned long long) unlock_us,
+	  (unsigned long long) kdf_runs, (unsigned long long) kdf_us);
+  fflush (stdout);
+}
+
+static void
+bench_pass (const char *pass, int n, char **paths)
+{
+  struct bench_ctx ctx = { 0 };
+  struct grub_trace_counter *counter;
+  grub_uint64_t start, elapsed;
+  grub_uint64_t reads = 0, read_bytes = 0, hits = 0, misses = 0;
+  grub_uint64_t decrypted = 0, decrypt_us = 0;
+  int i;
+
+  ctx.buf = xmalloc (BENCH_BUF_SIZE);
+  grub_trace_reset ();
+  grub_util_mm_reset_peak ();
+
+  start = grub_util_get_time_us ();
+  for (i = 0; i < n; i++)
+    bench_path (paths[i], &ctx);
+  elapsed = grub_util_get_time_us () - start;
+
+  for (counter = grub_trace_counters; counter; counter = counter->next)
+    if (strncmp (counter->name, "disk.loop", sizeof ("disk.loop") - 1) == 0)
+      {
+	reads += counter->count;
+	read_bytes += counter->bytes;
+      }
+    else if (strcmp (counter->name, "disk.cache.hit") == 0)
+      hits = counter->count;
+    else if (strcmp (counter->name, "disk.cache.miss") == 0)
+      misses = counter->count;
+    else if (strcmp (counter->name, "cryptodisk.decrypt") == 0)
+      {
+	decrypted = counter->bytes;
+	decrypt_us = grub_trace_ticks_to_us (counter->self_ticks);
+      }
+
+  /* One line of KEY=VALUE pairs per pass, for scripts to compare.  */
+  printf ("pass=%s files=%" GRUB_HOST_PRIuLONG_LONG
+	  " bytes=%" GRUB_HOST_PRIuLONG_LONG " usec=%" GRUB_HOST_PRIuLONG_LONG
+	  " mbps=%.1f disk_reads=%" GRUB_HOST_PRIuLONG_LONG
+	  " disk_read_bytes=%" GRUB_HOST_PRIuLONG_LONG
+	  " cache_hits=%" GRUB_HOST_PRIuLONG_LONG
+	  " cache_misses=%" GRUB_HOST_PRIuLONG_LONG
+	  " cache_hit_ratio=%.3f decrypt_bytes=%" GRUB_HOST_PRIuLONG_LONG
+	  " decrypt_usec=%" GRUB_HOST_PRIuLONG_LONG
+	  " alloc_peak=%" GRUB_HOST_PRIuLONG_LONG "\n",
+	  pass, (unsigned long long) ctx.files, (unsigned long long) ctx.bytes,
+	  (unsigned long long) elapsed,
+	  elapsed ? (double) ctx.bytes / elapsed : 0.0,
+	  (unsigned long long) reads, (unsigned long long) read_bytes,
+	  (unsigned long long) hits, (unsigned long long) misses,
+	  (hits + misses) ? (double) hits / (hits + misses) : 0.0,
+	  (unsigned long long) decrypted, (unsigned long long) decrypt_us,
+	  (unsigned long long) grub_util_mm_peak ());
+  fflush (stdout);
+
+  free (ctx.buf);
+}
+
 static const char *root = NULL;
 static int args_count = 0;
 static int nparm = 0;
@@ -482,6 +696,15 @@ fstest (int n)
 	grub_free (uuid);
 	grub_device_close (dev);
       }
+      break;
+    case CMD_BENCH:
+      if (mount_crypt)
+	bench_unlock ();
+      grub_disk_cache_invalidate_all ();
+      bench_drop_host_cache (images, num_disks);
+      bench_pass ("cold", n, args);
+      bench_pass ("warm", n, args);
+      break;
     }
     
   for (i = 0; i < num_disks; i++)
@@ -512,6 +735,8 @@ static struct argp_option options[] = {
   {N_("crc FILE"), 0, 0     , OPTION_DOC, N_("Get crc32 checksum of FILE."), 1},
   {N_("blocklist FILE"), 0, 0, OPTION_DOC, N_("Display blocklist of FILE."), 1},
   {N_("xnu_uuid DEVICE"), 0, 0, OPTION_DOC, N_("Compute XNU UUID of the device."), 1},
+  {N_("bench PATH..."), 0, 0, OPTION_DOC,
+   N_("Time cold and warm reads of the files in PATH."), 1},
   
   {"root",      'r', N_("DEVICE_NAME"), 0, N_("Set root device."),                 2},
   {"skip",      's', N_("NUM"),           0, N_("Skip N bytes from output file."),   2},
@@ -706,6 +931,11 @@ argp_parser (int key, char *arg, struct argp_state *state)
 	  cmd = CMD_XNU_UUID;
 	  nparm = 0;
 	}
+      else if (grub_strcmp (arg, "bench") == 0)
+	{
+	  cmd = CMD_BENCH;
+	  nparm = 1;
+	}
       else
 	{
 	  fprintf (stderr, _("Invalid command %s.\n"), arg);
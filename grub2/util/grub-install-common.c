@@ -460,6 +460,7 @@ static char **pubkeys;
 static size_t npubkeys;
 static char *sbat;
 static int disable_shim_lock;
+static int prelink;
 static char **x509keys;
 static size_t nx509keys;
 static grub_compression_t compression;
@@ -503,6 +504,9 @@ grub_install_parse (int key, char *arg)
     case GRUB_INSTALL_OPTIONS_DISABLE_SHIM_LOCK:
       disable_shim_lock = 1;
       return 1;
+    case GRUB_INSTALL_OPTIONS_PRELINK:
+      prelink = 1;
+      return 1;
     case 'x':
       x509keys = xrealloc (x509keys,
 			  sizeof (x509keys[0])
@@ -689,11 +693,12 @@ grub_install_make_image_wrap_file (const char *dir, const char *prefix,
 		  " --dtb '%s' "
 		  "--sbat '%s' "
 		  "--format '%s' --compression '%s' "
-		  "--appended-signature-size %zu %s %s %s\n",
+		  "--appended-signature-size %zu %s %s %s %s\n",
 		  dir, prefix,
 		  outname, dtb ? : "", sbat ? : "", mkimage_target,
 		  compnames[compression], appsig_size, note ? "--note" : "",
-		  disable_shim_lock ? "--disable-shim-lock" : "", s);
+		  disable_shim_lock ? "--disable-shim-lock" : "",
+		  prelink ? "--prelink" : "", s);
   free (s);
 
   tgt = grub_install_get_image_target (mkimage_target);
@@ -705,7 +710,7 @@ grub_install_make_image_wrap_file (const char *dir, const char *prefix,
 			       pubkeys, npubkeys, x509keys, nx509keys,
 			       config_path, tgt,
 			       note, appsig_size, compression, dtb, sbat,
-			       disable_shim_lock);
+			       disable_shim_lock, prelink);
   while (dc--)
     grub_install_pop_module ();
 }
@@ -84,6 +84,7 @@ static struct argp_option options[] = {
   {"compression",  'C', "(xz|none|auto)", 0, N_("choose the compression to use for core image"), 0},
   {"sbat", 's', N_("FILE"), 0, N_("SBAT metadata"), 0},
   {"disable-shim-lock", GRUB_INSTALL_OPTIONS_DISABLE_SHIM_LOCK, 0, 0, N_("disable shim_lock verifier"), 0},
+  {"prelink", GRUB_INSTALL_OPTIONS_PRELINK, 0, 0, N_("embed the modules as one bundle relocated at build time (i386 and x86_64 only)"), 0},
   {"verbose",     'v', 0,      0, N_("print verbose messages."), 0},
   {"appended-signature-size", 'S', N_("SIZE"), 0, N_("Add a note segment reserving SIZE bytes for an appended signature"), 0},
   { 0, 0, 0, 0, 0, 0 }
@@ -132,6 +133,7 @@ struct arguments
   char *sbat;
   int note;
   int disable_shim_lock;
+  int prelink;
   size_t appsig_size;
   const struct grub_install_image_target_desc *image_target;
   grub_compression_t comp;
@@ -259,6 +261,10 @@ argp_parser (int key, char *arg, struct argp_state *state)
       arguments->disable_shim_lock = 1;
       break;
 
+    case GRUB_INSTALL_OPTIONS_PRELINK:
+      arguments->prelink = 1;
+      break;
+
     case 'v':
       verbosity++;
       break;
@@ -347,7 +353,8 @@ main (int argc, char *argv[])
 			       arguments.image_target, arguments.note,
 			       arguments.appsig_size,
 			       arguments.comp, arguments.dtb,
-			       arguments.sbat, arguments.disable_shim_lock);
+			       arguments.sbat, arguments.disable_shim_lock,
+			       arguments.prelink);
 
   if (grub_util_file_sync (fp) < 0)
     grub_util_error (_("cannot sync `%s': %s"), arguments.output ? : "stdout",
@@ -2487,3 +2487,587 @@ SUFFIX (grub_mkimage_load_image) (const char *kernel_path,
 
   return out_img;
 }
+
+/* Prelinking of modules into a bundle, see struct grub_dl_bundle_header.  */
+
+enum prelink_kind
+  {
+    PRELINK_BUNDLE,
+    PRELINK_IMPORT,
+    PRELINK_ABS
+  };
+
+struct prelink_state
+{
+  char *image;
+  size_t image_size, image_alloc, align;
+  struct grub_dl_bundle_module *mods;
+  size_t nmods, mods_alloc;
+  struct grub_dl_bundle_symbol *syms;
+  size_t nsyms, syms_alloc;
+  grub_uint32_t *imports;
+  size_t nimports, imports_alloc;
+  struct grub_dl_bundle_fixup *fixups;
+  size_t nfixups, fixups_alloc;
+  char *strtab;
+  size_t strtab_size, strtab_alloc;
+};
+
+static void *
+prelink_grow (void *ptr, size_t *alloc, size_t needed, size_t elsize)
+{
+  if (needed <= *alloc)
+    return ptr;
+  while (*alloc < needed)
+    *alloc = *alloc ? *alloc * 2 : 64;
+  return xrealloc (ptr, *alloc * elsize);
+}
+
+static grub_uint32_t
+prelink_add_string (struct prelink_state *st, const char *str, size_t len)
+{
+  grub_uint32_t ret = st->strtab_size;
+
+  st->strtab = prelink_grow (st->strtab, &st->strtab_alloc,
+			     st->strtab_size + len + 1, 1);
+  memcpy (st->strtab + st->strtab_size, str, len);
+  st->strtab[st->strtab_size + len] = 0;
+  st->strtab_size += len + 1;
+  return ret;
+}
+
+static void
+prelink_add_fixup (struct prelink_state *st, grub_uint64_t offset,
+		   grub_uint32_t symbol, grub_uint32_t type, grub_uint64_t addend)
+{
+  struct grub_dl_bundle_fixup *f;
+
+  st->fixups = prelink_grow (st->fixups, &st->fixups_alloc, st->nfixups + 1,
+			     sizeof (*st->fixups));
+  f = &st->fixups[st->nfixups++];
+  f->offset = offset;
+  f->symbol = symbol;
+  f->type = type;
+  f->reserved = 0;
+  f->addend = addend;
+}
+
+/* Resolve an undefined symbol against the bundle so far, latest definition
+   first like grub_dl_resolve_symbol does, or else import it.  */
+static enum prelink_kind
+prelink_resolve (struct prelink_state *st, const char *name,
+		 grub_uint64_t *value)
+{
+  size_t i;
+
+  for (i = st->nsyms; i > 0; i--)
+    if (strcmp (st->strtab + st->syms[i - 1].name, name) == 0)
+      {
+	*value = st->syms[i - 1].offset;
+	return PRELINK_BUNDLE;
+      }
+
+  for (i = 0; i < st->nimports; i++)
+    if (strcmp (st->strtab + st->imports[i], name) == 0)
+      {
+	*value = i;
+	return PRELINK_IMPORT;
+      }
+
+  st->imports = prelink_grow (st->imports, &st->imports_alloc,
+			      st->nimports + 1, sizeof (*st->imports));
+  st->imports[st->nimports] = prelink_add_string (st, name, strlen (name));
+  *value = st->nimports++;
+  return PRELINK_IMPORT;
+}
+
+static void
+prelink_store (char *field, grub_uint32_t type, grub_uint64_t value,
+	       const struct grub_install_image_target_desc *image_target)
+{
+  grub_uint32_t v32;
+  grub_uint64_t v64;
+
+  switch (type)
+    {
+    case GRUB_DL_BUNDLE_FIXUP_ABS64:
+    case GRUB_DL_BUNDLE_FIXUP_PC64:
+      v64 = grub_host_to_target64 (value);
+      memcpy (field, &v64, sizeof (v64));
+      return;
+    case GRUB_DL_BUNDLE_FIXUP_ABS32:
+      if (image_target->voidp_sizeof == 8 && value != (grub_uint32_t) value)
+	grub_util_error ("relocation out of range");
+      break;
+    default:
+      if (image_target->voidp_sizeof == 8
+	  && (grub_int64_t) value != (grub_int32_t) value)
+	grub_util_error ("relocation out of range");
+      break;
+    }
+  v32 = grub_host_to_target32 (value);
+  memcpy (field, &v32, sizeof (v32));
+}
+
+static Elf_Shdr *
+SUFFIX (prelink_find_section) (Elf_Ehdr *e, size_t size, const char *name,
+			       const struct grub_install_image_target_desc *image_target)
+{
+  Elf_Shdr *sections, *s;
+  const char *shstr;
+  Elf_Half i, shnum, shentsize;
+
+  sections = (Elf_Shdr *) ((char *) e + grub_target_to_host (e->e_shoff));
+  shnum = grub_target_to_host16 (e->e_shnum);
+  shentsize = grub_target_to_host16 (e->e_shentsize);
+  s = (Elf_Shdr *) ((char *) sections
+		    + grub_target_to_host16 (e->e_shstrndx) * shentsize);
+  shstr = (char *) e + grub_target_to_host (s->sh_offset);
+
+  for (i = 0, s = sections; i < shnum;
+       i++, s = (Elf_Shdr *) ((char *) s + shentsize))
+    if (strcmp (shstr + grub_target_to_host32 (s->sh_name), name) == 0)
+      {
+	if (grub_target_to_host (s->sh_offset)
+	    + grub_target_to_host (s->sh_size) > size)
+	  grub_util_error (_("premature end of file %s"), name);
+	return s;
+      }
+  return NULL;
+}
+
+static void
+SUFFIX (prelink_module) (struct prelink_state *st, const char *path,
+			 const struct grub_install_image_target_desc *image_target)
+{
+  size_t size = grub_util_get_image_size (path);
+  char *img = xmalloc (size);
+  Elf_Ehdr *e = (Elf_Ehdr *) img;
+  Elf_Shdr *sections, *s, *symtab = NULL;
+  Elf_Half i, shnum, shentsize;
+  grub_uint64_t *sec_off, *sym_val = NULL, start, cur, align = 1;
+  grub_uint8_t *placed, *sym_kind = NULL;
+  struct grub_dl_bundle_module *mod;
+  const char *symstr = NULL, *license;
+  size_t nsyms = 0, symsize = 0, old_alloc, j;
+
+  grub_util_load_image (path, img);
+
+  if (size < sizeof (*e)
+      || memcmp (e->e_ident, ELFMAG, SELFMAG) != 0
+      || e->e_ident[EI_CLASS] != ELFCLASSXX
+      || grub_target_to_host16 (e->e_type) != ET_REL
+      || grub_target_to_host16 (e->e_machine) != image_target->elf_target)
+    grub_util_error (_("invalid ELF header in `%s'"), path);
+
+  shnum = grub_target_to_host16 (e->e_shnum);
+  shentsize = grub_target_to_host16 (e->e_shentsize);
+  if (grub_target_to_host (e->e_shoff) + (grub_uint64_t) shnum * shentsize > size)
+    grub_util_error (_("premature end of file %s"), path);
+  sections = (Elf_Shdr *) (img + grub_target_to_host (e->e_shoff));
+
+  st->mods = prelink_grow (st->mods, &st->mods_alloc, st->nmods + 1,
+			   sizeof (*st->mods));
+  mod = &st->mods[st->nmods];
+
+  s = SUFFIX (prelink_find_section) (e, size, ".modname", image_target);
+  if (!s)
+    grub_util_error ("no module name found in `%s'", path);
+  mod->name = prelink_add_string (st, img + grub_target_to_host (s->sh_offset),
+				  strnlen (img + grub_target_to_host (s->sh_offset),
+					   grub_target_to_host (s->sh_size)));
+
+  s = SUFFIX (prelink_find_section) (e, size, ".module_license", image_target);
+  license = s ? img + grub_target_to_host (s->sh_offset) : "";
+  if (strcmp (license, "LICENSE=GPLv3") != 0
+      && strcmp (license, "LICENSE=GPLv3+") != 0
+      && strcmp (license, "LICENSE=GPLv2+") != 0)
+    grub_util_error ("incompatible license in `%s'", path);
+
+  mod->deps = st->strtab_size;
+  s = SUFFIX (prelink_find_section) (e, size, ".moddeps", image_target);
+  if (s)
+    {
+      const char *dep = img + grub_target_to_host (s->sh_offset);
+      const char *end = dep + grub_target_to_host (s->sh_size);
+
+      while (dep < end && *dep)
+	{
+	  size_t len = strnlen (dep, end - dep);
+	  prelink_add_string (st, dep, len);
+	  dep += len + 1;
+	}
+    }
+  prelink_add_string (st, "", 0);
+
+  /* Lay the allocated sections out the way grub_dl_load_segments does.  */
+  sec_off = xcalloc (shnum, sizeof (*sec_off));
+  placed = xcalloc (shnum, sizeof (*placed));
+  for (i = 0, s = sections; i < shnum;
+       i++, s = (Elf_Shdr *) ((char *) s + shentsize))
+    if (align < grub_target_to_host (s->sh_addralign))
+      align = grub_target_to_host (s->sh_addralign);
+  start = cur = ALIGN_UP (st->image_size, align);
+  for (i = 0, s = sections; i < shnum;
+       i++, s = (Elf_Shdr *) ((char *) s + shentsize))
+    {
+      grub_uint64_t sh_size = grub_target_to_host (s->sh_size);
+      grub_uint64_t sh_align = grub_target_to_host (s->sh_addralign);
+
+      if (grub_target_to_host32 (s->sh_type) == SHT_SYMTAB && !symtab)
+	symtab = s;
+      if (!(grub_target_to_host (s->sh_flags) & SHF_ALLOC) || !sh_size)
+	continue;
+
+      cur = ALIGN_UP (cur, sh_align ? : 1);
+      old_alloc = st->image_alloc;
+      st->image = prelink_grow (st->image, &st->image_alloc, cur + sh_size, 1);
+      memset (st->image + old_alloc, 0, st->image_alloc - old_alloc);
+      if (grub_target_to_host32 (s->sh_type) == SHT_PROGBITS)
+	{
+	  if (grub_target_to_host (s->sh_offset) + sh_size > size)
+	    grub_util_error (_("premature end of file %s"), path);
+	  memcpy (st->image + cur, img + grub_target_to_host (s->sh_offset),
+		  sh_size);
+	}
+      sec_off[i] = cur;
+      placed[i] = 1;
+      cur += sh_size;
+    }
+  if (cur >= GRUB_DL_BUNDLE_NONE)
+    grub_util_error ("prelinked bundle is too large");
+  old_alloc = st->image_alloc;
+  st->image = prelink_grow (st->image, &st->image_alloc, cur, 1);
+  memset (st->image + old_alloc, 0, st->image_alloc - old_alloc);
+  st->image_size = cur;
+  if (st->align < align)
+    st->align = align;
+  mod->start = start;
+  mod->size = cur - start;
+  mod->init = GRUB_DL_BUNDLE_NONE;
+  mod->fini = GRUB_DL_BUNDLE_NONE;
+
+  /* Resolve symbols, mirroring grub_dl_resolve_symbols.  */
+  if (symtab)
+    {
+      Elf_Shdr *strs;
+
+      symsize = grub_target_to_host (symtab->sh_entsize);
+      nsyms = grub_target_to_host (symtab->sh_size) / symsize;
+      if (grub_target_to_host (symtab->sh_offset)
+	  + grub_target_to_host (symtab->sh_size) > size
+	  || grub_target_to_host32 (symtab->sh_link) >= shnum)
+	grub_util_error (_("premature end of file %s"), path);
+      strs = (Elf_Shdr *) ((char *) sections
+			   + grub_target_to_host32 (symtab->sh_link) * shentsize);
+      symstr = img + grub_target_to_host (strs->sh_offset);
+      sym_kind = xcalloc (nsyms, sizeof (*sym_kind));
+      sym_val = xcalloc (nsyms, sizeof (*sym_val));
+    }
+
+  for (j = 0; j < nsyms; j++)
+    {
+      Elf_Sym *sym = (Elf_Sym *) (img + grub_target_to_host (symtab->sh_offset)
+				  + j * symsize);
+      unsigned char type = ELF_ST_TYPE (sym->st_info);
+      unsigned char bind = sym->st_info >> 4;
+      const char *name = symstr + grub_target_to_host32 (sym->st_name);
+      Elf_Half shndx = grub_target_to_host16 (sym->st_shndx);
+      grub_uint64_t value = grub_target_to_host (sym->st_value);
+      int isfunc = 0;
+
+      switch (type)
+	{
+	case STT_NOTYPE:
+	case STT_OBJECT:
+	  if (sym->st_name != 0 && shndx == SHN_UNDEF)
+	    {
+	      sym_kind[j] = prelink_resolve (st, name, &sym_val[j]);
+	      continue;
+	    }
+	  break;
+
+	case STT_FUNC:
+	  isfunc = 1;
+	  break;
+
+	case STT_SECTION:
+	  value = 0;
+	  break;
+
+	case STT_FILE:
+	  sym_kind[j] = PRELINK_ABS;
+	  sym_val[j] = 0;
+	  continue;
+
+	default:
+	  grub_util_error ("unknown symbol type `%d' in `%s'", (int) type, path);
+	}
+
+      if (shndx < shnum && placed[shndx])
+	{
+	  sym_kind[j] = PRELINK_BUNDLE;
+	  sym_val[j] = value + sec_off[shndx];
+	}
+      else
+	{
+	  sym_kind[j] = PRELINK_ABS;
+	  sym_val[j] = value;
+	}
+
+      /* grub_mod_init and grub_mod_fini are static, so match them before
+	 local symbols are skipped, as grub_dl_resolve_symbols does.  */
+      if (isfunc && sym_kind[j] == PRELINK_BUNDLE
+	  && strcmp (name, "grub_mod_init") == 0)
+	mod->init = sym_val[j];
+      else if (isfunc && sym_kind[j] == PRELINK_BUNDLE
+	       && strcmp (name, "grub_mod_fini") == 0)
+	mod->fini = sym_val[j];
+
+      if (type == STT_SECTION || bind == STB_LOCAL)
+	continue;
+      if (sym_kind[j] != PRELINK_BUNDLE)
+	grub_util_error ("absolute symbol `%s' in `%s' can't be prelinked",
+			 name, path);
+
+      st->syms = prelink_grow (st->syms, &st->syms_alloc, st->nsyms + 1,
+			       sizeof (*st->syms));
+      st->syms[st->nsyms].name = prelink_add_string (st, name, strlen (name));
+      st->syms[st->nsyms].offset = sym_val[j];
+      st->syms[st->nsyms].module = st->nmods;
+      st->syms[st->nsyms].isfunc = isfunc;
+      st->nsyms++;
+    }
+
+  /* Apply what can be applied now and leave fixups for the rest.  */
+  for (i = 0, s = sections; i < shnum;
+       i++, s = (Elf_Shdr *) ((char *) s + shentsize))
+    {
+      grub_uint32_t sh_type = grub_target_to_host32 (s->sh_type);
+      grub_uint32_t target = grub_target_to_host32 (s->sh_info);
+      grub_uint64_t entsize, off, target_size;
+
+      if ((sh_type != SHT_REL && sh_type != SHT_RELA)
+	  || target >= shnum || !placed[target])
+	continue;
+      if (!symtab)
+	grub_util_error ("relocation without symbol table in `%s'", path);
+
+      entsize = grub_target_to_host (s->sh_entsize);
+      target_size = grub_target_to_host (((Elf_Shdr *) ((char *) sections
+							 + target * shentsize))->sh_size);
+      if (grub_target_to_host (s->sh_offset)
+	  + grub_target_to_host (s->sh_size) > size)
+	grub_util_error (_("premature end of file %s"), path);
+
+      for (off = 0; off + entsize <= grub_target_to_host (s->sh_size);
+	   off += entsize)
+	{
+	  Elf_Rela *r = (Elf_Rela *) (img + grub_target_to_host (s->sh_offset)
+				      + off);
+	  grub_uint64_t info = grub_target_to_host (r->r_info);
+	  grub_uint64_t roff = grub_target_to_host (r->r_offset);
+	  grub_uint64_t symi = ELF_R_SYM (info);
+	  grub_uint64_t addend = 0, pos, value;
+	  grub_uint32_t type, v32;
+	  grub_uint64_t v64;
+	  size_t width = 4;
+	  char *field;
+
+	  if (sh_type == SHT_RELA)
+	    addend = grub_target_to_host (r->r_addend);
+	  if (image_target->voidp_sizeof == 4)
+	    addend = (grub_int64_t) (grub_int32_t) addend;
+
+	  switch (image_target->elf_target * 0x100 + ELF_R_TYPE (info))
+	    {
+	    case EM_X86_64 * 0x100 + R_X86_64_64:
+	      type = GRUB_DL_BUNDLE_FIXUP_ABS64;
+	      width = 8;
+	      break;
+	    case EM_X86_64 * 0x100 + R_X86_64_PC64:
+	      type = GRUB_DL_BUNDLE_FIXUP_PC64;
+	      width = 8;
+	      break;
+	    case EM_X86_64 * 0x100 + R_X86_64_PC32:
+	    case EM_X86_64 * 0x100 + R_X86_64_PLT32:
+	    case EM_386 * 0x100 + R_386_PC32:
+	      type = GRUB_DL_BUNDLE_FIXUP_PC32;
+	      break;
+	    case EM_X86_64 * 0x100 + R_X86_64_32:
+	    case EM_386 * 0x100 + R_386_32:
+	      type = GRUB_DL_BUNDLE_FIXUP_ABS32;
+	      break;
+	    case EM_X86_64 * 0x100 + R_X86_64_32S:
+	      type = GRUB_DL_BUNDLE_FIXUP_ABS32S;
+	      break;
+	    default:
+	      grub_util_error ("relocation 0x%x in `%s' can't be prelinked",
+			       (unsigned) ELF_R_TYPE (info), path);
+	    }
+
+	  if (symi >= nsyms || roff + width > target_size)
+	    grub_util_error ("invalid relocation in `%s'", path);
+
+	  pos = sec_off[target] + roff;
+	  field = st->image + pos;
+
+	  /* Like the loaders, treat what's already in the field as part of
+	     the addend.  */
+	  if (width == 8)
+	    {
+	      memcpy (&v64, field, sizeof (v64));
+	      addend += grub_target_to_host64 (v64);
+	    }
+	  else
+	    {
+	      memcpy (&v32, field, sizeof (v32));
+	      v32 = grub_target_to_host32 (v32);
+	      if (type == GRUB_DL_BUNDLE_FIXUP_ABS32)
+		addend += v32;
+	      else
+		addend += (grub_int64_t) (grub_int32_t) v32;
+	    }
+
+	  switch (sym_kind[symi])
+	    {
+	    case PRELINK_BUNDLE:
+	      value = sym_val[symi] + addend;
+	      if (type == GRUB_DL_BUNDLE_FIXUP_PC32
+		  || type == GRUB_DL_BUNDLE_FIXUP_PC64)
+		prelink_store (field, type, value - pos, image_target);
+	      else
+		prelink_add_fixup (st, pos, GRUB_DL_BUNDLE_NONE, type, value);
+	      break;
+
+	    case PRELINK_IMPORT:
+	      prelink_add_fixup (st, pos, sym_val[symi], type, addend);
+	      break;
+
+	    default:
+	      if (type == GRUB_DL_BUNDLE_FIXUP_PC32
+		  || type == GRUB_DL_BUNDLE_FIXUP_PC64)
+		grub_util_error ("PC-relative relocation against an absolute"
+				 " symbol in `%s'", path);
+	      prelink_store (field, type, sym_val[symi] + addend, image_target);
+	      break;
+	    }
+	}
+    }
+
+  grub_util_info ("prelinked %s at 0x%" GRUB_HOST_PRIxLONG_LONG
+		  ", size 0x%" GRUB_HOST_PRIxLONG_LONG, path,
+		  (unsigned long long) start, (unsigned long long) mod->size);
+
+  st->nmods++;
+  free (sym_kind);
+  free (sym_val);
+  free (placed);
+  free (sec_off);
+  free (img);
+}
+
+char *
+SUFFIX (grub_mkimage_prelink_modules) (struct grub_util_path_list *path_list,
+				       const struct grub_install_image_target_desc *image_target,
+				       size_t *bundle_size)
+{
+  struct prelink_state st;
+  struct grub_util_path_list *p;
+  struct grub_dl_bundle_header *h;
+  size_t mods_offset, syms_offset, imports_offset, fixups_offset;
+  size_t strtab_offset, image_offset, total, i;
+  char *out;
+
+  if (image_target->elf_target != EM_X86_64
+      && image_target->elf_target != EM_386)
+    grub_util_error (_("prelinked modules aren't supported for this target"));
+
+  memset (&st, 0, sizeof (st));
+  st.align = 1;
+
+  for (p = path_list; p; p = p->next)
+    SUFFIX (prelink_module) (&st, p->name, image_target);
+
+  mods_offset = ALIGN_UP (sizeof (*h), 8);
+  syms_offset = ALIGN_UP (mods_offset + st.nmods * sizeof (*st.mods), 8);
+  imports_offset = ALIGN_UP (syms_offset + st.nsyms * sizeof (*st.syms), 8);
+  fixups_offset = ALIGN_UP (imports_offset
+			    + st.nimports * sizeof (*st.imports), 8);
+  strtab_offset = fixups_offset + st.nfixups * sizeof (*st.fixups);
+  image_offset = ALIGN_UP (strtab_offset + st.strtab_size, 8);
+  total = image_offset + st.image_size;
+
+  out = xcalloc (1, total);
+  h = (struct grub_dl_bundle_header *) out;
+  h->magic = grub_host_to_target32 (GRUB_DL_BUNDLE_MAGIC);
+  h->align = grub_host_to_target32 (st.align);
+  h->image_offset = grub_host_to_target32 (image_offset);
+  h->image_size = grub_host_to_target32 (st.image_size);
+  h->mods_offset = grub_host_to_target32 (mods_offset);
+  h->nmods = grub_host_to_target32 (st.nmods);
+  h->syms_offset = grub_host_to_target32 (syms_offset);
+  h->nsyms = grub_host_to_target32 (st.nsyms);
+  h->imports_offset = grub_host_to_target32 (imports_offset);
+  h->nimports = grub_host_to_target32 (st.nimports);
+  h->fixups_offset = grub_host_to_target32 (fixups_offset);
+  h->nfixups = grub_host_to_target32 (st.nfixups);
+  h->strtab_offset = grub_host_to_target32 (strtab_offset);
+  h->strtab_size = grub_host_to_target32 (st.strtab_size);
+
+  for (i = 0; i < st.nmods; i++)
+    {
+      struct grub_dl_bundle_module *m;
+
+      m = (struct grub_dl_bundle_module *) (out + mods_offset) + i;
+      m->name = grub_host_to_target32 (st.mods[i].name);
+      m->deps = grub_host_to_target32 (st.mods[i].deps);
+      m->start = grub_host_to_target32 (st.mods[i].start);
+      m->size = grub_host_to_target32 (st.mods[i].size);
+      m->init = grub_host_to_target32 (st.mods[i].init);
+      m->fini = grub_host_to_target32 (st.mods[i].fini);
+    }
+  for (i = 0; i < st.nsyms; i++)
+    {
+      struct grub_dl_bundle_symbol *sym;
+
+      sym = (struct grub_dl_bundle_symbol *) (out + syms_offset) + i;
+      sym->name = grub_host_to_target32 (st.syms[i].name);
+      sym->offset = grub_host_to_target32 (st.syms[i].offset);
+      sym->module = grub_host_to_target16 (st.syms[i].module);
+      sym->isfunc = grub_host_to_target16 (st.syms[i].isfunc);
+    }
+  for (i = 0; i < st.nimports; i++)
+    ((grub_uint32_t *) (out + imports_offset))[i]
+      = grub_host_to_target32 (st.imports[i]);
+  for (i = 0; i < st.nfixups; i++)
+    {
+      struct grub_dl_bundle_fixup *f;
+
+      f = (struct grub_dl_bundle_fixup *) (out + fixups_offset) + i;
+      f->offset = grub_host_to_target32 (st.fixups[i].offset);
+      f->symbol = grub_host_to_target32 (st.fixups[i].symbol);
+      f->type = grub_host_to_target32 (st.fixups[i].type);
+      f->addend = grub_host_to_target64 (st.fixups[i].addend);
+    }
+  memcpy (out + strtab_offset, st.strtab, st.strtab_size);
+  if (st.image_size)
+    memcpy (out + image_offset, st.image, st.image_size);
+
+  grub_util_info ("prelinked %" GRUB_HOST_PRIuLONG_LONG " modules: %"
+		  GRUB_HOST_PRIuLONG_LONG " symbols, %" GRUB_HOST_PRIuLONG_LONG
+		  " imports, %" GRUB_HOST_PRIuLONG_LONG " fixups",
+		  (unsigned long long) st.nmods, (unsigned long long) st.nsyms,
+		  (unsigned long long) st.nimports,
+		  (unsigned long long) st.nfixups);
+
+  free (st.image);
+  free (st.mods);
+  free (st.syms);
+  free (st.imports);
+  free (st.fixups);
+  free (st.strtab);
+
+  *bundle_size = total;
+  return out;
+}
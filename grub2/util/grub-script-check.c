@@ -46,10 +46,13 @@ struct arguments
 {
   int verbose;
   char *filename;
+  char *output;
 };
 
 static struct argp_option options[] = {
   {"verbose",     'v', 0,      0, N_("print verbose messages."), 0},
+  {"output",      'o', N_("FILE"), 0,
+   N_("also save the pre-parsed script to FILE."), 0},
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -66,6 +69,11 @@ argp_parser (int key, char *arg, struct argp_state *state)
       arguments->verbose = 1;
       break;
 
+    case 'o':
+      free (arguments->output);
+      arguments->output = xstrdup (arg);
+      break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num == 0)
 	arguments->filename = xstrdup (arg);
@@ -139,6 +147,32 @@ get_config_line (char **line, int cont __attribute__ ((unused)), void *data)
   return 0;
 }
 
+static void
+write_compiled (const char *filename, const char *output)
+{
+  char *source;
+  size_t size;
+  void *compiled;
+  grub_size_t compiled_size;
+  FILE *out;
+
+  size = grub_util_get_image_size (filename);
+  source = grub_util_read_image (filename);
+
+  if (grub_script_compile (source, size, &compiled, &compiled_size))
+    grub_util_error (_("cannot compile `%s': %s"), filename, grub_errmsg);
+
+  out = grub_util_fopen (output, "wb");
+  if (! out)
+    grub_util_error (_("cannot open `%s': %s"), output, strerror (errno));
+  grub_util_write_image (compiled, compiled_size, out, output);
+  if (fclose (out))
+    grub_util_error (_("cannot close `%s': %s"), output, strerror (errno));
+
+  free (compiled);
+  free (source);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -161,6 +195,9 @@ main (int argc, char *argv[])
       exit(1);
     }
 
+  if (ctx.arguments.output && ! ctx.arguments.filename)
+    grub_util_error ("%s", _("--output requires an input file"));
+
   /* Obtain ARGUMENT.  */
   if (!ctx.arguments.filename)
     {
@@ -214,5 +251,8 @@ main (int argc, char *argv[])
       return 1;
     }
 
+  if (ctx.arguments.output)
+    write_compiled (ctx.arguments.filename, ctx.arguments.output);
+
   return 0;
 }
@@ -873,7 +873,7 @@ grub_install_generate_image (const char *dir, const char *prefix,
 			     const struct grub_install_image_target_desc *image_target,
 			     int note, size_t appsig_size, grub_compression_t comp,
 			     const char *dtb_path, const char *sbat_path, 
-			     int disable_shim_lock)
+			     int disable_shim_lock, int prelink)
 {
   char *kernel_img, *core_img;
   size_t total_module_size, core_size;
@@ -884,6 +884,8 @@ grub_install_generate_image (const char *dir, const char *prefix,
   struct grub_util_path_list *path_list, *p;
   size_t decompress_size = 0;
   struct grub_mkimage_layout layout;
+  char *bundle = NULL;
+  size_t bundle_size = 0;
 
   if (comp == GRUB_COMPRESSION_AUTO)
     comp = image_target->default_compression;
@@ -962,9 +964,24 @@ grub_install_generate_image (const char *dir, const char *prefix,
       total_module_size += prefix_size + sizeof (struct grub_module_header);
     }
 
-  for (p = path_list; p; p = p->next)
-    total_module_size += (ALIGN_ADDR (grub_util_get_image_size (p->name))
-			  + sizeof (struct grub_module_header));
+  if (prelink && path_list)
+    {
+      if (image_target->voidp_sizeof == 4)
+	bundle = grub_mkimage_prelink_modules32 (path_list, image_target,
+						 &bundle_size);
+      else
+	bundle = grub_mkimage_prelink_modules64 (path_list, image_target,
+						 &bundle_size);
+      grub_util_info ("the size of the prelinked bundle is 0x%"
+		      GRUB_HOST_PRIxLONG_LONG,
+		      (unsigned long long) bundle_size);
+      total_module_size += (ALIGN_ADDR (bundle_size)
+			    + sizeof (struct grub_module_header));
+    }
+  else
+    for (p = path_list; p; p = p->next)
+      total_module_size += (ALIGN_ADDR (grub_util_get_image_size (p->name))
+			    + sizeof (struct grub_module_header));
 
   grub_util_info ("the total module size is 0x%" GRUB_HOST_PRIxLONG_LONG,
 		  (unsigned long long) total_module_size);
@@ -1023,21 +1040,36 @@ grub_install_generate_image (const char *dir, const char *prefix,
 	offset = layout.kernel_size + sizeof (struct grub_module_info32);
     }
 
-  for (p = path_list; p; p = p->next)
+  if (bundle)
     {
       struct grub_module_header *header;
-      size_t mod_size;
-
-      mod_size = ALIGN_ADDR (grub_util_get_image_size (p->name));
 
       header = (struct grub_module_header *) (kernel_img + offset);
-      header->type = grub_host_to_target32 (OBJ_TYPE_ELF);
-      header->size = grub_host_to_target32 (mod_size + sizeof (*header));
+      header->type = grub_host_to_target32 (OBJ_TYPE_PRELINKED);
+      header->size = grub_host_to_target32 (ALIGN_ADDR (bundle_size)
+					    + sizeof (*header));
       offset += sizeof (*header);
 
-      grub_util_load_image (p->name, kernel_img + offset);
-      offset += mod_size;
+      memcpy (kernel_img + offset, bundle, bundle_size);
+      offset += ALIGN_ADDR (bundle_size);
+      free (bundle);
     }
+  else
+    for (p = path_list; p; p = p->next)
+      {
+	struct grub_module_header *header;
+	size_t mod_size;
+
+	mod_size = ALIGN_ADDR (grub_util_get_image_size (p->name));
+
+	header = (struct grub_module_header *) (kernel_img + offset);
+	header->type = grub_host_to_target32 (OBJ_TYPE_ELF);
+	header->size = grub_host_to_target32 (mod_size + sizeof (*header));
+	offset += sizeof (*header);
+
+	grub_util_load_image (p->name, kernel_img + offset);
+	offset += mod_size;
+      }
 
   {
     size_t i;